@@ -0,0 +1,202 @@
+/*
+ *    Copyright (C) 2020 by RoboLab - University of Extremadura
+ *
+ *    This file is part of RoboComp
+ *
+ *    RoboComp is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    RoboComp is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with RoboComp.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef TRANSFORMSNAPSHOT_H
+#define TRANSFORMSNAPSHOT_H
+
+#include <math.h>
+#include <stdint.h>
+#include <vector>
+#include <QHash>
+#include <QPair>
+#include <QString>
+
+#include <innermodel/innermodel.h>
+
+/**
+* \brief Per-cycle cache of InnerModel frame chains.
+*
+* Each (destination, origin) pair is resolved once into a row-major 4x4 matrix
+* the first time it is requested after invalidate(). The batch methods then
+* apply that matrix to whole arrays of points (structure of arrays) writing
+* into caller-owned buffers, so the scene graph is not walked per point and no
+* QVec is allocated. Call invalidate() once per compute cycle, after the
+* updateTransformValues() calls of that cycle.
+*/
+class TransformSnapshot
+{
+public:
+	struct Matrix
+	{
+		float m[16];
+	};
+
+	TransformSnapshot(InnerModel *innerModel_=nullptr) : innerModel(innerModel_) { }
+
+	void setInnerModel(InnerModel *innerModel_)
+	{
+		innerModel = innerModel_;
+		invalidate();
+	}
+
+	/// Drops every cached chain. Must be called whenever the InnerModel changes.
+	void invalidate()
+	{
+		cache.clear();
+	}
+
+	/// Returns the cached row-major matrix taking points from \p orig to \p dest.
+	const Matrix &matrix(const QString &dest, const QString &orig)
+	{
+		const QPair<QString, QString> key(dest, orig);
+		auto it = cache.find(key);
+		if (it == cache.end())
+		{
+			Matrix mat;
+			const RTMat rt = innerModel->getTransformationMatrix(dest, orig);
+			for (int r=0; r<4; r++)
+				for (int c=0; c<4; c++)
+					mat.m[r*4+c] = rt(r, c);
+			it = cache.insert(key, mat);
+		}
+		return it.value();
+	}
+
+	/// Transforms n XYZ points given as three separate arrays.
+	void transformXYZ(const QString &dest, const QString &orig, const float *x, const float *y, const float *z, const size_t n, float *ox, float *oy, float *oz)
+	{
+		transformXYZ(matrix(dest, orig), x, y, z, n, ox, oy, oz);
+	}
+
+	/// Transforms n interleaved points (e.g. RoboCompRGBD::PointSeq, stride 4) reading x, y, z at xyz[i*stride].
+	void transformStrided(const QString &dest, const QString &orig, const float *xyz, const size_t stride, const size_t n, float *ox, float *oy, float *oz)
+	{
+		transformStrided(matrix(dest, orig), xyz, stride, n, ox, oy, oz);
+	}
+
+	/// Transforms n laser beams (x = dist*sin(angle), y = 0, z = dist*cos(angle) in the origin frame).
+	void transformPolar(const QString &dest, const QString &orig, const float *dist, const float *angle, const size_t n, float *ox, float *oy, float *oz)
+	{
+		transformPolar(matrix(dest, orig), dist, angle, n, ox, oy, oz);
+	}
+
+	/// Transforms n planar points lying on the y=0 plane of the origin frame.
+	void transformXZ(const QString &dest, const QString &orig, const float *x, const float *z, const size_t n, float *ox, float *oy, float *oz)
+	{
+		transformXZ(matrix(dest, orig), x, z, n, ox, oy, oz);
+	}
+
+	/// Converts n laser beams to cartesian coordinates in the laser frame (x = dist*sin(angle), z = dist*cos(angle)).
+	static void polarToCartesian(const float *dist, const float *angle, const size_t n, float *x, float *z)
+	{
+		#pragma omp simd
+		for (size_t i=0; i<n; i++)
+		{
+			x[i] = dist[i]*sinf(angle[i]);
+			z[i] = dist[i]*cosf(angle[i]);
+		}
+	}
+
+	static void transformXYZ(const Matrix &mat, const float *x, const float *y, const float *z, const size_t n, float *ox, float *oy, float *oz)
+	{
+		const float *m = mat.m;
+		const float m00=m[0], m01=m[1], m02=m[2],  m03=m[3];
+		const float m10=m[4], m11=m[5], m12=m[6],  m13=m[7];
+		const float m20=m[8], m21=m[9], m22=m[10], m23=m[11];
+		#pragma omp simd
+		for (size_t i=0; i<n; i++)
+		{
+			const float px=x[i], py=y[i], pz=z[i];
+			ox[i] = m00*px + m01*py + m02*pz + m03;
+			oy[i] = m10*px + m11*py + m12*pz + m13;
+			oz[i] = m20*px + m21*py + m22*pz + m23;
+		}
+	}
+
+	static void transformStrided(const Matrix &mat, const float *xyz, const size_t stride, const size_t n, float *ox, float *oy, float *oz)
+	{
+		const float *m = mat.m;
+		const float m00=m[0], m01=m[1], m02=m[2],  m03=m[3];
+		const float m10=m[4], m11=m[5], m12=m[6],  m13=m[7];
+		const float m20=m[8], m21=m[9], m22=m[10], m23=m[11];
+		#pragma omp simd
+		for (size_t i=0; i<n; i++)
+		{
+			const float px=xyz[i*stride], py=xyz[i*stride+1], pz=xyz[i*stride+2];
+			ox[i] = m00*px + m01*py + m02*pz + m03;
+			oy[i] = m10*px + m11*py + m12*pz + m13;
+			oz[i] = m20*px + m21*py + m22*pz + m23;
+		}
+	}
+
+	static void transformXZ(const Matrix &mat, const float *x, const float *z, const size_t n, float *ox, float *oy, float *oz)
+	{
+		const float *m = mat.m;
+		const float m00=m[0], m02=m[2],  m03=m[3];
+		const float m10=m[4], m12=m[6],  m13=m[7];
+		const float m20=m[8], m22=m[10], m23=m[11];
+		#pragma omp simd
+		for (size_t i=0; i<n; i++)
+		{
+			const float px=x[i], pz=z[i];
+			ox[i] = m00*px + m02*pz + m03;
+			oy[i] = m10*px + m12*pz + m13;
+			oz[i] = m20*px + m22*pz + m23;
+		}
+	}
+
+	static void transformPolar(const Matrix &mat, const float *dist, const float *angle, const size_t n, float *ox, float *oy, float *oz)
+	{
+		const float *m = mat.m;
+		const float m00=m[0], m02=m[2],  m03=m[3];
+		const float m10=m[4], m12=m[6],  m13=m[7];
+		const float m20=m[8], m22=m[10], m23=m[11];
+		#pragma omp simd
+		for (size_t i=0; i<n; i++)
+		{
+			const float px = dist[i]*sinf(angle[i]);
+			const float pz = dist[i]*cosf(angle[i]);
+			ox[i] = m00*px + m02*pz + m03;
+			oy[i] = m10*px + m12*pz + m13;
+			oz[i] = m20*px + m22*pz + m23;
+		}
+	}
+
+private:
+	InnerModel *innerModel;
+	QHash<QPair<QString, QString>, Matrix> cache;
+};
+
+/**
+* \brief Reusable SoA scratch buffers for TransformSnapshot batch calls.
+*/
+struct TransformBuffers
+{
+	std::vector<float> dist, angle;
+	std::vector<float> x, y, z;
+	std::vector<float> ox, oy, oz;
+
+	void resize(const size_t n)
+	{
+		dist.resize(n); angle.resize(n);
+		x.resize(n);  y.resize(n);  z.resize(n);
+		ox.resize(n); oy.resize(n); oz.resize(n);
+	}
+};
+
+#endif
@@ -0,0 +1,91 @@
+/*
+ *    Copyright (C) 2020 by RoboLab - University of Extremadura
+ *
+ *    This file is part of RoboComp
+ *
+ *    RoboComp is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    RoboComp is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with RoboComp.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Throughput of TransformSnapshot batches against per-point innerModel->transform,
+// on laser beams taken from a laser mounted on a moving robot:
+//   transformsnapshot_bench [beams per cycle] [cycles]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <chrono>
+#include <vector>
+
+#include <innermodel/innermodel.h>
+#include "transformsnapshot.h"
+
+static double now()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int main(int argc, char **argv)
+{
+	const int beams = argc > 1 ? atoi(argv[1]) : 720;
+	const int cycles = argc > 2 ? atoi(argv[2]) : 200;
+
+	// root -> world -> robot -> laser, the chain the components resolve for each beam
+	InnerModel *innerModel = new InnerModel();
+	InnerModelTransform *world = innerModel->newTransform("world", "static", innerModel->getRoot(), 0,0,0, 0,0,0, 0);
+	innerModel->getRoot()->addChild(world);
+	InnerModelTransform *robot = innerModel->newTransform("robot", "static", world, 0,0,0, 0,0,0, 0);
+	world->addChild(robot);
+	InnerModelTransform *laser = innerModel->newTransform("laser", "static", robot, 120,350,80, 0,0.05,0, 0);
+	robot->addChild(laser);
+
+	std::vector<float> dist(beams), angle(beams);
+	for (int i=0; i<beams; i++)
+	{
+		angle[i] = -M_PI_2 + M_PI*i/beams;
+		dist[i] = 500.f + 4000.f*rand()/RAND_MAX;
+	}
+	TransformSnapshot snapshot(innerModel);
+	TransformBuffers out;
+	out.resize(beams);
+	std::vector<float> ix(beams), iy(beams), iz(beams);
+
+	double tInner = 0, tSnapshot = 0, maxError = 0;
+	for (int c=0; c<cycles; c++)
+	{
+		innerModel->updateTransformValues("robot", 10.f*c, 0, 5.f*c, 0, 0.01f*c, 0);
+
+		double t = now();
+		for (int i=0; i<beams; i++)
+		{
+			const QVec p = innerModel->transform("world", QVec::vec3(dist[i]*sin(angle[i]), 0, dist[i]*cos(angle[i])), "laser");
+			ix[i] = p(0); iy[i] = p(1); iz[i] = p(2);
+		}
+		tInner += now() - t;
+
+		t = now();
+		snapshot.invalidate();
+		snapshot.transformPolar("world", "laser", dist.data(), angle.data(), beams, out.ox.data(), out.oy.data(), out.oz.data());
+		tSnapshot += now() - t;
+
+		for (int i=0; i<beams; i++)
+			maxError = std::max(maxError, (double)std::max(fabs(ix[i]-out.ox[i]), std::max(fabs(iy[i]-out.oy[i]), fabs(iz[i]-out.oz[i]))));
+	}
+	const double points = double(beams)*cycles;
+	printf("%d beams x %d cycles\n", beams, cycles);
+	printf("innerModel->transform  %8.1f ns/point  %8.2f Mpoints/s\n", 1e9*tInner/points, 1e-6*points/tInner);
+	printf("TransformSnapshot      %8.1f ns/point  %8.2f Mpoints/s  (x%.1f)\n", 1e9*tSnapshot/points, 1e-6*points/tSnapshot, tInner/tSnapshot);
+	printf("max difference %g mm\n", maxError);
+	delete innerModel;
+	return maxError > 1.0;
+}
@@ -24,6 +24,7 @@
 SpecificWorker::SpecificWorker(MapPrx& mprx) : GenericWorker(mprx)
 {
 	innerModel = new InnerModel("world.xml");
+	transforms.setInnerModel(innerModel);
 	
 	osgView = new OsgView (frame);
 	osgGA::TrackballManipulator *tb = new osgGA::TrackballManipulator;
@@ -74,6 +75,7 @@ void SpecificWorker::compute()
 		
  		rgbd_proxy->getXYZ(points, hState, bState);
 		qDebug() << points.size();
+		transforms.invalidate();
 		
 		if ( firstTime )
 		{
@@ -100,17 +102,16 @@ void SpecificWorker::computeBackground(RoboCompRGBD::PointSeq &points)
 		rgbd_proxy->getXYZ(points, hState, bState);
 		rgbd_proxy->getXYZ(points, hState, bState);
 	
-		data.resize(3,points.size()/4);
-		imvPointCloud->points->resize(points.size()/4);
-		imvPointCloud->colors->resize(points.size()/4);
-		int j=0;
-		for (size_t i = 0; i < points.size (); i+=4)
+		const size_t n = transformToWorld(points);
+		data.resize(3, n);
+		imvPointCloud->points->resize(n);
+		imvPointCloud->colors->resize(n);
+		for (size_t j = 0; j < n; j++)
 		{
-			osg::Vec3f d = QVecToOSGVec(innerModel->transform("world",QVec::vec3(points[i].x, points[i].y, points[i].z),"rgbd"));
-			data( 0, j ) = d.x();
-			data( 1, j ) = d.y();
-			data( 2, j++ ) = d.z();
-		}	
+			data( 0, j ) = cloudBuffers.ox[j];
+			data( 1, j ) = cloudBuffers.oy[j];
+			data( 2, j ) = cloudBuffers.oz[j];
+		}
 		nns = NNSearchF::createKDTreeLinearHeap( data );	
 }
 
@@ -134,10 +135,11 @@ void SpecificWorker::updatePointCloud(const RoboCompRGBD::PointSeq &points)
 {
 	imvPointCloud->points->clear();
 	imvPointCloud->colors->clear();
-	for (size_t i = 0; i < points.size (); i+=4)
+	const size_t n = transformToWorld(points);
+	for (size_t j = 0; j < n; j++)
 	{
-		 osg::Vec3f p = QVecToOSGVec(innerModel->transform("world",QVec::vec3(points[i].x, points[i].y, points[i].z),"rgbd"));
-		 if( filterP( p , points[i] ) )
+		 const osg::Vec3f p(cloudBuffers.ox[j], cloudBuffers.oy[j], cloudBuffers.oz[j]);
+		 if( filterP( p , points[j*4] ) )
 		 {
 				imvPointCloud->points->push_back(p);
 				imvPointCloud->colors->push_back( osg::Vec4( 1.,  0.,  0.,  1 ) );
@@ -147,6 +149,20 @@ void SpecificWorker::updatePointCloud(const RoboCompRGBD::PointSeq &points)
 }
 
 
+/**
+* \brief Transforms one of every four points from "rgbd" to "world" in a single batch
+* @return number of transformed points, stored in cloudBuffers.ox/oy/oz
+*/
+size_t SpecificWorker::transformToWorld(const RoboCompRGBD::PointSeq &points)
+{
+	const size_t n = (points.size()+3)/4;
+	cloudBuffers.resize(n);
+	if (n == 0)
+		return 0;
+	transforms.transformStrided("world", "rgbd", &points[0].x, 4*4, n, cloudBuffers.ox.data(), cloudBuffers.oy.data(), cloudBuffers.oz.data());
+	return n;
+}
+
 bool SpecificWorker::filterP( const osg::Vec3f &p, const RoboCompRGBD::PointXYZ &point )
 {
 	const int K = 1;
@@ -30,6 +30,7 @@
 #include <innermodel/innermodelviewer.h>
 #include <osgviewer/osgview.h>
 #include <nabo/nabo.h>
+#include <transformsnapshot/transformsnapshot.h>
 
 using namespace Nabo;
 using namespace Eigen;
@@ -52,6 +53,8 @@ private:
 	InnerModelViewer *innerModelViewer;
 	OsgView 			*osgView;			
 	IMVPointCloud *imvPointCloud;
+	TransformSnapshot transforms;
+	TransformBuffers cloudBuffers;
 	
   //libnabo	
 	NNSearchF* nns;
@@ -60,6 +63,7 @@ private:
 	void updatePointCloud(const PointSeq &points);
 	void storeBackground();
 	void computeBackground(PointSeq& points);
+	size_t transformToWorld(const PointSeq &points);
 	bool filterP( const osg::Vec3f& p, const PointXYZ& point);
 	
 };
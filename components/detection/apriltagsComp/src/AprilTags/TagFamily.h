@@ -6,6 +6,7 @@
 #include <stdio.h>
 #include <vector>
 #include <map>
+#include <unordered_map>
 
 #include "AprilTags/TagDetection.h"
 using namespace std;
@@ -54,9 +55,27 @@ public:
   static int popCount(unsigned long long w);
 
   //! Given an observed tag with code 'rCode', try to recover the id.
-  /*  The corresponding fields of TagDetection will be filled in. */
+  /*  The corresponding fields of TagDetection will be filled in.
+   *  Uses the decode index when errorRecoveryBits is within its radius.
+   *  Codes farther than errorRecoveryBits from every tag come back with
+   *  good false, id -1 and hammingDistance errorRecoveryBits+1 instead of
+   *  the nearest code: finding it would take the exhaustive search. Call
+   *  decodeExhaustive() for the nearest code of a rejected observation.
+   */
   void decode(TagDetection& det, unsigned long long rCode) const;
 
+  //! Same as decode(), comparing against every code under all four rotations.
+  void decodeExhaustive(TagDetection& det, unsigned long long rCode) const;
+
+  //! Builds the decode index for the current errorRecoveryBits.
+  /*  Called by the constructor and whenever errorRecoveryBits changes. */
+  void buildDecodeIndex();
+
+  //! Number of entries, approximate size in bytes and build time of the decode index.
+  size_t decodeIndexEntries() const { return decodeIndex.size(); }
+  size_t decodeIndexBytes() const;
+  double decodeIndexBuildMs() const { return indexBuildMs; }
+
   //! Prints the hamming distances of the tag codes.
   void printHammingDistances() const;
 
@@ -87,6 +106,21 @@ public:
   //! The array of the codes. The id for a code is its index.
   std::vector<unsigned long long> codes;
 
+  //! Largest errorRecoveryBits served by the decode index, beyond it decode() is exhaustive.
+  static const int maxIndexRadius = 2;
+
+  //! Best match for an observed code, as found by decodeExhaustive().
+  struct DecodeEntry {
+    int id;
+    unsigned char rotation;
+    unsigned char hammingDistance;
+  };
+
+  //! Every rotated code and every code within indexRadius bits of it, mapped to its best match.
+  std::unordered_map<unsigned long long, DecodeEntry> decodeIndex;
+  int indexRadius;
+  double indexBuildMs;
+
   static const int  popCountTableShift = 12;
   static const unsigned int popCountTableSize = 1 << popCountTableShift;
   static unsigned char popCountTable[popCountTableSize];
@@ -41,11 +41,11 @@ namespace AprilTags {
     int width = image.cols;
     int height = image.rows;
     AprilTags::FloatImage fimOrig(width, height);
-    int i = 0;
+    // row by row, so that ROIs of a larger image (non-continuous Mats) work too
     for (int y=0; y<height; y++) {
+      const uchar *row = image.ptr<uchar>(y);
       for (int x=0; x<width; x++) {
-        fimOrig.set(x, y, image.data[i]/255.);
-        i++;
+        fimOrig.set(x, y, row[x]/255.);
       }
     }
     std::pair<int,int> opticalCenter(width/2, height/2);
@@ -1,4 +1,5 @@
 #include <iostream>
+#include <chrono>
 
 #include "TagFamily.h"
 
@@ -28,18 +29,79 @@ namespace AprilTags {
 TagFamily::TagFamily(const TagCodes& tagCodes)
   : blackBorder(1), bits(tagCodes.bits), dimension((int)std::sqrt((float)bits)),
     minimumHammingDistance(tagCodes.minHammingDistance),
-    errorRecoveryBits(1), codes() {
+    errorRecoveryBits(1), codes(), indexRadius(-1), indexBuildMs(0) {
   if ( bits != dimension*dimension )
     cerr << "Error: TagFamily constructor called with bits=" << bits << "; must be a square number!" << endl;
   codes = tagCodes.codes;
+  buildDecodeIndex();
 }
 
 void TagFamily::setErrorRecoveryBits(int b) {
   errorRecoveryBits = b;
+  buildDecodeIndex();
 }
 
 void TagFamily::setErrorRecoveryFraction(float v) {
   errorRecoveryBits = (int) (((int) (minimumHammingDistance-1)/2)*v);
+  buildDecodeIndex();
+}
+
+void TagFamily::buildDecodeIndex() {
+  const int radius = min(errorRecoveryBits, maxIndexRadius);
+  if (radius == indexRadius)
+    return;
+  const auto start = std::chrono::steady_clock::now();
+  decodeIndex.clear();
+  indexRadius = radius;
+  indexBuildMs = 0;
+  if (radius < 0)
+    return;
+
+  size_t perCode = 1;
+  for (int k = 1, c = 1; k <= radius; k++) {
+    c = c * (bits-k+1) / k;
+    perCode += c;
+  }
+  decodeIndex.reserve(codes.size() * 4 * perCode);
+
+  // decode() matches rotate90^rot(obs) against codes[id], which is the same as
+  // matching obs against codes[id] rotated (4-rot) times. Ties keep the lowest
+  // (id, rotation), like the exhaustive search does.
+  const unsigned long long one = 1;
+  auto insert = [this](unsigned long long key, int id, int rot, int d) {
+    auto it = decodeIndex.find(key);
+    if (it == decodeIndex.end()) {
+      decodeIndex[key] = DecodeEntry{id, (unsigned char) rot, (unsigned char) d};
+      return;
+    }
+    DecodeEntry &e = it->second;
+    if (d < e.hammingDistance ||
+        (d == e.hammingDistance && (id < e.id || (id == e.id && rot < e.rotation))))
+      e = DecodeEntry{id, (unsigned char) rot, (unsigned char) d};
+  };
+  for (unsigned int id = 0; id < codes.size(); id++) {
+    unsigned long long rotated[4];
+    rotated[0] = codes[id];
+    for (int r = 1; r < 4; r++)
+      rotated[r] = rotate90(rotated[r-1], dimension);
+    for (int rot = 0; rot < 4; rot++) {
+      const unsigned long long key = rotated[(4-rot) % 4];
+      insert(key, id, rot, 0);
+      for (int i = 0; i < bits && radius >= 1; i++) {
+        insert(key ^ (one<<i), id, rot, 1);
+        for (int j = i+1; j < bits && radius >= 2; j++)
+          insert(key ^ (one<<i) ^ (one<<j), id, rot, 2);
+      }
+    }
+  }
+
+  indexBuildMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+size_t TagFamily::decodeIndexBytes() const {
+  // nodes (key, entry and next pointer) plus the bucket array
+  const size_t node = sizeof(unsigned long long) + sizeof(DecodeEntry) + sizeof(void*);
+  return decodeIndex.size() * node + decodeIndex.bucket_count() * sizeof(void*);
 }
 
 unsigned long long TagFamily::rotate90(unsigned long long w, int d) {
@@ -81,6 +143,31 @@ int TagFamily::popCount(unsigned long long w) {
 }
 
 void TagFamily::decode(TagDetection& det, unsigned long long rCode) const {
+  if (errorRecoveryBits > indexRadius) {
+    decodeExhaustive(det, rCode);
+    return;
+  }
+
+  det.obsCode = rCode;
+  auto it = decodeIndex.find(rCode);
+  if (it == decodeIndex.end()) {
+    // farther than errorRecoveryBits from every code: not a tag
+    det.id = -1;
+    det.hammingDistance = errorRecoveryBits+1;
+    det.rotation = 0;
+    det.good = false;
+    det.code = 0;
+    return;
+  }
+  const DecodeEntry &e = it->second;
+  det.id = e.id;
+  det.hammingDistance = e.hammingDistance;
+  det.rotation = e.rotation;
+  det.good = (det.hammingDistance <= errorRecoveryBits);
+  det.code = codes[e.id];
+}
+
+void TagFamily::decodeExhaustive(TagDetection& det, unsigned long long rCode) const {
   int  bestId = -1;
   int  bestHamming = INT_MAX;
   int  bestRotation = 0;
@@ -33,6 +33,7 @@ SpecificWorker::SpecificWorker(MapPrx& mprx) : GenericWorker(mprx), m_tagDetecto
 	aux.value = "0";
 	worker_params["frameRate"] = aux;
 	flip = false;
+	trackingMode = false;
 }
 
 /**
@@ -140,6 +141,24 @@ bool SpecificWorker::setParams(RoboCompCommonBehavior::ParameterList params)
             qDebug("Error reading config param FlipImage. It's false.");
         }
 
+	int fullFrameEvery = 10;
+	float roiPadding = 0.5;
+	try
+	{
+		RoboCompCommonBehavior::Parameter par = params.at("TrackingMode");
+		trackingMode = (par.value == "True" || par.value == "true" || par.value == "1");
+		par = params.at("FullFrameEvery");
+		fullFrameEvery = std::max(1, QString::fromStdString(par.value).toInt());
+		par = params.at("ROIPadding");
+		roiPadding = QString::fromStdString(par.value).toFloat();
+	}
+	catch(const std::exception &e)
+	{
+		qDebug("Error reading config params TrackingMode, FullFrameEvery or ROIPadding (%s). Using the defaults from there on.", e.what());
+	}
+	tagTracker.setParams(fullFrameEvery, roiPadding);
+	printf("TrackingMode: %d (full frame every %d frames, ROI padding %f)\n", trackingMode, fullFrameEvery, roiPadding);
+
 	try
 	{
 		RoboCompCommonBehavior::Parameter par = params.at("CameraName");
@@ -338,7 +357,7 @@ void SpecificWorker::searchTags(const cv::Mat &image_gray)
     {
         cv::flip(image_gray, dst, 0);
     }
-    vector< ::AprilTags::TagDetection> detections = m_tagDetector->extractTags(dst);
+    vector< ::AprilTags::TagDetection> detections = trackingMode ? tagTracker.detect(*m_tagDetector, dst) : m_tagDetector->extractTags(dst);
 
     std::cout << detections.size() << " tags detected:" << std::endl;
 	print_detection(detections);
@@ -38,6 +38,7 @@
 #include <AprilTags/Tag25h9.h>
 #include <AprilTags/Tag36h9.h>
 #include <AprilTags/Tag36h11.h>
+#include "tagtracker.h"
 
 #define PI M_PI
 #define TWOPI  2.0*M_PI
@@ -97,6 +98,10 @@ private:
 	inline double standardRad(double t);
 	void rotationFromMatrix(const Eigen::Matrix3d &R, double &rx, double &ry, double &rz);
 	void searchTags(const cv::Mat &image_gray);
+
+	// Tracking mode: full-frame detection every FullFrameEvery frames, ROI detection around predicted tags in between
+	bool trackingMode;
+	TagTracker tagTracker;
 	cv::Mat image_gray, image_color;
 	int INPUTIFACE;
 	
@@ -0,0 +1,80 @@
+// Decode time per observed code with the Hamming index and with the exhaustive
+// search, for several families and error recovery bits. Half of the codes are
+// tags with a few flipped bits, the rest random. Also checks that both decoders
+// accept the same codes with the same id, rotation and distance.
+//   tagdecode_bench [codes]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include <AprilTags/TagFamily.h>
+#include <AprilTags/Tag16h5.h>
+#include <AprilTags/Tag25h9.h>
+#include <AprilTags/Tag36h11.h>
+
+using namespace AprilTags;
+
+static double now()
+{
+  return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int main(int argc, char **argv)
+{
+  const int numCodes = argc > 1 ? atoi(argv[1]) : 200000;
+  const struct { const char *name; const TagCodes *codes; } families[] = {
+    {"16h5", &tagCodes16h5}, {"25h9", &tagCodes25h9}, {"36h11", &tagCodes36h11}};
+
+  printf("%d codes per run\n", numCodes);
+  printf("%-6s %5s %10s %10s %10s %12s %12s %8s %10s\n", "family", "bits", "entries", "index KB", "build ms",
+         "index ns", "search ns", "speedup", "mismatch");
+  int mismatches = 0;
+  for (const auto &f : families) {
+    for (int recovery = 0; recovery <= 3; recovery++) {
+      TagFamily family(*f.codes);
+      family.setErrorRecoveryBits(recovery);
+
+      std::mt19937_64 rng(30);
+      std::vector<unsigned long long> observed(numCodes);
+      const unsigned long long mask = family.bits < 64 ? (1ULL << family.bits) - 1 : ~0ULL;
+      for (int i = 0; i < numCodes; i++) {
+        if (i % 2) {
+          unsigned long long c = family.codes[rng() % family.codes.size()];
+          for (int r = rng() % 4; r > 0; r--)
+            c = TagFamily::rotate90(c, family.dimension);
+          for (int k = rng() % 4; k > 0; k--)
+            c ^= 1ULL << (rng() % family.bits);
+          observed[i] = c;
+        } else {
+          observed[i] = rng() & mask;
+        }
+      }
+
+      std::vector<TagDetection> indexed(numCodes), searched(numCodes);
+      double t = now();
+      for (int i = 0; i < numCodes; i++)
+        family.decode(indexed[i], observed[i]);
+      const double tIndex = now() - t;
+      t = now();
+      for (int i = 0; i < numCodes; i++)
+        family.decodeExhaustive(searched[i], observed[i]);
+      const double tSearch = now() - t;
+
+      int mismatch = 0;
+      for (int i = 0; i < numCodes; i++) {
+        const TagDetection &a = indexed[i], &b = searched[i];
+        if (a.good != b.good || (a.good && (a.id != b.id || a.rotation != b.rotation || a.hammingDistance != b.hammingDistance)))
+          mismatch++;
+      }
+      mismatches += mismatch;
+      printf("%-6s %5d %10zu %10.1f %10.1f %12.1f %12.1f %8.1f %10d\n", f.name, recovery, family.decodeIndexEntries(),
+             family.decodeIndexBytes()/1024., family.decodeIndexBuildMs(), 1e9*tIndex/numCodes, 1e9*tSearch/numCodes,
+             tSearch/tIndex, mismatch);
+      fflush(stdout);
+    }
+  }
+  return mismatches ? 1 : 0;
+}
@@ -0,0 +1,142 @@
+/*
+ *    Copyright (C) 2006-2019 by RoboLab - University of Extremadura
+ *
+ *    This file is part of RoboComp
+ *
+ *    RoboComp is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    RoboComp is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with RoboComp.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "tagtracker.h"
+#include <algorithm>
+#include <cfloat>
+
+TagTracker::TagTracker()
+{
+	fullFrameEvery = 10;
+	roiPadding = 0.5;
+	framesSinceFullFrame = 0;
+	fullFrame = true;
+}
+
+void TagTracker::setParams(int fullFrameEvery_, float roiPadding_)
+{
+	fullFrameEvery = std::max(1, fullFrameEvery_);
+	roiPadding = roiPadding_;
+}
+
+void TagTracker::reset()
+{
+	tracks.clear();
+	framesSinceFullFrame = 0;
+}
+
+/**
+* \brief Detects the tracked tags inside padded ROIs predicted from their last corners and velocity.
+* Falls back to full-frame detection every fullFrameEvery frames and whenever a tracked tag is lost.
+*/
+std::vector< ::AprilTags::TagDetection> TagTracker::detect(::AprilTags::TagDetector &detector, const cv::Mat &image)
+{
+	std::vector< ::AprilTags::TagDetection> detections;
+	if (tracks.empty() or framesSinceFullFrame+1 >= fullFrameEvery)
+	{
+		detections = detector.extractTags(image);
+		framesSinceFullFrame = 0;
+		fullFrame = true;
+		updateTracks(detections);
+		return detections;
+	}
+	framesSinceFullFrame++;
+	fullFrame = false;
+
+	const cv::Rect imageRect(0, 0, image.cols, image.rows);
+	bool lost = false;
+	for (const auto &track : tracks)
+	{
+		float minX=FLT_MAX, minY=FLT_MAX, maxX=-FLT_MAX, maxY=-FLT_MAX;
+		for (int c=0; c<4; c++)
+		{
+			const float x = track.detection.p[c].first  + track.velocity.x;
+			const float y = track.detection.p[c].second + track.velocity.y;
+			minX = std::min(minX, x); maxX = std::max(maxX, x);
+			minY = std::min(minY, y); maxY = std::max(maxY, y);
+		}
+		const float pad = roiPadding*std::max(maxX-minX, maxY-minY) + 8;
+		const cv::Rect roi = cv::Rect(cv::Point(minX-pad, minY-pad), cv::Point(maxX+pad+1, maxY+pad+1)) & imageRect;
+
+		bool found = false;
+		if (roi.width >= 16 and roi.height >= 16)
+		{
+			for (auto det : detector.extractTags(image(roi)))
+			{
+				// Back to full-image coordinates
+				for (int c=0; c<4; c++)
+				{
+					det.p[c].first  += roi.x;
+					det.p[c].second += roi.y;
+				}
+				det.cxy.first  += roi.x;  det.cxy.second += roi.y;
+				det.hxy.first  += roi.x;  det.hxy.second += roi.y;
+				found = found or det.id == track.detection.id;
+
+				// ROIs of nearby tags can overlap: keep one detection per tag
+				bool duplicate = false;
+				for (auto &other : detections)
+				{
+					if (other.id == det.id and other.overlapsTooMuch(det))
+					{
+						if (det.hammingDistance < other.hammingDistance)
+							other = det;
+						duplicate = true;
+						break;
+					}
+				}
+				if (not duplicate)
+					detections.push_back(det);
+			}
+		}
+		lost = lost or not found;
+	}
+
+	if (lost)
+	{
+		// Track loss: redo this frame on the whole image
+		detections = detector.extractTags(image);
+		framesSinceFullFrame = 0;
+		fullFrame = true;
+	}
+	updateTracks(detections);
+	return detections;
+}
+
+void TagTracker::updateTracks(const std::vector< ::AprilTags::TagDetection> &detections)
+{
+	std::vector<TrackedTag> newTracks;
+	newTracks.reserve(detections.size());
+	for (const auto &det : detections)
+	{
+		TrackedTag track;
+		track.detection = det;
+		track.velocity = cv::Point2f(0, 0);
+		for (const auto &old : tracks)
+		{
+			if (old.detection.id == det.id and old.detection.overlapsTooMuch(det))
+			{
+				track.velocity = cv::Point2f(det.cxy.first - old.detection.cxy.first, det.cxy.second - old.detection.cxy.second);
+				break;
+			}
+		}
+		newTracks.push_back(track);
+	}
+	tracks.swap(newTracks);
+}
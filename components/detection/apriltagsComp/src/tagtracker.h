@@ -0,0 +1,57 @@
+/*
+ *    Copyright (C) 2006-2019 by RoboLab - University of Extremadura
+ *
+ *    This file is part of RoboComp
+ *
+ *    RoboComp is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    RoboComp is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with RoboComp.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TAGTRACKER_H
+#define TAGTRACKER_H
+
+#include <vector>
+#include "opencv2/opencv.hpp"
+#include <AprilTags/TagDetector.h>
+
+/**
+* \brief Tracking mode of the detector: full-frame detection every fullFrameEvery frames,
+* ROI detection around the predicted position of each tracked tag in between.
+*/
+class TagTracker
+{
+public:
+	TagTracker();
+	void setParams(int fullFrameEvery, float roiPadding);
+	/// Forget the tracked tags, so that the next frame is detected on the whole image
+	void reset();
+	/// Detections of the next frame of the sequence, in full-image coordinates
+	std::vector< ::AprilTags::TagDetection> detect(::AprilTags::TagDetector &detector, const cv::Mat &image);
+	/// Whether the last call to detect() ran on the whole image
+	bool lastWasFullFrame() const { return fullFrame; }
+
+private:
+	struct TrackedTag
+	{
+		::AprilTags::TagDetection detection;
+		cv::Point2f velocity;  // pixels per frame of the tag's center
+	};
+	int fullFrameEvery;
+	float roiPadding;
+	int framesSinceFullFrame;
+	bool fullFrame;
+	std::vector<TrackedTag> tracks;
+	void updateTracks(const std::vector< ::AprilTags::TagDetection> &detections);
+};
+
+#endif
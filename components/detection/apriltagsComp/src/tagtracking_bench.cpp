@@ -0,0 +1,166 @@
+// Latency per frame and recall of the tracking mode (TagTracker) against
+// full-frame detection on every frame of a sequence. The sequence is a video or
+// an image pattern readable by cv::VideoCapture (e.g. frames/%04d.png); without
+// one, tag36h11 markers moving over a cluttered VGA background are generated.
+// Recall is the share of the tags found on the whole frame that tracking also finds.
+//   tagtracking_bench [sequence|-] [full frame every] [ROI padding] [frames]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <set>
+#include <vector>
+
+#include <AprilTags/TagDetector.h>
+#include <AprilTags/Tag36h11.h>
+#include "tagtracker.h"
+
+static double now()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/// Markers bouncing around a 640x480 image with some dark boxes as clutter
+static std::vector<cv::Mat> makeSequence(int frames)
+{
+	const int width = 640, height = 480, numTags = 4;
+	const AprilTags::TagFamily family(AprilTags::tagCodes36h11);
+	const int dim = family.dimension, cells = dim + 4;  // data, black border and white margin
+	std::mt19937 rng(31);
+
+	cv::Mat background(height, width, CV_8UC1);
+	for (int y=0; y<height; y++)
+		for (int x=0; x<width; x++)
+			background.at<uchar>(y, x) = 90 + (80*x)/width + rng()%21 - 10;
+	for (int b=0; b<40; b++)
+	{
+		const int bx = rng()%(width-40), by = rng()%(height-40), bw = 10 + rng()%30, bh = 10 + rng()%30;
+		for (int y=by; y<by+bh; y++)
+			for (int x=bx; x<bx+bw; x++)
+				background.at<uchar>(y, x) = 30 + rng()%40;
+	}
+
+	struct Marker { float x, y, vx, vy; int side; unsigned long long code; };
+	std::vector<Marker> markers;
+	for (int i=0; i<numTags; i++)
+	{
+		const int side = cells*(7 + i);
+		markers.push_back({float(50 + (i%2)*300), float(40 + (i/2)*220), 1.5f + i, 2.5f - i*0.7f, side, family.codes[i]});
+	}
+
+	std::vector<cv::Mat> sequence;
+	for (int f=0; f<frames; f++)
+	{
+		cv::Mat frame = background.clone();
+		for (auto &m : markers)
+		{
+			const int px = int(m.x), py = int(m.y), cell = m.side/cells;
+			for (int y=0; y<m.side; y++)
+			{
+				uchar *row = frame.ptr<uchar>(py + y);
+				const int gy = y/cell;
+				for (int x=0; x<m.side; x++)
+				{
+					const int gx = x/cell;
+					bool white;
+					if (gx == 0 or gy == 0 or gx == cells-1 or gy == cells-1)
+						white = true;
+					else if (gx == 1 or gy == 1 or gx == cells-2 or gy == cells-2)
+						white = false;
+					else
+					{
+						// TagDetector reads the data cells from the last row up, MSB first
+						const int bit = (gy-2)*dim + (gx-2);
+						white = (m.code >> (family.bits-1-bit)) & 1;
+					}
+					row[px + x] = white ? 225 : 25;
+				}
+			}
+			m.x += m.vx;  m.y += m.vy;
+			if (m.x < 0 or m.x + m.side >= width)  { m.vx = -m.vx; m.x += 2*m.vx; }
+			if (m.y < 0 or m.y + m.side >= height) { m.vy = -m.vy; m.y += 2*m.vy; }
+		}
+		sequence.push_back(frame);
+	}
+	return sequence;
+}
+
+static void stats(std::vector<double> t, double &mean, double &p99)
+{
+	std::sort(t.begin(), t.end());
+	mean = 0;
+	for (double v : t)
+		mean += v;
+	mean /= t.size();
+	p99 = t[std::min(t.size()-1, size_t(0.99*t.size()))];
+}
+
+int main(int argc, char **argv)
+{
+	const char *path = argc > 1 ? argv[1] : "-";
+	const int fullFrameEvery = argc > 2 ? atoi(argv[2]) : 10;
+	const float roiPadding = argc > 3 ? atof(argv[3]) : 0.5;
+	const int maxFrames = argc > 4 ? atoi(argv[4]) : 200;
+
+	std::vector<cv::Mat> sequence;
+	if (strcmp(path, "-") != 0)
+	{
+		cv::VideoCapture capture(path);
+		if (not capture.isOpened())
+		{
+			fprintf(stderr, "Cannot open %s\n", path);
+			return 2;
+		}
+		cv::Mat frame, gray;
+		while (int(sequence.size()) < maxFrames and capture.read(frame))
+		{
+			cv::cvtColor(frame, gray, CV_BGR2GRAY);
+			sequence.push_back(gray.clone());
+		}
+	}
+	else
+		sequence = makeSequence(maxFrames);
+	if (sequence.empty())
+	{
+		fprintf(stderr, "No frames\n");
+		return 2;
+	}
+
+	AprilTags::TagDetector detector(AprilTags::tagCodes36h11);
+	TagTracker tracker;
+	tracker.setParams(fullFrameEvery, roiPadding);
+
+	std::vector<double> tFull, tTrack;
+	size_t fullTags = 0, trackedTags = 0, fullFrames = 0;
+	for (const cv::Mat &frame : sequence)
+	{
+		double t = now();
+		const std::vector<AprilTags::TagDetection> full = detector.extractTags(frame);
+		tFull.push_back(now() - t);
+		t = now();
+		const std::vector<AprilTags::TagDetection> tracked = tracker.detect(detector, frame);
+		tTrack.push_back(now() - t);
+		fullFrames += tracker.lastWasFullFrame();
+
+		std::set<int> ids;
+		for (const auto &d : tracked)
+			ids.insert(d.id);
+		for (const auto &d : full)
+			trackedTags += ids.count(d.id);
+		fullTags += full.size();
+	}
+
+	double meanFull, p99Full, meanTrack, p99Track;
+	stats(tFull, meanFull, p99Full);
+	stats(tTrack, meanTrack, p99Track);
+	printf("%zu frames %dx%d, full frame every %d, ROI padding %.2f\n", sequence.size(), sequence[0].cols, sequence[0].rows, fullFrameEvery, roiPadding);
+	printf("%-12s %12s %12s\n", "mode", "mean [ms]", "p99 [ms]");
+	printf("%-12s %12.2f %12.2f\n", "full frame", 1e3*meanFull, 1e3*p99Full);
+	printf("%-12s %12.2f %12.2f\n", "tracking", 1e3*meanTrack, 1e3*p99Track);
+	printf("tags per frame %.2f, recall %.4f, frames detected on the whole image %.1f%%\n", double(fullTags)/sequence.size(),
+	       fullTags ? double(trackedTags)/fullTags : 1., 100.*fullFrames/sequence.size());
+	return 0;
+}
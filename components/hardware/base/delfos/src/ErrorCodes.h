@@ -19,5 +19,6 @@
 #define RQ_GET_CONFIG_FAILED     14
 #define RQ_GET_VALUE_FAILED      15
 #define RQ_SET_COMMAND_FAILED    16
+#define RQ_ERR_STREAMING         17
 
 #endif
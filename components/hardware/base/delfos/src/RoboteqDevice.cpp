@@ -7,18 +7,31 @@
 #include <time.h>
 #include <sstream>
 #include <unistd.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <chrono>
 
 #include "RoboteqDevice.h"
 #include "ErrorCodes.h"
+#include "Constants.h"
 
 using namespace std;
 
 #define BUFFER_SIZE 1024
 #define MISSING_VALUE -1024
 
-RoboteqDevice::RoboteqDevice()
+static int64_t steadyMicroseconds()
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+RoboteqDevice::RoboteqDevice() : streaming(false)
 {
 	handle = RQ_INVALID_HANDLE;
+	memset(current, 0, sizeof(current));
+	memset(&stats, 0, sizeof(stats));
+	pendingHead = pendingTail = 0;
+	latencySumMs = 0;
 }
 RoboteqDevice::~RoboteqDevice()
 {
@@ -84,6 +97,7 @@ int RoboteqDevice::Connect(string port)
 
 void RoboteqDevice::Disconnect()
 {
+	StopStreaming();
 	if(IsConnected())
 		close(handle);
 
@@ -181,6 +195,9 @@ int RoboteqDevice::IssueCommand(string commandType, string command, string args,
 	string read;
 	response = "";
 
+	if(IsStreaming())
+		return RQ_ERR_STREAMING;
+
 	if(args == "")
 		status = Write(commandType + command + "\r");
 	else
@@ -283,6 +300,8 @@ int RoboteqDevice::SetCommand(bool CAN, int commandItem, int index, int value)
 
 	if(index < 0)
 		return RQ_INDEX_OUT_RANGE;
+	if(IsStreaming())
+		return SendAsync((CAN ? "@02!" : "!") + string(command) + " " + args + "\r");
         if (CAN)
             status = IssueCommand("@02!", command, args, 10, response, true);
         else
@@ -375,6 +394,219 @@ int RoboteqDevice::GetValue(bool CAN, int operatingItem, int &result)
 	return GetValue(CAN, operatingItem, 0, result);
 }
 
+int RoboteqDevice::StartStreaming(int periodms)
+{
+	if(!IsConnected())
+		return RQ_ERR_NOT_CONNECTED;
+	if(IsStreaming())
+		return RQ_SUCCESS;
+
+	tcflush(handle, TCIFLUSH);
+	memset(current, 0, sizeof(current));
+	for(int i = 0; i < 2; i++)
+		telemetry[i].store(current[i]);
+	{
+		std::lock_guard<std::mutex> lock(ackMutex);
+		pendingHead = pendingTail = 0;
+		memset(&stats, 0, sizeof(stats));
+		latencySumMs = 0;
+	}
+
+	streaming = true;
+	reader = std::thread(&RoboteqDevice::ReaderLoop, this);
+
+	// Each query issued after clearing the history is answered and appended to it,
+	// "# nn" then makes the controller repeat the whole history every nn ms.
+	char repeat[20];
+	sprintf(repeat, "# %i\r", periodms);
+	const string history = "# C\r"
+		"?$04\r?$03\r?$0D\r"
+		"@02?$04\r@02?$03\r@02?$0D\r";
+	int status;
+	{
+		std::lock_guard<std::mutex> lock(writeMutex);
+		status = Write(history + repeat);
+	}
+	if(status != RQ_SUCCESS)
+		StopStreaming();
+	return status;
+}
+
+void RoboteqDevice::StopStreaming()
+{
+	if(!streaming.exchange(false))
+		return;
+	{
+		std::lock_guard<std::mutex> lock(writeMutex);
+		Write("# C\r");
+	}
+	if(reader.joinable())
+		reader.join();
+	usleep(20000);
+	tcflush(handle, TCIFLUSH);
+}
+
+bool RoboteqDevice::IsStreaming() const
+{
+	return streaming.load(std::memory_order_relaxed);
+}
+
+bool RoboteqDevice::GetTelemetry(bool CAN, RoboteqTelemetry &result) const
+{
+	while(!telemetry[CAN ? 1 : 0].tryLoad(result)) { }
+	return result.timestamp != 0;
+}
+
+RoboteqCommandStats RoboteqDevice::GetCommandStats() const
+{
+	std::lock_guard<std::mutex> lock(ackMutex);
+	return stats;
+}
+
+int RoboteqDevice::SendAsync(const string &str)
+{
+	std::lock_guard<std::mutex> lock(writeMutex);
+	{
+		std::lock_guard<std::mutex> ackLock(ackMutex);
+		if(pendingHead - pendingTail == PENDING_SIZE)
+		{
+			pendingTail++;
+			stats.lost++;
+		}
+		pending[pendingHead++ % PENDING_SIZE] = steadyMicroseconds();
+		stats.sent++;
+	}
+	return Write(str);
+}
+
+void RoboteqDevice::ReaderLoop()
+{
+	char buf[BUFFER_SIZE];
+	string line;
+	struct pollfd pfd;
+	pfd.fd = handle;
+	pfd.events = POLLIN;
+
+	while(streaming)
+	{
+		if(poll(&pfd, 1, 50) <= 0)
+			continue;
+		const int countRcv = read(handle, buf, BUFFER_SIZE);
+		if(countRcv <= 0)
+			continue;
+		const int64_t now = steadyMicroseconds();
+		for(int i = 0; i < countRcv; i++)
+		{
+			if(buf[i] == '\r' || buf[i] == '\n')
+			{
+				if(!line.empty())
+					ParseLine(line, now);
+				line.clear();
+			}
+			else if(line.length() < 128)
+				line += buf[i];
+		}
+	}
+}
+
+/**
+* \brief Decodes one line from the controller
+* Telemetry answers look like "$04=120:-35" (optionally prefixed by the CAN node, "@02$04=...").
+* Echoed commands are skipped, "+" and "-" acknowledge the oldest pending command.
+*/
+void RoboteqDevice::ParseLine(const string &line, const int64_t now)
+{
+	if(line == "+" || line == "-")
+	{
+		std::lock_guard<std::mutex> lock(ackMutex);
+		if(pendingHead == pendingTail)
+			return;
+		const double latency = (now - pending[pendingTail++ % PENDING_SIZE]) / 1000.;
+		if(line == "+")
+			stats.acked++;
+		else
+			stats.failed++;
+		latencySumMs += latency;
+		stats.meanLatencyMs = latencySumMs / (stats.acked + stats.failed);
+		if(latency > stats.maxLatencyMs)
+			stats.maxLatencyMs = latency;
+		return;
+	}
+
+	string::size_type pos = 0;
+	int node = 0;
+	if(line[0] == '@')
+	{
+		if(line.length() < 4)
+			return;
+		node = 1;
+		pos = 3;
+		while(pos < line.length() && line[pos] == ' ')
+			pos++;
+	}
+	if(pos >= line.length() || line[pos] != '$')
+		return;   // echo of a command or query
+	const string::size_type equal = line.find('=', pos);
+	if(equal == string::npos)
+		return;
+	const int item = strtol(line.c_str() + pos + 1, NULL, 16);
+
+	int32_t values[3];
+	int n = 0;
+	const char *p = line.c_str() + equal + 1;
+	while(n < 3)
+	{
+		char *end;
+		values[n] = strtol(p, &end, 10);
+		if(end == p)
+			break;
+		n++;
+		if(*end != ':')
+			break;
+		p = end + 1;
+	}
+	if(n == 0)
+		return;
+
+	RoboteqTelemetry &t = current[node];
+	switch(item)
+	{
+	case _C:
+		for(int i = 0; i < n && i < 2; i++) t.counts[i] = values[i];
+		break;
+	case _S:
+		for(int i = 0; i < n && i < 2; i++) t.speeds[i] = values[i];
+		break;
+	case _V:
+		for(int i = 0; i < n; i++) t.volts[i] = values[i];
+		break;
+	default:
+		return;
+	}
+	t.timestamp = now;
+	t.samples++;
+	telemetry[node].store(t);
+}
+
+void RoboteqDevice::TelemetrySlot::store(const RoboteqTelemetry &v)
+{
+	const uint32_t s = seq.load(std::memory_order_relaxed);
+	seq.store(s+1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	value = v;
+	seq.store(s+2, std::memory_order_release);
+}
+
+bool RoboteqDevice::TelemetrySlot::tryLoad(RoboteqTelemetry &out) const
+{
+	const uint32_t s0 = seq.load(std::memory_order_acquire);
+	if(s0 & 1)
+		return false;
+	out = value;
+	std::atomic_thread_fence(std::memory_order_acquire);
+	return seq.load(std::memory_order_relaxed) == s0;
+}
+
 
 string ReplaceString(string source, string find, string replacement)
 {
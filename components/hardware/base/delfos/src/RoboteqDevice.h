@@ -1,11 +1,39 @@
 #ifndef __RoboteqDevice_H_
 #define __RoboteqDevice_H_
 
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <stdint.h>
+#include <string.h>
+
 using namespace std;
 
 string ReplaceString(string source, string find, string replacement);
 void sleepms(int milliseconds);
 
+/**
+* \brief Latest telemetry of one controller, as streamed by its query history
+*/
+struct RoboteqTelemetry
+{
+	int64_t timestamp;     // steady clock (us) of the last sample, 0 if none arrived yet
+	uint32_t samples;      // lines received
+	int32_t counts[2];     // ?C  encoder counts
+	int32_t speeds[2];     // ?S  speed (RPM)
+	int32_t volts[3];      // ?V  internal, battery and 5V output (tenths of volt)
+};
+
+/**
+* \brief Statistics of the fire-and-forget commands sent while streaming
+*/
+struct RoboteqCommandStats
+{
+	uint64_t sent, acked, failed, lost;
+	double meanLatencyMs, maxLatencyMs;
+};
+
 class RoboteqDevice
 {
 private:
@@ -13,6 +41,34 @@ private:
 	int fd0;
 	int handle;
 
+	// Streaming mode: a reader thread owns the port input while it runs
+	class TelemetrySlot
+	{
+	public:
+		TelemetrySlot() : seq(0) { memset(&value, 0, sizeof(value)); }
+		void store(const RoboteqTelemetry &v);
+		bool tryLoad(RoboteqTelemetry &out) const;
+	private:
+		std::atomic<uint32_t> seq;
+		RoboteqTelemetry value;
+	};
+	static const int PENDING_SIZE = 64;
+
+	std::atomic<bool> streaming;
+	std::thread reader;
+	std::mutex writeMutex;
+	TelemetrySlot telemetry[2];
+	RoboteqTelemetry current[2];     // reader thread's working copy
+	mutable std::mutex ackMutex;
+	int64_t pending[PENDING_SIZE];   // send time of the commands waiting for +/-
+	uint32_t pendingHead, pendingTail;
+	RoboteqCommandStats stats;
+	double latencySumMs;
+
+	void ReaderLoop();
+	void ParseLine(const string &line, const int64_t now);
+	int SendAsync(const string &str);
+
 protected:
 	void InitPort();
 
@@ -40,6 +96,20 @@ public:
 	int GetValue(bool CAN, int operatingItem, int index, int &result);
 	int GetValue(bool CAN, int operatingItem, int &result);
 
+	/**
+	* \brief Streaming mode
+	* The controllers repeat their query history (counts, speeds and voltages) every periodms,
+	* a background thread parses it into a lock-free store and SetCommand returns as soon as
+	* the command is written, its acknowledgement being accounted asynchronously.
+	* Synchronous queries and configuration return RQ_ERR_STREAMING until StopStreaming().
+	*/
+	int StartStreaming(int periodms);
+	void StopStreaming();
+	bool IsStreaming() const;
+	/// Latest telemetry of the local (CAN=false) or CAN node 2 controller, false if nothing arrived yet
+	bool GetTelemetry(bool CAN, RoboteqTelemetry &result) const;
+	RoboteqCommandStats GetCommandStats() const;
+
 	RoboteqDevice();
 	~RoboteqDevice();
 };
@@ -1,6 +1,7 @@
 #include <delfos.h>
 
 #include <QMutexLocker>
+#include <algorithm>
 
 Delfos::Delfos()
 {
@@ -78,6 +79,36 @@ void Delfos::setVelocity(float V1, float V2, float V3, float V4)
 }
 
 
+bool Delfos::startTelemetry(int periodms)
+{
+	status = device.StartStreaming(periodms);
+	if (status != RQ_SUCCESS)
+	{
+		cout<<"Error starting telemetry stream: "<<status<<"."<<endl;
+		return false;
+	}
+	return true;
+}
 
 
+bool Delfos::getVelocity(float &V1, float &V2, float &V3, float &V4, int64_t &timestamp)
+{
+	RoboteqTelemetry front, back;
+	if (not device.GetTelemetry(false, front) or not device.GetTelemetry(true, back))
+		return false;
+	V1 = front.speeds[0];
+	V2 = front.speeds[1];
+	V3 = back.speeds[0];
+	V4 = back.speeds[1];
+	timestamp = std::min(front.timestamp, back.timestamp);
+	return true;
+}
+
 
+float Delfos::getBatteryVoltage()
+{
+	RoboteqTelemetry front;
+	if (not device.GetTelemetry(false, front))
+		return 0;
+	return front.volts[1] / 10.;
+}
@@ -28,6 +28,15 @@ public:
     void setVelocity(float x, float z, float angle);
     void setVelocity(float V1, float V2, float V3, float V4);
 
+    /// Streams the controllers' telemetry every periodms instead of polling them
+    bool startTelemetry(int periodms);
+    /// Measured speeds in setVelocity(V1..V4) order and the time (us, steady clock) of the oldest one, false if there is no telemetry yet
+    bool getVelocity(float &V1, float &V2, float &V3, float &V4, int64_t &timestamp);
+    /// Battery voltage (V) of the local controller, 0 if unknown
+    float getBatteryVoltage();
+    bool isStreaming() { return device.IsStreaming(); }
+    RoboteqCommandStats getCommandStats() { return device.GetCommandStats(); }
+
 private:
     QMutex *mutex;
     int status;
@@ -0,0 +1,244 @@
+// Two simulated Roboteq controllers (local and CAN node 2) behind a pseudo
+// terminal, for RoboteqDevice without the hardware. The simulator echoes every
+// line, answers ?FID, ?$03 (speed), ?$04 (counts) and ?$0D (volts), acknowledges
+// ! and ^ with +, and implements the query history: "# C" clears it and "# nn"
+// repeats it every nn ms, the encoder counts advancing by 10 on every repetition.
+// Reports the odometry rate (four wheel speeds per sample) and the SetCommand
+// latency when polling, then the telemetry rate per controller, SetCommand call
+// time and acknowledgement latency when streaming.
+//   roboteqpty_test [seconds] [telemetry period ms]
+// Returns 1 on a lost or failed acknowledgement, wrong or missing telemetry, or
+// synchronous queries not refused while streaming or not working after it.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "RoboteqDevice.h"
+#include "ErrorCodes.h"
+#include "Constants.h"
+
+static int64_t now_us()
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static const int SPEED = 120;
+
+/// Answer of one controller to a query or command, without the echo
+static string answer(const string &query, int32_t counts)
+{
+	string prefix, body = query;
+	if(body.compare(0, 3, "@02") == 0)
+	{
+		prefix = "@02";
+		body = body.substr(3);
+	}
+	if(body == "?FID")
+		return "FID=Roboteq v1.8 SDC2XXX 01/01/2020\r";
+	if(body[0] == '!' || body[0] == '^')
+		return "+\r";
+	if(body[0] != '?')
+		return "";
+
+	// "?$03" asks for both channels, "?$03 1" for one
+	const string::size_type space = body.find(' ');
+	const string item = body.substr(1, space == string::npos ? string::npos : space - 1);
+	char line[64];
+	if(item == "$04")
+		sprintf(line, "%s$04=%d:%d", prefix.c_str(), counts, -counts);
+	else if(item == "$03")
+		sprintf(line, "%s$03=%d:%d", prefix.c_str(), SPEED, -SPEED);
+	else if(item == "$0D")
+		sprintf(line, "%s$0D=120:245:50", prefix.c_str());
+	else
+		return "-\r";
+	string out = line;
+	if(space != string::npos)
+		out = out.substr(0, out.find(':'));
+	return out + "\r";
+}
+
+static void simulateControllers(int master, std::atomic<bool> &stop)
+{
+	std::vector<string> history;
+	int period = 0;
+	int64_t next = 0;
+	int32_t counts = 0;
+	string line;
+	while(!stop)
+	{
+		struct pollfd p = {master, POLLIN, 0};
+		poll(&p, 1, 1);
+		char buf[512];
+		const ssize_t n = (p.revents & POLLIN) ? read(master, buf, sizeof(buf)) : 0;
+		for(ssize_t i = 0; i < n; i++)
+		{
+			if(buf[i] != '\r')
+			{
+				line += buf[i];
+				continue;
+			}
+			string out = line + "\r";
+			if(line == "# C")
+			{
+				history.clear();
+				period = 0;
+			}
+			else if(line.compare(0, 2, "# ") == 0)
+			{
+				period = atoi(line.c_str() + 2);
+				next = now_us();
+			}
+			else
+			{
+				out += answer(line, counts);
+				if(line.find('?') != string::npos && period == 0)
+					history.push_back(line);
+			}
+			if(write(master, out.c_str(), out.size()) < 0)
+				perror("write");
+			line.clear();
+		}
+		if(period > 0 && now_us() >= next)
+		{
+			next += period*1000;
+			counts += 10;
+			string out;
+			for(const auto &query : history)
+				out += answer(query, counts);
+			if(write(master, out.c_str(), out.size()) < 0)
+				perror("write");
+		}
+	}
+}
+
+static void stats(std::vector<double> v, double &mean, double &p99)
+{
+	mean = p99 = 0;
+	if(v.empty())
+		return;
+	std::sort(v.begin(), v.end());
+	for(double x : v)
+		mean += x;
+	mean /= v.size();
+	p99 = v[std::min(v.size()-1, size_t(0.99*v.size()))];
+}
+
+int main(int argc, char **argv)
+{
+	const double seconds = argc > 1 ? atof(argv[1]) : 2;
+	const int period = argc > 2 ? atoi(argv[2]) : 10;
+
+	const int master = posix_openpt(O_RDWR | O_NOCTTY);
+	if(master < 0 || grantpt(master) != 0 || unlockpt(master) != 0)
+	{
+		perror("pty");
+		return 2;
+	}
+	struct termios tio;
+	tcgetattr(master, &tio);
+	cfmakeraw(&tio);
+	tcsetattr(master, TCSANOW, &tio);
+	std::atomic<bool> stop(false);
+	std::thread simulator(simulateControllers, master, std::ref(stop));
+
+	int failures = 0;
+	RoboteqDevice device;
+	if(device.Connect(ptsname(master)) != RQ_SUCCESS)
+	{
+		printf("connect failed\n");
+		stop = true;
+		simulator.join();
+		return 1;
+	}
+
+	// Polling, as without TelemetryPeriod: an odometry sample reads the four wheel speeds
+	int value, samples = 0;
+	int64_t start = now_us();
+	while(now_us() - start < 5e5*seconds)
+	{
+		failures += device.GetValue(false, _S, 1, value) != RQ_SUCCESS;
+		failures += device.GetValue(false, _S, 2, value) != RQ_SUCCESS;
+		failures += device.GetValue(true, _S, 1, value) != RQ_SUCCESS;
+		failures += device.GetValue(true, _S, 2, value) != RQ_SUCCESS;
+		samples++;
+	}
+	const double pollingRate = samples / (1e-6*(now_us() - start));
+	std::vector<double> polled;
+	start = now_us();
+	while(now_us() - start < 2.5e5*seconds)
+	{
+		const int64_t t = now_us();
+		failures += device.SetCommand(false, _G, 1, 100) != RQ_SUCCESS;
+		polled.push_back(1e-3*(now_us() - t));
+	}
+
+	// Streaming
+	if(device.StartStreaming(period) != RQ_SUCCESS)
+	{
+		printf("StartStreaming failed\n");
+		failures++;
+	}
+	const bool refused = device.GetValue(false, _S, 1, value) == RQ_ERR_STREAMING;
+	RoboteqTelemetry local, can;
+	int64_t lastLocal = 0, lastCan = 0;
+	int localSamples = 0, canSamples = 0, wrong = 0, commands = 0;
+	std::vector<double> calls;
+	start = now_us();
+	while(now_us() - start < 1e6*seconds)
+	{
+		if(device.GetTelemetry(false, local) && local.timestamp != lastLocal)
+		{
+			lastLocal = local.timestamp;
+			localSamples++;
+			wrong += local.speeds[0] != SPEED || local.speeds[1] != -SPEED || local.counts[0] != -local.counts[1] || local.volts[1] != 245;
+		}
+		if(device.GetTelemetry(true, can) && can.timestamp != lastCan)
+		{
+			lastCan = can.timestamp;
+			canSamples++;
+			wrong += can.speeds[0] != SPEED || can.speeds[1] != -SPEED || can.counts[0] != -can.counts[1] || can.volts[1] != 245;
+		}
+		// What SetSpeedBase does on every compute
+		const int64_t t = now_us();
+		failures += device.SetCommand(false, _G, 1, 100) != RQ_SUCCESS;
+		failures += device.SetCommand(true, _G, 2, -100) != RQ_SUCCESS;
+		calls.push_back(1e-3*(now_us() - t)/2);
+		commands += 2;
+		usleep(1000);
+	}
+	usleep(50000);
+	const RoboteqCommandStats acks = device.GetCommandStats();
+	device.StopStreaming();
+	const bool resumed = device.GetValue(false, _S, 1, value) == RQ_SUCCESS;
+	device.Disconnect();
+	stop = true;
+	simulator.join();
+	close(master);
+
+	double meanPolled, p99Polled, meanCall, p99Call;
+	stats(polled, meanPolled, p99Polled);
+	stats(calls, meanCall, p99Call);
+	const double expected = seconds*1000./period;
+	printf("polling:   %.1f odometry samples/s, SetCommand mean %.2f ms p99 %.2f ms\n", pollingRate, meanPolled, p99Polled);
+	printf("streaming: every %d ms, local %.1f samples/s, CAN node %.1f samples/s, %d wrong\n", period, localSamples/seconds, canSamples/seconds, wrong);
+	printf("streaming: %d commands, SetCommand mean %.4f ms p99 %.4f ms\n", commands, meanCall, p99Call);
+	printf("streaming: sent %lu acked %lu failed %lu lost %lu, acknowledgement mean %.3f ms max %.3f ms\n", (unsigned long)acks.sent,
+	       (unsigned long)acks.acked, (unsigned long)acks.failed, (unsigned long)acks.lost, acks.meanLatencyMs, acks.maxLatencyMs);
+	printf("synchronous queries refused while streaming: %s, working after it: %s\n", refused ? "yes" : "no", resumed ? "yes" : "no");
+
+	// The reader thread may miss a repetition now and then, not a fifth of them
+	const bool ok = failures == 0 && wrong == 0 && refused && resumed && acks.failed == 0 && acks.lost == 0 && acks.acked == acks.sent
+		&& localSamples > 0.8*expected && canSamples > 0.8*expected;
+	return ok ? 0 : 1;
+}
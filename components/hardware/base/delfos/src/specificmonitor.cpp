@@ -98,6 +98,10 @@ void SpecificMonitor::readConfig(RoboCompCommonBehavior::ParameterList &params )
 	aux.editable = true;
 	configGetString("", "DelfosBase.AxesLength", aux.value, "422.");
 	params["DelfosBase.AxesLength"] = aux;
+
+	aux.editable = false;
+	configGetString("", "DelfosBase.TelemetryPeriod", aux.value, "10");
+	params["DelfosBase.TelemetryPeriod"] = aux;
 }
 
 //comprueba que los parametros sean correctos y los transforma a la estructura del worker
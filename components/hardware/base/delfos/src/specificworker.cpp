@@ -107,6 +107,11 @@ bool SpecificWorker::setParams(RoboCompCommonBehavior::ParameterList params)
 	M_vels_2_wheels(3,2) = -ll;
 	M_vels_2_wheels = M_vels_2_wheels.operator*(1./(R)); // 1/R instead of 1/(2*pi*R) because we use rads/s instead of rev/s
 	M_vels_2_wheels.print("M_vels_2_wheels");
+
+	// With telemetry streaming odometry integrates the measured wheel speeds and commands don't block
+	const int telemetryPeriod = QString::fromStdString(params["DelfosBase.TelemetryPeriod"].value).toInt();
+	if (telemetryPeriod > 0 and delfos->startTelemetry(telemetryPeriod))
+		printf("delfos: streaming telemetry every %d ms\n", telemetryPeriod);
 	
 	timer.start(Period);
 	return true;
@@ -143,16 +148,38 @@ double SpecificWorker::getElapsedSeconds(bool clear)
 	return ret;
 }
 
+/**
+* \brief Measured wheel speeds (rad/s) from the controllers' telemetry, false if it is missing or stale
+*/
+bool SpecificWorker::measuredWheelVels(QVec &vels)
+{
+	float v1, v2, v3, v4;
+	int64_t timestamp;
+	if (not delfos->isStreaming() or not delfos->getVelocity(v1, v2, v3, v4, timestamp))
+		return false;
+	const int64_t now = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	if (now - timestamp > 200000)
+		return false;
+	// Inverse of the conversion and the sign flips done in setWheels
+	const double rpm2rps = (2.*M_PI)/60.;
+	const double encoderFactor = 71.0/8.0;
+	vels = QVec::vec4(v1, -v2, v3, -v4).operator*(rpm2rps / encoderFactor);
+	return true;
+}
+
 void SpecificWorker::computeOdometry(bool forced)
 {
 	QMutexLocker locker(mutex);
 	const double elapsedTime = getElapsedSeconds();
-	
-	if (forced or elapsedTime > 0.08)
+	QVec vels = wheelVels;
+	const bool measured = measuredWheelVels(vels);
+
+	// Without telemetry the commanded speeds are integrated, at most every 80 ms
+	if (forced or measured or elapsedTime > 0.08)
 	{
 		getElapsedSeconds(true);
 		QVec newP;
-		QVec wheelsInc = wheelVels.operator*(elapsedTime);
+		QVec wheelsInc = vels.operator*(elapsedTime);
 		QVec deltaPos = M_wheels_2_vels * wheelsInc;
 
 		// Raw odometry
@@ -31,6 +31,7 @@
 
 #include <genericworker.h>
 #include <innermodel/innermodel.h>
+#include <chrono>
 
 #include "delfos.h"
 
@@ -56,6 +57,7 @@ public:
 private:
 	void setWheels(QVec wheelVels_);
 	void computeOdometry(bool forced=false);
+	bool measuredWheelVels(QVec &vels);
 	float R, l1, l2;
 	QMat M_wheels_2_vels;
 	QMat M_vels_2_wheels;
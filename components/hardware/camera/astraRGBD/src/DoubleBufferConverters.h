@@ -6,253 +6,50 @@
 #define PROJECT_DOUBLEBUFFERCONVERTERS_H
 
 #include <qdebug.h>
+#include <LazyFrameStore.h>
 
 
-//TODO: This implementantions should go it's own file
-class ByteSeqConverter : public Converter<astra::ColorFrame, RoboCompRGBD::imgType>
+// Converters of the image streams. They read the raw frames kept by the
+// MultiFrameListener and only run when a client asks for that stream
+// (see LazyStream). The byte streams (imgType) are the raw data themselves.
+class ColorSeqConverter
 {
-private:
-	std::size_t size=0;
 public:
-	ByteSeqConverter(std::size_t _size)
+	static bool ItoO(const RawFrame<RoboCompRGBD::imgType> &iTypeData, RoboCompRGBD::ColorSeq &oTypeData)
 	{
-		size=_size;
-	}
-	bool clear(RoboCompRGBD::imgType &oTypeData)
-	{
-		oTypeData.clear();
+		oTypeData.resize(iTypeData.width*iTypeData.height);
+		memcpy(&oTypeData[0], &iTypeData.data[0], iTypeData.width*iTypeData.height*3);
 		return true;
 	}
-    bool ItoO(const astra::ColorFrame &iTypeData, RoboCompRGBD::imgType &oTypeData)
-    {
-		if(oTypeData.size()<this->size)
-		{
-			oTypeData.resize(size);
-		}
-        if (iTypeData.is_valid())
-        {
-
-            //            this->resize(d.width() * d.height()*data_size);
-            memcpy(&oTypeData[0], iTypeData.data(), iTypeData.width()*iTypeData.height()*3);
-            //            std::copy(std::begin(d.data()), std::end(d.data()), std::begin(writeBuffer));
-            return true;
-        }
-        return false;
-    }
-
-    bool OtoI(const RoboCompRGBD::imgType &oTypeData, astra::ColorFrame &iTypeData)
-    {
-        return false;
-    }
 };
 
-class PointSeqConverter : public Converter<astra::PointFrame, RoboCompRGBD::PointSeq>
+class PointSeqConverter
 {
-private:
-	std::size_t size=0;
 public:
-	PointSeqConverter(std::size_t _size)
+	static bool ItoO(const RawFrame<RoboCompRGBD::imgType> &iTypeData, RoboCompRGBD::PointSeq &oTypeData)
 	{
-		size=_size;
-	}
-	bool clear(RoboCompRGBD::PointSeq &oTypeData)
-	{
-		oTypeData.clear();
-		return true;
-	}
-    bool ItoO(const astra::PointFrame &iTypeData, RoboCompRGBD::PointSeq &oTypeData)
-    {
-		if(oTypeData.size()<this->size)
+		const std::size_t points = iTypeData.data.size()/(3*sizeof(float));
+		oTypeData.resize(points);
+		const float *xyz = reinterpret_cast<const float *>(&iTypeData.data[0]);
+		for (std::size_t i = 0; i < points; i++)
 		{
-			oTypeData.resize(size);
+			oTypeData[i].x = xyz[3*i];
+			oTypeData[i].y = xyz[3*i+1];
+			oTypeData[i].z = xyz[3*i+2];
 		}
-        if (iTypeData.is_valid())
-        {
-
-            //            this->resize(d.width() * d.height()*data_size);
-//            std::cout<<"iTypeData length "<<iTypeData.length()<<endl;
-//            memcpy(&oTypeData[0], iTypeData.data(), iTypeData.length());
-            int non0 = 0;
-			for(uint i = 0; i< iTypeData.length(); i++)
-			{
-				oTypeData[i].x = iTypeData.data()[i].x;
-				oTypeData[i].y = iTypeData.data()[i].y;
-				oTypeData[i].z = iTypeData.data()[i].z;
-				if(iTypeData.data()[i].x != 0 or iTypeData.data()[i].y != 0 or iTypeData.data()[i].z != 0)
-				{
-					non0++;
-				}
-				std::cout<<non0<<" non 0 values in Point Stream";
-			}
-            //            std::copy(std::begin(d.data()), std::end(d.data()), std::begin(writeBuffer));
-            return true;
-        }
-        return false;
-    }
-
-    bool OtoI(const RoboCompRGBD::PointSeq &oTypeData, astra::PointFrame &iTypeData)
-    {
-        return false;
-    }
-};
-
-
-class PointStreamConverter : public Converter<astra::PointFrame, RoboCompRGBD::imgType>
-{
-private:
-	std::size_t size=0;
-public:
-	PointStreamConverter(std::size_t _size)
-	{
-		size=_size;
-	}
-	bool clear(RoboCompRGBD::imgType &oTypeData)
-	{
-		oTypeData.clear();
 		return true;
 	}
-    bool ItoO(const astra::PointFrame &iTypeData, RoboCompRGBD::imgType &oTypeData)
-    {
-		if(oTypeData.size()<this->size)
-		{
-			oTypeData.resize(size);
-		}
-        if (iTypeData.is_valid())
-        {
-
-            //            this->resize(d.width() * d.height()*data_size);
-//            std::cout<<"iTypeData length "<<iTypeData.length()<<endl;
-            memcpy(&oTypeData[0], iTypeData.data(), iTypeData.length()*3*4);
-//            auto point = iTypeData.data()[10];
-//			std::cout<<"Point ("<<point.x<<", "<<point.y<<", "<<point.z<<")"<<std::endl;
-//            int non0 = 0;
-//			for(uint i = 0; i< iTypeData.length(); i++)
-//			{
-//				oTypeData[i].x = iTypeData.data()[i].x;
-//				oTypeData[i].y = iTypeData.data()[i].y;
-//				oTypeData[i].z = iTypeData.data()[i].z;
-////				if(iTypeData.data()[i].x != 0 or iTypeData.data()[i].y != 0 or iTypeData.data()[i].z != 0)
-////				{
-////					non0++;
-////				}
-////				std::cout<<non0<<" non 0 values in Point Stream"<<endl;
-//			}
-            //            std::copy(std::begin(d.data()), std::end(d.data()), std::begin(writeBuffer));
-            return true;
-        }
-        return false;
-    }
-
-    bool OtoI(const RoboCompRGBD::imgType &oTypeData, astra::PointFrame &iTypeData)
-    {
-        return false;
-    }
 };
 
-class ColorSeqConverter : public Converter<astra::ColorFrame, RoboCompRGBD::ColorSeq>
+class FloatSeqConverter
 {
-private:
-	std::size_t size=0;
 public:
-	ColorSeqConverter(std::size_t _size)
-	{
-		size=_size;
-	}
-	bool clear(RoboCompRGBD::ColorSeq &oTypeData)
+	static bool ItoO(const RawFrame< std::vector<int16_t> > &iTypeData, RoboCompRGBD::DepthSeq &oTypeData)
 	{
-		oTypeData.clear();
+		oTypeData.resize(iTypeData.data.size());
+		std::copy(iTypeData.data.begin(), iTypeData.data.end(), oTypeData.begin());
 		return true;
 	}
-    bool ItoO(const astra::ColorFrame &iTypeData, RoboCompRGBD::ColorSeq &oTypeData)
-    {
-		if(oTypeData.size()<this->size)
-		{
-			oTypeData.resize(size);
-		}
-        if (iTypeData.is_valid())
-        {
-
-            //            this->resize(d.width() * d.height()*data_size);
-            memcpy(&oTypeData[0], iTypeData.data(), iTypeData.width()*iTypeData.height()*3);
-            //            std::copy(std::begin(d.data()), std::end(d.data()), std::begin(writeBuffer));
-            return true;
-        }
-        return false;
-    }
-
-    bool OtoI(const RoboCompRGBD::ColorSeq &oTypeData, astra::ColorFrame &iTypeData)
-    {
-        return false;
-    }
-};
-//class ByteSeqConverter : public Converter<astra::ColorFrame, RoboCompRGBD::imgType>
-//{
-//private:
-//	std::size_t size=0;
-//public:
-//	ByteSeqConverter(std::size_t _size)
-//	{
-//		size=_size;
-//	}
-//bool clear(, RoboCompRGBD::imgType &)
-//{
-//	oTypeData.clear();
-//return true;
-//}
-//    bool ItoO(const astra::ColorFrame &iTypeData, RoboCompRGBD::imgType &oTypeData)
-//    {
-//		  if(oTypeData.size()<this->size)
-// {
-// oTypeData.resize(size);
-//        if (iTypeData.is_valid())
-//        {
-//
-//            //            this->resize(d.width() * d.height()*data_size);
-//            memcpy(&oTypeData[0], iTypeData.data(), iTypeData.width()*iTypeData.height()*3);
-//            //            std::copy(std::begin(d.data()), std::end(d.data()), std::begin(writeBuffer));
-//            return true;
-//        }
-//        return false;
-//    }
-//
-//    bool OtoI(const RoboCompRGBD::imgType &oTypeData, astra::ColorFrame &iTypeData)
-//    {
-//        return false;
-//    }
-//};
-
-class FloatSeqConverter : public Converter<astra::DepthFrame, RoboCompRGBD::DepthSeq>
-{
-private:
-	std::size_t size=0;
-public:
-	FloatSeqConverter(std::size_t _size)
-	{
-		size=_size;
-	}
-	bool clear(RoboCompRGBD::DepthSeq &oTypeData)
-	{
-		oTypeData.clear();
-		return true;
-	}
-    bool ItoO(const astra::DepthFrame &iTypeData, RoboCompRGBD::DepthSeq &oTypeData)
-    {
-		if(oTypeData.size()<this->size)
-		{
-			oTypeData.resize(size);
-		}
-        if (iTypeData.is_valid())
-        {
-            std::copy(&iTypeData.data()[0], &iTypeData.data()[0]+(iTypeData.width()*iTypeData.height()), std::begin(oTypeData));
-            return true;
-        }
-        return false;
-    }
-
-    bool OtoI(const RoboCompRGBD::DepthSeq &oTypeData, astra::DepthFrame &iTypeData)
-    {
-        return false;
-    }
 };
 
 
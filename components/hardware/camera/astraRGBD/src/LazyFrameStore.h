@@ -0,0 +1,130 @@
+//
+// Created by robolab on 18/10/20.
+//
+
+#ifndef PROJECT_LAZYFRAMESTORE_H
+#define PROJECT_LAZYFRAMESTORE_H
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <vector>
+
+/**
+* \brief Raw data of one stream for one frame. Immutable once published.
+*/
+template<typename Data>
+struct RawFrame
+{
+	uint64_t id;
+	int width, height;
+	Data data;
+};
+
+/**
+* \brief Recycles the buffers nobody else holds any more, so that capturing
+* and converting frames does not allocate once the pool has warmed up.
+*/
+template<typename T>
+class BufferPool
+{
+public:
+	std::shared_ptr<T> acquire()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		for (auto &buffer : buffers)
+		{
+			// Only the pool owns it, so no one can get a new reference to it
+			if (buffer.use_count() == 1)
+			{
+				std::atomic_thread_fence(std::memory_order_acquire);
+				return buffer;
+			}
+		}
+		buffers.push_back(std::make_shared<T>());
+		return buffers.back();
+	}
+
+private:
+	std::mutex mutex;
+	std::vector< std::shared_ptr<T> > buffers;
+};
+
+/**
+* \brief Latest raw frame of a stream, shared by reference with every reader.
+* Publishing only swaps a pointer, so the frame callback never waits for readers.
+*/
+template<typename Data>
+class FrameSlot
+{
+public:
+	void publish(const std::shared_ptr< const RawFrame<Data> > &frame)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		frame_ = frame;
+	}
+
+	void clear()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		frame_.reset();
+	}
+
+	/// nullptr until the first frame arrives
+	std::shared_ptr< const RawFrame<Data> > latest() const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return frame_;
+	}
+
+private:
+	mutable std::mutex mutex;
+	std::shared_ptr< const RawFrame<Data> > frame_;
+};
+
+/**
+* \brief Conversion of the frames of a FrameSlot into an interface type, done on demand.
+*
+* A frame is converted the first time it is requested and the result is shared
+* with every later caller asking for the same frame id. Frames nobody asks for
+* are never converted. Converter::ItoO(const RawFrame<Data>&, Out&) does the work.
+*/
+template<typename Data, typename Out, typename Converter>
+class LazyStream
+{
+public:
+	LazyStream(const FrameSlot<Data> &slot_) : slot(slot_), convertedId(0) { }
+
+	/// Converted latest frame, nullptr if there is none yet
+	std::shared_ptr<const Out> get()
+	{
+		const std::shared_ptr< const RawFrame<Data> > frame = slot.latest();
+		if (not frame)
+			return nullptr;
+		std::lock_guard<std::mutex> lock(mutex);
+		if (converted and convertedId == frame->id)
+			return converted;
+		std::shared_ptr<Out> out = pool.acquire();
+		if (not Converter::ItoO(*frame, *out))
+			return converted;
+		converted = out;
+		convertedId = frame->id;
+		return converted;
+	}
+
+	void clear()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		converted.reset();
+	}
+
+private:
+	const FrameSlot<Data> &slot;
+	std::mutex mutex;
+	BufferPool<Out> pool;
+	std::shared_ptr<const Out> converted;
+	uint64_t convertedId;
+};
+
+#endif //PROJECT_LAZYFRAMESTORE_H
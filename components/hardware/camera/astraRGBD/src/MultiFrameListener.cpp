@@ -7,13 +7,29 @@
 #include <ctime>
 #include "innermodel/innermodel.h"
 
-MultiFrameListener::MultiFrameListener(RoboCompHumanTrackerJointsAndRGB::HumanTrackerJointsAndRGBPrx &_pubproxy, int _cameraID) : pubproxy (_pubproxy)
+/**
+* \brief Copies the raw data of a frame into a recycled buffer and makes it the latest frame of the slot.
+* This is the only per-frame work done for the image streams, conversions are left to the readers.
+*/
+template<typename Data>
+static void publish_raw(BufferPool< RawFrame<Data> > &pool, FrameSlot<Data> &slot, const uint64_t id, const void *data, const std::size_t bytes, const int width, const int height)
+{
+	std::shared_ptr< RawFrame<Data> > raw = pool.acquire();
+	raw->id = id;
+	raw->width = width;
+	raw->height = height;
+	raw->data.resize(bytes/sizeof(typename Data::value_type));
+	memcpy(&raw->data[0], data, bytes);
+	slot.publish(raw);
+}
+
+MultiFrameListener::MultiFrameListener(RoboCompHumanTrackerJointsAndRGB::HumanTrackerJointsAndRGBPrx &_pubproxy, int _cameraID) : frameId(0), depthBuff(depthSlot), colorBuff(colorSlot), pointBuff(pointSlot), pubproxy (_pubproxy)
 {
     cameraID = _cameraID;
     streamBools["depth"]=false;
     streamBools["color"]=false;
     streamBools["ir"]=false;
-    streamBools["points"]=false;
+    streamBools["point"]=false;
     streamBools["hand"]=false;
     streamBools["body"]=false;
     reader = new astra::StreamReader(streamSet.create_reader());
@@ -25,24 +41,13 @@ MultiFrameListener::MultiFrameListener(RoboCompHumanTrackerJointsAndRGB::HumanTr
     bodyStream  = new astra::BodyStream(configure_body(*reader));
 
 
-    byteConverter = new ByteSeqConverter(640*480*3);
-    depthConverter = new FloatSeqConverter(640*480);
-    colorConverter = new ColorSeqConverter(640*480);
-    pointStreamConverter = new PointStreamConverter(640*480*3*4);
-    pointConverter = new PointSeqConverter(640*480);
     bodiesConverter = new BodiesPeopleConverter();
     bodyRgbConverter = new BodyRGBConverter();
 
 
-    colorBuff2.init(*byteConverter);
-    colorBuff.init(*colorConverter);
-    depthBuff.init(*depthConverter);
-    pointStreamBuff.init(*pointStreamConverter);
-    pointBuff.init(*pointConverter);
     bodyBuff.init(*bodiesConverter);
     bodyRGBMix.init(*bodyRgbConverter);
 
-    end = chrono::steady_clock::now();
     std::map<astra::JointType, ::std::string> JOINT2STRING = {
             std::make_pair(astra::JointType::Head,"Head"),
             std::make_pair(astra::JointType::Neck,"Neck"),
@@ -67,8 +72,7 @@ MultiFrameListener::MultiFrameListener(RoboCompHumanTrackerJointsAndRGB::HumanTr
 }
 void MultiFrameListener::on_frame_ready(astra::StreamReader& reader, astra::Frame& frame)
 {
-    auto start = chrono::steady_clock::now();
-//	cout << "SAME FRAME READY " << endl;
+    const uint64_t id = ++frameId;
     auto t0 = std::chrono::high_resolution_clock::now();
     unsigned long milliseconds_since_epoch = t0.time_since_epoch() / std::chrono::milliseconds(1);
 //    qDebug()<<typeid(milliseconds_since_epoch).name()<<endl;
@@ -78,7 +82,7 @@ void MultiFrameListener::on_frame_ready(astra::StreamReader& reader, astra::Fram
         const astra::DepthFrame depthFrame = frame.get<astra::DepthFrame>();
         if (depthFrame.is_valid())
         {
-            depthBuff.put(depthFrame, sizeof(short));
+            publish_raw(depthFrames, depthSlot, id, depthFrame.data(), depthFrame.width()*depthFrame.height()*sizeof(int16_t), depthFrame.width(), depthFrame.height());
         }
     }
     if (streamBools["color"])
@@ -86,12 +90,9 @@ void MultiFrameListener::on_frame_ready(astra::StreamReader& reader, astra::Fram
         astra::ColorFrame colorFrame = frame.get<astra::ColorFrame>();
         if(colorFrame.is_valid())
         {
-            // Huge odd job because of the 2 image formats od the RGBD interface ColorSeq and ImgType
-            colorBuff.put(colorFrame, sizeof(astra::RgbPixel));
-            colorBuff2.put(colorFrame, sizeof(astra::RgbPixel));
+            // Shared by both image formats of the RGBD interface, ColorSeq and imgType
+            publish_raw(colorFrames, colorSlot, id, colorFrame.data(), colorFrame.width()*colorFrame.height()*sizeof(astra::RgbPixel), colorFrame.width(), colorFrame.height());
         }
-//        cout << "lapse COLORS "<<chrono::duration <double, milli> (end-start).count() << " ms" << endl;
-        end =  chrono::steady_clock::now();
     }
 	if (streamBools["point"])
 	{
@@ -99,10 +100,8 @@ void MultiFrameListener::on_frame_ready(astra::StreamReader& reader, astra::Fram
 		astra::PointFrame pointFrame = frame.get<astra::PointFrame>();
 		if(pointFrame.is_valid())
 		{
-//		pointBuff.put(pointFrame, sizeof(float)*4);
-            pointStreamBuff.put(pointFrame, sizeof(float)*4);
+			publish_raw(pointFrames, pointSlot, id, pointFrame.data(), pointFrame.length()*sizeof(astra::Vector3f), pointFrame.width(), pointFrame.height());
 		}
-        end =  chrono::steady_clock::now();
 	}
 
 
@@ -212,37 +211,7 @@ void MultiFrameListener::on_frame_ready(astra::StreamReader& reader, astra::Fram
 		RoboCompHumanTrackerJointsAndRGB::MixedJointsRGB output;
 		bodyRGBMix.get(output);
 		output.cameraID = cameraID;
-                qDebug()<<"OUTPUT is Frame with timestamp: "<<output.timeStamp<<" and Person with "<< output.persons.size()<<" and color"<< output.rgbImage.width<<endl;
 		pubproxy->newPersonListAndRGB(output);
-if(output.persons.size()>0){ 
-qDebug()<<"******************BODY******************";
-        const float fx=535.4, fy=539.2, sx=1, sy=1, Ox=320, Oy=240;
-        QMat K = QMat::zeros(3,3);
-	K(0,0) = fx/sx; K(0,1) = 0.f; 		K(0,2) = Ox;
-	K(1,0) = 0; 	 K(1,1) = -fy/sy; 	K(1,2) = Oy;
-	K(2,0) = 0;		 K(2,1) = 0;		K(2,2) = 1;
-RoboCompHumanTrackerJointsAndRGB::PersonList people = output.persons;
-DepthSeq depth;
-depthBuff.get(depth);
-qDebug()<<"depth size"<<depth.size();
-for (auto person: people){
-try{
-    QVec p3D = QVec::vec3(person.second.joints.at("Head")[0], person.second.joints.at("Head")[1], person.second.joints.at("Head")[2]);
-    p3D.print("Head joint");
-    //point in depth image
-    QVec img = K * p3D;
-    int x = img[0]/img[2];
-    int y = img[1]/img[2];
-    float depthP = depth[y*640+x];
-    QVec pDepth= QVec::vec3( (x-320) *depthP/535.4  , -(y-240)*depthP/539.2, depthP);
-    pDepth.print("Depth point");
-}catch(...)
-{qDebug()<<"no data for that joint";}
-}
-}
-//points 
-//PointsSeq points = pointBuff.get(points);
-
     }
 
 }
@@ -295,50 +264,43 @@ void MultiFrameListener::set_body_stream(bool body_bool)
 
 void MultiFrameListener::get_depth(DepthSeq& depth)
 {
-//    cout<<"MultiFrameListener::get_depth"<<endl;
-    depthBuff.get(depth);
-
+    const std::shared_ptr<const DepthSeq> converted = depthBuff.get();
+    if (converted)
+        depth = *converted;
 }
 
 void MultiFrameListener::get_points(PointSeq& points)
 {
-//    cout<<"MultiFrameListener::get_points"<<endl;
-	typedef std::chrono::duration<float> fsec;
-	std::chrono::system_clock::time_point initial_time = std::chrono::system_clock::now();
-    pointBuff.get(points);
-	std::cout<<"Multiframe: fps "<<fsec(1)/( std::chrono::system_clock::now() - initial_time)<<endl;
+    const std::shared_ptr<const PointSeq> converted = pointBuff.get();
+    if (converted)
+        points = *converted;
 }
 
 void MultiFrameListener::get_points_stream(imgType& pointsStream)
 {
-//    cout<<"MultiFrameListener::get_points"<<endl;
-    typedef std::chrono::duration<float> fsec;
-    std::chrono::system_clock::time_point initial_time = std::chrono::system_clock::now();
-    pointStreamBuff.get(pointsStream);
-    std::cout<<"Multiframe: fps "<<fsec(1)/( std::chrono::system_clock::now() - initial_time)<<endl;
+    const std::shared_ptr< const RawFrame<imgType> > raw = pointSlot.latest();
+    if (raw)
+        pointsStream = raw->data;
 }
 
 void MultiFrameListener::get_color(ColorSeq& colors)
 {
-//    cout<<"MultiFrameListener::get_color"<<endl;
-    colorBuff.get(colors);
+    const std::shared_ptr<const ColorSeq> converted = colorBuff.get();
+    if (converted)
+        colors = *converted;
 }
 
 void MultiFrameListener::get_color(imgType& colors)
 {
-//    if (colorBuff2.size==0) return;
-//    cout<<"MultiFrameListener::get_color2"<<endl;
-    colorBuff2.get(colors);
-    // Hack to fix a problem with the ColorSeq and imgType types of RGBD interface
-//    colors.resize(colors.size()/3);
+    const std::shared_ptr< const RawFrame<imgType> > raw = colorSlot.latest();
+    if (raw)
+        colors = raw->data;
 }
 
 
 void MultiFrameListener::get_people(RoboCompHumanTracker::PersonList& people)
 {
-    qDebug()<<"get_People_1 "<<people.size();
     bodyBuff.get(people);
-    qDebug()<<"get_People_2 "<<people.size();
 
 //    if (is_writting) //la bandera dice si se esta leyendo a la vez que escribiendo
 //    {
@@ -13,6 +13,7 @@
 #include <genericworker.h>
 #include <doublebuffer/DoubleBuffer.h>
 #include <DoubleBufferConverters.h>
+#include <LazyFrameStore.h>
 //#include <opencv2/opencv.hpp>
 #include <mutex>
 #include <chrono>
@@ -34,25 +35,24 @@ class MultiFrameListener : public astra::FrameListener
     astra::InfraredStream *irStream;
     astra::HandStream *handStream;
 
-    DoubleBuffer<astra::PointFrame, RoboCompRGBD::imgType, PointStreamConverter> pointStreamBuff;
-	DoubleBuffer<astra::PointFrame, RoboCompRGBD::PointSeq, PointSeqConverter> pointBuff;
-    DoubleBuffer<astra::DepthFrame, RoboCompRGBD::DepthSeq, FloatSeqConverter> depthBuff;
-    DoubleBuffer<astra::ColorFrame, RoboCompRGBD::ColorSeq, ColorSeqConverter> colorBuff;
-    DoubleBuffer<astra::ColorFrame, RoboCompRGBD::imgType, ByteSeqConverter> colorBuff2;
+	// Raw frames of the image streams, converted only when a client asks for them
+	uint64_t frameId;
+	BufferPool< RawFrame< std::vector<int16_t> > > depthFrames;
+	BufferPool< RawFrame<RoboCompRGBD::imgType> > colorFrames, pointFrames;
+	FrameSlot< std::vector<int16_t> > depthSlot;
+	FrameSlot<RoboCompRGBD::imgType> colorSlot, pointSlot;
+	LazyStream<std::vector<int16_t>, RoboCompRGBD::DepthSeq, FloatSeqConverter> depthBuff;
+	LazyStream<RoboCompRGBD::imgType, RoboCompRGBD::ColorSeq, ColorSeqConverter> colorBuff;
+	LazyStream<RoboCompRGBD::imgType, RoboCompRGBD::PointSeq, PointSeqConverter> pointBuff;
+
     DoubleBuffer<astra::BodyFrame, RoboCompHumanTracker::PersonList, BodiesPeopleConverter> bodyBuff;
 	DoubleBuffer<std::tuple<astra::ColorFrame&,astra::BodyFrame&, long int>, RoboCompHumanTrackerJointsAndRGB::MixedJointsRGB, BodyRGBConverter> bodyRGBMix;
 
 
-    ByteSeqConverter *byteConverter;
-    FloatSeqConverter *depthConverter;
-    ColorSeqConverter *colorConverter;
-    PointStreamConverter *pointStreamConverter;
-	PointSeqConverter *pointConverter;
     BodiesPeopleConverter *bodiesConverter;
 	BodyRGBConverter *bodyRgbConverter;
 
     RoboCompHumanTracker::PersonList bodylist;
-    std::chrono::steady_clock::time_point end;
 	RoboCompHumanTrackerJointsAndRGB::HumanTrackerJointsAndRGBPrx &pubproxy;
 //    DoubleBuffer<RoboCompRGBD::PointSeq> pointBuff;
 //    DoubleBuffer<RoboCompRGBD::DepthSeq> depthBuff;
@@ -0,0 +1,216 @@
+// A producer thread stands for on_frame_ready: every 1/fps s it copies a VGA
+// depth frame into a pooled RawFrame and publishes it. With 0 to 4 consumers
+// calling RGBD_getDepth-like reads at a given rate, it reports the time spent in
+// the callback, the latency of a read, conversions per captured frame and how
+// many raw buffers the pool allocated, for the lazy store and for the former eager
+// conversion (depth to float in the callback, copied out to every reader).
+// Every depth frame is filled with its id, so a torn or mixed read is caught.
+//   lazyframestore_bench [frames] [fps] [reads per second per consumer]
+// Returns 1 on a torn read.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "LazyFrameStore.h"
+
+static double now()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static std::atomic<uint64_t> conversions(0);
+
+/// Same work as FloatSeqConverter, on the raw depth frame
+class DepthConverter
+{
+public:
+	static bool ItoO(const RawFrame< std::vector<int16_t> > &iTypeData, std::vector<float> &oTypeData)
+	{
+		oTypeData.resize(iTypeData.data.size());
+		std::copy(iTypeData.data.begin(), iTypeData.data.end(), oTypeData.begin());
+		conversions++;
+		return true;
+	}
+};
+
+static void stats(std::vector<double> v, double &mean, double &p99)
+{
+	mean = p99 = 0;
+	if (v.empty())
+		return;
+	std::sort(v.begin(), v.end());
+	for (double x : v)
+		mean += x;
+	mean /= v.size();
+	p99 = v[std::min(v.size()-1, size_t(0.99*v.size()))];
+}
+
+struct Result
+{
+	double callbackMean, callbackP99, readMean, readP99;
+	uint64_t reads, torn, conversions;
+	size_t buffers;
+};
+
+/// The astra callback: the SDK frame only lives for the call, so its data is always copied once
+static void capture(const std::vector<int16_t> &device, uint64_t id, RawFrame< std::vector<int16_t> > &raw)
+{
+	raw.id = id;
+	raw.width = 640;
+	raw.height = 480;
+	raw.data.assign(device.begin(), device.end());
+	std::fill(raw.data.begin(), raw.data.begin() + 16, int16_t(id));
+}
+
+static bool torn(const std::vector<float> &depth)
+{
+	for (int i=1; i<16; i++)
+		if (depth[i] != depth[0])
+			return true;
+	return false;
+}
+
+static Result run(bool lazy, int consumers, int frames, double fps, double rate)
+{
+	const std::vector<int16_t> device(640*480, 1500);
+	std::atomic<bool> stop(false);
+	std::atomic<uint64_t> torn_(0), reads(0);
+	std::vector< std::vector<double> > readTimes(consumers);
+	std::vector<double> callbackTimes;
+	conversions = 0;
+
+	// Lazy: raw frames published by pointer, converted on the first read of each id
+	BufferPool< RawFrame< std::vector<int16_t> > > rawPool;
+	FrameSlot< std::vector<int16_t> > slot;
+	LazyStream< std::vector<int16_t>, std::vector<float>, DepthConverter > stream(slot);
+	size_t rawBuffers = 0;
+
+	// Eager: converted in the callback into a double buffer, copied out under its lock
+	std::mutex eagerMutex;
+	std::vector<float> eagerBuffers[2];
+	int eagerFront = 0;
+	RawFrame< std::vector<int16_t> > eagerRaw;
+
+	std::vector<std::thread> threads;
+	for (int c=0; c<consumers; c++)
+	{
+		threads.emplace_back([&, c]()
+		{
+			std::vector<float> copy;
+			while (not stop)
+			{
+				const double t = now();
+				if (lazy)
+				{
+					const std::shared_ptr<const std::vector<float>> depth = stream.get();
+					if (depth)
+					{
+						readTimes[c].push_back(now() - t);
+						torn_ += torn(*depth);
+						reads++;
+					}
+				}
+				else
+				{
+					std::lock_guard<std::mutex> lock(eagerMutex);
+					if (not eagerBuffers[eagerFront].empty())
+					{
+						copy = eagerBuffers[eagerFront];
+						readTimes[c].push_back(now() - t);
+						torn_ += torn(copy);
+						reads++;
+					}
+				}
+				std::this_thread::sleep_for(std::chrono::duration<double>(1./rate));
+			}
+		});
+	}
+
+	const double period = 1./fps;
+	double next = now();
+	for (int f=1; f<=frames; f++)
+	{
+		const double t = now();
+		if (lazy)
+		{
+			std::shared_ptr< RawFrame< std::vector<int16_t> > > raw = rawPool.acquire();
+			capture(device, f, *raw);
+			slot.publish(raw);
+		}
+		else
+		{
+			capture(device, f, eagerRaw);
+			const int back = 1 - eagerFront;
+			DepthConverter::ItoO(eagerRaw, eagerBuffers[back]);
+			std::lock_guard<std::mutex> lock(eagerMutex);
+			eagerFront = back;
+		}
+		callbackTimes.push_back(now() - t);
+		next += period;
+		std::this_thread::sleep_for(std::chrono::duration<double>(std::max(0., next - now())));
+	}
+	stop = true;
+	for (auto &t : threads)
+		t.join();
+
+	// Every buffer the raw pool holds was allocated once, count them by acquiring until a new one shows up
+	std::vector< std::shared_ptr< RawFrame< std::vector<int16_t> > > > held;
+	if (lazy)
+	{
+		slot.clear();
+		stream.clear();
+		while (true)
+		{
+			held.push_back(rawPool.acquire());
+			if (held.back()->data.empty())
+				break;
+		}
+		rawBuffers = held.size() - 1;
+	}
+
+	Result r;
+	stats(callbackTimes, r.callbackMean, r.callbackP99);
+	std::vector<double> all;
+	for (const auto &v : readTimes)
+		all.insert(all.end(), v.begin(), v.end());
+	stats(all, r.readMean, r.readP99);
+	r.reads = reads;
+	r.torn = torn_;
+	r.conversions = conversions;
+	r.buffers = rawBuffers;
+	return r;
+}
+
+int main(int argc, char **argv)
+{
+	const int frames = argc > 1 ? atoi(argv[1]) : 150;
+	const double fps = argc > 2 ? atof(argv[2]) : 30;
+	const double rate = argc > 3 ? atof(argv[3]) : 30;
+
+	uint64_t torn = 0;
+	printf("%d VGA depth frames at %.0f fps, every consumer reads at %.0f Hz\n", frames, fps, rate);
+	printf("%-6s %9s %14s %14s %13s %13s %8s %13s %12s\n", "mode", "consumers", "callback [ms]", "callback p99", "read [ms]", "read p99",
+	       "reads", "conv./frame", "raw buffers");
+	for (int consumers=0; consumers<=4; consumers++)
+	{
+		for (const bool lazy : {false, true})
+		{
+			const Result r = run(lazy, consumers, frames, fps, rate);
+			torn += r.torn;
+			char buffers[16] = "-";
+			if (lazy)
+				snprintf(buffers, sizeof(buffers), "%zu", r.buffers);
+			printf("%-6s %9d %14.3f %14.3f %13.3f %13.3f %8lu %13.2f %12s\n", lazy ? "lazy" : "eager", consumers, 1e3*r.callbackMean,
+			       1e3*r.callbackP99, 1e3*r.readMean, 1e3*r.readP99, (unsigned long)r.reads, double(r.conversions)/frames, buffers);
+			fflush(stdout);
+		}
+	}
+	printf("torn reads %lu\n", (unsigned long)torn);
+	return torn ? 1 : 0;
+}
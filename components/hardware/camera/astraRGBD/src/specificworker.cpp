@@ -131,9 +131,6 @@ void
 SpecificWorker::RGBD_getXYZ(PointSeq& points, RoboCompJointMotor::MotorStateMap& hState,
 		RoboCompGenericBase::TBaseState& bState)
 {
-	typedef std::chrono::duration<float> fsec;
-	std::chrono::system_clock::time_point initial_time = std::chrono::system_clock::now();
-
 	if (!this->pointB) {
 		std::cout << "WARNING: A request for a not initiated STREAM have been received." << endl;
 		std::cout
@@ -142,10 +139,6 @@ SpecificWorker::RGBD_getXYZ(PointSeq& points, RoboCompJointMotor::MotorStateMap&
 		return;
 	}
 	frameListener->get_points(points);
-
-	std::cout << "RGBD_getXYZ: fps " << fsec(1)/(std::chrono::system_clock::now()-initial_time) << endl;
-	compute_fps(true);
-
 }
 
 void
@@ -0,0 +1,141 @@
+/*
+ *    Copyright (C) 2020 by RoboLab - University of Extremadura
+ *
+ *    This file is part of RoboComp
+ *
+ *    RoboComp is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    RoboComp is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with RoboComp.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef IMUSAMPLEBUFFER_H
+#define IMUSAMPLEBUFFER_H
+
+#include <atomic>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+* \brief One IMU reading in RoboComp axes, with the orientation estimated up to it
+*/
+struct ImuSample
+{
+	double timestamp;   // device time (s)
+	float acc[3];       // g
+	float gyr[3];       // rad/s
+	float mag[3];       // gauss
+	float ori[3];       // pitch, yaw, roll (rad)
+};
+
+/**
+* \brief Lock-free ring keeping the last SIZE samples of the IMU.
+*
+* Written only by the device callback. Every slot is protected by its own
+* sequence counter: readers never block the writer and retry a slot that was
+* being overwritten, so any sample they get is a consistent one.
+*/
+class ImuSampleBuffer
+{
+public:
+	static const uint32_t SIZE = 1024;
+
+	ImuSampleBuffer() : count(0)
+	{
+		for (uint32_t i=0; i<SIZE; i++)
+			slots[i].seq.store(0, std::memory_order_relaxed);
+	}
+
+	void push(const ImuSample &sample)
+	{
+		const uint64_t c = count.load(std::memory_order_relaxed);
+		Slot &slot = slots[c % SIZE];
+		const uint32_t s = slot.seq.load(std::memory_order_relaxed);
+		slot.seq.store(s+1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		slot.sample = sample;
+		slot.seq.store(s+2, std::memory_order_release);
+		count.store(c+1, std::memory_order_release);
+	}
+
+	/// Total number of samples pushed
+	uint64_t size() const { return count.load(std::memory_order_acquire); }
+
+	/// Most recent sample, false if there is none yet
+	bool latest(ImuSample &out) const
+	{
+		uint64_t c;
+		do
+		{
+			c = count.load(std::memory_order_acquire);
+			if (c == 0)
+				return false;
+		} while (not read(c-1, out));
+		return true;
+	}
+
+	/**
+	* \brief Appends to out every sample newer than timestamp, oldest first
+	* Samples already overwritten by the writer are skipped.
+	* @return number of samples appended
+	*/
+	uint32_t since(const double timestamp, std::vector<ImuSample> &out) const
+	{
+		const uint64_t c = count.load(std::memory_order_acquire);
+		const uint64_t first = c > SIZE ? c-SIZE : 0;
+		// Newest to oldest until reaching the timestamp
+		uint64_t begin = c;
+		ImuSample sample;
+		while (begin > first)
+		{
+			if (not read(begin-1, sample) or sample.timestamp <= timestamp)
+				break;
+			begin--;
+		}
+		const size_t before = out.size();
+		for (uint64_t i=begin; i<c; i++)
+		{
+			if (read(i, sample))
+				out.push_back(sample);
+		}
+		return out.size() - before;
+	}
+
+protected:
+	// Protected so that imusamplebuffer_test can stage a write in progress or an overwritten slot
+	struct Slot
+	{
+		std::atomic<uint32_t> seq;
+		ImuSample sample;
+	};
+	Slot slots[SIZE];
+	std::atomic<uint64_t> count;
+
+	/// Reads sample number i, false if it is no longer (or not yet) in the ring
+	bool read(const uint64_t i, ImuSample &out) const
+	{
+		const Slot &slot = slots[i % SIZE];
+		while (true)
+		{
+			const uint32_t s0 = slot.seq.load(std::memory_order_acquire);
+			if (s0 & 1)
+				continue;
+			out = slot.sample;
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (slot.seq.load(std::memory_order_relaxed) != s0)
+				continue;
+			// Each lap adds 2 to the counter: the slot must hold lap i/SIZE
+			return s0 == 2*(i/SIZE + 1);
+		}
+	}
+};
+
+#endif
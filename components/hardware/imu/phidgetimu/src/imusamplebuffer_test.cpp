@@ -0,0 +1,242 @@
+/*
+ *    Copyright (C) 2020 by RoboLab - University of Extremadura
+ *
+ *    This file is part of RoboComp
+ *
+ *    RoboComp is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    RoboComp is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with RoboComp.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Checks of ImuSampleBuffer: ring order and wraparound, since() ordering and
+// overflow, the per-slot sequence counter (a reader waits for a write in
+// progress and never returns it torn), the lap check (a slot overwritten by a
+// later lap is not returned as an older sample), and a writer pushing as fast
+// as it can while readers call latest() and since(), every sample carrying its
+// own number in all of its fields so that a torn or misplaced one shows.
+//   imusamplebuffer_test [seconds]
+// Returns 1 if any check fails.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "imusamplebuffer.h"
+
+/// Buffer with access to its slots, to stage what the writer does between two instructions
+class StagedBuffer : public ImuSampleBuffer
+{
+public:
+	using ImuSampleBuffer::Slot;
+	Slot &slot(uint64_t i) { return slots[i % SIZE]; }
+};
+
+static ImuSample sampleNumber(uint64_t n)
+{
+	ImuSample s;
+	s.timestamp = n;
+	for (int k=0; k<3; k++)
+		s.acc[k] = s.gyr[k] = s.mag[k] = s.ori[k] = float(n % 1000000) + k;
+	return s;
+}
+
+/// Number of a sample made by sampleNumber, -1 if its fields disagree (torn)
+static int64_t numberOf(const ImuSample &s)
+{
+	const uint64_t n = uint64_t(s.timestamp);
+	for (int k=0; k<3; k++)
+	{
+		const float v = float(n % 1000000) + k;
+		if (s.acc[k] != v or s.gyr[k] != v or s.mag[k] != v or s.ori[k] != v)
+			return -1;
+	}
+	return n;
+}
+
+static int failures = 0;
+
+static void check(bool ok, const char *what)
+{
+	printf("%-64s %s\n", what, ok ? "ok" : "FAIL");
+	failures += not ok;
+}
+
+/// since() output must be consecutive numbers from first to last
+static bool consecutive(const std::vector<ImuSample> &v, int64_t first, int64_t last)
+{
+	if (int64_t(v.size()) != last - first + 1)
+		return false;
+	for (size_t i=0; i<v.size(); i++)
+		if (numberOf(v[i]) != first + int64_t(i))
+			return false;
+	return true;
+}
+
+static void ring()
+{
+	const uint64_t SIZE = ImuSampleBuffer::SIZE;
+	StagedBuffer buffer;
+	ImuSample s;
+	std::vector<ImuSample> out;
+	check(not buffer.latest(s) and buffer.since(-1, out) == 0 and buffer.size() == 0, "empty ring has no latest and no samples");
+
+	for (uint64_t n=1; n<=10; n++)
+		buffer.push(sampleNumber(n));
+	check(buffer.latest(s) and numberOf(s) == 10, "latest is the last pushed");
+	out.clear();
+	check(buffer.since(0, out) == 10 and consecutive(out, 1, 10), "since before the first returns all, oldest first");
+	out.clear();
+	check(buffer.since(5, out) == 5 and consecutive(out, 6, 10), "since a timestamp returns only newer samples");
+	out.clear();
+	check(buffer.since(10, out) == 0 and out.empty(), "since the newest returns nothing");
+	out.assign(1, sampleNumber(0));
+	check(buffer.since(8, out) == 2 and out.size() == 3 and numberOf(out[1]) == 9, "since appends to what out holds");
+
+	// Three laps and a bit: only the last SIZE samples are left
+	const uint64_t total = 3*SIZE + 17;
+	for (uint64_t n=11; n<=total; n++)
+		buffer.push(sampleNumber(n));
+	check(buffer.size() == total and buffer.latest(s) and numberOf(s) == int64_t(total), "latest after wrapping around");
+	out.clear();
+	check(buffer.since(0, out) == SIZE and consecutive(out, total - SIZE + 1, total), "since older than the ring returns the last SIZE only");
+	out.clear();
+	check(buffer.since(total - 5, out) == 5 and consecutive(out, total - 4, total), "since across the wrap point");
+	for (uint64_t i=total-SIZE; i<total; i++)
+		if (buffer.slot(i).seq.load() != 2*(i/SIZE + 1))
+		{
+			check(false, "every slot counter tells its lap");
+			return;
+		}
+	check(true, "every slot counter tells its lap");
+}
+
+static void lap()
+{
+	const uint64_t SIZE = ImuSampleBuffer::SIZE;
+	StagedBuffer buffer;
+	for (uint64_t n=1; n<=100; n++)
+		buffer.push(sampleNumber(n));
+
+	// Sample index 39 (number 40) overwritten by the next lap as seen by a slow reader:
+	// it and everything older must be left out, not returned in its place
+	StagedBuffer::Slot &slot = buffer.slot(39);
+	slot.sample = sampleNumber(39 + SIZE + 1);
+	slot.seq.store(2*(39/SIZE + 2));
+	std::vector<ImuSample> out;
+	check(buffer.since(0, out) == 60 and consecutive(out, 41, 100), "a slot of a later lap ends since() going back");
+
+	// A slot that still holds the previous lap is not returned either
+	StagedBuffer older;
+	for (uint64_t n=1; n<=SIZE+10; n++)
+		older.push(sampleNumber(n));
+	StagedBuffer::Slot &stale = older.slot(SIZE+5);
+	stale.sample = sampleNumber(6);
+	stale.seq.store(2);
+	out.clear();
+	check(older.since(0, out) == 4 and consecutive(out, SIZE+7, SIZE+10), "a slot of an earlier lap ends since() going back");
+}
+
+static void seqlock()
+{
+	const uint64_t SIZE = ImuSampleBuffer::SIZE;
+	StagedBuffer buffer;
+	for (uint64_t n=1; n<=SIZE; n++)
+		buffer.push(sampleNumber(n));
+
+	// The writer is halfway through overwriting the oldest slot with sample SIZE+1:
+	// odd counter, half-written sample, count not yet increased
+	StagedBuffer::Slot &slot = buffer.slot(0);
+	const uint32_t s = slot.seq.load();
+	slot.seq.store(s+1);
+	slot.sample.acc[0] = slot.sample.gyr[1] = -1.f;
+
+	std::atomic<bool> done(false);
+	std::vector<ImuSample> out;
+	std::thread reader([&]() { buffer.since(0, out); done = true; });
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	check(not done, "a reader waits while the slot is being written");
+
+	// The write completes: the slot now belongs to the next lap and is left out,
+	// the rest comes whole and in order
+	slot.sample = sampleNumber(SIZE+1);
+	slot.seq.store(s+2);
+	reader.join();
+	check(consecutive(out, 2, SIZE), "and then leaves the overwritten sample out, never torn");
+}
+
+static void concurrent(double seconds)
+{
+	StagedBuffer buffer;
+	std::atomic<bool> stop(false);
+	std::thread writer([&]()
+	{
+		for (uint64_t n=1; not stop; n++)
+			buffer.push(sampleNumber(n));
+	});
+
+	uint64_t reads = 0, checked = 0, torn = 0, disorder = 0, backwards = 0;
+	int64_t lastLatest = 0;
+	double since = 0;
+	std::vector<ImuSample> out;
+	const auto end = std::chrono::steady_clock::now() + std::chrono::duration<double>(seconds);
+	while (std::chrono::steady_clock::now() < end)
+	{
+		ImuSample s;
+		if (buffer.latest(s))
+		{
+			const int64_t n = numberOf(s);
+			torn += n < 0;
+			backwards += n < lastLatest;
+			lastLatest = n;
+			checked++;
+		}
+		out.clear();
+		buffer.since(since, out);
+		int64_t previous = int64_t(since);
+		for (const ImuSample &x : out)
+		{
+			const int64_t n = numberOf(x);
+			torn += n < 0;
+			disorder += n <= previous;
+			previous = n;
+		}
+		checked += out.size();
+		if (not out.empty())
+			since = out.back().timestamp;
+		// Now and then a reader that falls a lap behind
+		if (reads % 64 == 0)
+			since = std::max(0., since - 2*ImuSampleBuffer::SIZE);
+		reads++;
+	}
+	stop = true;
+	writer.join();
+	printf("%.1f s: %lu samples pushed, %lu reads, %lu samples checked\n", seconds, (unsigned long)buffer.size(),
+	       (unsigned long)reads, (unsigned long)checked);
+	check(torn == 0, "concurrent: no torn sample");
+	check(disorder == 0, "concurrent: since() strictly newer and in order");
+	check(backwards == 0, "concurrent: latest() never goes back");
+}
+
+int main(int argc, char **argv)
+{
+	const double seconds = argc > 1 ? atof(argv[1]) : 2;
+	ring();
+	lap();
+	seqlock();
+	concurrent(seconds);
+	printf("%s\n", failures ? "FAILED" : "all passed");
+	return failures ? 1 : 0;
+}
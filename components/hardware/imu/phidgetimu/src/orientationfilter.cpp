@@ -0,0 +1,150 @@
+/*
+ *    Copyright (C) 2020 by RoboLab - University of Extremadura
+ *
+ *    This file is part of RoboComp
+ *
+ *    RoboComp is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    RoboComp is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with RoboComp.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "orientationfilter.h"
+
+#include <math.h>
+
+static inline bool normalize(const float *v, float out[3])
+{
+	const float n = sqrtf(v[0]*v[0] + v[1]*v[1] + v[2]*v[2]);
+	if (not (n > 1e-6f) or not (n < 1e30f))
+		return false;
+	out[0] = v[0]/n;
+	out[1] = v[1]/n;
+	out[2] = v[2]/n;
+	return true;
+}
+
+static inline void cross(const float *a, const float *b, float out[3])
+{
+	out[0] = a[1]*b[2] - a[2]*b[1];
+	out[1] = a[2]*b[0] - a[0]*b[2];
+	out[2] = a[0]*b[1] - a[1]*b[0];
+}
+
+OrientationFilter::OrientationFilter() : kp(1.f), ki(0.f)
+{
+	reset();
+}
+
+void OrientationFilter::reset()
+{
+	q[0] = 1.f;
+	q[1] = q[2] = q[3] = 0.f;
+	integral[0] = integral[1] = integral[2] = 0.f;
+	initialized = false;
+}
+
+/**
+* \brief Starts from the rotation taking the measured up direction to the world y axis, so the filter does not have to converge from scratch
+*/
+void OrientationFilter::alignToGravity(const float *acc)
+{
+	float up[3];
+	const float minusAcc[3] = { -acc[0], -acc[1], -acc[2] };
+	if (not normalize(minusAcc, up))
+		return;
+	// Shortest arc from up (sensor) to (0,1,0) (world)
+	const float w = 1.f + up[1];
+	if (w < 1e-6f)
+	{
+		q[0] = 0.f; q[1] = 1.f; q[2] = 0.f; q[3] = 0.f;
+	}
+	else
+	{
+		const float axis[3] = { -up[2], 0.f, up[0] };   // up x (0,1,0)
+		const float n = sqrtf(w*w + axis[0]*axis[0] + axis[2]*axis[2]);
+		q[0] = w/n; q[1] = axis[0]/n; q[2] = 0.f; q[3] = axis[2]/n;
+	}
+	initialized = true;
+}
+
+void OrientationFilter::update(const float *acc, const float *gyr, const float *mag, const float dt)
+{
+	float a[3] = { 0.f, 0.f, 0.f }, m[3] = { 0.f, 0.f, 0.f };
+	const bool haveAcc = acc and normalize(acc, a);
+	const bool haveMag = mag and normalize(mag, m);
+	if (not initialized)
+	{
+		if (haveAcc)
+			alignToGravity(acc);
+		return;
+	}
+
+	const float w = q[0], x = q[1], y = q[2], z = q[3];
+	const float kp = this->kp, ki = this->ki;
+	// RoboComp angles are left-handed: the right-handed rate is the opposite
+	float g[3] = { -gyr[0], -gyr[1], -gyr[2] };
+
+	if (haveAcc)
+	{
+		// Estimated up direction in the sensor frame (second row of R) against the measured one
+		const float v[3] = { 2.f*(x*y + w*z), 1.f - 2.f*(x*x + z*z), 2.f*(y*z - w*x) };
+		const float up[3] = { -a[0], -a[1], -a[2] };
+		float e[3];
+		cross(up, v, e);
+		if (haveMag)
+		{
+			// Field in the world frame, its horizontal part defines north (+z)
+			const float h[3] = {
+				(1.f-2.f*(y*y+z*z))*m[0] + 2.f*(x*y-w*z)*m[1] + 2.f*(x*z+w*y)*m[2],
+				2.f*(x*y+w*z)*m[0] + (1.f-2.f*(x*x+z*z))*m[1] + 2.f*(y*z-w*x)*m[2],
+				2.f*(x*z-w*y)*m[0] + 2.f*(y*z+w*x)*m[1] + (1.f-2.f*(x*x+y*y))*m[2] };
+			const float bz = sqrtf(h[0]*h[0] + h[2]*h[2]), by = h[1];
+			// Expected field in the sensor frame: R^T (0, by, bz)
+			const float b[3] = {
+				2.f*(x*y+w*z)*by + 2.f*(x*z-w*y)*bz,
+				(1.f-2.f*(x*x+z*z))*by + 2.f*(y*z+w*x)*bz,
+				2.f*(y*z-w*x)*by + (1.f-2.f*(x*x+y*y))*bz };
+			float em[3];
+			cross(m, b, em);
+			e[0] += em[0]; e[1] += em[1]; e[2] += em[2];
+		}
+		for (int i=0; i<3; i++)
+		{
+			if (ki > 0.f)
+			{
+				integral[i] += ki * e[i] * dt;
+				g[i] += integral[i];
+			}
+			g[i] += kp * e[i];
+		}
+	}
+
+	// q += 0.5 q (0, g) dt
+	const float hdt = 0.5f * dt;
+	q[0] += (-x*g[0] - y*g[1] - z*g[2]) * hdt;
+	q[1] += ( w*g[0] + y*g[2] - z*g[1]) * hdt;
+	q[2] += ( w*g[1] - x*g[2] + z*g[0]) * hdt;
+	q[3] += ( w*g[2] + x*g[1] - y*g[0]) * hdt;
+	const float n = sqrtf(q[0]*q[0] + q[1]*q[1] + q[2]*q[2] + q[3]*q[3]);
+	for (int i=0; i<4; i++)
+		q[i] /= n;
+}
+
+void OrientationFilter::euler(float ori[3]) const
+{
+	const float w = q[0], x = q[1], y = q[2], z = q[3];
+	// Gravity as the accelerometer would read it at rest (-up), so pitch and roll match the tilt formulas
+	const float gx = -2.f*(x*y + w*z), gy = -(1.f - 2.f*(x*x + z*z)), gz = -2.f*(y*z - w*x);
+	ori[0] =  atan2f(gz, -gy);
+	// Heading of the sensor's z axis in the world horizontal plane, same sign as pitch and roll against the rates
+	ori[1] =  atan2f(2.f*(x*z + w*y), 1.f - 2.f*(x*x + y*y));
+	ori[2] = -atan2f(gx, -gy);
+}
@@ -0,0 +1,67 @@
+/*
+ *    Copyright (C) 2020 by RoboLab - University of Extremadura
+ *
+ *    This file is part of RoboComp
+ *
+ *    RoboComp is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    RoboComp is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with RoboComp.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef ORIENTATIONFILTER_H
+#define ORIENTATIONFILTER_H
+
+#include <atomic>
+
+/**
+* \brief Mahony complementary filter estimating the IMU orientation.
+*
+* Works in RoboComp axes (y up). The gyroscope is integrated on every sample
+* and the drift is corrected with a PI controller on the error between the
+* measured and the estimated gravity direction (and, optionally, the
+* horizontal component of the magnetic field, which fixes the yaw).
+*/
+class OrientationFilter
+{
+public:
+	OrientationFilter();
+
+	/// kp: proportional gain (convergence speed), ki: integral gain (gyro bias). Safe while another thread runs update().
+	void setGains(const float kp_, const float ki_) { kp = kp_; ki = ki_; }
+	void reset();
+
+	/**
+	* \brief Integrates one sample
+	* @param acc accelerometer (any unit), ignored if null or zero
+	* @param gyr angular rate (rad/s), RoboComp sign convention
+	* @param mag magnetometer (any unit), ignored if null or zero
+	* @param dt seconds since the previous sample
+	*/
+	void update(const float *acc, const float *gyr, const float *mag, const float dt);
+
+	/**
+	* \brief Pitch, yaw and roll (rad) with the same conventions as the accelerometer tilt
+	* Every angle turns against the rate of its axis (XGyr, YGyr, ZGyr), as RoboComp angles are left-handed.
+	*/
+	void euler(float ori[3]) const;
+	/// w, x, y, z: sensor to world rotation
+	const float *quaternion() const { return q; }
+
+private:
+	float q[4];
+	float integral[3];
+	std::atomic<float> kp, ki;
+	bool initialized;
+
+	void alignToGravity(const float *acc);
+};
+
+#endif
@@ -0,0 +1,288 @@
+/*
+ *    Copyright (C) 2020 by RoboLab - University of Extremadura
+ *
+ *    This file is part of RoboComp
+ *
+ *    RoboComp is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    RoboComp is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with RoboComp.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Playback of IMU samples through OrientationFilter, the way addSample feeds it.
+// A recording holds one sample per line as ImuSampleBuffer::since returns them
+// (timestamp s, acc g, gyr rad/s, mag gauss, RoboComp axes); the filter's pitch
+// and roll are compared with the accelerometer tilt whenever the sensor is close
+// to rest. Without a recording, a sensor tumbling with known rates is simulated
+// with noise and gyro bias, and the estimate is compared with the true
+// orientation for several gains, with and without magnetometer, while another
+// thread keeps changing the gains as setParams may. It also checks that pitch,
+// yaw and roll all turn against XGyr, YGyr and ZGyr, as getAngularVel reports them.
+//   orientationfilter_test [recording|-] [rate Hz] [seconds]
+// Returns 1 if an error is over its bound, an angle has the wrong sign or the output is not finite.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "orientationfilter.h"
+
+static double now()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void stats(std::vector<double> v, double &mean, double &p99)
+{
+	mean = p99 = 0;
+	if (v.empty())
+		return;
+	std::sort(v.begin(), v.end());
+	for (double x : v)
+		mean += x;
+	mean /= v.size();
+	p99 = v[std::min(v.size()-1, size_t(0.99*v.size()))];
+}
+
+/// w, x, y, z, sensor to world, right-handed as inside the filter
+struct Quat
+{
+	double w, x, y, z;
+	Quat operator*(const Quat &b) const
+	{
+		return { w*b.w - x*b.x - y*b.y - z*b.z, w*b.x + x*b.w + y*b.z - z*b.y, w*b.y - x*b.z + y*b.w + z*b.x, w*b.z + x*b.y - y*b.x + z*b.w };
+	}
+	static Quat axisAngle(const double *v, const double angle)
+	{
+		const double n = sqrt(v[0]*v[0] + v[1]*v[1] + v[2]*v[2]);
+		if (n < 1e-12)
+			return { 1, 0, 0, 0 };
+		const double s = sin(angle/2)/n;
+		return { cos(angle/2), v[0]*s, v[1]*s, v[2]*s };
+	}
+	/// World vector in the sensor frame, R^T v
+	void toSensor(const double *v, double *out) const
+	{
+		const double R[3][3] = {
+			{ 1-2*(y*y+z*z), 2*(x*y-w*z), 2*(x*z+w*y) },
+			{ 2*(x*y+w*z), 1-2*(x*x+z*z), 2*(y*z-w*x) },
+			{ 2*(x*z-w*y), 2*(y*z+w*x), 1-2*(x*x+y*y) } };
+		for (int i=0; i<3; i++)
+			out[i] = R[0][i]*v[0] + R[1][i]*v[1] + R[2][i]*v[2];
+	}
+	/// Heading of the sensor z axis in the world horizontal plane, the quantity yaw reports
+	double heading() const { return atan2(2*(x*z + w*y), 1 - 2*(x*x + y*y)); }
+};
+
+static double angleBetween(const double *a, const double *b)
+{
+	const double d = a[0]*b[0] + a[1]*b[1] + a[2]*b[2];
+	const double c[3] = { a[1]*b[2] - a[2]*b[1], a[2]*b[0] - a[0]*b[2], a[0]*b[1] - a[1]*b[0] };
+	return atan2(sqrt(c[0]*c[0] + c[1]*c[1] + c[2]*c[2]), d);
+}
+
+struct Errors
+{
+	double tilt, heading, updateMean, updateP99;
+	bool finite;
+};
+
+/**
+* \brief Tumbles a simulated sensor and returns the largest errors over the second half of the run
+* The field points north (+z) and down, the gyroscope has white noise plus the given bias.
+*/
+static Errors simulate(OrientationFilter &filter, const double rate, const double seconds, const bool useMag, const float bias)
+{
+	std::mt19937 rng(40);
+	std::normal_distribution<double> gyroNoise(0., 0.01), accNoise(0., 0.01), magNoise(0., 0.005);
+	const double dt = 1./rate;
+	const double up[3] = { 0, 1, 0 }, field[3] = { 0, -0.4, 0.2 };
+	const double ax[3] = { 1, 0, 0 }, az[3] = { 0, 0, 1 };
+	Quat truth = Quat::axisAngle(ax, 0.2) * Quat::axisAngle(az, -0.1);
+
+	Errors e = { 0, 0, 0, 0, true };
+	std::vector<double> times;
+	const int steps = seconds*rate;
+	for (int i=0; i<steps; i++)
+	{
+		const double t = i*dt;
+		const double w[3] = { 0.8*sin(t), 0.3, 0.5*cos(0.7*t) };   // right-handed body rates
+		const double n = sqrt(w[0]*w[0] + w[1]*w[1] + w[2]*w[2]);
+		truth = truth * Quat::axisAngle(w, n*dt);
+
+		double upS[3], fieldS[3];
+		truth.toSensor(up, upS);
+		truth.toSensor(field, fieldS);
+		float acc[3], gyr[3], mag[3];
+		for (int k=0; k<3; k++)
+		{
+			acc[k] = -upS[k] + accNoise(rng);
+			gyr[k] = -w[k] + gyroNoise(rng) + (k == 1 ? bias : 0.f);   // left-handed, as the device callback gives them
+			mag[k] = fieldS[k] + magNoise(rng);
+		}
+		const double t0 = now();
+		filter.update(acc, gyr, useMag ? mag : NULL, i == 0 ? 0.f : float(dt));
+		times.push_back(now() - t0);
+
+		const float *q = filter.quaternion();
+		const Quat estimate = { q[0], q[1], q[2], q[3] };
+		double upEstimate[3];
+		estimate.toSensor(up, upEstimate);
+		for (int k=0; k<4; k++)
+			e.finite = e.finite and std::isfinite(q[k]);
+		if (i >= steps/2)
+		{
+			e.tilt = std::max(e.tilt, angleBetween(upS, upEstimate));
+			e.heading = std::max(e.heading, fabs(remainder(estimate.heading() - truth.heading(), 2*M_PI)));
+		}
+	}
+	stats(times, e.updateMean, e.updateP99);
+	return e;
+}
+
+/// Angles after turning from level at +rate on one axis for a second: each must go against its rate
+static bool checkSigns(const double rate)
+{
+	bool ok = true;
+	const char *names[3] = { "XGyr", "YGyr", "ZGyr" };
+	for (int axis=0; axis<3; axis++)
+	{
+		OrientationFilter filter;
+		filter.setGains(0.f, 0.f);
+		const float acc[3] = { 0.f, -1.f, 0.f };
+		float gyr[3] = { 0.f, 0.f, 0.f };
+		gyr[axis] = 0.3f;
+		const int steps = rate;
+		for (int i=0; i<=steps; i++)
+			filter.update(acc, gyr, NULL, i == 0 ? 0.f : float(1./rate));
+		float ori[3];
+		filter.euler(ori);
+		// ori is pitch (x), yaw (y), roll (z)
+		for (int k=0; k<3; k++)
+			ok = ok and fabsf(ori[k] - (k == axis ? -0.3f : 0.f)) < 1e-3f;
+		printf("  %s +0.3 rad/s for 1 s: pitch %+.3f yaw %+.3f roll %+.3f\n", names[axis], ori[0], ori[1], ori[2]);
+	}
+	return ok;
+}
+
+static int playback(const char *path)
+{
+	FILE *file = fopen(path, "r");
+	if (not file)
+	{
+		fprintf(stderr, "Cannot open %s\n", path);
+		return 2;
+	}
+	OrientationFilter filter;
+	std::vector<double> times, tiltResidual;
+	double timestamp, lastTimestamp = -1;
+	float acc[3], gyr[3], mag[3], ori[3] = { 0.f, 0.f, 0.f };
+	bool finite = true;
+	int samples = 0;
+	while (fscanf(file, "%lf %f %f %f %f %f %f %f %f %f", &timestamp, &acc[0], &acc[1], &acc[2], &gyr[0], &gyr[1], &gyr[2], &mag[0], &mag[1], &mag[2]) == 10)
+	{
+		const float dt = lastTimestamp < 0 ? 0.f : float(timestamp - lastTimestamp);
+		lastTimestamp = timestamp;
+		const double t0 = now();
+		filter.update(acc, gyr, mag, dt);
+		filter.euler(ori);
+		times.push_back(now() - t0);
+		samples++;
+		for (int k=0; k<3; k++)
+			finite = finite and std::isfinite(ori[k]);
+
+		// At rest the accelerometer alone gives pitch and roll, as the component did before the filter
+		const float norm = sqrtf(acc[0]*acc[0] + acc[1]*acc[1] + acc[2]*acc[2]);
+		const float rotating = sqrtf(gyr[0]*gyr[0] + gyr[1]*gyr[1] + gyr[2]*gyr[2]);
+		if (fabsf(norm - 1.f) < 0.05f and rotating < 0.05f)
+		{
+			const float pitch = atan2f(acc[2], -acc[1]), roll = -atan2f(acc[0], -acc[1]);
+			tiltResidual.push_back(std::max(fabsf(remainderf(pitch - ori[0], 2*M_PI)), fabsf(remainderf(roll - ori[2], 2*M_PI))));
+		}
+	}
+	fclose(file);
+
+	double meanTime, p99Time, meanTilt, p99Tilt;
+	stats(times, meanTime, p99Time);
+	stats(tiltResidual, meanTilt, p99Tilt);
+	printf("%s: %d samples, update and euler mean %.2f us p99 %.2f us\n", path, samples, 1e6*meanTime, 1e6*p99Time);
+	printf("at rest (%zu samples): filter against accelerometer tilt mean %.4f rad p99 %.4f rad\n", tiltResidual.size(), meanTilt, p99Tilt);
+	printf("last pitch %+.4f yaw %+.4f roll %+.4f rad\n", ori[0], ori[1], ori[2]);
+	return finite ? 0 : 1;
+}
+
+int main(int argc, char **argv)
+{
+	const char *path = argc > 1 ? argv[1] : "-";
+	const double rate = argc > 2 ? atof(argv[2]) : 250;
+	const double seconds = argc > 3 ? atof(argv[3]) : 20;
+	if (strcmp(path, "-") != 0)
+		return playback(path);
+
+	bool ok = true;
+	printf("signs\n");
+	ok = checkSigns(rate) and ok;
+
+	struct Case
+	{
+		const char *name;
+		float kp, ki, bias;
+		bool mag, concurrent;
+		double maxTilt, maxHeading;   // bounds, negative if not checked
+	} cases[] = {
+		{ "gyro only",                0.f, 0.f,  0.f,  false, false, 0.05, -1 },
+		{ "kp 1",                     1.f, 0.f,  0.f,  false, false, 0.02, -1 },
+		{ "kp 1, bias 0.02",          1.f, 0.f,  0.02f, false, false, 0.05, -1 },
+		{ "kp 1 ki 0.1, bias 0.02",   1.f, 0.1f, 0.02f, false, false, 0.02, -1 },
+		{ "kp 1, magnetometer",       1.f, 0.f,  0.f,  true,  false, 0.02, 0.05 },
+		{ "kp 1-2 set concurrently",  1.f, 0.f,  0.f,  true,  true,  0.02, 0.05 },
+	};
+	printf("%.0f Hz, %.0f s, errors over the second half\n", rate, seconds);
+	printf("%-26s %12s %14s %12s %12s\n", "case", "tilt [rad]", "heading [rad]", "update [us]", "p99 [us]");
+	for (const Case &c : cases)
+	{
+		OrientationFilter filter;
+		filter.setGains(c.kp, c.ki);
+		std::atomic<bool> stop(false);
+		std::thread setter;
+		if (c.concurrent)
+		{
+			// setParams from the Ice thread while the device thread filters
+			setter = std::thread([&]()
+			{
+				for (int i=0; not stop; i++)
+				{
+					filter.setGains(1.f + (i%2), 0.f);
+					std::this_thread::yield();
+				}
+			});
+		}
+		const Errors e = simulate(filter, rate, seconds, c.mag, c.bias);
+		stop = true;
+		if (setter.joinable())
+			setter.join();
+
+		const bool pass = e.finite and e.tilt <= c.maxTilt and (c.maxHeading < 0 or e.heading <= c.maxHeading);
+		ok = ok and pass;
+		char heading[16] = "-";
+		if (c.mag)
+			snprintf(heading, sizeof(heading), "%.4f", e.heading);
+		printf("%-26s %12.4f %14s %12.3f %12.3f%s\n", c.name, e.tilt, heading, 1e6*e.updateMean, 1e6*e.updateP99, pass ? "" : "  FAIL");
+	}
+	return ok ? 0 : 1;
+}
@@ -85,6 +85,17 @@ bool SpecificMonitor::sendParamsToWorker(RoboCompCommonBehavior::ParameterList p
 ///We need to supply a list of accepted values to each call
 void SpecificMonitor::readConfig(RoboCompCommonBehavior::ParameterList &params )
 {
+	RoboCompCommonBehavior::Parameter aux;
+	aux.editable = false;
+	configGetString("", "IMU.DataRate", aux.value, "16");
+	params["IMU.DataRate"] = aux;
+	configGetString("", "IMU.FilterKp", aux.value, "1.0");
+	params["IMU.FilterKp"] = aux;
+	configGetString("", "IMU.FilterKi", aux.value, "0.0");
+	params["IMU.FilterKi"] = aux;
+	configGetString("", "IMU.UseMagnetometer", aux.value, "false");
+	params["IMU.UseMagnetometer"] = aux;
+
 // 	RoboCompCommonBehavior::Parameter aux;
 // 	aux.editable = true;
 // 	string name = PROGRAM_NAME;
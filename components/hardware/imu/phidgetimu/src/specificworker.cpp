@@ -18,11 +18,6 @@
  */
 #include "specificworker.h"
 
-float Acc[3];
-float Gyr[3];
-float Mag[3];
-float Ori[3];
-
 
 //callback that will run if the Spatial is attached to the computer
 int CCONV AttachHandler(CPhidgetHandle spatial, void *userptr)
@@ -54,27 +49,28 @@ int CCONV ErrorHandler(CPhidgetHandle spatial, void *userptr, int ErrorCode, con
 //count - the number of spatial data event packets included in this event
 int CCONV SpatialDataHandler(CPhidgetSpatialHandle spatial, void *userptr, CPhidgetSpatial_SpatialEventDataHandle *data, int count)
 {
-	Acc[0] = -data[count-1]->acceleration[0];
-	Acc[1] = -data[count-1]->acceleration[2];
-	Acc[2] =  data[count-1]->acceleration[1];
-	Gyr[0] = -data[count-1]->angularRate[0]*M_PI/180.;
-	Gyr[1] = -data[count-1]->angularRate[2]*M_PI/180.;
-	Gyr[2] =  data[count-1]->angularRate[1]*M_PI/180.;
-	Mag[0] = -data[count-1]->magneticField[0];
-	Mag[1] = -data[count-1]->magneticField[2];
-	Mag[2] =  data[count-1]->magneticField[1];
-
-	
-	Ori[0] =  atan2(Acc[2], -Acc[1]);
-	Ori[1] = 0;
-	Ori[2] = -atan2(Acc[0], -Acc[1]);
-	for (int o=0; o<3; o++)
+	SpecificWorker *worker = (SpecificWorker *)userptr;
+	for (int i=0; i<count; i++)
 	{
-		while(Ori[o] > +M_PI) Ori[o]-=2.*M_PI;
-		while(Ori[o] < -M_PI) Ori[o]+=2.*M_PI;
+		ImuSample sample;
+		sample.timestamp = data[i]->timestamp.seconds + data[i]->timestamp.microseconds/1000000.;
+		sample.acc[0] = -data[i]->acceleration[0];
+		sample.acc[1] = -data[i]->acceleration[2];
+		sample.acc[2] =  data[i]->acceleration[1];
+		sample.gyr[0] = -data[i]->angularRate[0]*M_PI/180.;
+		sample.gyr[1] = -data[i]->angularRate[2]*M_PI/180.;
+		sample.gyr[2] =  data[i]->angularRate[1]*M_PI/180.;
+		// Devices without compass report PUNK_DBL
+		if (data[i]->magneticField[0] < 1e100)
+		{
+			sample.mag[0] = -data[i]->magneticField[0];
+			sample.mag[1] = -data[i]->magneticField[2];
+			sample.mag[2] =  data[i]->magneticField[1];
+		}
+		else
+			sample.mag[0] = sample.mag[1] = sample.mag[2] = 0.f;
+		worker->addSample(sample);
 	}
-// 	printf("Acc: (%f, %f, %f)\n", Acc[0], Acc[1], Acc[2]);
-// 	printf("Ori: (%f, %f, %f)\n", Ori[0], Ori[1], Ori[2]);
 	return 0;
 }
 
@@ -117,7 +113,11 @@ SpecificWorker::SpecificWorker(MapPrx& mprx) : GenericWorker(mprx)
 	int result;
 	const char *err;
 
-	CPhidgetSpatialHandle spatial = 0;
+	lastTimestamp = -1;
+	useMagnetometer = false;
+	resetRequested = false;
+
+	spatial = 0;
 	CPhidgetSpatial_create(&spatial);
 	CPhidget_open((CPhidgetHandle)spatial, -1);
 	if((result = CPhidget_waitForAttachment((CPhidgetHandle)spatial, 3000)))
@@ -127,12 +127,9 @@ SpecificWorker::SpecificWorker(MapPrx& mprx) : GenericWorker(mprx)
 		exit(1);
 	}
 	display_properties((CPhidgetHandle)spatial);
-	CPhidgetSpatial_setDataRate(spatial, 16);
 	CPhidget_set_OnAttach_Handler((CPhidgetHandle)spatial, AttachHandler, NULL);
 	CPhidget_set_OnDetach_Handler((CPhidgetHandle)spatial, DetachHandler, NULL);
 	CPhidget_set_OnError_Handler((CPhidgetHandle)spatial, ErrorHandler, NULL);
-	CPhidgetSpatial_set_OnSpatialData_Handler(spatial, SpatialDataHandler, NULL);
-	printf("Reading.....\n");
 }
 
 /**
@@ -140,17 +137,42 @@ SpecificWorker::SpecificWorker(MapPrx& mprx) : GenericWorker(mprx)
 */
 SpecificWorker::~SpecificWorker()
 {
-	
+	CPhidget_close((CPhidgetHandle)spatial);
+	CPhidget_delete((CPhidgetHandle)spatial);
 }
 
 bool SpecificWorker::setParams(RoboCompCommonBehavior::ParameterList params)
 {
-	timer.start(Period);
-	
+	const int dataRate = QString::fromStdString(params["IMU.DataRate"].value).toInt();
+	filter.setGains(QString::fromStdString(params["IMU.FilterKp"].value).toFloat(), QString::fromStdString(params["IMU.FilterKi"].value).toFloat());
+	useMagnetometer = QString::fromStdString(params["IMU.UseMagnetometer"].value).contains("true");
 
+	// Samples are only delivered once the filter is configured
+	CPhidgetSpatial_setDataRate(spatial, dataRate);
+	CPhidgetSpatial_set_OnSpatialData_Handler(spatial, SpatialDataHandler, this);
+	printf("Reading every %d ms.....\n", dataRate);
+
+	timer.start(Period);
 	return true;
 }
 
+/**
+* \brief Runs the orientation filter on a new sample and stores it. Called from the device thread only.
+*/
+void SpecificWorker::addSample(ImuSample &sample)
+{
+	if (resetRequested.exchange(false))
+	{
+		filter.reset();
+		lastTimestamp = -1;
+	}
+	const float dt = lastTimestamp < 0 ? 0.f : float(sample.timestamp - lastTimestamp);
+	lastTimestamp = sample.timestamp;
+	filter.update(sample.acc, sample.gyr, useMagnetometer ? sample.mag : NULL, dt);
+	filter.euler(sample.ori);
+	samples.push(sample);
+}
+
 void SpecificWorker::compute()
 {
 // 	try
@@ -167,73 +189,47 @@ void SpecificWorker::compute()
 
 void SpecificWorker::resetImu()
 {
-	mutex->lock();
-	for (int i=0; i<3; ++i)
-	{
-		Mag[i] = 0.f;
-		Acc[i] = 0.f;
-		Gyr[i] = 0.f;
-	}
-	mutex->unlock();
+	resetRequested = true;
 }
 
 Gyroscope SpecificWorker::getAngularVel()
 {
-	Gyroscope d;
-	mutex->lock();
-	d.XGyr = Gyr[0];
-	d.YGyr = Gyr[1];
-	d.ZGyr = Gyr[2];
-	mutex->unlock();
-	return d;
+	return getDataImu().gyro;
 }
 
 Orientation SpecificWorker::getOrientation()
 {
-	Orientation d;
-	mutex->lock();
-	d.Pitch = Ori[0];
-	d.Yaw   = Ori[1];
-	d.Roll  = Ori[2];
-	mutex->unlock();
-	return d;
+	return getDataImu().rot;
 }
 
 DataImu SpecificWorker::getDataImu()
 {
+	ImuSample sample;
+	if (not samples.latest(sample))
+		memset(&sample, 0, sizeof(sample));
 	DataImu d;
-	d.acc = getAcceleration();
-	d.gyro = getAngularVel();
-	d.mag = getMagneticFields();
-	d.rot = getOrientation();
+	d.acc.XAcc = sample.acc[0];
+	d.acc.YAcc = sample.acc[1];
+	d.acc.ZAcc = sample.acc[2];
+	d.gyro.XGyr = sample.gyr[0];
+	d.gyro.YGyr = sample.gyr[1];
+	d.gyro.ZGyr = sample.gyr[2];
+	d.mag.XMag = sample.mag[0];
+	d.mag.YMag = sample.mag[1];
+	d.mag.ZMag = sample.mag[2];
+	d.rot.Pitch = sample.ori[0];
+	d.rot.Yaw   = sample.ori[1];
+	d.rot.Roll  = sample.ori[2];
 	return d;
 }
 
 Magnetic SpecificWorker::getMagneticFields()
 {
-	Magnetic d;
-	mutex->lock();
-	d.XMag = Mag[0];
-	d.YMag = Mag[1];
-	d.ZMag = Mag[2];
-	mutex->unlock();
-	return d;
+	return getDataImu().mag;
 }
 
 Acceleration SpecificWorker::getAcceleration()
 {
-	Acceleration d;
-	mutex->lock();
-	d.XAcc = Acc[0];
-	d.YAcc = Acc[1];
-	d.ZAcc = Acc[2];
-	printf("acc: %f %f %f\n", d.XAcc, d.YAcc, d.ZAcc);
-	mutex->unlock();
-	return d;
+	return getDataImu().acc;
 }
 
-
-
-
-
-
@@ -30,6 +30,12 @@
 
 
 #include <phidget21.h>
+#include <atomic>
+#include <string.h>
+#include <vector>
+
+#include "imusamplebuffer.h"
+#include "orientationfilter.h"
 
 class SpecificWorker : public GenericWorker
 {
@@ -46,6 +52,8 @@ public:
 	Magnetic getMagneticFields();
 	Acceleration getAcceleration();
 
+	void addSample(ImuSample &sample);
+
 public slots:
 	void compute();
 	
@@ -53,6 +61,12 @@ public slots:
 private:
 
 	CPhidgetSpatialHandle spatial;
+	ImuSampleBuffer samples;
+	// Only updated from the device callback, setParams may change its gains and useMagnetometer meanwhile
+	OrientationFilter filter;
+	double lastTimestamp;
+	std::atomic<bool> useMagnetometer;
+	std::atomic<bool> resetRequested;
 
 private slots:
 	
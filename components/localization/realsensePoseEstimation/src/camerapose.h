@@ -0,0 +1,110 @@
+/*
+ *    Copyright (C) 2020 by RoboLab - University of Extremadura
+ *
+ *    This file is part of RoboComp
+ *
+ *    RoboComp is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    RoboComp is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with RoboComp.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef CAMERAPOSE_H
+#define CAMERAPOSE_H
+
+#include <math.h>
+#include <Eigen/Dense>
+#include <Eigen/Geometry>
+
+#include "poseringbuffer.h"
+
+struct euler_angle{
+    float x;
+    float y;
+    float z;
+};
+
+// Camera axes in the world, written by setInitialPose and read lock-free by the pose readers
+struct EXTRINSICS {
+    Eigen::Affine3f origen_camera;   //Matrix de ejes de la camara respecto al origen
+    Eigen::Vector3f origen_robot_translation;
+};
+
+// Pose of one camera interpolated to the fused query time
+struct CAMERA_POSE {
+    Eigen::Affine3f origen_world;   //3
+    euler_angle angles;              //4
+    unsigned int mapper_confidence;     //5
+    unsigned int tracker_confidence;    //6
+};
+
+inline euler_angle quaternion_to_euler_angle(float qw, float qx, float qy, float qz){
+    float auxZ;
+    float auxY;
+    float auxX;
+
+    auxZ = atan2(2*qy*qw-2*qx*qz, 1- 2*qy*qy - 2*qz*qz);
+    auxY = asin(2*qx*qy + 2*qz*qw);
+    auxX = atan2(2*qx*qw-2*qy*qz , 1 - 2*qx*qx - 2*qz*qz);
+
+
+    float equal = qx*qy + qz*qw;
+    if (equal < 0.5+pow(10,-5) and equal > 0.5-pow(10,-5)) {
+        auxZ = 2.0 * atan2(qx, qw);
+        auxX = 0.0;
+    }
+    if (equal < -0.5+pow(10,-5) and equal > -0.5-pow(10,-5)) {
+        auxZ = -2.0 * atan2(qx, qw);
+        auxX = 0.0;
+    }
+
+    euler_angle ret;
+    ret.x = auxX;
+    ret.y = auxZ;
+    ret.z = auxY;
+    return ret;
+}
+
+/**
+* \brief Pose of a camera's axes in the world at the given time, without taking any lock
+* @return false if the camera has not produced any sample yet
+*/
+inline bool camera_pose(const PoseRingBuffer &poses, const SeqLockValue<EXTRINSICS> &camera_extrinsics, const euler_angle &rot_init_angles,
+                        double timestamp, CAMERA_POSE &pose)
+{
+    PoseSample sample;
+    if (not poses.sample(timestamp, sample))
+        return false;
+    const EXTRINSICS extrinsics = camera_extrinsics.load();
+
+    Eigen::Affine3f camera_world(Eigen::Translation3f(sample.translation));
+    camera_world.rotate(sample.rotation);
+
+    pose.origen_world.linear() = camera_world.linear() * extrinsics.origen_camera.linear();
+    pose.origen_world.translation() = extrinsics.origen_camera.linear() * camera_world.translation() + extrinsics.origen_robot_translation;
+
+    Eigen::Quaternion<float> quatOut(pose.origen_world.linear());
+    euler_angle angOut = quaternion_to_euler_angle(quatOut.w(),quatOut.x(),quatOut.y(),quatOut.z());
+
+    angOut.x = angOut.x - rot_init_angles.x;
+    angOut.y = angOut.y - rot_init_angles.y;
+    angOut.z = angOut.z - rot_init_angles.z;
+
+    auto wrap = [](float a){ return a < -M_PI ? a + (2*M_PI) : (a > M_PI ? a - (2*M_PI) : a); };
+    pose.angles.x = wrap(angOut.x);
+    pose.angles.y = wrap(angOut.y);
+    pose.angles.z = wrap(angOut.z);
+
+    pose.mapper_confidence = sample.mapper_confidence;
+    pose.tracker_confidence = sample.tracker_confidence;
+    return true;
+}
+
+#endif
@@ -0,0 +1,225 @@
+/*
+ *    Copyright (C) 2020 by RoboLab - University of Extremadura
+ *
+ *    This file is part of RoboComp
+ *
+ *    RoboComp is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    RoboComp is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with RoboComp.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Plays several T265 .bag recordings at once, each through its own pipeline
+// callback into a PoseRingBuffer as the component does, while a reader samples
+// every camera at the common query time. Reports staleness (host now minus the
+// query time) and skew (spread of the cameras' newest samples), mean and p99.
+// Without .bag files, one writer thread per simulated camera pushes 200 Hz poses
+// along a known trajectory, and every interpolated pose, and the world pose and
+// Euler angles the component reports from it, are checked against it.
+//   poseplayback_test [seconds] [file.bag ...]
+//   poseplayback_test [seconds] -[simulated cameras]
+// Returns 1 if a read was torn, extrapolated or off the trajectory.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <limits>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <librealsense2/rs.hpp>
+
+#include "poseringbuffer.h"
+#include "camerapose.h"
+
+static double nowMs()
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+static const double origin = nowMs();
+
+/// Simulated trajectory: 1 m/s forward while turning 0.1 rad/s, so that every pose tells its own time
+static PoseSample trajectory(double t)
+{
+	PoseSample s;
+	s.timestamp = t;
+	s.translation = Eigen::Vector3f(float((t - origin)*1e-3), 0.f, 0.f);
+	s.rotation = Eigen::Quaternionf(Eigen::AngleAxisf(float((t - origin)*1e-4), Eigen::Vector3f::UnitY()));
+	s.tracker_confidence = s.mapper_confidence = 3;
+	return s;
+}
+
+static void stats(std::vector<double> v, double &mean, double &p99)
+{
+	mean = p99 = 0;
+	if (v.empty())
+		return;
+	std::sort(v.begin(), v.end());
+	for (double x : v)
+		mean += x;
+	mean /= v.size();
+	p99 = v[std::min(v.size()-1, size_t(0.99*v.size()))];
+}
+
+int main(int argc, char **argv)
+{
+	const double seconds = argc > 1 ? atof(argv[1]) : 10;
+	std::vector<std::string> bags;
+	int simulated = 3;
+	for (int i=2; i<argc; i++)
+	{
+		if (argv[i][0] == '-')
+			simulated = atoi(argv[i]+1);
+		else
+			bags.push_back(argv[i]);
+	}
+	const int numCameras = bags.empty() ? simulated : bags.size();
+	std::unique_ptr<PoseRingBuffer[]> rings(new PoseRingBuffer[numCameras]);
+	// Cameras at the world origin, so that the reported pose is the camera's own
+	SeqLockValue<EXTRINSICS> extrinsics;
+	EXTRINSICS identity;
+	identity.origen_camera.setIdentity();
+	identity.origen_robot_translation.setZero();
+	extrinsics.store(identity);
+	const euler_angle rot_init_angles = {0.f, 0.f, 0.f};
+
+	// Writers: one librealsense playback pipeline or one simulated 200 Hz camera per ring
+	std::atomic<bool> stop(false);
+	std::vector<rs2::pipeline> pipes;
+	std::vector<std::thread> writers;
+	if (not bags.empty())
+	{
+		for (int c=0; c<numCameras; c++)
+		{
+			rs2::config cfg;
+			cfg.enable_device_from_file(bags[c], false);
+			cfg.enable_stream(RS2_STREAM_POSE, RS2_FORMAT_6DOF);
+			rs2::pipeline pipe;
+			PoseRingBuffer &ring = rings[c];
+			// Recorded timestamps are from the day of the recording: stamp on arrival as for device clocks
+			pipe.start(cfg, [&ring](rs2::frame frame)
+			{
+				rs2::frame f = frame;
+				if (auto frames = frame.as<rs2::frameset>())
+					f = frames.first_or_default(RS2_STREAM_POSE);
+				auto pose_frame = f.as<rs2::pose_frame>();
+				if (not pose_frame)
+					return;
+				const rs2_pose pose = pose_frame.get_pose_data();
+				PoseSample sample;
+				sample.timestamp = nowMs();
+				sample.translation = Eigen::Vector3f(pose.translation.x, pose.translation.y, pose.translation.z);
+				sample.rotation = Eigen::Quaternionf(pose.rotation.w, pose.rotation.x, pose.rotation.y, pose.rotation.z);
+				sample.tracker_confidence = pose.tracker_confidence;
+				sample.mapper_confidence = pose.mapper_confidence;
+				ring.push(sample);
+			});
+			pipes.push_back(pipe);
+		}
+	}
+	else
+	{
+		for (int c=0; c<numCameras; c++)
+		{
+			writers.emplace_back([&, c]()
+			{
+				std::mt19937 rng(32 + c);
+				std::uniform_real_distribution<double> jitter(-0.5, 0.5);
+				while (not stop)
+				{
+					rings[c].push(trajectory(nowMs()));
+					std::this_thread::sleep_for(std::chrono::microseconds(int(1000*(5 + jitter(rng)))));
+				}
+			});
+		}
+	}
+
+	// Reader: what compute() and the FullPoseEstimation interface do, as fast as it can
+	std::vector<double> staleness, skew;
+	uint64_t reads = 0, errors = 0, clamped = 0;
+	const double start = nowMs();
+	while (nowMs() - start < 1e3*seconds)
+	{
+		double oldest = std::numeric_limits<double>::max(), newest = 0;
+		bool ready = true;
+		PoseSample last;
+		for (int c=0; c<numCameras and ready; c++)
+		{
+			ready = rings[c].latest(last);
+			oldest = std::min(oldest, last.timestamp);
+			newest = std::max(newest, last.timestamp);
+		}
+		if (not ready)
+		{
+			std::this_thread::yield();
+			continue;
+		}
+		const double query = oldest;
+		staleness.push_back(nowMs() - query);
+		skew.push_back(newest - oldest);
+		for (int c=0; c<numCameras; c++)
+		{
+			PoseSample s;
+			if (not rings[c].sample(query, s))
+			{
+				errors++;
+				continue;
+			}
+			// Only a camera that started after the query time is clamped, to its first sample
+			if (s.timestamp != query)
+				clamped++;
+			if (s.timestamp < query)
+				errors++;
+			CAMERA_POSE pose;
+			if (not camera_pose(rings[c], extrinsics, rot_init_angles, query, pose))
+				errors++;
+			else if (bags.empty())
+			{
+				const PoseSample expected = trajectory(s.timestamp);
+				const float yaw = float((s.timestamp - origin)*1e-4);
+				if ((s.translation - expected.translation).norm() > 1e-4f or s.rotation.angularDistance(expected.rotation) > 1e-3f)
+					errors++;
+				if ((pose.origen_world.translation() - expected.translation).norm() > 1e-4f or std::abs(pose.angles.y - yaw) > 1e-3f
+				    or std::abs(pose.angles.x) > 1e-3f or std::abs(pose.angles.z) > 1e-3f)
+					errors++;
+			}
+			else if (not s.translation.allFinite() or std::abs(s.rotation.norm() - 1.f) > 1e-3f)
+				errors++;
+		}
+		reads++;
+		// Readers poll at about 1 kHz; the fused estimate is not needed faster
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	stop = true;
+	for (auto &w : writers)
+		w.join();
+	for (auto &p : pipes)
+		p.stop();
+
+	double meanStale, p99Stale, meanSkew, p99Skew;
+	stats(staleness, meanStale, p99Stale);
+	stats(skew, meanSkew, p99Skew);
+	printf("%d %s cameras, %.1f s, %lu fused reads (%.0f/s)\n", numCameras, bags.empty() ? "simulated" : "recorded", seconds,
+	       (unsigned long)reads, reads/seconds);
+	for (int c=0; c<numCameras; c++)
+		printf("  camera %d: %lu samples (%.1f Hz)\n", c, (unsigned long)rings[c].size(), rings[c].size()/seconds);
+	printf("staleness  mean %.3f ms  p99 %.3f ms\n", meanStale, p99Stale);
+	printf("skew       mean %.3f ms  p99 %.3f ms\n", meanSkew, p99Skew);
+	printf("clamped    %lu\n", (unsigned long)clamped);
+	printf("bad reads  %lu\n", (unsigned long)errors);
+	return errors ? 1 : 0;
+}
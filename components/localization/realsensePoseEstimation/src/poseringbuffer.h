@@ -0,0 +1,177 @@
+/*
+ *    Copyright (C) 2020 by RoboLab - University of Extremadura
+ *
+ *    This file is part of RoboComp
+ *
+ *    RoboComp is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    RoboComp is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with RoboComp.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef POSERINGBUFFER_H
+#define POSERINGBUFFER_H
+
+#include <algorithm>
+#include <atomic>
+#include <stdint.h>
+#include <Eigen/Dense>
+#include <Eigen/Geometry>
+
+/**
+* \brief Single-writer, multi-reader value protected by a sequence counter.
+*
+* The writer never blocks and readers never take a lock: a reader retries if
+* the counter was odd (write in progress) or changed while it was copying.
+* T must be trivially copyable.
+*/
+template<typename T>
+class SeqLockValue
+{
+public:
+	SeqLockValue() : seq(0), value() { }
+
+	/// Must not be called concurrently from two threads
+	void store(const T &v)
+	{
+		const uint32_t s = seq.load(std::memory_order_relaxed);
+		seq.store(s+1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		value = v;
+		seq.store(s+2, std::memory_order_release);
+	}
+
+	/// Returns false if a write overlapped the copy
+	bool tryLoad(T &out) const
+	{
+		const uint32_t s0 = seq.load(std::memory_order_acquire);
+		if (s0 & 1)
+			return false;
+		out = value;
+		std::atomic_thread_fence(std::memory_order_acquire);
+		return seq.load(std::memory_order_relaxed) == s0;
+	}
+
+	T load() const
+	{
+		T out;
+		while (not tryLoad(out)) { }
+		return out;
+	}
+
+private:
+	std::atomic<uint32_t> seq;
+	T value;
+};
+
+/**
+* \brief Timestamped pose of a tracking camera, as reported by librealsense.
+* Timestamps are milliseconds in the host clock domain.
+*/
+struct PoseSample
+{
+	double timestamp;
+	Eigen::Vector3f translation;
+	Eigen::Quaternionf rotation;
+	uint32_t tracker_confidence;
+	uint32_t mapper_confidence;
+};
+
+/**
+* \brief Lock-free ring of the last SIZE poses of one camera.
+*
+* Written only by the camera's frame callback; any thread can sample it at an
+* arbitrary time, getting the pose interpolated between the two bracketing
+* samples (lerp for the translation, slerp for the rotation).
+*/
+class PoseRingBuffer
+{
+public:
+	static const uint32_t SIZE = 64;
+
+	PoseRingBuffer() : count(0) { }
+
+	void push(const PoseSample &sample)
+	{
+		const uint64_t c = count.load(std::memory_order_relaxed);
+		slots[c % SIZE].store(sample);
+		count.store(c+1, std::memory_order_release);
+	}
+
+	uint64_t size() const { return count.load(std::memory_order_acquire); }
+
+	/// Most recent sample, false if the camera has not produced any yet
+	bool latest(PoseSample &out) const
+	{
+		uint64_t c;
+		do
+		{
+			c = count.load(std::memory_order_acquire);
+			if (c == 0)
+				return false;
+		} while (not slots[(c-1) % SIZE].tryLoad(out));
+		return true;
+	}
+
+	/**
+	* \brief Pose of the camera at time t
+	* Times newer than the last sample or older than the ring are clamped, never extrapolated.
+	* @return false if the camera has not produced any sample yet
+	*/
+	bool sample(const double t, PoseSample &out) const
+	{
+		const uint64_t c = count.load(std::memory_order_acquire);
+		if (c == 0)
+			return false;
+		// The oldest slot is left alone: the writer may be overwriting it right now
+		const uint64_t first = c > SIZE ? c-SIZE+1 : 0;
+
+		PoseSample newer, older;
+		bool haveNewer = false;
+		for (uint64_t i=c; i-- > first; )
+		{
+			if (not slots[i % SIZE].tryLoad(older))
+				break;
+			// A slot overwritten by a newer lap breaks the monotonic order
+			if (haveNewer and older.timestamp > newer.timestamp)
+				break;
+			if (older.timestamp <= t)
+			{
+				out = haveNewer ? interpolate(older, newer, t) : older;
+				return true;
+			}
+			newer = older;
+			haveNewer = true;
+		}
+		if (not haveNewer)
+			return latest(out);
+		out = newer;
+		return true;
+	}
+
+	static PoseSample interpolate(const PoseSample &a, const PoseSample &b, const double t)
+	{
+		const double span = b.timestamp - a.timestamp;
+		const float w = span > 0 ? float((t - a.timestamp) / span) : 0.f;
+		PoseSample r;
+		r.timestamp = t;
+		r.translation = a.translation + w*(b.translation - a.translation);
+		r.rotation = a.rotation.slerp(w, b.rotation);
+		r.tracker_confidence = std::min(a.tracker_confidence, b.tracker_confidence);
+		r.mapper_confidence = std::min(a.mapper_confidence, b.mapper_confidence);
+		return r;
+	}
+
+private:
+	SeqLockValue<PoseSample> slots[SIZE];
+	std::atomic<uint64_t> count;
+};
+
+#endif
@@ -32,8 +32,10 @@ SpecificWorker::SpecificWorker(TuplePrx tprx, bool startup_check): GenericWorker
 SpecificWorker::~SpecificWorker()
 {
 	std::cout << "Destroying SpecificWorker" << std::endl;
-	for (const auto &[key, value] : cameras_dict) {
-	    delete(cameras_dict[key].odometer);
+	for (auto &[key, value] : cameras_dict) {
+	    // Stop the callback thread before its camera is destroyed
+	    try { value.pipe.stop(); } catch(const std::exception& e) { }
+	    delete(value.odometer);
 	}
 }
 
@@ -58,9 +60,10 @@ bool SpecificWorker::setParams(RoboCompCommonBehavior::ParameterList params)
 	//Leemos todas las camaras del config
     for(int i=0; i<num_cameras; i++)
     {
-        PARAMS param_camera;
         name = params["name_"+std::to_string(i)].value;
         std::cout<<"Cargando: "<<name<<std::endl;
+        //PARAMS holds the lock-free pose ring, so it is built in place
+        PARAMS &param_camera = cameras_dict[name];
         param_camera.device_serial = params["device_serial_"+std::to_string(i)].value;
         param_camera.rot_init_angles.x = (PI * (std::stof(params["rx_"+ std::to_string(i)].value))) / 180;
         param_camera.rot_init_angles.y = (PI * (std::stof(params["ry_"+std::to_string(i)].value))) / 180;
@@ -73,9 +76,12 @@ bool SpecificWorker::setParams(RoboCompCommonBehavior::ParameterList params)
         param_camera.robot_camera = Eigen::Translation3f(Eigen::Vector3f(tx,ty,tz));
         param_camera.robot_camera.rotate(Eigen::AngleAxisf (param_camera.rot_init_angles.x,Eigen::Vector3f::UnitX()) * Eigen::AngleAxisf (param_camera.rot_init_angles.y, Eigen::Vector3f::UnitY()) * Eigen::AngleAxisf(param_camera.rot_init_angles.z, Eigen::Vector3f::UnitZ()));
         // ejes de la camara respecto a origen
-        param_camera.origen_camera.linear() = param_camera.robot_camera.linear() * this->origen_robot.linear();
-        param_camera.origen_camera.translation() = this->origen_robot.linear() * param_camera.robot_camera.translation() + this->origen_robot.translation();
-        //std::cout<<param_camera.origen_camera.matrix()<<std::endl;
+        EXTRINSICS extrinsics;
+        extrinsics.origen_camera.linear() = param_camera.robot_camera.linear() * this->origen_robot.linear();
+        extrinsics.origen_camera.translation() = this->origen_robot.linear() * param_camera.robot_camera.translation() + this->origen_robot.translation();
+        extrinsics.origen_robot_translation = this->origen_robot.translation();
+        param_camera.extrinsics.store(extrinsics);
+        //std::cout<<extrinsics.origen_camera.matrix()<<std::endl;
 
         try
         {
@@ -110,16 +116,15 @@ bool SpecificWorker::setParams(RoboCompCommonBehavior::ParameterList params)
                     else
                         std::cout<<"No se pudo abrir el "<<etc_path<<".json"<<std::endl;
             }
-            // Start pipeline with chosen configuration
-            param_camera.pipe.start(cfg);
+            // Start pipeline with chosen configuration. Frames are delivered on a librealsense
+            // thread of this camera, so every T265 is acquired concurrently and never waited on.
+            param_camera.pipe.start(cfg, [this, &param_camera](rs2::frame frame){ pose_callback(param_camera, frame); });
         }catch(const std::exception& e)
         {
             std::cout << e.what() << std::endl;
             qFatal("Unable to open device, please check config file");
         }
 
-        //Incluimos la camara generada en el diccionario de camaras
-        cameras_dict.emplace(name,param_camera);
         std::cout<<"Camara añadida: "<<name<<std::endl;
     }
 	return true;
@@ -144,116 +149,97 @@ void SpecificWorker::initialize(int period)
 	timer.start(Period);
 }
 
-void SpecificWorker::compute()
+/**
+* \brief Frame callback of a camera pipeline, runs on that camera's librealsense thread.
+* Only pushes the raw pose into the camera's ring; all the frame math is done by the readers.
+*/
+void SpecificWorker::pose_callback(PARAMS &camera, const rs2::frame &frame)
 {
-    //RoboCompGenericBase::TBaseState Base = self.differentialrobot_proxy.getBaseState();
-    ///this->genericbase_proxy->getBaseState(Base);
-
-    euler_angle ang;
-    for (const auto &[key, value] : cameras_dict) {
-
-        rs2_vector v;
-        v.z = 0; // v.z = -Base.advVz/1000;
-        v.y = 0;
-        v.x = 0;
-        //cameras_dict[key].odometer->send_wheel_odometry(0,0,v);
-        //std::cout<<"Velocidad "<<v.z<<std::endl;
-
-        auto frames = value.pipe.wait_for_frames();
-        // Get a frame from the pose stream
-        auto f = frames.first_or_default(RS2_STREAM_POSE);
-        // Cast the frame to pose_frame and get its data
-        auto pose_data = f.as<rs2::pose_frame>().get_pose_data();
-        // Print the x, y, z values of the translation, relative to initial position
-
-        ang = quaternion_to_euler_angle(pose_data.rotation.w, pose_data.rotation.x, pose_data.rotation.y, pose_data.rotation.z);
-
-        Eigen::Quaternion<float> quatIn(pose_data.rotation.w, pose_data.rotation.x, pose_data.rotation.y, pose_data.rotation.z);
-        Eigen::Affine3f camera_world(Eigen::Translation3f(Eigen::Vector3f(pose_data.translation.x,pose_data.translation.y,pose_data.translation.z)));
-        camera_world.rotate(quatIn);
-
-        bufferMutex.lock();
-        cameras_dict[key].origen_world.linear() = camera_world.linear() * cameras_dict[key].origen_camera.linear();
-        cameras_dict[key].origen_world.translation() = cameras_dict[key].origen_camera.linear() * camera_world.translation() + this->origen_robot.translation();
-
-
-        //Eigen::Quaternion<float> quatOut(camera_world.linear() * this->origen_robot.linear());
-        Eigen::Quaternion<float> quatOut(cameras_dict[key].origen_world.linear() ) ;
-        euler_angle angOut = quaternion_to_euler_angle(quatOut.w(),quatOut.x(),quatOut.y(),quatOut.z());
+    rs2::frame f = frame;
+    if (auto frames = frame.as<rs2::frameset>())
+        f = frames.first_or_default(RS2_STREAM_POSE);
+    auto pose_frame = f.as<rs2::pose_frame>();
+    if (not pose_frame)
+        return;
+    const rs2_pose pose_data = pose_frame.get_pose_data();
+
+    PoseSample sample;
+    // Global and system time are host milliseconds, comparable across cameras. Otherwise stamp on arrival.
+    const rs2_timestamp_domain domain = pose_frame.get_frame_timestamp_domain();
+    if (domain == RS2_TIMESTAMP_DOMAIN_GLOBAL_TIME or domain == RS2_TIMESTAMP_DOMAIN_SYSTEM_TIME)
+        sample.timestamp = pose_frame.get_timestamp();
+    else
+        sample.timestamp = std::chrono::duration<double, std::milli>(std::chrono::system_clock::now().time_since_epoch()).count();
+    sample.translation = Eigen::Vector3f(pose_data.translation.x, pose_data.translation.y, pose_data.translation.z);
+    sample.rotation = Eigen::Quaternionf(pose_data.rotation.w, pose_data.rotation.x, pose_data.rotation.y, pose_data.rotation.z);
+    sample.tracker_confidence = pose_data.tracker_confidence;
+    sample.mapper_confidence = pose_data.mapper_confidence;
+    camera.poses.push(sample);
+}
 
-        /*
-        cameras_dict[key].angles.x = angOut.x;
-        cameras_dict[key].angles.y = angOut.y;
-        cameras_dict[key].angles.z = angOut.z;
+/**
+* \brief Latest instant for which every camera has a pose: the oldest of the cameras' newest samples.
+* Sampling there interpolates all the cameras and never extrapolates. Returns 0 if a camera has no data yet.
+* @param skew spread between the newest samples of the cameras (ms)
 */
+double SpecificWorker::common_query_time(double &skew) const
+{
+    double oldest = std::numeric_limits<double>::max(), newest = 0;
+    PoseSample last;
+    for (const auto &[key, value] : cameras_dict)
+    {
+        if (not value.poses.latest(last))
+        {
+            skew = 0;
+            return 0;
+        }
+        oldest = std::min(oldest, last.timestamp);
+        newest = std::max(newest, last.timestamp);
+    }
+    skew = cameras_dict.empty() ? 0 : newest - oldest;
+    return cameras_dict.empty() ? 0 : oldest;
+}
 
+/**
+* \brief Pose of a camera's axes in the world at the given time, without taking any lock
+*/
+bool SpecificWorker::camera_pose(const PARAMS &camera, double timestamp, CAMERA_POSE &pose) const
+{
+    return ::camera_pose(camera.poses, camera.extrinsics, camera.rot_init_angles, timestamp, pose);
+}
 
-        angOut.x = angOut.x - cameras_dict[key].rot_init_angles.x;
-        angOut.y = angOut.y - cameras_dict[key].rot_init_angles.y;
-        angOut.z = angOut.z - cameras_dict[key].rot_init_angles.z;
-
-        if (angOut.x<-M_PI)
-            cameras_dict[key].angles.x = angOut.x + (2*M_PI);
-        else {if(angOut.x>M_PI)
-            cameras_dict[key].angles.x = angOut.x - (2*M_PI);
-        else
-            cameras_dict[key].angles.x=angOut.x;}
-
-        if (angOut.y<-M_PI){
-            cameras_dict[key].angles.y = angOut.y + (2*M_PI);
-            std::cout<< "-180"<<std::endl;
-        }
-        else {
-            if(angOut.y>M_PI){
-                cameras_dict[key].angles.y = angOut.y - (2*M_PI);
-            std::cout<< "180"<<std::endl;
-            }
-            else{
-                cameras_dict[key].angles.y=angOut.y;
-                std::cout<< "NAN"<<std::endl;
-            }
-        }
+void SpecificWorker::compute()
+{
+    //RoboCompGenericBase::TBaseState Base = self.differentialrobot_proxy.getBaseState();
+    ///this->genericbase_proxy->getBaseState(Base);
+    //cameras_dict[key].odometer->send_wheel_odometry(0,0,v);
 
-        if (angOut.z<-M_PI)
-            cameras_dict[key].angles.z = angOut.z + (2*M_PI);
-        else {if(angOut.z>M_PI)
-            cameras_dict[key].angles.z = angOut.z - (2*M_PI);
-        else
-            cameras_dict[key].angles.z=angOut.z;}
-
-        cameras_dict[key].mapper_confidence = pose_data.mapper_confidence;
-        cameras_dict[key].tracker_confidence = pose_data.tracker_confidence;
-
-        //std::cout<<"\r"<< "Quat entrada vs Quat salida: " <<std::setprecision(3)<<quatIn.w()<<" "<<quatOut.w()<<"/"<<quatIn.x()<<" "<<quatOut.x()<<"/"<<quatIn.y()<<" "<<quatOut.y()<<"/"<<quatIn.z()<<" "<<quatOut.z();
-        //std::cout<<"\r" << "Ang entrada vs Ang salida: " << std::setprecision(3)<<180* ang.x/M_PI<<" "<<180*ang.x/M_PI<<" / "<<180*angAux.y/M_PI<<" "<<180* ang.y/M_PI<<" / "<<180*angAux.z/M_PI<<" "<<180*ang.z/M_PI << endl;
-
-        bufferMutex.unlock();
-
-        if(print_output){
-            /*std::cout << "\r" << std::setprecision(3)*/
-            std::cout << "Device: " << key <<std::setprecision(3)
-
-            << std::fixed
-            << cameras_dict[key].origen_world.matrix().coeff(0,3)<< " "
-            << cameras_dict[key].origen_world.matrix().coeff(1,3) << " "
-            << cameras_dict[key].origen_world.matrix().coeff(2,3)<< " (met) "/*
-            << quatOut.x() << " "
-            << quatOut.y() << " "
-            << quatOut.z() << " "
-            << quatOut.w() << " (quat) " << " "*/
-            << 180*cameras_dict[key].angles.x/PI << " "
-            << 180*cameras_dict[key].angles.y/PI << " "
-            << 180*cameras_dict[key].angles.z/PI << " (grad) " << " "/*
-            << cameras_dict[key].angles.x << " "
-            << cameras_dict[key].angles.y << " "
-            << cameras_dict[key].angles.z << "(rad)"*/
-            << std::endl;
-
-            //FullPoseEstimation_getFullPoseEuler();
-        }
+    // Acquisition runs in the pipeline callbacks; compute only reports
+    if(not print_output)
+        return;
 
+    double skew;
+    const double query = common_query_time(skew);
+    if (query == 0)
+        return;
+    const double now = std::chrono::duration<double, std::milli>(std::chrono::system_clock::now().time_since_epoch()).count();
 
+    CAMERA_POSE pose;
+    for (const auto &[key, value] : cameras_dict) {
+        if (not camera_pose(value, query, pose))
+            continue;
+        /*std::cout << "\r" << std::setprecision(3)*/
+        std::cout << "Device: " << key <<std::setprecision(3)
+        << std::fixed
+        << pose.origen_world.matrix().coeff(0,3)<< " "
+        << pose.origen_world.matrix().coeff(1,3) << " "
+        << pose.origen_world.matrix().coeff(2,3)<< " (met) "
+        << 180*pose.angles.x/PI << " "
+        << 180*pose.angles.y/PI << " "
+        << 180*pose.angles.z/PI << " (grad) " << " "
+        << std::endl;
     }
+    std::cout << "Staleness: " << now - query << " ms, skew: " << skew << " ms" << std::endl;
 }
 
 int SpecificWorker::startup_check()
@@ -265,42 +251,53 @@ int SpecificWorker::startup_check()
 
 RoboCompFullPoseEstimation::FullPoseEuler SpecificWorker::FullPoseEstimation_getFullPoseEuler()
 {
-	std::lock_guard<std::mutex> lock(bufferMutex);
+	//Every camera is sampled at the same instant, reading the rings without locks
+	double skew;
+	const double query = common_query_time(skew);
 
 	int sigma = 0;
 	RoboCompFullPoseEstimation::FullPoseEuler ret;
 	ret.source = "realsense";
+	ret.x = ret.y = ret.z = ret.rx = ret.ry = ret.rz = 0;
+	if (query == 0)
+	    return ret;
+
+	CAMERA_POSE pose;
 	for (const auto &[key, value] : cameras_dict)
 	{
+	    if (not camera_pose(value, query, pose))
+	        continue;
 	    //CALCULATE ADDITION BOTH DATA'S CAMERA
-	    ret.x = ret.x + cameras_dict[key].origen_world.matrix().coeff(0,3) * cameras_dict[key].tracker_confidence;
-	    ret.y = ret.y + cameras_dict[key].origen_world.matrix().coeff(1,3) * cameras_dict[key].tracker_confidence;
-	    ret.z = ret.z + cameras_dict[key].origen_world.matrix().coeff(2,3) * cameras_dict[key].tracker_confidence;
-	    ret.rx = ret.rx + cameras_dict[key].angles.x * cameras_dict[key].tracker_confidence;
-	    ret.ry = ret.ry + cameras_dict[key].angles.y * cameras_dict[key].tracker_confidence;
-	    ret.rz = ret.rz + cameras_dict[key].angles.z * cameras_dict[key].tracker_confidence;
-        sigma = sigma + cameras_dict[key].tracker_confidence;
-
-        //CALCULATE AVERAGE OF POSITION
-        ret.x = ret.x / sigma;
-        ret.y = ret.y / sigma;
-        ret.z = ret.z / sigma;
-
-        //CALCULATE AVERAGE OF ANGLES  (CHECK -PI to PI transition !!!!)
-        ret.rx = ret.rx / sigma;
-        ret.ry = ret.ry / sigma;
-        ret.rz = ret.rz / sigma;
-
-        if(print_output)
-            std::cout << "\r" << "Resultado" << " " <<
-                                sigma << " " <<
-                                ret.x << " " <<
-                                ret.y << " " <<
-                                ret.z << " " <<
-                                ret.rx << " " <<
-                                ret.ry << " " <<
-                                ret.rz << std::endl;
+	    ret.x = ret.x + pose.origen_world.matrix().coeff(0,3) * pose.tracker_confidence;
+	    ret.y = ret.y + pose.origen_world.matrix().coeff(1,3) * pose.tracker_confidence;
+	    ret.z = ret.z + pose.origen_world.matrix().coeff(2,3) * pose.tracker_confidence;
+	    ret.rx = ret.rx + pose.angles.x * pose.tracker_confidence;
+	    ret.ry = ret.ry + pose.angles.y * pose.tracker_confidence;
+	    ret.rz = ret.rz + pose.angles.z * pose.tracker_confidence;
+        sigma = sigma + pose.tracker_confidence;
 	}
+	if (sigma == 0)
+	    return ret;
+
+	//CALCULATE AVERAGE OF POSITION
+	ret.x = ret.x / sigma;
+	ret.y = ret.y / sigma;
+	ret.z = ret.z / sigma;
+
+	//CALCULATE AVERAGE OF ANGLES  (CHECK -PI to PI transition !!!!)
+	ret.rx = ret.rx / sigma;
+	ret.ry = ret.ry / sigma;
+	ret.rz = ret.rz / sigma;
+
+	if(print_output)
+	    std::cout << "\r" << "Resultado" << " " <<
+	                        sigma << " " <<
+	                        ret.x << " " <<
+	                        ret.y << " " <<
+	                        ret.z << " " <<
+	                        ret.rx << " " <<
+	                        ret.ry << " " <<
+	                        ret.rz << std::endl;
 
 	return ret;
 }
@@ -308,73 +305,51 @@ RoboCompFullPoseEstimation::FullPoseEuler SpecificWorker::FullPoseEstimation_get
 
 RoboCompFullPoseEstimation::FullPoseMatrix SpecificWorker::FullPoseEstimation_getFullPoseMatrix()
 {
-    std::lock_guard<std::mutex> lock(bufferMutex);
-
     RoboCompFullPoseEstimation::FullPoseMatrix fullMatrix;
     fullMatrix.source = "camera_side";
     std::string camera = "camera_side";
-    
-    fullMatrix.m00 = cameras_dict[camera].origen_camera.matrix().coeff(0,0);
-    fullMatrix.m01 = cameras_dict[camera].origen_camera.matrix().coeff(0,1);
-    fullMatrix.m02 = cameras_dict[camera].origen_camera.matrix().coeff(0,2);
-    fullMatrix.m03 = cameras_dict[camera].origen_camera.matrix().coeff(0,3);
-    fullMatrix.m10 = cameras_dict[camera].origen_camera.matrix().coeff(1,0);
-    fullMatrix.m11 = cameras_dict[camera].origen_camera.matrix().coeff(1,1);
-    fullMatrix.m12 = cameras_dict[camera].origen_camera.matrix().coeff(1,2);
-    fullMatrix.m13 = cameras_dict[camera].origen_camera.matrix().coeff(1,3);
-    fullMatrix.m20 = cameras_dict[camera].origen_camera.matrix().coeff(2,0);
-    fullMatrix.m21 = cameras_dict[camera].origen_camera.matrix().coeff(2,1);
-    fullMatrix.m22 = cameras_dict[camera].origen_camera.matrix().coeff(2,2);
-    fullMatrix.m23 = cameras_dict[camera].origen_camera.matrix().coeff(2,3);
-    fullMatrix.m30 = cameras_dict[camera].origen_camera.matrix().coeff(3,0);
-    fullMatrix.m31 = cameras_dict[camera].origen_camera.matrix().coeff(3,1);
-    fullMatrix.m32 = cameras_dict[camera].origen_camera.matrix().coeff(3,2);
-    fullMatrix.m33 = cameras_dict[camera].origen_camera.matrix().coeff(3,3);
+    auto it = cameras_dict.find(camera);
+    if (it == cameras_dict.end())
+        return fullMatrix;
+    const Eigen::Matrix4f m = it->second.extrinsics.load().origen_camera.matrix();
+
+    fullMatrix.m00 = m.coeff(0,0);
+    fullMatrix.m01 = m.coeff(0,1);
+    fullMatrix.m02 = m.coeff(0,2);
+    fullMatrix.m03 = m.coeff(0,3);
+    fullMatrix.m10 = m.coeff(1,0);
+    fullMatrix.m11 = m.coeff(1,1);
+    fullMatrix.m12 = m.coeff(1,2);
+    fullMatrix.m13 = m.coeff(1,3);
+    fullMatrix.m20 = m.coeff(2,0);
+    fullMatrix.m21 = m.coeff(2,1);
+    fullMatrix.m22 = m.coeff(2,2);
+    fullMatrix.m23 = m.coeff(2,3);
+    fullMatrix.m30 = m.coeff(3,0);
+    fullMatrix.m31 = m.coeff(3,1);
+    fullMatrix.m32 = m.coeff(3,2);
+    fullMatrix.m33 = m.coeff(3,3);
     return fullMatrix;
 }
 void SpecificWorker::FullPoseEstimation_setInitialPose(float x, float y, float z, float rx, float ry, float rz)
 {
+    //Writers are serialized; readers keep going lock-free on the extrinsics seqlocks
+    std::lock_guard<std::mutex> lock(bufferMutex);
+
     //Ejes del robot despecto al origen-mapa
     this->origen_robot=Eigen::Translation3f(Eigen::Vector3f(x,y,z));
     this->origen_robot.rotate(Eigen::AngleAxisf (rx, Eigen::Vector3f::UnitX()) * Eigen::AngleAxisf (ry, Eigen::Vector3f::UnitY()) * Eigen::AngleAxisf(rz, Eigen::Vector3f::UnitZ()));
 
-    for (const auto &[key, value] : cameras_dict) {
-
-        cameras_dict[key].origen_camera.linear() =  cameras_dict[key].robot_camera.linear() * this->origen_robot.linear();
-        cameras_dict[key].origen_camera.translation() = this->origen_robot.linear() *  cameras_dict[key].robot_camera.translation() + this->origen_robot.translation();
-
+    for (auto &[key, value] : cameras_dict) {
+        EXTRINSICS extrinsics;
+        extrinsics.origen_camera.linear() =  value.robot_camera.linear() * this->origen_robot.linear();
+        extrinsics.origen_camera.translation() = this->origen_robot.linear() *  value.robot_camera.translation() + this->origen_robot.translation();
+        extrinsics.origen_robot_translation = this->origen_robot.translation();
+        value.extrinsics.store(extrinsics);
     }
 
 }
 
-SpecificWorker::euler_angle SpecificWorker::quaternion_to_euler_angle(float qw, float qx, float qy, float qz){
-    float auxZ;
-    float auxY;
-    float auxX;
-
-    auxZ = atan2(2*qy*qw-2*qx*qz, 1- 2*qy*qy - 2*qz*qz);
-    auxY = asin(2*qx*qy + 2*qz*qw);
-    auxX = atan2(2*qx*qw-2*qy*qz , 1 - 2*qx*qx - 2*qz*qz);
-
-
-    float equal = qx*qy + qz*qw;
-    if (equal < 0.5+pow(10,-5) and equal > 0.5-pow(10,-5)) {
-        auxZ = 2.0 * atan2(qx, qw);
-        auxX = 0.0;
-    }
-    if (equal < -0.5+pow(10,-5) and equal > -0.5-pow(10,-5)) {
-        auxZ = -2.0 * atan2(qx, qw);
-        auxX = 0.0;
-    }
-
-    euler_angle ret;
-    ret.x = auxX;
-    ret.y = auxZ;
-    ret.z = auxY;
-    return ret;
-}
-
-
 /**************************************/
 // From the RoboCompDifferentialRobot you can call this methods:
 // this->differentialrobot_proxy->correctOdometer(...)
@@ -39,8 +39,14 @@
 #undef Q_FOREACH
 
 #include <iomanip>
+#include <chrono>
+#include <limits>
+#include <mutex>
 #include <librealsense2/rs.hpp> // Include RealSense Cross Platform API
 
+#include "poseringbuffer.h"
+#include "camerapose.h"
+
 class SpecificWorker : public GenericWorker
 {
 	Q_OBJECT
@@ -60,32 +66,25 @@ public slots:
 		void initialize(int period);
 
 	private:
-        struct euler_angle{
-            float x;
-            float y;
-            float z;
-        };
-
         struct PARAMS {
             std::string device_serial;          //0
             rs2::pipeline pipe;               //2
             Eigen::Affine3f robot_camera;
-            Eigen::Affine3f origen_camera;   //Matrix de ejes de la camara respecto al origen
-            Eigen::Affine3f origen_world;   //3
+            SeqLockValue<EXTRINSICS> extrinsics;
             euler_angle rot_init_angles;
-            euler_angle angles;              //4
-            unsigned int mapper_confidence;     //5
-            unsigned int tracker_confidence;    //6
-            rs2::wheel_odometer* odometer;
+            PoseRingBuffer poses;            // filled by the pipeline callback thread of this camera
+            rs2::wheel_odometer* odometer = nullptr;
         };
 
 		bool print_output = false;
 		int num_cameras;
         std::map<string, PARAMS> cameras_dict{};
-        mutable std::mutex bufferMutex;
+        mutable std::mutex bufferMutex;  // serializes setInitialPose writers only
         Eigen::Affine3f origen_robot;   //Matrix de ejes de la robot respecto al origen
 
-        euler_angle quaternion_to_euler_angle(float w, float x, float y, float z);
+        void pose_callback(PARAMS &camera, const rs2::frame &frame);
+        double common_query_time(double &skew) const;
+        bool camera_pose(const PARAMS &camera, double timestamp, CAMERA_POSE &pose) const;
 
 		std::shared_ptr < InnerModel > innerModel;
 		bool startup_check_flag;
@@ -50,70 +50,41 @@ void SpecificWorker::initialize(int period)
 	this->Period = period;
 	xPos = 0;
 	zPos = 0;
+	ryPos = 0;
 	timer.start(Period);
 	emit this->initializetocompute();
 
 }
 
-void SpecificWorker::compute_initial_pose(int ntimes)
-{
-	QPointF posL, posR;
-	float xMed = 0;
-	float zMed = 0;
-	float angle = 0;
-	for (int cont=0; cont < ntimes; cont++)
-	{
-        posL = readData(left_device);
-		if (ndevices == 2)
-		{
-			posR = readData(right_device);
-			xMed += (posL.x() + posR.x()) / 2.;
-			zMed += (posL.y() + posR.y()) / 2.;
-			angle += QLineF(posR, posL).angle();
-		}
-		else
-		{
-			xMed += posL.x();
-			zMed += posL.y();
-		}
-		std::this_thread::sleep_for(std::chrono::milliseconds(100));
-	}
-	xPos = xMed / ntimes;
-	zPos = zMed / ntimes;
-	ryPos = angle / ntimes;
-	std::cout << "initial pose: "<< xPos << " " << zPos << " " << ryPos << std::endl;
-}
+/**
+* \brief Watchdog and statistics. Reading is event driven (readDevice), compute only
+* re-sends requests that got no answer and reports the pose rate and latency.
+*/
 void SpecificWorker::compute()
 {
-	QPointF posL = readData(left_device);
-
-	try
+	const int64_t now = now_us();
+	UWBDevice *devices[2] = {&left_device, &right_device};
+	for (int i=0; i<ndevices; i++)
 	{
-		RoboCompFullPoseEstimation::FullPose pose;
-		pose.source = "uwb";
-		pose.x = posL.x();
-		pose.z = posL.y();
-		if (ndevices == 2)
+		if (devices[i]->pending and now - devices[i]->request_time > request_timeout)
 		{
-			QPointF posR = readData(right_device);
-			pose.x = (posL.x() + posR.x()) / 2.;
-			pose.z  = (posL.y() + posR.y()) / 2.;
-			pose.ry = degreesToRadians(QLineF(posR, posL).angle()-180);
-			xPos = pose.x;
-			zPos = pose.z;
-			ryPos = pose.ry;
+			devices[i]->parser.reset();
+			requestPosition(*devices[i]);
 		}
-		std::cout << "Pose read(x,z,ry): "<< pose.x << " " << pose.z << " " << pose.ry << std::endl;
-		fullposeestimationpub_pubproxy->newFullPose(pose);
 	}
-	catch(const Ice::Exception &e)
+
+	if (now - stats_start >= 1000000)
 	{
-		std::cout <<"Error pose publication, check Ice connection: "<< e << std::endl;
+		if (stats_poses > 0)
+			std::cout << "Pose read(x,z,ry): "<< xPos << " " << zPos << " " << ryPos
+			          << " rate: " << stats_poses * 1e6 / (now - stats_start) << " Hz"
+			          << " latency: " << stats_latency / stats_poses / 1000. << " ms" << std::endl;
+		stats_start = now;
+		stats_poses = 0;
+		stats_latency = 0;
 	}
-
 }
 
-
 void SpecificWorker::sm_compute()
 {
 	//std::cout<<"Entered state compute"<<std::endl;
@@ -126,24 +97,36 @@ void SpecificWorker::sm_initialize()
 	std::cout<<"Entered initial state initialize"<<std::endl;
 	//Check devices number => If there is just one, left variable is used
 	ndevices = std::stoi( params["ndevices"].value);
-	left_device.setPortName(QString::fromStdString(params["left"].value));
-	if(!left_device.open(QIODevice::ReadWrite))
+	initial_reading = std::stoi( params["initial_reading"].value);
+	if (params.find("pair_window") != params.end())
+		pair_window = std::stoi(params["pair_window"].value) * 1000;
+	left_device.serial.setPortName(QString::fromStdString(params["left"].value));
+	if(!left_device.serial.open(QIODevice::ReadWrite))
 	{
 		std::cout << "Error opening left_device: " << params["left"].value << std::endl;
  		exit(-1); 
 	}
-	left_device.setBaudRate(QSerialPort::Baud115200);
+	left_device.serial.setBaudRate(QSerialPort::Baud115200);
 	if (ndevices == 2)
 	{
-		right_device.setPortName(QString::fromStdString(params["right"].value));
-		if(!right_device.open(QIODevice::ReadWrite))
+		right_device.serial.setPortName(QString::fromStdString(params["right"].value));
+		if(!right_device.serial.open(QIODevice::ReadWrite))
 		{
-			std::cout << "Error opening left_device: " << params["right"].value << std::endl;
+			std::cout << "Error opening right_device: " << params["right"].value << std::endl;
 			exit(-1); 
 		}
-		right_device.setBaudRate(QSerialPort::Baud115200);
+		right_device.serial.setBaudRate(QSerialPort::Baud115200);
 	}
-	compute_initial_pose(std::stoi( params["initial_reading"].value));
+
+	//Both ports are serviced from the event loop as their bytes arrive, each at its own rate
+	connect(&left_device.serial, &QSerialPort::readyRead, this, [this]{ readDevice(left_device, ndevices == 2 ? &right_device : nullptr, true); });
+	requestPosition(left_device);
+	if (ndevices == 2)
+	{
+		connect(&right_device.serial, &QSerialPort::readyRead, this, [this]{ readDevice(right_device, &left_device, false); });
+		requestPosition(right_device);
+	}
+	stats_start = now_us();
 }
 
 void SpecificWorker::sm_finalize()
@@ -152,52 +135,97 @@ void SpecificWorker::sm_finalize()
 }
 
 
+/// Sends a dwm_pos_get request (type 0x02, length 0). The answer is handled by readDevice
+void SpecificWorker::requestPosition(UWBDevice &device)
+{
+	static const char request[2] = {2, 0};
+	device.serial.write(request, sizeof(request));
+	device.pending = true;
+	device.request_time = now_us();
+}
 
-QPointF SpecificWorker::readData(QSerialPort &serial)
+/**
+* \brief readyRead handler of a tag. Drains the port into the framer, stamping the bytes
+* with their arrival time, and pairs every decoded sample with an unpaired one of the other tag.
+*/
+void SpecificWorker::readDevice(UWBDevice &device, UWBDevice *other, bool is_left)
 {
-	QByteArray responseData;
-	responseData.append((char)2);
-    responseData.append((char)0);
-
-//	for(int i=0; i<1; i++)
-//	{
-		serial.write(responseData);
-  		if (serial.waitForBytesWritten(200)) {}
-          //qDebug() << "escrito ok";
-		int numRead = 0, numReadTotal = 0;
-
-		char *b;b = new char[18];
-		for (;;) 
+	uint8_t buffer[64];
+	qint64 n;
+	while ((n = device.serial.read((char *)buffer, sizeof(buffer))) > 0)
+		device.parser.push(buffer, n, now_us());
+
+	UWBSample sample;
+	while (device.parser.next(sample))
+	{
+		device.history.add(sample);
+		device.pending = false;
+		const QPointF pos(sample.x, sample.y);
+		if (other == nullptr)
+			publishPose(pos, nullptr, sample.timestamp);
+		else
 		{
-			if (serial.waitForReadyRead(100)) 
+			UWBSample match;
+			if (device.history.pairNewest(other->history, pair_window, match))
 			{
-				numRead  = serial.read(b + numReadTotal, serial.bytesAvailable());
-				numReadTotal += numRead;
+				const QPointF otherPos(match.x, match.y);
+				if (is_left)
+					publishPose(pos, &otherPos, sample.timestamp);
+				else
+					publishPose(otherPos, &pos, sample.timestamp);
 			}
-			if(numReadTotal >= 18)
-			break;
 		}
+	}
+	if (not device.pending)
+		requestPosition(device);
+}
 
-		// for(int i=0; i<18; i++)
-		// 	std::cout << (int)b[i] << " "; 
-		// std::cout <<  std::endl;
+/**
+* \brief Fuses the tags' positions and publishes them, or accumulates them while the initial pose is computed
+* @param timestamp arrival time of the sample that completed the pose
+*/
+void SpecificWorker::publishPose(const QPointF &posL, const QPointF *posR, int64_t timestamp)
+{
+	RoboCompFullPoseEstimation::FullPose pose;
+	pose.source = "uwb";
+	pose.x = posL.x();
+	pose.z = posL.y();
+	pose.ry = ryPos;
+	if (posR != nullptr)
+	{
+		pose.x = (posL.x() + posR->x()) / 2.;
+		pose.z  = (posL.y() + posR->y()) / 2.;
+		pose.ry = degreesToRadians(QLineF(*posR, posL).angle()-180);
+	}
 
-		if(!(b[0] == 64 and b[1] == 1 and b[2] == 0 and b[3] == 65))
-		{	
-			qDebug() << "Bad sequence, aborting";
-			return QPointF();
+	if (initial_count < initial_reading)
+	{
+		xMed += pose.x;
+		zMed += pose.z;
+		ryMed += pose.ry;
+		if (++initial_count == initial_reading)
+		{
+			xPos = xMed / initial_reading;
+			zPos = zMed / initial_reading;
+			ryPos = ryMed / initial_reading;
+			std::cout << "initial pose: "<< xPos << " " << zPos << " " << ryPos << std::endl;
 		}
+		return;
+	}
 
-		int x = bitsToInt((unsigned char*)b,5,true);
-		int y = bitsToInt((unsigned char*)b,9,true);
-		int z = bitsToInt((unsigned char*)b,13,true);
-		//qDebug() << x << y << z;
-		//qDebug() << "---------------------";
-		delete b;
-		serial.flush();
-		//usleep(100000);
-		return(QPointF(x,y));
-//	}
+	xPos = pose.x;
+	zPos = pose.z;
+	ryPos = pose.ry;
+	try
+	{
+		fullposeestimationpub_pubproxy->newFullPose(pose);
+	}
+	catch(const Ice::Exception &e)
+	{
+		std::cout <<"Error pose publication, check Ice connection: "<< e << std::endl;
+	}
+	stats_poses++;
+	stats_latency += now_us() - timestamp;
 }
 
 //UTILITIES
@@ -211,18 +239,6 @@ float SpecificWorker::degreesToRadians(const float angle_)
 	else return angle;
 }
 
-int SpecificWorker::bitsToInt( const unsigned char* bits, uint init, bool little_endian)
-	{
-		int result = 0;
-		if (little_endian)
-			for (int n = sizeof( result ); n >= 0; n--)
-			result = (result << 8) + bits[ init + n ];
-		else
-			for (unsigned n = 0; n < sizeof( result ); n++)
-			result = (result << 8) + bits[ n ];
-		return result;
-	}
-
 
 //***********INTERFACE*****************//
 
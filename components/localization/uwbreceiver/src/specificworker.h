@@ -30,6 +30,23 @@
 #include <genericworker.h>
 #include <innermodel/innermodel.h>
 #include <QtSerialPort/QSerialPort>
+#include <chrono>
+#include <cstdlib>
+#include <algorithm>
+
+#include "uwbframeparser.h"
+
+/**
+* \brief Serial port of one UWB tag, with its framer and the last samples it produced
+*/
+struct UWBDevice
+{
+	QSerialPort serial;
+	UWBFrameParser parser;
+	UWBHistory history;
+	bool pending = false;      // a dwm_pos_get request is waiting for its answer
+	int64_t request_time = 0;  // us
+};
 
 class SpecificWorker : public GenericWorker
 {
@@ -38,10 +55,11 @@ public:
 	SpecificWorker(TuplePrx tprx);
 	~SpecificWorker();
 	bool setParams(RoboCompCommonBehavior::ParameterList params);
-	QPointF readData(QSerialPort &serial);
-	void compute_initial_pose(int ntimes);
+	void requestPosition(UWBDevice &device);
+	void readDevice(UWBDevice &device, UWBDevice *other, bool is_left);
+	void publishPose(const QPointF &posL, const QPointF *posR, int64_t timestamp);
     float degreesToRadians(const float angle_);
-	int bitsToInt( const unsigned char* bits, uint init, bool little_endian = true );
+	static int64_t now_us() { return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count(); }
 	//Ice interface
 	FullPose FullPoseEstimation_getFullPose();
 	void FullPoseEstimation_setInitialPose(float x, float y, float z, float rx, float ry, float rz);
@@ -58,13 +76,25 @@ public slots:
 private:
 	std::shared_ptr<InnerModel> innerModel;
     RoboCompCommonBehavior::ParameterList params;
-	QSerialPort left_device, right_device;
+	UWBDevice left_device, right_device;
 	int ndevices = 0;
 	int left_offset;
 	int right_offset;
 	float xPos;
 	float zPos;
 	float ryPos;
+	int64_t pair_window = 50000;      // us, max skew between the left and right samples of a pose
+	int64_t request_timeout = 200000; // us, a request without answer is sent again
+
+	//Initial pose is the average of the first initial_reading poses, nothing is published meanwhile
+	int initial_reading = 0;
+	int initial_count = 0;
+	float xMed = 0, zMed = 0, ryMed = 0;
+
+	//Publication statistics, reported once per second
+	int64_t stats_start = 0;
+	int stats_poses = 0;
+	double stats_latency = 0;
 
 };
 
@@ -0,0 +1,167 @@
+/*
+ *    Copyright (C) 2020 by RoboLab - University of Extremadura
+ *
+ *    This file is part of RoboComp
+ *
+ *    RoboComp is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    RoboComp is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with RoboComp.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef UWBFRAMEPARSER_H
+#define UWBFRAMEPARSER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+* \brief Position sample decoded from a tag's dwm_pos_get response
+*/
+struct UWBSample
+{
+	int64_t timestamp;   // host time (us) at which the first byte of the response arrived
+	int32_t x, y, z;     // mm
+	uint8_t quality;
+};
+
+/**
+* \brief Incremental, allocation-free framer for the 18 byte dwm_pos_get response
+*
+*   0x40 0x01 0x00 | 0x41 0x0D | x(4) y(4) z(4) quality(1)   (little endian)
+*
+* Bytes are pushed as they arrive, each one stamped with its arrival time, into
+* a fixed ring. next() extracts complete frames and resynchronizes byte by byte
+* on garbage. When the ring is full the oldest bytes are dropped.
+*/
+class UWBFrameParser
+{
+public:
+	static const uint32_t FRAME_SIZE = 18;
+	static const uint32_t RING_SIZE = 256;   // power of two
+
+	UWBFrameParser() : head(0), tail(0), dropped(0) { }
+
+	void reset() { head = tail = 0; }
+
+	uint32_t available() const { return head - tail; }
+	uint32_t droppedBytes() const { return dropped; }
+
+	void push(const uint8_t *data, const size_t n, const int64_t timestamp)
+	{
+		for (size_t i=0; i<n; i++)
+		{
+			if (available() == RING_SIZE)
+			{
+				tail++;
+				dropped++;
+			}
+			bytes[head & (RING_SIZE-1)] = data[i];
+			stamps[head & (RING_SIZE-1)] = timestamp;
+			head++;
+		}
+	}
+
+	/// Extracts the next complete frame, false if more bytes are needed
+	bool next(UWBSample &sample)
+	{
+		while (available() >= FRAME_SIZE)
+		{
+			if (at(0) != 0x40 or at(1) != 0x01 or at(2) != 0x00 or at(3) != 0x41 or at(4) != 0x0D)
+			{
+				tail++;
+				dropped++;
+				continue;
+			}
+			sample.timestamp = stamps[tail & (RING_SIZE-1)];
+			sample.x = int32At(5);
+			sample.y = int32At(9);
+			sample.z = int32At(13);
+			sample.quality = at(17);
+			tail += FRAME_SIZE;
+			return true;
+		}
+		return false;
+	}
+
+private:
+	uint8_t bytes[RING_SIZE];
+	int64_t stamps[RING_SIZE];
+	uint32_t head, tail, dropped;
+
+	inline uint8_t at(const uint32_t i) const { return bytes[(tail + i) & (RING_SIZE-1)]; }
+	inline int32_t int32At(const uint32_t i) const
+	{
+		return int32_t(uint32_t(at(i)) | (uint32_t(at(i+1)) << 8) | (uint32_t(at(i+2)) << 16) | (uint32_t(at(i+3)) << 24));
+	}
+};
+
+/**
+* \brief Last samples of one tag, for pairing them with the other tag's samples
+*
+* Each sample goes into at most one pair, so a left/right pair makes one pose
+* whichever tag completes it.
+*/
+class UWBHistory
+{
+public:
+	static const uint32_t SIZE = 8;
+
+	UWBHistory() : count(0) { }
+
+	void add(const UWBSample &sample)
+	{
+		samples[count % SIZE] = sample;
+		paired[count % SIZE] = false;
+		count++;
+	}
+
+	uint32_t size() const { return count; }
+
+	/**
+	* \brief Pairs the newest sample with the unpaired sample of \p other closest in time
+	* @param window max skew between the two samples (us)
+	* @return false if there is no unpaired sample of \p other within the window; nothing is marked then
+	*/
+	bool pairNewest(UWBHistory &other, const int64_t window, UWBSample &match)
+	{
+		if (count == 0 or paired[(count-1) % SIZE])
+			return false;
+		const UWBSample &sample = samples[(count-1) % SIZE];
+		int64_t best = window + 1;
+		int32_t bestSlot = -1;
+		const uint32_t n = other.count < SIZE ? other.count : SIZE;
+		for (uint32_t i=0; i<n; i++)
+		{
+			const uint32_t slot = (other.count - 1 - i) % SIZE;
+			if (other.paired[slot])
+				continue;
+			const int64_t dt = other.samples[slot].timestamp > sample.timestamp ? other.samples[slot].timestamp - sample.timestamp : sample.timestamp - other.samples[slot].timestamp;
+			if (dt < best)
+			{
+				best = dt;
+				bestSlot = slot;
+			}
+		}
+		if (bestSlot < 0)
+			return false;
+		match = other.samples[bestSlot];
+		other.paired[bestSlot] = true;
+		paired[(count-1) % SIZE] = true;
+		return true;
+	}
+
+private:
+	UWBSample samples[SIZE];
+	bool paired[SIZE];
+	uint32_t count;
+};
+
+#endif
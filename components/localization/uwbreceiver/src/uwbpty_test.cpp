@@ -0,0 +1,240 @@
+/*
+ *    Copyright (C) 2020 by RoboLab - University of Extremadura
+ *
+ *    This file is part of RoboComp
+ *
+ *    RoboComp is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    RoboComp is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with RoboComp.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Two simulated DWM1001 tags behind pseudo terminals, answering dwm_pos_get
+// requests with the position of a robot driving in a circle, with some line
+// noise. The reader side does what SpecificWorker::readDevice does: frames the
+// bytes with UWBFrameParser, pairs left and right with UWBHistory and makes one
+// pose per pair. Each tag numbers its answers in z, so that a sample used in two
+// poses or a frame lost on the way is caught.
+//   uwbpty_test [seconds] [tag answer delay ms]
+// Returns 1 on a duplicated sample, a lost frame or a pose off the trajectory.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include "uwbframeparser.h"
+
+static int64_t now_us()
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static const int64_t origin = now_us();
+static const double RADIUS = 3000, SPEED = 500, BASELINE = 400;  // mm, mm/s, mm between the tags
+
+/// Position (mm) of the left or right tag of the robot at time t (us)
+static void tagPosition(int64_t t, bool left, double &x, double &y)
+{
+	const double a = (t - origin)*1e-6*SPEED/RADIUS;
+	const double r = RADIUS + (left ? -BASELINE/2 : BASELINE/2);
+	x = r*cos(a);
+	y = r*sin(a);
+}
+
+/// Master side of a pseudo terminal, the reader opens the slave side as the component opens the tag's port
+static int openPty(int &slave)
+{
+	const int master = posix_openpt(O_RDWR | O_NOCTTY);
+	if (master < 0 or grantpt(master) != 0 or unlockpt(master) != 0)
+		return -1;
+	slave = open(ptsname(master), O_RDWR | O_NOCTTY | O_NONBLOCK);
+	struct termios tio;
+	tcgetattr(slave, &tio);
+	cfmakeraw(&tio);
+	tcsetattr(slave, TCSANOW, &tio);
+	return master;
+}
+
+/// The tag: waits for 0x02 0x00 and answers after the delay, sometimes with garbage before the frame
+static void simulateTag(int master, bool left, int delayUs, std::atomic<bool> &stop, uint32_t &answered)
+{
+	std::mt19937 rng(left ? 33 : 34);
+	uint8_t request[2];
+	size_t got = 0;
+	while (not stop)
+	{
+		struct pollfd p = {master, POLLIN, 0};
+		if (poll(&p, 1, 50) <= 0)
+			continue;
+		const ssize_t n = read(master, request + got, 2 - got);
+		if (n <= 0)
+			continue;
+		got += n;
+		if (got < 2)
+			continue;
+		got = 0;
+		if (request[0] != 2 or request[1] != 0)
+			continue;
+		std::this_thread::sleep_for(std::chrono::microseconds(delayUs + int(rng() % 1000)));
+
+		std::vector<uint8_t> out;
+		if (rng() % 10 == 0)
+			for (int g=rng()%7; g>0; g--)
+				out.push_back(rng() % 256);
+		double x, y;
+		tagPosition(now_us(), left, x, y);
+		const int32_t v[3] = {int32_t(lrint(x)), int32_t(lrint(y)), int32_t(answered)};
+		const uint8_t header[5] = {0x40, 0x01, 0x00, 0x41, 0x0D};
+		out.insert(out.end(), header, header + 5);
+		for (int k=0; k<3; k++)
+			for (int b=0; b<4; b++)
+				out.push_back(uint32_t(v[k]) >> (8*b));
+		out.push_back(100);
+		if (write(master, out.data(), out.size()) == ssize_t(out.size()))
+			answered++;
+	}
+}
+
+static void stats(std::vector<double> v, double &mean, double &p99)
+{
+	mean = p99 = 0;
+	if (v.empty())
+		return;
+	std::sort(v.begin(), v.end());
+	for (double x : v)
+		mean += x;
+	mean /= v.size();
+	p99 = v[std::min(v.size()-1, size_t(0.99*v.size()))];
+}
+
+int main(int argc, char **argv)
+{
+	const double seconds = argc > 1 ? atof(argv[1]) : 5;
+	const int delayUs = 1000*(argc > 2 ? atof(argv[2]) : 10);
+	const int64_t pairWindow = 50000, requestTimeout = 200000;
+
+	struct Tag
+	{
+		int master, slave;
+		UWBFrameParser parser;
+		UWBHistory history;
+		bool pending;
+		int64_t requestTime;
+		uint32_t answered, received;
+		int32_t lastSeq;
+		std::set<int32_t> used;
+		std::vector<double> requestLatency;
+	} tags[2];
+	std::atomic<bool> stop(false);
+	std::vector<std::thread> simulators;
+	for (int t=0; t<2; t++)
+	{
+		Tag &tag = tags[t];
+		tag.master = openPty(tag.slave);
+		if (tag.master < 0 or tag.slave < 0)
+		{
+			perror("pty");
+			return 2;
+		}
+		tag.pending = false;
+		tag.answered = tag.received = 0;
+		tag.lastSeq = -1;
+		simulators.emplace_back(simulateTag, tag.master, t == 0, delayUs, std::ref(stop), std::ref(tag.answered));
+	}
+
+	auto requestPosition = [](Tag &tag)
+	{
+		static const uint8_t request[2] = {2, 0};
+		if (write(tag.slave, request, sizeof(request)) == sizeof(request))
+		{
+			tag.pending = true;
+			tag.requestTime = now_us();
+		}
+	};
+
+	uint32_t poses = 0, duplicates = 0, lost = 0, offTrack = 0;
+	std::vector<double> poseLatency;
+	requestPosition(tags[0]);
+	requestPosition(tags[1]);
+	const int64_t start = now_us();
+	while (now_us() - start < int64_t(1e6*seconds))
+	{
+		struct pollfd fds[2] = {{tags[0].slave, POLLIN, 0}, {tags[1].slave, POLLIN, 0}};
+		poll(fds, 2, 20);
+		for (int t=0; t<2; t++)
+		{
+			Tag &device = tags[t], &other = tags[1-t];
+			uint8_t buffer[64];
+			ssize_t n;
+			while ((n = read(device.slave, buffer, sizeof(buffer))) > 0)
+				device.parser.push(buffer, n, now_us());
+
+			UWBSample sample;
+			while (device.parser.next(sample))
+			{
+				device.received++;
+				lost += sample.z - device.lastSeq - 1;
+				device.lastSeq = sample.z;
+				device.requestLatency.push_back(1e-3*(sample.timestamp - device.requestTime));
+				device.history.add(sample);
+				device.pending = false;
+
+				UWBSample match;
+				if (device.history.pairNewest(other.history, pairWindow, match))
+				{
+					poses++;
+					poseLatency.push_back(1e-3*(now_us() - sample.timestamp));
+					duplicates += not device.used.insert(sample.z).second;
+					duplicates += not other.used.insert(match.z).second;
+					// Both tags seen within the window: the midpoint is near the robot's circle
+					const double mx = 0.5*(sample.x + match.x), my = 0.5*(sample.y + match.y);
+					if (fabs(sqrt(mx*mx + my*my) - RADIUS) > 10 + SPEED*1e-6*pairWindow)
+						offTrack++;
+				}
+			}
+			if (not device.pending or now_us() - device.requestTime > requestTimeout)
+				requestPosition(device);
+		}
+	}
+	stop = true;
+	for (auto &s : simulators)
+		s.join();
+
+	double meanPose, p99Pose;
+	stats(poseLatency, meanPose, p99Pose);
+	printf("%.1f s, tag answer delay %d-%d ms\n", seconds, delayUs/1000, delayUs/1000 + 1);
+	for (int t=0; t<2; t++)
+	{
+		double mean, p99;
+		stats(tags[t].requestLatency, mean, p99);
+		printf("  %s tag: %u answers, %u framed (%.1f Hz), %u garbage bytes skipped, request to answer mean %.2f ms p99 %.2f ms\n",
+		       t == 0 ? "left " : "right", tags[t].answered, tags[t].received, tags[t].received/seconds, tags[t].parser.droppedBytes(), mean, p99);
+		close(tags[t].slave);
+		close(tags[t].master);
+	}
+	const uint32_t pairs = std::min(tags[0].received, tags[1].received);
+	printf("poses %u (%.1f Hz, %.2f per left/right pair), framing to publication mean %.3f ms p99 %.3f ms\n", poses, poses/seconds,
+	       pairs ? double(poses)/pairs : 0., meanPose, p99Pose);
+	printf("duplicated samples %u, lost frames %u, poses off the trajectory %u\n", duplicates, lost, offTrack);
+	return duplicates or lost or offTrack ? 1 : 0;
+}
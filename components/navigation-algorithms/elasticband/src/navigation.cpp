@@ -14,6 +14,7 @@ void Navigation<TMap,TController>::initialize( const Grid<>::Dimensions &dim, st
 {
     //qDebug() << "Navigation - " << __FUNCTION__;
     innerModel = innerModel_;
+    transforms.setInnerModel(innerModel.get());
     configparams = configparams_;
     scene = scene_;
     omnirobot_proxy = omnirobot_proxy_;
@@ -45,6 +46,7 @@ void Navigation<TMap,TController>::initialize( const Grid<>::Dimensions &dim, st
 template<typename TMap, typename TController>
 void Navigation<TMap,TController>::update(const RoboCompLaser::TLaserData &laser_data, Target &target, bool needsReplaning)
 {
+    transforms.invalidate();  // robot pose was updated for this cycle
     QVec current_robot_pose = innerModel->transformS6D("world", "robot");
     QVec nose_3d = innerModel->transform("world", QVec::vec3(0, 0, 250), "robot");
     const auto &[laser_poly, laser_cart] = read_laser_data(laser_data);
@@ -285,14 +287,23 @@ std::tuple<QPolygonF, std::vector<QPointF>> Navigation<TMap,TController>::read_l
 {
     QPolygonF laser_poly;
     std::vector<QPointF> laser_cart;
-    for (const auto l : laser_data)
+    const size_t n = laser_data.size();
+    auto &b = laser_buffers;
+    b.resize(n);
+    for (const auto &[i, l] : iter::enumerate(laser_data))
     {
-        //convert laser polar coordinates to cartesian
-        float x = l.dist * sin(l.angle);
-        float y = l.dist * cos(l.angle);
-        QVec laserWorld = innerModel->transform("world", QVec::vec3(x, 0, y), "laser");
-        laser_poly << QPointF(x, y);
-        laser_cart.emplace_back(QPointF(laserWorld.x(), laserWorld.z()));
+        b.dist[i] = l.dist;
+        b.angle[i] = l.angle;
+    }
+    //convert laser polar coordinates to cartesian and then to world, in one batch per scan
+    TransformSnapshot::polarToCartesian(b.dist.data(), b.angle.data(), n, b.x.data(), b.z.data());
+    transforms.transformXZ("world", "laser", b.x.data(), b.z.data(), n, b.ox.data(), b.oy.data(), b.oz.data());
+    laser_poly.reserve(n);
+    laser_cart.reserve(n);
+    for (size_t i = 0; i < n; i++)
+    {
+        laser_poly << QPointF(b.x[i], b.z[i]);
+        laser_cart.emplace_back(QPointF(b.ox[i], b.oz[i]));
     }
     return std::make_tuple(laser_poly, laser_cart);
 }
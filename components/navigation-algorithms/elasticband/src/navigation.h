@@ -12,6 +12,7 @@
 #include <genericworker.h>
 #include <Laser.h>
 #include "collisions.h"
+#include <transformsnapshot/transformsnapshot.h>
 #include <QPolygonF>
 #include <QPointF>
 #include <cppitertools/chain.hpp>
@@ -66,6 +67,8 @@ class Navigation
     private:
         std::shared_ptr<Collisions> collisions;
         std::shared_ptr<InnerModel> innerModel;
+        TransformSnapshot transforms;
+        TransformBuffers laser_buffers;
         std::shared_ptr<RoboCompCommonBehavior::ParameterList> configparams;
         RoboCompOmniRobot::OmniRobotPrxPtr omnirobot_proxy;
 
@@ -0,0 +1,69 @@
+/*
+ *    Copyright (C) 2020 by RoboLab - University of Extremadura
+ *
+ *    This file is part of RoboComp
+ *
+ *    RoboComp is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    RoboComp is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with RoboComp.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "depthprojector.h"
+
+#include <math.h>
+
+DepthProjector::DepthProjector() : w(0), h(0), fx(0), fy(0)
+{
+}
+
+void DepthProjector::setIntrinsics(const int32_t width, const int32_t height, const float fx_, const float fy_, const float cx, const float cy)
+{
+	w = width;
+	h = height;
+	fx = fx_;
+	fy = fy_;
+	rayX.resize(w);
+	rayY.resize(h);
+	for (int32_t x=0; x<w; x++)
+		rayX[x] = (x - cx) / fx;
+	for (int32_t y=0; y<h; y++)
+		rayY[y] = (cy - y) / fy;
+}
+
+void DepthProjector::setFieldOfView(const int32_t width, const int32_t height, const float hfov, const float vfov)
+{
+	setIntrinsics(width, height, width / (2.f*tanf(hfov/2.f)), height / (2.f*tanf(vfov/2.f)), width/2, height/2);
+}
+
+void DepthProjector::project(const uint16_t *depth, RoboCompRGBD::PointXYZ *points, float *depthOut) const
+{
+	const float *rx = rayX.data();
+	#pragma omp parallel for schedule(static)
+	for (int32_t y=0; y<h; y++)
+	{
+		const uint16_t *d = depth + int64_t(y)*w;
+		RoboCompRGBD::PointXYZ *p = points + int64_t(y)*w;
+		float *o = depthOut + int64_t(y)*w;
+		const float ry = rayY[y];
+		#pragma omp simd
+		for (int32_t x=0; x<w; x++)
+		{
+			// Missing depth (0) gives NaN, which propagates to every component
+			const float z = d[x];
+			const float s = d[x] != 0 ? z : NAN;
+			o[x] = z;
+			p[x].x = s*rx[x];
+			p[x].y = s*ry;
+			p[x].z = s;
+			p[x].w = s*0.f + 1.f;
+		}
+	}
+}
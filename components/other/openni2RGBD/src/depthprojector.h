@@ -0,0 +1,61 @@
+/*
+ *    Copyright (C) 2020 by RoboLab - University of Extremadura
+ *
+ *    This file is part of RoboComp
+ *
+ *    RoboComp is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    RoboComp is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with RoboComp.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef DEPTHPROJECTOR_H
+#define DEPTHPROJECTOR_H
+
+#include <stdint.h>
+#include <vector>
+#include <RGBD.h>
+
+/**
+* \brief Projects depth images into 3D points with the camera intrinsics.
+*
+* The rays of the pinhole model are tabulated once per resolution, divided by
+* the focal length and scaled to z=1, so a point is just depth times ray. The
+* model has no distortion, so the x component only depends on the column and
+* the y component on the row. Rows are processed in parallel with OpenMP.
+*/
+class DepthProjector
+{
+public:
+	DepthProjector();
+
+	/// fx, fy, cx, cy in pixels
+	void setIntrinsics(const int32_t width, const int32_t height, const float fx, const float fy, const float cx, const float cy);
+	/// Pinhole intrinsics of a camera given by its field of view (radians), centred principal point
+	void setFieldOfView(const int32_t width, const int32_t height, const float hfov, const float vfov);
+
+	int32_t width() const { return w; }
+	int32_t height() const { return h; }
+	float focalX() const { return fx; }
+	float focalY() const { return fy; }
+
+	/**
+	* \brief Fills width*height points and depth values from a depth image in millimetres
+	* Pixels without depth give NaN points.
+	*/
+	void project(const uint16_t *depth, RoboCompRGBD::PointXYZ *points, float *depthOut) const;
+
+private:
+	int32_t w, h;
+	float fx, fy;
+	std::vector<float> rayX, rayY;
+};
+
+#endif
@@ -0,0 +1,145 @@
+/*
+ *    Copyright (C) 2020 by RoboLab - University of Extremadura
+ *
+ *    This file is part of RoboComp
+ *
+ *    RoboComp is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    RoboComp is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with RoboComp.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "depthprojector.h"
+
+// Time per frame of DepthProjector::project against the former per-pixel loop
+// of computeCoordinates, at QVGA, VGA and 720p, on synthetic depth with 20% of
+// the pixels missing. Both use the former 574 px focal length and centred
+// principal point, so their points must match.
+//   depthprojector_bench [frames] [width height ...]
+// Returns 1 if a point differs by more than 1e-3 mm or only one of them is NaN.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include "depthprojector.h"
+
+using namespace RoboCompRGBD;
+
+static double now()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/// The loop computeCoordinates ran on every frame before DepthProjector
+static void formerLoop(uint16_t *pixDepth, std::vector<float> &depthBuff, std::vector<PointXYZ> &pointsBuff, const int IMAGE_WIDTH, const int IMAGE_HEIGHT)
+{
+	static const float flength_x = 574;
+	static const float flength_y = 574;
+	for( int y=0 ; y<IMAGE_HEIGHT ; y++ )
+	{
+		for( int x=0 ; x<IMAGE_WIDTH ; x++ )
+		{
+			const int offset = y*IMAGE_WIDTH + x;
+			pixDepth[offset]*=1;
+			depthBuff[offset] = pixDepth[offset];
+			const float z = float(pixDepth[offset]);
+			if( z < 0.1 )
+			{
+				pointsBuff[offset].x = NAN;
+				pointsBuff[offset].y = NAN;
+				pointsBuff[offset].z = NAN;
+				pointsBuff[offset].w = NAN;
+			}
+			else
+			{
+				pointsBuff[offset].x = z * (x - IMAGE_WIDTH/2) / flength_x;
+				pointsBuff[offset].y = z * (IMAGE_HEIGHT/2- y) / flength_y;
+				pointsBuff[offset].z = z;
+				pointsBuff[offset].w = 1.0;
+			}
+		}
+	}
+}
+
+static void stats(std::vector<double> v, double &mean, double &p99)
+{
+	std::sort(v.begin(), v.end());
+	mean = 0;
+	for (double x : v)
+		mean += x;
+	mean /= v.size();
+	p99 = v[std::min(v.size()-1, size_t(0.99*v.size()))];
+}
+
+int main(int argc, char **argv)
+{
+	const int frames = argc > 1 ? atoi(argv[1]) : 200;
+	std::vector<int> sizes;
+	for (int i=2; i+1<argc; i+=2)
+	{
+		sizes.push_back(atoi(argv[i]));
+		sizes.push_back(atoi(argv[i+1]));
+	}
+	if (sizes.empty())
+		sizes = {320, 240, 640, 480, 1280, 720};
+
+	bool match = true;
+	printf("%d frames per resolution\n", frames);
+	printf("%-10s %14s %14s %14s %14s %10s %12s\n", "size", "former [ms]", "former p99", "project [ms]", "project p99", "speedup", "max err [mm]");
+	for (size_t s=0; s+1<sizes.size(); s+=2)
+	{
+		const int W = sizes[s], H = sizes[s+1];
+		std::mt19937 rng(38);
+		std::vector<uint16_t> depth(W*H);
+		for (auto &d : depth)
+			d = rng()%5 == 0 ? 0 : 500 + rng()%4000;
+		std::vector<float> formerDepth(W*H), newDepth(W*H);
+		std::vector<PointXYZ> formerPoints(W*H), newPoints(W*H);
+		DepthProjector projector;
+		projector.setIntrinsics(W, H, 574, 574, W/2, H/2);
+
+		std::vector<double> tFormer, tNew;
+		for (int f=0; f<frames; f++)
+		{
+			double t = now();
+			formerLoop(depth.data(), formerDepth, formerPoints, W, H);
+			tFormer.push_back(now() - t);
+			t = now();
+			projector.project(depth.data(), newPoints.data(), newDepth.data());
+			tNew.push_back(now() - t);
+		}
+
+		double error = 0;
+		for (int i=0; i<W*H; i++)
+		{
+			const PointXYZ &a = formerPoints[i], &b = newPoints[i];
+			if (std::isnan(a.x) != std::isnan(b.x) or std::isnan(a.z) != std::isnan(b.z) or formerDepth[i] != newDepth[i])
+				error = INFINITY;
+			else if (not std::isnan(a.x))
+				error = std::max(error, double(std::max(std::max(fabsf(a.x-b.x), fabsf(a.y-b.y)), std::max(fabsf(a.z-b.z), fabsf(a.w-b.w)))));
+		}
+		match = match and error <= 1e-3;
+
+		double meanFormer, p99Former, meanNew, p99New;
+		stats(tFormer, meanFormer, p99Former);
+		stats(tNew, meanNew, p99New);
+		char size[16];
+		snprintf(size, sizeof(size), "%dx%d", W, H);
+		printf("%-10s %14.3f %14.3f %14.3f %14.3f %10.2f %12.2e\n", size, 1e3*meanFormer, 1e3*p99Former, 1e3*meanNew, 1e3*p99New,
+		       meanFormer/meanNew, error);
+		fflush(stdout);
+	}
+	return match ? 0 : 1;
+}
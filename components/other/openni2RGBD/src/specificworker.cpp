@@ -139,9 +139,7 @@ void SpecificWorker::getData(imgType& rgbMatrix, depthType& distanceMatrix, Robo
 	RGBMutex->lock();
 	rgbMatrix=*colorImage;
 	RGBMutex->unlock();
-	depthMutex->lock();
-	distanceMatrix=*depthImage;
-	depthMutex->unlock();
+	depthBuff.copy(distanceMatrix);
 
 }
 
@@ -378,8 +376,9 @@ void SpecificWorker::initializeStreams()
 	pointsBuff.resize(IMAGE_WIDTH*IMAGE_HEIGHT);
 	depthBuff.resize(IMAGE_WIDTH*IMAGE_HEIGHT);
 
-	depthBuffer = new vector<float>(IMAGE_WIDTH*IMAGE_HEIGHT);
-	depthImage = new vector<float>(IMAGE_WIDTH*IMAGE_HEIGHT);
+	projector.setFieldOfView(IMAGE_WIDTH, IMAGE_HEIGHT, depth.getHorizontalFieldOfView(), depth.getVerticalFieldOfView());
+	printf("Using depth focal length: %f x %f\n", projector.focalX(), projector.focalY());
+
 	colorImage = new vector<Ice::Byte>(IMAGE_WIDTH*IMAGE_HEIGHT*3); //x3 para RGB888Pixel
 	//initializeStreams();
 
@@ -479,23 +478,7 @@ void SpecificWorker::readDepth()
 		return;
 	}
 	
-	//pixDepth = (openni::DepthPixel *) depthFrame.getData();
-	/**
-	openni::DepthPixel * myPixDepth = (openni::DepthPixel *) depthFrame.getData();
-	
-	depthMutex->lock();
-	memcpy(&depthImage->operator[](0),myPixDepth,IMAGE_HEIGHT*IMAGE_WIDTH);
-
-	depthMutex->unlock();
-	**/
 	pixDepth = (DepthPixel*)depthFrame.getData();
-	///¿PUEDE HACERSE CON MEMCPY? DISTINTOS TIPOS... (short, float). Creo que NO
-	//memcpy(&depthBuffer->operator[](0),pixDepth,IMAGE_WIDTH*IMAGE_HEIGHT*sizeof(float));	//ESTO SUSTITUIRÍA AL FOR DE DEBAJO
-	for(int i=0;i<IMAGE_WIDTH*IMAGE_HEIGHT;i++) depthBuffer->operator[](i)=pixDepth[i];
-	depthMutex->lock();
-	depthImage=depthBuffer;
-	//memcpy(&depthImage->operator[](0),&depthBuffer->operator[](0),IMAGE_WIDTH*IMAGE_HEIGHT*sizeof(float)); //ESTO SUSTITUIRÍA AL = DE ARRIBA
-	depthMutex->unlock();
 }
 
 void SpecificWorker::readColor()
@@ -526,54 +509,19 @@ void SpecificWorker::readColor()
 
 }
 
+/**
+* \brief Projects the last depth frame straight into the writer side of the point and depth buffers
+*/
 void SpecificWorker::computeCoordinates()
 {
-	//QMutexLocker l(pointsMutex); 57.00 43.00
-	//static const float fovW = 57;
-	//static const float fovH = 43;
-	// focal: 522 sale abierto
-	static const float flength_x = 574;//device.getDepthFocalLength(640);//545;// IMAGE_WIDTH / (2.f * tan( fovW / 2.0 ) );
-	static const float flength_y = 574;//device.getDepthFocalLength(640);//545;// IMAGE_HEIGHT / (2.f * tan( fovH / 2.0 ) );
-// 	printf("%dx%d %f %f\n", IMAGE_WIDTH, IMAGE_HEIGHT, flength_x, flength_y);
-	//#pragma omp for schedule(static, 5)
-	for( int y=0 ; y<IMAGE_HEIGHT ; y++ )
-	{
-		for( int x=0 ; x<IMAGE_WIDTH ; x++ )
-		{
-			const int offset = y*IMAGE_WIDTH + x;
-
-			//Copy to depth doublebuffer
-			pixDepth[offset]*=1;
-			depthBuff[offset] = pixDepth[offset];
-
-			const float z = float(pixDepth[offset]);
-
-			if( z < 0.1 )
-			{
-				//pixDepth[offset] = 8;
-				pointsBuff[offset].x = NAN;
-				pointsBuff[offset].y = NAN;
-				pointsBuff[offset].z = NAN;
-				pointsBuff[offset].w = NAN;
-			}
-			else
-			{
-				//(*depthImage)[offset] = z;
-				pointsBuff[offset].x = z * (x - IMAGE_WIDTH/2) / flength_x;
-				pointsBuff[offset].y = z * (IMAGE_HEIGHT/2- y) / flength_y;
-				pointsBuff[offset].z = z;
-				pointsBuff[offset].w = 1.0;
-			}
-		}
-
-	}
+	projector.project(pixDepth, &(*pointsBuff.getWriter())[0], &(*depthBuff.getWriter())[0]);
 }
 
 void SpecificWorker::normalizeDepth()
 {
 	for (int i=0; i<(IMAGE_HEIGHT*IMAGE_WIDTH); i++)
 	{
-		normalDepth[i]=(255.-(255.*float(depthBuffer->operator[](i))/1000.));
+		normalDepth[i]=(255.-(255.*float(pixDepth[i])/1000.));
 		if (normalDepth[i] > 255) normalDepth[i] = 255;
 		if (normalDepth[i] < 0) normalDepth[i] = 0;
 	}
@@ -586,9 +534,6 @@ void SpecificWorker::closeStreams()
 	device.close();
 	OpenNI::shutdown();
 
-	delete depthBuffer;
-
-	delete depthImage;
 	delete colorImage;
 
 	delete usersMutex;
@@ -20,6 +20,7 @@
 #define SPECIFICWORKER_H
 
 #include <genericworker.h>
+#include <depthprojector.h>
 #include <OpenNI.h>
 #include <PS1080.h>
 #include <map>
@@ -102,10 +103,8 @@ Q_OBJECT
 	VideoStream* pStream;
 	int changedStreamDummy;
 	DepthPixel* pixDepth;
-	RoboCompRGBD::DepthSeq* depthBuffer;
 	RoboCompRGBD::ColorSeq* colorBuffer;
 	imgType* colorImage;
-	depthType* depthImage;
 	
 	///MUTEX
 	QMutex *usersMutex, *RGBMutex, *depthMutex, *pointsMutex, *bStateMutex, *mStateMutex;
@@ -119,6 +118,7 @@ Q_OBJECT
 	
 	DoubleBuffer<RoboCompRGBD::PointSeq> pointsBuff;
 	DoubleBuffer<RoboCompRGBD::DepthSeq> depthBuff;
+	DepthProjector projector;
 	
 	RoboCompGenericBase::TBaseState bState;
 	RoboCompJointMotor::MotorStateMap mState;
@@ -0,0 +1,114 @@
+//========================================================================
+//  This software is free: you can redistribute it and/or modify
+//  it under the terms of the GNU Lesser General Public License Version 3,
+//  as published by the Free Software Foundation.
+//
+//  This software is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public License
+//  Version 3 in the file COPYING that came with this distribution.
+//  If not, see <http://www.gnu.org/licenses/>.
+//========================================================================
+/*!
+\file    atlas_bench.cpp
+\brief   Startup time and memory of the localization with the atlas loaded
+         eagerly or lazily, and the cycle times while it moves through the
+         maps of the atlas
+*/
+//========================================================================
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <vector>
+
+#include "vectorparticlefilter.h"
+#include "timer.h"
+
+using namespace std;
+
+/// Resident memory of the process now, in MB
+double residentMB()
+{
+  FILE* fid = fopen("/proc/self/status","r");
+  if(fid==NULL)
+    return 0.0;
+  char line[256];
+  long kb = 0;
+  while(fgets(line, sizeof(line), fid)!=NULL){
+    if(sscanf(line, "VmRSS: %ld", &kb)==1)
+      break;
+  }
+  fclose(fid);
+  return kb/1024.0;
+}
+
+/// Peak resident memory of the process, in MB
+double peakResidentMB()
+{
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss/1024.0;
+}
+
+int main(int argc, char** argv)
+{
+  if(argc<3){
+    printf("usage: atlas_bench <maps folder> <eager|lazy> [memory budget MB] [cycles per map] [particles]\n");
+    return 1;
+  }
+  bool lazy = (strcmp(argv[2],"lazy")==0);
+  double budget = (argc>3)? atof(argv[3]) : 0.0;
+  int cyclesPerMap = (argc>4)? atoi(argv[4]) : 50;
+  int numParticles = (argc>5)? atoi(argv[5]) : 100;
+
+  VectorLocalization2D::MotionModelParams motionParams;
+  motionParams.Alpha1 = 0.5;
+  motionParams.Alpha2 = RAD(25.0);
+  motionParams.Alpha3 = 0.5;
+  motionParams.kernelSize = 5;
+
+  double startRSS = residentMB();
+  double t = GetTimeSec();
+  VectorLocalization2D localization(argv[1], lazy, size_t(budget*1024.0*1024.0));
+  if(localization.atlas.size()<1){
+    printf("No maps in the atlas of %s\n", argv[1]);
+    return 1;
+  }
+  localization.initialize(numParticles, localization.atlas.mapName(0).c_str(), vector2f(0.0,0.0), 0.0, 0.3, RAD(5.0));
+  double startup = GetTimeSec()-t;
+  printf("\n%s atlas of %d maps, budget %.0f MB\n", lazy? "Lazy" : "Eager", localization.atlas.size(), budget);
+  printf("startup %.1f ms, RSS %.1f MB (%.1f MB over the process), maps %.1f MB in %d loaded\n", 1e3*startup, residentMB(),
+         residentMB()-startRSS, localization.atlas.memoryUsage()/1048576.0, int(localization.atlas.loadedMaps().size()));
+
+  //Goes through the maps in turn: each switch is asked for, and is made by a later cycle once the map is in
+  printf("%-12s %10s %12s %12s %12s %10s\n", "map", "cycles", "switch [ms]", "cycle [ms]", "max [ms]", "maps [MB]");
+  for(int i=1; i<=localization.atlas.size(); i++){
+    const char* name = localization.atlas.mapName(i%localization.atlas.size()).c_str();
+    double requested = GetTimeSec();
+    localization.setLocation(vector2f(0.0,0.0), 0.0, name, 0.3, RAD(5.0));
+    double switched = -1.0, total = 0.0, maxCycle = 0.0;
+    int cycles = 0;
+    while(cycles<cyclesPerMap || switched<0.0){
+      double c = GetTimeSec();
+      localization.predict(0.01, 0.0, RAD(0.1), motionParams);
+      c = GetTimeSec()-c;
+      total += c;
+      maxCycle = max(maxCycle, c);
+      cycles++;
+      if(switched<0.0 && strcmp(localization.getCurrentMapName(), name)==0)
+        switched = GetTimeSec()-requested;
+      //The rest of a cycle, for the loader to run
+      Sleep(0.001);
+    }
+    printf("%-12s %10d %12.1f %12.3f %12.3f %10.1f\n", name, cycles, 1e3*switched, 1e3*total/cycles, 1e3*maxCycle,
+           localization.atlas.memoryUsage()/1048576.0);
+    fflush(stdout);
+  }
+  printf("RSS %.1f MB, peak %.1f MB\n", residentMB(), peakResidentMB());
+  return 0;
+}
@@ -0,0 +1,270 @@
+//========================================================================
+//  This software is free: you can redistribute it and/or modify
+//  it under the terms of the GNU Lesser General Public License Version 3,
+//  as published by the Free Software Foundation.
+//
+//  This software is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public License
+//  Version 3 in the file COPYING that came with this distribution.
+//  If not, see <http://www.gnu.org/licenses/>.
+//========================================================================
+/*!
+\file    kld_bench.cpp
+\brief   Replays a simulated run through a map with fixed particle counts
+         and with KLD resampling, for the cycle time and the error
+*/
+//========================================================================
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include "vectorparticlefilter.h"
+#include "timer.h"
+
+using namespace std;
+
+// Noise of the simulated laser and odometry
+static const float RangeStdDev = 0.02;
+static const float OdometryTransStdDev = 0.05;
+static const float OdometryAngleStdDev = 0.05;
+
+struct Step{
+  float dx, dy, dtheta;
+  vector2f loc;
+  float angle;
+  vector<float> scan;
+};
+
+struct Result{
+  double cycleTime;
+  double maxCycleTime;
+  double meanParticles;
+  int maxParticles;
+  double meanError, lateError;
+  double meanAngleError;
+};
+
+/// The parameters of etc/localization_parameters.cfg
+void setParams(VectorLocalization2D::MotionModelParams &motionParams, VectorLocalization2D::LidarParams &lidarParams)
+{
+  motionParams.Alpha1 = 0.5;
+  motionParams.Alpha2 = RAD(25.0);
+  motionParams.Alpha3 = 0.5;
+  motionParams.kernelSize = 5;
+
+  lidarParams.angleResolution = RAD(180.0/720.0);
+  lidarParams.numRays = 720;
+  lidarParams.minAngle = -0.5*(lidarParams.numRays-1)*lidarParams.angleResolution;
+  lidarParams.maxAngle = lidarParams.minAngle + (lidarParams.numRays-0.5)*lidarParams.angleResolution;
+  lidarParams.maxRange = 30.0;
+  lidarParams.minRange = 0.025;
+  lidarParams.laserToBaseTrans = Vector2f(0.0,0.0);
+  lidarParams.laserToBaseRot = Matrix2f::Identity();
+  lidarParams.correlationFactor = 1.0/80000.0;
+  lidarParams.logShortHitProb = -sq(1.5/0.03);
+  lidarParams.lidarStdDev = sq(0.03);
+  lidarParams.logObstacleProb = -sq(0.8/0.03);
+  lidarParams.logOutOfRangeProb = -sq(4.0/0.03);
+  lidarParams.kernelSize = 5.0;
+  lidarParams.minPoints = 10;
+  lidarParams.numSteps = 3;
+  lidarParams.correspondenceMargin = 0.1;
+  lidarParams.etaAngle = 4*0.05;
+  lidarParams.etaLoc = 4*0.1;
+  lidarParams.maxAngleGradient = RAD(10.0);
+  lidarParams.maxLocGradient = 0.1;
+  lidarParams.minCosAngleError = cos(RAD(30.0));
+  lidarParams.attractorRange = 0.5;
+  lidarParams.minRefineFraction = 0.001;
+  lidarParams.initialize();
+}
+
+/// Ranges seen from loc, angle with the rays of lidarParams
+vector<float> simulateScan(VectorMap &map, vector2f loc, float angle, const VectorLocalization2D::LidarParams &lidarParams)
+{
+  int n = lidarParams.numRays;
+  float da = lidarParams.angleResolution;
+  //getRayCast casts one ray less than asked for, centered on angle
+  vector<float> scan = map.getRayCast(loc, angle + 0.5*da, da, n+1, lidarParams.minRange, lidarParams.maxRange);
+  scan.resize(n, lidarParams.maxRange);
+  for(int i=0; i<n; i++){
+    if(scan[i]<lidarParams.maxRange)
+      scan[i] = max(lidarParams.minRange, scan[i] + randn(RangeStdDev, 0.0f));
+  }
+  return scan;
+}
+
+/// A random walk through the free space of the map: forward, and turning away from walls
+vector<Step> simulateRun(VectorMap &map, int numSteps, const VectorLocalization2D::LidarParams &lidarParams)
+{
+  //A start with walls on every side, at least 0.5m away; no steps if none is found
+  const int maxAttempts = 10000;
+  vector2f loc;
+  float angle = 0.0;
+  vector<Step> steps;
+  int attempt = 0;
+  for(; attempt<maxAttempts; attempt++){
+    loc.set(frand(map.minX, map.maxX), frand(map.minY, map.maxY));
+    angle = frand(-M_PI, M_PI);
+    vector<float> around = map.getRayCast(loc, angle, RAD(1.0), 361, 0.0, 30.0);
+    float nearest = *min_element(around.begin(), around.end());
+    float furthest = *max_element(around.begin(), around.end());
+    if(nearest>0.5 && furthest<30.0)
+      break;
+  }
+  if(attempt==maxAttempts)
+    return steps;
+  for(int i=0; i<numSteps; i++){
+    float dtheta = randn(float(RAD(2.0)), 0.0f);
+    vector<float> ahead = map.getRayCast(loc, angle+dtheta, RAD(5.0), 13, 0.0, 30.0);
+    if(*min_element(ahead.begin(), ahead.end())<1.0)
+      dtheta += RAD(30.0)*((frand(0.0,1.0)<0.5)? -1.0 : 1.0);
+    float dx = 0.1;
+    angle = angle_mod(angle+dtheta);
+    vector2f delta = vector2f(dx, 0.0).rotate(angle);
+    vector<float> check = map.getRayCast(loc, angle, RAD(1.0), 3, 0.0, 30.0);
+    if(*min_element(check.begin(), check.end())<0.3){
+      dx = 0.0;
+      delta.zero();
+    }
+    loc += delta;
+    Step step;
+    step.dx = dx + randn(OdometryTransStdDev*dx, 0.0f);
+    step.dy = 0.0;
+    step.dtheta = dtheta + randn(float(OdometryAngleStdDev*fabs(dtheta) + RAD(0.1)), 0.0f);
+    step.loc = loc;
+    step.angle = angle;
+    step.scan = simulateScan(map, loc, angle, lidarParams);
+    steps.push_back(step);
+  }
+  return steps;
+}
+
+Result replay(VectorLocalization2D &localization, const char* mapName, const vector<Step> &steps, int numParticles, bool useKLD,
+              const VectorLocalization2D::KLDParams &kldParams, VectorLocalization2D::MotionModelParams &motionParams,
+              VectorLocalization2D::LidarParams &lidarParams, float locUncertainty, float angleUncertainty, unsigned int seed)
+{
+  srand(seed);
+  localization.setKLDParams(kldParams);
+  localization.initialize(numParticles, mapName, steps[0].loc, steps[0].angle, locUncertainty, angleUncertainty);
+  Result r;
+  r.cycleTime = r.maxCycleTime = r.meanParticles = r.meanError = r.lateError = r.meanAngleError = 0.0;
+  r.maxParticles = 0;
+  int numLate = 0;
+  for(unsigned int i=1; i<steps.size(); i++){
+    const Step &step = steps[i];
+    for(int j=0; j<lidarParams.numRays; j++)
+      lidarParams.laserScan[j] = step.scan[j];
+    double t = GetTimeSec();
+    localization.predict(step.dx, step.dy, step.dtheta, motionParams);
+    localization.refineLidar(lidarParams);
+    localization.updateLidar(lidarParams, motionParams);
+    localization.resample(useKLD? VectorLocalization2D::KLDResampling : VectorLocalization2D::LowVarianceResampling);
+    vector2f loc;
+    float angle;
+    localization.computeLocation(loc, angle);
+    t = GetTimeSec() - t;
+    r.cycleTime += t;
+    r.maxCycleTime = max(r.maxCycleTime, t);
+    r.meanParticles += localization.getNumParticles();
+    r.maxParticles = max(r.maxParticles, localization.getNumParticles());
+    float error = (loc-step.loc).length();
+    r.meanError += error;
+    r.meanAngleError += fabs(angle_diff(angle, step.angle));
+    if(i>=steps.size()/2){
+      r.lateError += error;
+      numLate++;
+    }
+  }
+  int n = steps.size()-1;
+  r.cycleTime /= n;
+  r.meanParticles /= n;
+  r.meanError /= n;
+  r.meanAngleError /= n;
+  r.lateError /= numLate;
+  return r;
+}
+
+int main(int argc, char** argv)
+{
+  int numSteps = (argc>3)? atoi(argv[3]) : 200;
+  int numRuns = (argc>4)? atoi(argv[4]) : 3;
+  if(argc<3 || numSteps<1 || numRuns<1){
+    printf("usage: kld_bench <maps folder> <map name in the atlas> [steps] [runs] [fixed counts...]\n");
+    return 1;
+  }
+  vector<int> counts;
+  for(int i=5; i<argc; i++)
+    counts.push_back(atoi(argv[i]));
+  if(counts.empty()){
+    counts.push_back(20);
+    counts.push_back(30);
+    counts.push_back(40);
+    counts.push_back(60);
+  }
+
+  VectorLocalization2D localization(argv[1]);
+  int mapIndex = localization.atlas.find(argv[2]);
+  shared_ptr<VectorMap> map;
+  if(mapIndex>=0)
+    map = localization.atlas.get(mapIndex);
+  if(!map || map->lines.size()<1){
+    printf("Map %s not in the atlas of %s\n", argv[2], argv[1]);
+    return 1;
+  }
+
+  VectorLocalization2D::MotionModelParams motionParams;
+  VectorLocalization2D::LidarParams lidarParams;
+  setParams(motionParams, lidarParams);
+  VectorLocalization2D::KLDParams kldParams;
+  kldParams.binSize = 2.0;
+  kldParams.binAngle = RAD(30.0);
+  kldParams.epsilon = 0.2;
+  kldParams.delta = 0.01;
+  kldParams.minParticles = counts[0];
+  kldParams.maxParticles = counts.back();
+
+  //Starts with the uncertainty of a fresh initial pose, so the particles begin spread out
+  const float locUncertainty = 1.0;
+  const float angleUncertainty = RAD(20.0);
+
+  printf("%s, %d runs of %d steps; KLD from %d to %d particles\n", argv[2], numRuns, numSteps, kldParams.minParticles, kldParams.maxParticles);
+  printf("%-12s %10s %10s %10s %10s %12s %12s %12s\n", "particles", "mean", "max", "cycle [ms]", "max [ms]", "error [m]", "late [m]", "angle [deg]");
+  for(int k=0; k<=int(counts.size()); k++){
+    bool useKLD = (k==int(counts.size()));
+    int numParticles = useKLD? kldParams.maxParticles : counts[k];
+    Result total;
+    memset(&total, 0, sizeof(total));
+    for(int run=0; run<numRuns; run++){
+      srand(1000+run);
+      vector<Step> steps = simulateRun(*map, numSteps, lidarParams);
+      if(steps.empty()){
+        printf("No start in %s with walls on every side within 30m\n", argv[2]);
+        return 1;
+      }
+      Result r = replay(localization, argv[2], steps, numParticles, useKLD, kldParams, motionParams, lidarParams, locUncertainty, angleUncertainty, 2000+run);
+      total.cycleTime += r.cycleTime/numRuns;
+      total.maxCycleTime = max(total.maxCycleTime, r.maxCycleTime);
+      total.meanParticles += r.meanParticles/numRuns;
+      total.maxParticles = max(total.maxParticles, r.maxParticles);
+      total.meanError += r.meanError/numRuns;
+      total.lateError += r.lateError/numRuns;
+      total.meanAngleError += r.meanAngleError/numRuns;
+    }
+    char name[64];
+    if(useKLD)
+      snprintf(name, sizeof(name), "KLD");
+    else
+      snprintf(name, sizeof(name), "%d", counts[k]);
+    printf("%-12s %10.1f %10d %10.2f %10.2f %12.3f %12.3f %12.2f\n", name, total.meanParticles, total.maxParticles,
+           1e3*total.cycleTime, 1e3*total.maxCycleTime, total.meanError, total.lateError, DEG(total.meanAngleError));
+    fflush(stdout);
+  }
+  return 0;
+}
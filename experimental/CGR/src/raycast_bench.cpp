@@ -0,0 +1,206 @@
+//========================================================================
+//  This software is free: you can redistribute it and/or modify
+//  it under the terms of the GNU Lesser General Public License Version 3,
+//  as published by the Free Software Foundation.
+//
+//  This software is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public License
+//  Version 3 in the file COPYING that came with this distribution.
+//  If not, see <http://www.gnu.org/licenses/>.
+//========================================================================
+/*!
+\file    raycast_bench.cpp
+\brief   Compares the ray casts of a map through its line grid, through
+         its pre-render, and through the scene lines of every ray
+*/
+//========================================================================
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include "vector_map.h"
+#include "timer.h"
+
+using namespace std;
+
+// The laser of localization_parameters.cfg
+static const int NumRays = 720;
+static const float AngleResolution = RAD(0.25);
+static const float MinRange = 0.025;
+static const float MaxRange = 30.0;
+
+/// getSceneLines over all the lines of the map, as it was before the line grid
+vector<int> legacySceneLines(VectorMap &map, vector2f loc, float maxRange)
+{
+  static const float eps = 1e-6;
+  vector<int> linesList, sceneLines;
+  vector<line2f> tmpList;
+  for(unsigned int i=0; i<map.lines.size(); i++){
+    if(map.lines[i].closestDistFromLine(loc, true)<maxRange)
+      linesList.push_back(i);
+  }
+  for(unsigned int i=0; i<linesList.size(); i++){
+    line2f curLine = map.lines[linesList[i]];
+    for(unsigned int j=0;j<linesList.size() && curLine.Length()>=eps; j++){
+      if(i==j || map.lines[linesList[j]].Length()<eps)
+        continue;
+      map.trimOcclusion(loc, map.lines[linesList[j]], curLine, tmpList);
+    }
+    if(curLine.Length()>eps)
+      sceneLines.push_back(linesList[i]);
+  }
+  return sceneLines;
+}
+
+/// getRayCast without a pre-render, as it was before the line grid: the scene lines once per ray
+vector<float> legacyRayCast(VectorMap &map, vector2f loc, float angle)
+{
+  float a0 = angle - 0.5*(NumRays-1.0)*AngleResolution;
+  float a1 = angle + 0.5*(NumRays-1.0)*AngleResolution;
+  vector<float> rayCast;
+  for(float a=a0; a<a1; a += AngleResolution){
+    float ray = MaxRange;
+    vector<int> sceneLines = legacySceneLines(map, loc, MaxRange);
+    for(unsigned int i=0; i<sceneLines.size(); i++){
+      if(map.lines[sceneLines[i]].intersects(loc,a))
+        ray = min(ray, map.lines[sceneLines[i]].distFromLine1(loc, a, false));
+    }
+    rayCast.push_back(ray);
+  }
+  return rayCast;
+}
+
+/// Nearest hit of every ray over all the lines of the map, the reference
+vector<float> exhaustiveRayCast(VectorMap &map, vector2f loc, float angle)
+{
+  float a0 = angle - 0.5*(NumRays-1.0)*AngleResolution;
+  float a1 = angle + 0.5*(NumRays-1.0)*AngleResolution;
+  vector<float> rayCast;
+  for(float a=a0; a<a1; a += AngleResolution){
+    float ray = MaxRange;
+    for(unsigned int i=0; i<map.lines.size(); i++){
+      if(map.lines[i].intersects(loc,a))
+        ray = min(ray, map.lines[i].distFromLine1(loc, a, false));
+    }
+    rayCast.push_back(ray);
+  }
+  return rayCast;
+}
+
+/// Rays whose ranges differ by more than 1mm
+int countDifferent(const vector<float> &r1, const vector<float> &r2)
+{
+  int n = 0;
+  for(unsigned int i=0; i<r1.size() && i<r2.size(); i++){
+    if(!(fabs(r1[i]-r2[i])<=0.001))
+      n++;
+  }
+  return n + abs(int(r1.size())-int(r2.size()));
+}
+
+int countDifferent(const vector<int> &c1, const vector<int> &c2)
+{
+  int n = 0;
+  for(unsigned int i=0; i<c1.size() && i<c2.size(); i++){
+    if(c1[i]!=c2[i])
+      n++;
+  }
+  return n + abs(int(c1.size())-int(c2.size()));
+}
+
+int main(int argc, char** argv)
+{
+  if(argc<3){
+    printf("usage: raycast_bench <maps folder> <map name> [poses] [legacy poses]\n");
+    return 1;
+  }
+  int numPoses = (argc>3)? atoi(argv[3]) : 200;
+  int numLegacyPoses = (argc>4)? atoi(argv[4]) : 5;
+
+  VectorMap grid(argv[2], argv[1], false);
+  VectorMap preRender(argv[2], argv[1], true);
+  if(grid.lines.size()<1){
+    printf("Unable to load map %s\n", argv[2]);
+    return 1;
+  }
+  printf("%s: %d lines, line grid %d x %d\n", argv[2], int(grid.lines.size()), grid.lineGridWidth, grid.lineGridHeight);
+
+  //Poses drawn inside the extents of the map, the same for every method
+  srand(1);
+  vector<vector2f> locs;
+  vector<float> angles;
+  for(int i=0; i<numPoses; i++){
+    locs.push_back(vector2f(grid.minX + (grid.maxX-grid.minX)*rand()/float(RAND_MAX), grid.minY + (grid.maxY-grid.minY)*rand()/float(RAND_MAX)));
+    angles.push_back(M_2PI*rand()/float(RAND_MAX) - M_PI);
+  }
+
+  vector<vector<float> > gridCasts(numPoses);
+  double t = GetTimeSec();
+  for(int i=0; i<numPoses; i++)
+    gridCasts[i] = grid.getRayCast(locs[i], angles[i], AngleResolution, NumRays, MinRange, MaxRange);
+  double gridTime = GetTimeSec()-t;
+  int different = 0;
+  t = GetTimeSec();
+  for(int i=0; i<numPoses; i++)
+    different += countDifferent(gridCasts[i], exhaustiveRayCast(grid, locs[i], angles[i]));
+  double exhaustiveTime = GetTimeSec()-t;
+  printf("line grid ray cast:    %10.0f rays/s, %d of %d rays differ from all the lines\n", numPoses*NumRays/gridTime, different, numPoses*NumRays);
+  printf("all the lines:         %10.0f rays/s\n", numPoses*NumRays/exhaustiveTime);
+
+  //Only the time: the ranges follow the pre-render, which is coarser and may be shorter than MaxRange
+  if(preRender.preRenderExists){
+    t = GetTimeSec();
+    for(int i=0; i<numPoses; i++)
+      preRender.getRayCast(locs[i], angles[i], AngleResolution, NumRays, MinRange, MaxRange);
+    double preRenderTime = GetTimeSec()-t;
+    printf("pre-render ray cast:   %10.0f rays/s\n", numPoses*NumRays/preRenderTime);
+  }
+
+  numLegacyPoses = min(numLegacyPoses, numPoses);
+  if(numLegacyPoses>0){
+    int different = 0;
+    t = GetTimeSec();
+    for(int i=0; i<numLegacyPoses; i++)
+      different += countDifferent(gridCasts[i], legacyRayCast(grid, locs[i], angles[i]));
+    double legacyTime = GetTimeSec()-t;
+    printf("per ray scene lines:   %10.0f rays/s, %d of %d rays differ from the line grid\n", numLegacyPoses*NumRays/legacyTime, different, numLegacyPoses*NumRays);
+
+    //The correspondences, against those over the scene lines of the pose and over all the lines
+    vector<int> allLines;
+    for(unsigned int i=0; i<grid.lines.size(); i++)
+      allLines.push_back(i);
+    int differentCorrespondences = 0, differentExhaustive = 0, differentSceneLines = 0;
+    double gridCorrTime = 0.0, legacyCorrTime = 0.0;
+    for(int i=0; i<numLegacyPoses; i++){
+      float a0 = angles[i] - 0.5*(NumRays-1.0)*AngleResolution;
+      float a1 = angles[i] + 0.5*(NumRays-1.0)*AngleResolution;
+      t = GetTimeSec();
+      vector<int> gridCorrespondences = grid.getRayToLineCorrespondences(locs[i], a0, a1, AngleResolution, MinRange, MaxRange);
+      gridCorrTime += GetTimeSec()-t;
+      t = GetTimeSec();
+      vector<int> sceneLines = legacySceneLines(grid, locs[i], MaxRange);
+      vector<int> legacyCorrespondences;
+      for(float a=a0; a<a1; a += AngleResolution)
+        legacyCorrespondences.push_back(grid.getLineCorrespondence(locs[i], a, MinRange, MaxRange, sceneLines));
+      legacyCorrTime += GetTimeSec()-t;
+      differentCorrespondences += countDifferent(gridCorrespondences, legacyCorrespondences);
+      vector<int> exhaustiveCorrespondences;
+      for(float a=a0; a<a1; a += AngleResolution)
+        exhaustiveCorrespondences.push_back(grid.getLineCorrespondence(locs[i], a, MinRange, MaxRange, allLines));
+      differentExhaustive += countDifferent(gridCorrespondences, exhaustiveCorrespondences);
+      if(grid.getSceneLines(locs[i], MaxRange)!=sceneLines)
+        differentSceneLines++;
+    }
+    printf("correspondences:       %10.0f rays/s line grid, %10.0f rays/s scene lines, %d of %d differ\n",
+           numLegacyPoses*NumRays/gridCorrTime, numLegacyPoses*NumRays/legacyCorrTime, differentCorrespondences, numLegacyPoses*NumRays);
+    printf("correspondences over all the lines: %d of %d differ from the line grid\n", differentExhaustive, numLegacyPoses*NumRays);
+    printf("scene lines differ at %d of %d poses\n", differentSceneLines, numLegacyPoses);
+  }
+  return 0;
+}
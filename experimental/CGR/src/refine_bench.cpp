@@ -0,0 +1,190 @@
+//========================================================================
+//  This software is free: you can redistribute it and/or modify
+//  it under the terms of the GNU Lesser General Public License Version 3,
+//  as published by the Free Software Foundation.
+//
+//  This software is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public License
+//  Version 3 in the file COPYING that came with this distribution.
+//  If not, see <http://www.gnu.org/licenses/>.
+//========================================================================
+/*!
+\file    refine_bench.cpp
+\brief   Times the LIDAR refinement of the particles against their number
+         and the number of threads, and checks that the refined particles
+         do not depend on the threads
+*/
+//========================================================================
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include "vectorparticlefilter.h"
+#include "timer.h"
+
+using namespace std;
+
+static const float RangeStdDev = 0.02;
+
+/// The parameters of etc/localization_parameters.cfg
+void setParams(VectorLocalization2D::LidarParams &lidarParams)
+{
+  lidarParams.angleResolution = RAD(180.0/720.0);
+  lidarParams.numRays = 720;
+  lidarParams.minAngle = -0.5*(lidarParams.numRays-1)*lidarParams.angleResolution;
+  lidarParams.maxAngle = lidarParams.minAngle + (lidarParams.numRays-0.5)*lidarParams.angleResolution;
+  lidarParams.maxRange = 30.0;
+  lidarParams.minRange = 0.025;
+  lidarParams.laserToBaseTrans = Vector2f(0.0,0.0);
+  lidarParams.laserToBaseRot = Matrix2f::Identity();
+  lidarParams.correlationFactor = 1.0/80000.0;
+  lidarParams.logShortHitProb = -sq(1.5/0.03);
+  lidarParams.lidarStdDev = sq(0.03);
+  lidarParams.logObstacleProb = -sq(0.8/0.03);
+  lidarParams.logOutOfRangeProb = -sq(4.0/0.03);
+  lidarParams.kernelSize = 5.0;
+  lidarParams.minPoints = 10;
+  lidarParams.numSteps = 3;
+  lidarParams.correspondenceMargin = 0.1;
+  lidarParams.etaAngle = 4*0.05;
+  lidarParams.etaLoc = 4*0.1;
+  lidarParams.maxAngleGradient = RAD(10.0);
+  lidarParams.maxLocGradient = 0.1;
+  lidarParams.minCosAngleError = cos(RAD(30.0));
+  lidarParams.attractorRange = 0.5;
+  lidarParams.minRefineFraction = 0.001;
+  lidarParams.initialize();
+}
+
+/// A pose with walls on every side, at least 0.5m away
+void simulatePose(VectorMap &map, vector2f &loc, float &angle)
+{
+  while(true){
+    loc.set(frand(map.minX, map.maxX), frand(map.minY, map.maxY));
+    angle = frand(-M_PI, M_PI);
+    vector<float> around = map.getRayCast(loc, angle, RAD(1.0), 361, 0.0, 30.0);
+    if(*min_element(around.begin(), around.end())>0.5 && *max_element(around.begin(), around.end())<30.0)
+      return;
+  }
+}
+
+/// Ranges seen from loc, angle with the rays of lidarParams
+void simulateScan(VectorMap &map, vector2f loc, float angle, VectorLocalization2D::LidarParams &lidarParams)
+{
+  int n = lidarParams.numRays;
+  float da = lidarParams.angleResolution;
+  //getRayCast casts one ray less than asked for, centered on angle
+  vector<float> scan = map.getRayCast(loc, angle + 0.5*da, da, n+1, lidarParams.minRange, lidarParams.maxRange);
+  scan.resize(n, lidarParams.maxRange);
+  for(int i=0; i<n; i++){
+    if(scan[i]<lidarParams.maxRange)
+      scan[i] = max(lidarParams.minRange, scan[i] + randn(RangeStdDev, 0.0f));
+    lidarParams.laserScan[i] = scan[i];
+  }
+}
+
+struct Result{
+  double time;
+  vector<Particle2D> particles;
+  double locError, angleError;
+};
+
+/// Refines the same particles reps times, returns the fastest time and the refined particles
+Result refine(VectorLocalization2D &localization, const char* mapName, int numParticles, int numThreads, vector2f loc, float angle,
+              const VectorLocalization2D::LidarParams &lidarParams, int reps)
+{
+  localization.setRefineThreads(numThreads);
+  srand(7);
+  localization.initialize(numParticles, mapName, loc, angle, 0.3, RAD(5.0));
+  Result r;
+  r.time = 1e9;
+  for(int i=0; i<reps; i++){
+    double t = GetTimeSec();
+    localization.refineLidar(lidarParams);
+    r.time = min(r.time, GetTimeSec()-t);
+  }
+  r.particles = localization.particlesRefined;
+  r.locError = r.angleError = 0.0;
+  for(int i=0; i<numParticles; i++){
+    r.locError += (r.particles[i].loc-loc).length()/numParticles;
+    r.angleError += fabs(angle_diff(r.particles[i].angle, angle))/numParticles;
+  }
+  return r;
+}
+
+bool identical(const vector<Particle2D> &p1, const vector<Particle2D> &p2)
+{
+  if(p1.size()!=p2.size())
+    return false;
+  for(unsigned int i=0; i<p1.size(); i++){
+    if(memcmp(&p1[i].loc, &p2[i].loc, sizeof(p1[i].loc))!=0 || memcmp(&p1[i].angle, &p2[i].angle, sizeof(p1[i].angle))!=0)
+      return false;
+  }
+  return true;
+}
+
+int main(int argc, char** argv)
+{
+  if(argc<3){
+    printf("usage: refine_bench <maps folder> <map name in the atlas> [threads] [steps] [reps] [particle counts...]\n");
+    return 1;
+  }
+  int numThreads = (argc>3)? atoi(argv[3]) : 0;
+  int numSteps = (argc>4)? atoi(argv[4]) : 3;
+  int reps = (argc>5)? atoi(argv[5]) : 3;
+  vector<int> counts;
+  for(int i=6; i<argc; i++)
+    counts.push_back(atoi(argv[i]));
+  if(counts.empty()){
+    counts.push_back(100);
+    counts.push_back(250);
+    counts.push_back(500);
+    counts.push_back(1000);
+    counts.push_back(2000);
+  }
+
+  VectorLocalization2D localization(argv[1]);
+  int mapIndex = localization.atlas.find(argv[2]);
+  shared_ptr<VectorMap> map;
+  if(mapIndex>=0)
+    map = localization.atlas.get(mapIndex);
+  if(!map || map->lines.size()<1){
+    printf("Map %s not in the atlas of %s\n", argv[2], argv[1]);
+    return 1;
+  }
+  if(numThreads<=0)
+    numThreads = max(1, int(std::thread::hardware_concurrency()));
+
+  VectorLocalization2D::LidarParams lidarParams;
+  setParams(lidarParams);
+  lidarParams.numSteps = numSteps;
+  VectorLocalization2D::LidarParams toleranceParams = lidarParams;
+  toleranceParams.refineLocTolerance = 0.001;
+  toleranceParams.refineAngleTolerance = RAD(0.05);
+  srand(1);
+  vector2f loc;
+  float angle;
+  simulatePose(*map, loc, angle);
+  //The copy shares the scan
+  simulateScan(*map, loc, angle, lidarParams);
+
+  printf("%s, %d threads, %d reps; %d steps, and with tolerances of %.1fmm %.2f°\n", argv[2], numThreads, reps, lidarParams.numSteps,
+         1e3*toleranceParams.refineLocTolerance, DEG(toleranceParams.refineAngleTolerance));
+  printf("%-10s %12s %12s %12s %10s %12s %12s %12s\n", "particles", "1 thr [ms]", "N thr [ms]", "[us/part.]", "identical", "tol. [ms]", "error [m]", "tol. [m]");
+  for(unsigned int k=0; k<counts.size(); k++){
+    Result serial = refine(localization, argv[2], counts[k], 1, loc, angle, lidarParams, reps);
+    Result parallel = refine(localization, argv[2], counts[k], numThreads, loc, angle, lidarParams, reps);
+    Result tolerance = refine(localization, argv[2], counts[k], numThreads, loc, angle, toleranceParams, reps);
+    printf("%-10d %12.2f %12.2f %12.2f %10s %12.2f %12.4f %12.4f\n", counts[k], 1e3*serial.time, 1e3*parallel.time,
+           1e6*parallel.time/counts[k], identical(serial.particles, parallel.particles)? "yes" : "NO",
+           1e3*tolerance.time, parallel.locError, tolerance.locError);
+    fflush(stdout);
+  }
+  return 0;
+}
@@ -217,6 +217,8 @@ void SpecificWorker::LoadParameters()
     error = error || !c.getReal("minCosAngleError", lidarParams.minCosAngleError);
     error = error || !c.getReal("correspondenceMargin", lidarParams.correspondenceMargin);
     error = error || !c.getReal("minRefineFraction", lidarParams.minRefineFraction);
+    error = error || !c.getReal("refineLocTolerance", lidarParams.refineLocTolerance);
+    error = error || !c.getReal("refineAngleTolerance", lidarParams.refineAngleTolerance);
     
     lidarParams.initialize();
     
@@ -225,6 +227,49 @@ void SpecificWorker::LoadParameters()
       exit(2);
     }
   }
+  
+  {
+    ConfigReader::SubTree c(config,"refineParams");
+    
+    bool error = false;
+    error = error || !c.getInt("numThreads", refineThreads);
+    
+    if(error){
+      printf("Error Loading Refine Parameters!\n");
+      exit(2);
+    }
+  }
+  
+  {
+    ConfigReader::SubTree c(config,"atlasParams");
+    
+    bool error = false;
+    error = error || !c.getBool("lazy", lazyAtlas);
+    error = error || !c.getReal("memoryBudget", atlasMemoryBudget);
+    
+    if(error){
+      printf("Error Loading Atlas Parameters!\n");
+      exit(2);
+    }
+  }
+  
+  {
+    ConfigReader::SubTree c(config,"kldParams");
+    
+    bool error = false;
+    error = error || !c.getBool("enabled", useKLD);
+    error = error || !c.getReal("binSize", kldParams.binSize);
+    error = error || !c.getReal("binAngle", kldParams.binAngle);
+    error = error || !c.getReal("epsilon", kldParams.epsilon);
+    error = error || !c.getReal("delta", kldParams.delta);
+    error = error || !c.getInt("minParticles", kldParams.minParticles);
+    error = error || !c.getInt("maxParticles", kldParams.maxParticles);
+    
+    if(error){
+      printf("Error Loading KLD Parameters!\n");
+      exit(2);
+    }
+  }
 
 
 }
@@ -261,6 +306,9 @@ bool SpecificWorker::setParams(RoboCompCommonBehavior::ParameterList params)
 	printf("Alpha3           : %f\n",motionParams.Alpha3);
 	printf("UsePointCloud    : %d\n",usePointCloud?1:0);
 	printf("UseLIDAR         : %d\n",noLidar?0:1);
+	printf("KLDResampling    : %d\n",useKLD?1:0);
+	printf("RefineThreads    : %d\n",refineThreads);
+	printf("LazyAtlas        : %d\n",lazyAtlas?1:0);
 	printf("Visualizations   : %d\n",debugLevel>=0?1:0);
 	printf("\n");
   
@@ -274,7 +322,9 @@ bool SpecificWorker::setParams(RoboCompCommonBehavior::ParameterList params)
 	//Una vez cargado el innermodel y los parametros, cargamos los mapas con sus lineas y las pintamos.
 
 	string mapsFolder("etc/maps");
-	localization = new VectorLocalization2D(mapsFolder.c_str());
+	localization = new VectorLocalization2D(mapsFolder.c_str(), lazyAtlas, size_t(atlasMemoryBudget*1024.0*1024.0));
+	localization->setKLDParams(kldParams);
+	localization->setRefineThreads(refineThreads);
 	localization->initialize(numParticles,
 	curMapName.c_str(),initialLoc,initialAngle,locUncertainty,angleUncertainty);
 
@@ -329,8 +379,10 @@ void SpecificWorker::compute()
 	
 	localization->refineLidar(lidarParams);
 	localization->updateLidar(lidarParams, motionParams);
-	localization->resample(VectorLocalization2D::LowVarianceResampling);
+	localization->resample(useKLD? VectorLocalization2D::KLDResampling : VectorLocalization2D::LowVarianceResampling);
 	localization->computeLocation(curLoc,curAngle);
+	//A lazy atlas loads the maps when the robot gets to them
+	drawLines();
 // 	if(fabs(bStateOld.correctedX - (-curLoc.y*1000)) > 10 or (fabs(bStateOld.correctedZ - curLoc.x*1000)) > 10 or fabs(bStateOld.correctedAlpha - (-curAngle)) > 0.03)
 	float poseCertainty = cgrCertainty();
 // 	if(poseUncertainty>0.4)
@@ -386,10 +438,12 @@ void SpecificWorker::drawLines()
 	float p0y;
 	float p1x;
 	float p1y;
-	vector<VectorMap> maps = localization->getMaps();
-	int i = 0;
-	for( auto m : maps)
+	for( auto map : localization->atlas.loadedMaps())
 	{
+		const VectorMap &m = *map;
+		if( not drawnMaps.insert(m.mapName).second )
+			continue;
+		int i = 0;
 		for( auto l: m.lines)
 		{
                         p0x =l.p0.x * 1000.f;
@@ -400,7 +454,7 @@ void SpecificWorker::drawLines()
 			QVec n = QVec::vec2(p1y-p0y,p1x-p0x);
 			float width = (QVec::vec2(p1x-p0x,p1y-p0y)).norm2();
                         std::ostringstream oss;
-                        oss << m.mapName << i;                        
+                        oss << m.mapName << "_" << i;
 			InnerModelDraw::addPlane_notExisting(
 			  innerModelViewer,
 			  QString::fromStdString("LINEA_"+oss.str()), "floor",
@@ -415,7 +469,11 @@ void SpecificWorker::drawLines()
 }
 void SpecificWorker::drawParticles()
 {
-	for(uint i = 0; i<localization->particles.size(); ++i)
+	//With KLD resampling there are markers for as many particles as there can be
+	uint numMarkers = localization->particles.size();
+	if(useKLD)
+		numMarkers = max(numMarkers, uint(kldParams.maxParticles));
+	for(uint i = 0; i<numMarkers; ++i)
 	{
 		const QString transf = QString::fromStdString("particle_")+QString::number(i);
 		const QString item = QString::fromStdString("plane_")+QString::number(i);
@@ -438,6 +496,7 @@ void SpecificWorker::drawParticles()
 		{
 			const QString item = QString::fromStdString("laserPoint_")+QString::number(i);
 			const QString transf = QString::fromStdString("laserPointTransf_")+QString::number(i);
+			laserPointTransfs.push_back(transf);
 			InnerModelDraw::addTransform(innerModelViewer,transf,"redTransform");
 			InnerModelDraw::addPlane_notExisting(innerModelViewer, item,transf,QVec::vec3(0,0,0),QVec::vec3(0,1,0),"#FFFFFF",QVec::vec3(50, 50, 50));
 		}
@@ -458,6 +517,14 @@ void SpecificWorker::updateParticles()
 		}
 		i++;
 	}
+	//Markers left over after KLD resampling removed particles go under the estimate
+	for(;; i++)
+	{
+		const QString cadena = QString::fromStdString("particle_")+QString::number(i);
+		if (!innerModelViewer->innerModel->getNode(cadena))
+			break;
+		innerModel->updateTransformValues(cadena, -curLoc.y*1000, 0, curLoc.x*1000, 0, -curAngle, 0, "floor");
+	}
 	innerModel->updateTransformValues("redTransform", -curLoc.y*1000, 0, curLoc.x*1000, 0, -curAngle, 0, "floor");
 }
 
@@ -470,7 +537,7 @@ float SpecificWorker::cgrCertainty()
 	{
 		distTotal += sqrt(pow(curLoc.x - particle.loc.x,2) + pow(curLoc.y - particle.loc.y,2));
 	}
-	float avgDist = distTotal / numParticles;
+	float avgDist = distTotal / localization->particles.size();
 
 	return (avgDist / motionParams.kernelSize);
 }
@@ -521,17 +588,17 @@ void SpecificWorker::updateLaser()
     }
     else
     {
-        int j=0, cont=0;
-        for(auto i : laserData)
-        {
-// 		if(cont>=100 and cont<=668)
-		{
-			const QString transf = QString::fromStdString("laserPointTransf_")+QString::number(cont);
-			lidarParams.laserScan[j] = i.dist/1000.f;
-			innerModel->updateTransformValues(transf, i.dist*sin(i.angle), 0, i.dist*cos(i.angle), 0, 0, 0, "redTransform");
-			j++;
-		}
-		cont++;
+	const int n = laserData.size();
+	laserBuffers.resize(n);
+	for (int i=0; i<n; i++)
+	{
+		lidarParams.laserScan[i] = laserData[i].dist/1000.f;
+		laserBuffers.dist[i] = laserData[i].dist;
+		laserBuffers.angle[i] = laserData[i].angle;
 	}
+	// All the beams are converted in one batch, then only the drawing nodes are updated
+	TransformSnapshot::polarToCartesian(laserBuffers.dist.data(), laserBuffers.angle.data(), n, laserBuffers.x.data(), laserBuffers.z.data());
+	for (int i=0; i<n and i<laserPointTransfs.size(); i++)
+		innerModel->updateTransformValues(laserPointTransfs[i], laserBuffers.x[i], 0, laserBuffers.z[i], 0, 0, 0, "redTransform");
     }
 }
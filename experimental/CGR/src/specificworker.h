@@ -30,8 +30,10 @@
 #include <innermodel/innermodel.h>
 #include <osgviewer/osgview.h>
 #include "innermodeldraw.h"
+#include <transformsnapshot/transformsnapshot.h>
 #include <innermodel/innermodelviewer.h>
 #include <math.h>
+#include <set>
 
 class SpecificWorker : public GenericWorker
 {
@@ -65,6 +67,15 @@ private:
 	float locUncertainty, angleUncertainty;
 	VectorLocalization2D::MotionModelParams motionParams;
 	VectorLocalization2D::LidarParams lidarParams;
+	VectorLocalization2D::KLDParams kldParams;
+	bool useKLD;
+	int refineThreads;
+	bool lazyAtlas;
+	float atlasMemoryBudget;
+	TransformBuffers laserBuffers;
+	/// Maps whose lines are in the viewer; with a lazy atlas, maps are drawn as they get loaded
+	std::set<std::string> drawnMaps;
+	QVector<QString> laserPointTransfs;
 };
 
 #endif
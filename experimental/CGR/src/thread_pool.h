@@ -0,0 +1,121 @@
+//========================================================================
+//  This software is free: you can redistribute it and/or modify
+//  it under the terms of the GNU Lesser General Public License Version 3,
+//  as published by the Free Software Foundation.
+//
+//  This software is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public License
+//  Version 3 in the file COPYING that came with this distribution.
+//  If not, see <http://www.gnu.org/licenses/>.
+//========================================================================
+/*!
+\file    thread_pool.h
+\brief   Persistent worker threads that share out the indices of a loop
+*/
+//========================================================================
+
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+Runs the iterations of a loop over numThreads threads: the calling thread and
+numThreads-1 workers that wait between loops. Each thread takes the next index
+in turn, so the work balances itself when the iterations take different times.
+**/
+class ThreadPool{
+public:
+  /// Work for index i, on thread (0 is the calling thread)
+  typedef std::function<void(int i, int thread)> Task;
+
+  ThreadPool(int _numThreads) : numThreads(std::max(1,_numThreads)), generation(0), stop(false)
+  {
+    for(int i=1; i<numThreads; i++)
+      workers.push_back(std::thread(&ThreadPool::work, this, i));
+  }
+
+  ~ThreadPool()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stop = true;
+    }
+    start.notify_all();
+    for(unsigned int i=0; i<workers.size(); i++)
+      workers[i].join();
+  }
+
+  int size() const {return numThreads;}
+
+  /// Calls task(i, thread) for every i in [0,n), returns once all are done
+  void run(int n, const Task& _task)
+  {
+    if(numThreads==1 || n<2){
+      for(int i=0; i<n; i++)
+        _task(i,0);
+      return;
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      task = &_task;
+      numTasks = n;
+      next = 0;
+      busy = numThreads-1;
+      generation++;
+    }
+    start.notify_all();
+    runTasks(0);
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [this]{return busy==0;});
+    task = 0;
+  }
+
+private:
+  void runTasks(int thread)
+  {
+    for(int i=next++; i<numTasks; i=next++)
+      (*task)(i,thread);
+  }
+
+  void work(int thread)
+  {
+    unsigned int lastGeneration = 0;
+    while(true){
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        start.wait(lock, [&]{return stop || generation!=lastGeneration;});
+        if(stop)
+          return;
+        lastGeneration = generation;
+      }
+      runTasks(thread);
+      std::lock_guard<std::mutex> lock(mutex);
+      if(--busy==0)
+        done.notify_one();
+    }
+  }
+
+  int numThreads;
+  std::vector<std::thread> workers;
+  std::mutex mutex;
+  std::condition_variable start, done;
+  unsigned int generation;
+  bool stop;
+  const Task* task;
+  int numTasks;
+  std::atomic<int> next;
+  int busy;
+};
+
+#endif //THREAD_POOL_H
@@ -0,0 +1,271 @@
+//========================================================================
+//  This software is free: you can redistribute it and/or modify
+//  it under the terms of the GNU Lesser General Public License Version 3,
+//  as published by the Free Software Foundation.
+//
+//  This software is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public License
+//  Version 3 in the file COPYING that came with this distribution.
+//  If not, see <http://www.gnu.org/licenses/>.
+//========================================================================
+/*!
+\file    vector_atlas.cpp
+\brief   C++ Implementation: VectorAtlas
+*/
+//========================================================================
+
+#include "vector_atlas.h"
+
+VectorAtlas::VectorAtlas()
+{
+  lazy = false;
+  memoryBudget = 0;
+  useCount = 0;
+  stop = false;
+}
+
+VectorAtlas::~VectorAtlas()
+{
+  {
+    lock_guard<mutex> lock(atlasMutex);
+    stop = true;
+  }
+  queueChanged.notify_all();
+  if(loaderThread.joinable())
+    loaderThread.join();
+}
+
+bool VectorAtlas::load(const char* _mapsFolder, bool _lazy, size_t _memoryBudget)
+{
+  static const bool debug = false;
+  //Reloading: the loader thread must not be using the old entries
+  if(loaderThread.joinable()){
+    {
+      lock_guard<mutex> lock(atlasMutex);
+      stop = true;
+    }
+    queueChanged.notify_all();
+    loaderThread.join();
+  }
+  stop = false;
+  queue.clear();
+  mapsFolder = string(_mapsFolder);
+  lazy = _lazy;
+  memoryBudget = _memoryBudget;
+  entries.clear();
+  transitions.clear();
+  
+  string atlasFile = mapsFolder + "/atlas.txt";
+  cout <<atlasFile << endl;
+  FILE* fid = fopen(atlasFile.c_str(),"r");
+  if(fid==NULL){
+    TerminalWarning("Unable to load Atlas!");
+    return false;
+  }
+  char mapName[4096];
+  int mapNum;
+  if(debug) printf("Loading Atlas...\n");
+  while(fscanf(fid,"%d %s\n",&mapNum,mapName)==2){
+    Entry entry;
+    entry.name = string(mapName);
+    entry.bytes = 0;
+    entry.lastUsed = 0;
+    entry.queued = entry.loading = false;
+    entries.push_back(entry);
+  }
+  fclose(fid);
+  
+  //The transitions are optional
+  string transitionsFile = mapsFolder + "/transitions.txt";
+  fid = fopen(transitionsFile.c_str(),"r");
+  if(fid!=NULL){
+    char toMapName[4096];
+    Transition t;
+    while(fscanf(fid,"%s %f %f %f %s\n",mapName,&t.loc.x,&t.loc.y,&t.radius,toMapName)==5){
+      t.from = find(mapName);
+      t.to = find(toMapName);
+      if(t.from<0 || t.to<0){
+        char buf[8192];
+        snprintf(buf, 8191, "Transition from %s to %s: map not in the Atlas", mapName, toMapName);
+        TerminalWarning(buf);
+        continue;
+      }
+      transitions.push_back(t);
+    }
+    fclose(fid);
+  }
+  
+  if(lazy){
+    loaderThread = thread(&VectorAtlas::loader, this);
+    if(debug) printf("%d maps in the Atlas, loaded as they are needed.\n",size());
+  }else{
+    for(int i=0; i<size(); i++){
+      if(debug) printf("Loading map %s\n",entries[i].name.c_str());
+      entries[i].map = loadMap(i);
+      entries[i].bytes = entries[i].map->memoryUsage();
+    }
+    if(debug) printf("Done Loading Atlas.\n");
+  }
+  return true;
+}
+
+int VectorAtlas::find(const char* name) const
+{
+  for(int i=0; i<size(); i++){
+    if(entries[i].name.compare(name)==0)
+      return i;
+  }
+  return -1;
+}
+
+shared_ptr<VectorMap> VectorAtlas::loadMap(int i)
+{
+  return shared_ptr<VectorMap>(new VectorMap(entries[i].name.c_str(), mapsFolder.c_str(), true));
+}
+
+shared_ptr<VectorMap> VectorAtlas::get(int i)
+{
+  unique_lock<mutex> lock(atlasMutex);
+  Entry &entry = entries[i];
+  entry.lastUsed = ++useCount;
+  if(entry.loading)
+    mapLoaded.wait(lock, [&]{return !entry.loading;});
+  if(entry.map)
+    return entry.map;
+  //Not loaded, nor being loaded: load it here rather than wait for its turn in the queue
+  if(entry.queued){
+    queue.erase(std::find(queue.begin(), queue.end(), i));
+    entry.queued = false;
+  }
+  entry.loading = true;
+  lock.unlock();
+  shared_ptr<VectorMap> map = loadMap(i);
+  lock.lock();
+  entry.loading = false;
+  vector<shared_ptr<VectorMap> > evicted;
+  insert(i, map, evicted);
+  mapLoaded.notify_all();
+  //The evicted maps are freed after the lock is released
+  lock.unlock();
+  return map;
+}
+
+shared_ptr<VectorMap> VectorAtlas::request(int i)
+{
+  lock_guard<mutex> lock(atlasMutex);
+  Entry &entry = entries[i];
+  entry.lastUsed = ++useCount;
+  if(!entry.map)
+    enqueue(i);
+  return entry.map;
+}
+
+void VectorAtlas::prefetch(int i, vector2f loc)
+{
+  lock_guard<mutex> lock(atlasMutex);
+  for(unsigned int j=0; j<transitions.size(); j++){
+    const Transition &t = transitions[j];
+    if(t.from!=i || (loc-t.loc).sqlength()>sq(t.radius))
+      continue;
+    //Near a transition, the next map is kept from being evicted
+    entries[t.to].lastUsed = ++useCount;
+    if(!entries[t.to].map)
+      enqueue(t.to);
+  }
+}
+
+vector<shared_ptr<VectorMap> > VectorAtlas::loadedMaps()
+{
+  lock_guard<mutex> lock(atlasMutex);
+  vector<shared_ptr<VectorMap> > maps;
+  for(int i=0; i<size(); i++){
+    if(entries[i].map)
+      maps.push_back(entries[i].map);
+  }
+  return maps;
+}
+
+size_t VectorAtlas::memoryUsage()
+{
+  lock_guard<mutex> lock(atlasMutex);
+  size_t bytes = 0;
+  for(int i=0; i<size(); i++){
+    if(entries[i].map)
+      bytes += entries[i].bytes;
+  }
+  return bytes;
+}
+
+void VectorAtlas::insert(int i, shared_ptr<VectorMap> map, vector<shared_ptr<VectorMap> > &evicted)
+{
+  static const bool debug = false;
+  entries[i].map = map;
+  entries[i].bytes = map->memoryUsage();
+  entries[i].lastUsed = ++useCount;
+  if(memoryBudget==0)
+    return;
+  size_t bytes = 0;
+  for(int j=0; j<size(); j++){
+    if(entries[j].map)
+      bytes += entries[j].bytes;
+  }
+  while(bytes>memoryBudget){
+    //The least recently used map that nobody else holds
+    int oldest = -1;
+    for(int j=0; j<size(); j++){
+      if(j==i || !entries[j].map || entries[j].map.use_count()>1)
+        continue;
+      if(oldest<0 || entries[j].lastUsed<entries[oldest].lastUsed)
+        oldest = j;
+    }
+    if(oldest<0)
+      break;
+    if(debug) printf("Evicting map %s\n",entries[oldest].name.c_str());
+    bytes -= entries[oldest].bytes;
+    evicted.push_back(entries[oldest].map);
+    entries[oldest].map.reset();
+  }
+}
+
+void VectorAtlas::enqueue(int i)
+{
+  if(entries[i].queued || entries[i].loading)
+    return;
+  entries[i].queued = true;
+  queue.push_back(i);
+  queueChanged.notify_one();
+}
+
+void VectorAtlas::loader()
+{
+  static const bool debug = false;
+  unique_lock<mutex> lock(atlasMutex);
+  while(true){
+    queueChanged.wait(lock, [this]{return stop || !queue.empty();});
+    if(stop)
+      return;
+    int i = queue.front();
+    queue.pop_front();
+    Entry &entry = entries[i];
+    entry.queued = false;
+    if(entry.map)
+      continue;
+    entry.loading = true;
+    lock.unlock();
+    if(debug) printf("Loading map %s in the background\n",entry.name.c_str());
+    shared_ptr<VectorMap> map = loadMap(i);
+    lock.lock();
+    entry.loading = false;
+    vector<shared_ptr<VectorMap> > evicted;
+    insert(i, map, evicted);
+    mapLoaded.notify_all();
+    //Frees the evicted maps without holding up the users of the atlas
+    lock.unlock();
+    evicted.clear();
+    lock.lock();
+  }
+}
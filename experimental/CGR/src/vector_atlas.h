@@ -0,0 +1,114 @@
+//========================================================================
+//  This software is free: you can redistribute it and/or modify
+//  it under the terms of the GNU Lesser General Public License Version 3,
+//  as published by the Free Software Foundation.
+//
+//  This software is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public License
+//  Version 3 in the file COPYING that came with this distribution.
+//  If not, see <http://www.gnu.org/licenses/>.
+//========================================================================
+/*!
+\file    vector_atlas.h
+\brief   C++ Interface: VectorAtlas
+*/
+//========================================================================
+
+#ifndef VECTOR_ATLAS_H
+#define VECTOR_ATLAS_H
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "vector_map.h"
+
+using namespace std;
+
+/**
+The maps listed in atlas.txt. Loaded eagerly, every map is read when the atlas
+is loaded. Loaded lazily, a map is read the first time it is needed, and maps
+can be requested ahead of time: a thread loads them in the background, and
+request() returns them once they are ready, without waiting. Past the memory
+budget, the least recently used maps are dropped, except those still held by
+their users.
+
+Optionally, transitions.txt next to atlas.txt lists the places where the robot
+moves from one map to another, one per line:
+  <from map> <x> <y> <radius> <to map>
+in the frame of the poses of the localization. The "to" map is loaded in the
+background once the robot is within radius of (x,y) on the "from" map.
+**/
+class VectorAtlas{
+public:
+  class Transition{
+    public:
+    int from;
+    vector2f loc;
+    float radius;
+    int to;
+  };
+
+  VectorAtlas();
+  ~VectorAtlas();
+
+  /// Reads the atlas of mapsFolder, and with lazy false, all of its maps. A budget of 0 bytes is unlimited
+  bool load(const char* _mapsFolder, bool _lazy, size_t _memoryBudget);
+  /// Number of maps in the atlas
+  int size() const {return int(entries.size());}
+  /// Index of the named map, -1 if it is not in the atlas
+  int find(const char* name) const;
+  const string& mapName(int i) const {return entries[i].name;}
+  /// The map, loaded now if it is not yet
+  shared_ptr<VectorMap> get(int i);
+  /// The map if it is loaded, otherwise null, and the map is loaded in the background
+  shared_ptr<VectorMap> request(int i);
+  /// Loads in the background the maps of the transitions of map i near loc
+  void prefetch(int i, vector2f loc);
+  /// The maps that are loaded
+  vector<shared_ptr<VectorMap> > loadedMaps();
+  /// Bytes taken by the maps that are loaded
+  size_t memoryUsage();
+
+private:
+  class Entry{
+    public:
+    string name;
+    shared_ptr<VectorMap> map;
+    size_t bytes;
+    /// Last use, to evict the least recently used maps first
+    unsigned long lastUsed;
+    /// Waiting for the loader thread, or being loaded
+    bool queued, loading;
+  };
+
+  shared_ptr<VectorMap> loadMap(int i);
+  /// Keeps map i, evicting others while over the budget; called with the mutex held, the evicted maps are freed by the caller
+  void insert(int i, shared_ptr<VectorMap> map, vector<shared_ptr<VectorMap> > &evicted);
+  /// Queues map i for the loader thread; called with the mutex held
+  void enqueue(int i);
+  void loader();
+
+  string mapsFolder;
+  bool lazy;
+  size_t memoryBudget;
+  vector<Entry> entries;
+  vector<Transition> transitions;
+  unsigned long useCount;
+
+  mutex atlasMutex;
+  condition_variable queueChanged, mapLoaded;
+  deque<int> queue;
+  thread loaderThread;
+  bool stop;
+};
+
+#endif //VECTOR_ATLAS_H
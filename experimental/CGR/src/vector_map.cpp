@@ -145,10 +145,144 @@ bool VectorMap::loadMap(const char* name, bool usePreRender)
     }
   }
   
+  buildLineGrid();
+  
   if(debug) printf("Done loading map\n\n");
   return true;
 }
 
+void VectorMap::buildLineGrid()
+{
+  static const float eps = 0.01;
+  lineGridResolution = 0.5;
+  lineGrid.clear();
+  lineGridWidth = lineGridHeight = 0;
+  if(lines.size()<1)
+    return;
+  lineGridWidth = floor((maxX-minX)/lineGridResolution)+1;
+  lineGridHeight = floor((maxY-minY)/lineGridResolution)+1;
+  lineGrid.resize(lineGridWidth*lineGridHeight);
+  
+  const float halfCell = 0.5*lineGridResolution + eps;
+  for(unsigned int i=0; i<lines.size(); i++){
+    line2f &l = lines[i];
+    //Also computes the cached values of the line, so that the queries below do not write to it
+    vector2f perp = l.Perp();
+    int x0 = bound<int,int>(floor((min(l.P0().x,l.P1().x)-eps-minX)/lineGridResolution), 0, int(lineGridWidth)-1);
+    int x1 = bound<int,int>(floor((max(l.P0().x,l.P1().x)+eps-minX)/lineGridResolution), 0, int(lineGridWidth)-1);
+    int y0 = bound<int,int>(floor((min(l.P0().y,l.P1().y)-eps-minY)/lineGridResolution), 0, int(lineGridHeight)-1);
+    int y1 = bound<int,int>(floor((max(l.P0().y,l.P1().y)+eps-minY)/lineGridResolution), 0, int(lineGridHeight)-1);
+    //A cell of the bounding box holds the line if the line passes through the (slightly grown) cell
+    const float reach = halfCell*(fabs(perp.x)+fabs(perp.y));
+    for(int x=x0; x<=x1; x++){
+      for(int y=y0; y<=y1; y++){
+        vector2f c(minX+(x+0.5)*lineGridResolution, minY+(y+0.5)*lineGridResolution);
+        if(fabs(perp.dot(c-l.P0()))<=reach)
+          lineGrid[x+y*lineGridWidth].push_back(i);
+      }
+    }
+  }
+}
+
+template <class Visitor>
+void VectorMap::traverseLineGrid(vector2f loc, vector2f dir, float minRange, float maxRange, Visitor &visit)
+{
+  if(lineGridWidth<1 || lineGridHeight<1)
+    return;
+  const float res = lineGridResolution;
+  const float gridMin[2] = {minX, minY};
+  const float gridMax[2] = {minX+lineGridWidth*res, minY+lineGridHeight*res};
+  const float p[2] = {loc.x, loc.y};
+  const float d[2] = {dir.x, dir.y};
+  
+  //Clip the ray to the extents of the grid
+  float t0 = minRange, t1 = maxRange;
+  for(int k=0; k<2; k++){
+    if(fabs(d[k])<FLT_MIN){
+      if(p[k]<gridMin[k] || p[k]>gridMax[k])
+        return;
+      continue;
+    }
+    float ta = (gridMin[k]-p[k])/d[k];
+    float tb = (gridMax[k]-p[k])/d[k];
+    if(ta>tb)
+      swap(ta,tb);
+    t0 = max(t0,ta);
+    t1 = min(t1,tb);
+  }
+  if(t0>t1)
+    return;
+  
+  //Walk the cells crossed by the ray, in order
+  vector2f start = loc + t0*dir;
+  int x = bound<int,int>(floor((start.x-minX)/res), 0, int(lineGridWidth)-1);
+  int y = bound<int,int>(floor((start.y-minY)/res), 0, int(lineGridHeight)-1);
+  const int stepX = (dir.x>0.0)? 1 : -1;
+  const int stepY = (dir.y>0.0)? 1 : -1;
+  float tMaxX = (fabs(dir.x)<FLT_MIN)? FLT_MAX : (minX+(x+(stepX>0))*res-loc.x)/dir.x;
+  float tMaxY = (fabs(dir.y)<FLT_MIN)? FLT_MAX : (minY+(y+(stepY>0))*res-loc.y)/dir.y;
+  const float tDeltaX = (fabs(dir.x)<FLT_MIN)? FLT_MAX : res/fabs(dir.x);
+  const float tDeltaY = (fabs(dir.y)<FLT_MIN)? FLT_MAX : res/fabs(dir.y);
+  
+  while(true){
+    float tExit = min(min(tMaxX,tMaxY),t1);
+    if(visit(lineGrid[x+y*lineGridWidth], tExit) || tExit>=t1)
+      return;
+    if(tMaxX<tMaxY){
+      x += stepX;
+      if(x<0 || x>=int(lineGridWidth))
+        return;
+      tMaxX += tDeltaX;
+    }else{
+      y += stepY;
+      if(y<0 || y>=int(lineGridHeight))
+        return;
+      tMaxY += tDeltaY;
+    }
+  }
+}
+
+namespace{
+  /// Nearest hit of a ray on the lines of the cells visited, as in getRayCast
+  struct RayCastVisitor{
+    const vector<line2f> &lines;
+    vector2f loc, heading;
+    float ray;
+    RayCastVisitor(const vector<line2f> &_lines, vector2f _loc, vector2f _heading, float maxRange) : lines(_lines), loc(_loc), heading(_heading), ray(maxRange) {}
+    bool operator()(const vector<int> &cell, float tExit){
+      for(unsigned int i=0; i<cell.size(); i++){
+        line2f &l = const_cast<line2f&>(lines[cell[i]]);
+        if(l.intersects(loc,heading,false))
+          ray = min(ray, float(fabs(l.Perp().dot(loc-l.P0())/l.Dir().cross(heading))));
+      }
+      //Hits on lines of later cells are further than the exit of this one
+      return ray<=tExit;
+    }
+  };
+  
+  /// Nearest line crossed by the segment loc1-loc2 in the cells visited, as in getLineCorrespondence
+  struct CorrespondenceVisitor{
+    const vector<line2f> &lines;
+    vector2f loc, loc1, loc2;
+    float bestSq;
+    int bestLine;
+    CorrespondenceVisitor(const vector<line2f> &_lines, vector2f _loc, vector2f _loc1, vector2f _loc2) : lines(_lines), loc(_loc), loc1(_loc1), loc2(_loc2), bestSq((_loc2-_loc).sqlength()), bestLine(-1) {}
+    bool operator()(const vector<int> &cell, float tExit){
+      for(unsigned int i=0; i<cell.size(); i++){
+        line2f &l = const_cast<line2f&>(lines[cell[i]]);
+        if(!l.intersects(loc1,loc2,false,false,true))
+          continue;
+        float sqDist = (l.intersection(loc1,loc2,false,false)-loc).sqlength();
+        if(sqDist<bestSq || (sqDist==bestSq && cell[i]<bestLine)){
+          bestSq = sqDist;
+          bestLine = cell[i];
+        }
+      }
+      return bestLine>=0 && bestSq<=sq(tExit);
+    }
+  };
+}
+
 
 VectorMap::VectorMap(const char* name, const char* _mapsFolder, bool usePreRender)
 {
@@ -161,6 +295,21 @@ VectorMap::~VectorMap()
 {
 }
 
+size_t VectorMap::memoryUsage() const
+{
+  size_t bytes = sizeof(VectorMap) + lines.capacity()*sizeof(line2f);
+  bytes += visibilityList.capacity()*sizeof(vector<vector<int> >);
+  for(unsigned int x=0; x<visibilityList.size(); x++){
+    bytes += visibilityList[x].capacity()*sizeof(vector<int>);
+    for(unsigned int y=0; y<visibilityList[x].size(); y++)
+      bytes += visibilityList[x][y].capacity()*sizeof(int);
+  }
+  bytes += lineGrid.capacity()*sizeof(vector<int>);
+  for(unsigned int i=0; i<lineGrid.size(); i++)
+    bytes += lineGrid[i].capacity()*sizeof(int);
+  return bytes;
+}
+
 std::vector< int >* VectorMap::getVisibilityList(float x, float y)
 {
   int xInd = bound((x-minX)/visListResolution,0.0,visListWidth-1.0);
@@ -212,19 +361,12 @@ vector<float> VectorMap::getRayCast(vector2f loc, float angle, float da, int num
         }
       }
     }else{
-      /*
-      for(unsigned int i=0; i<lines.size(); i++){
-        if(lines[i].intersects(loc,a))
-          ray = min(ray, lines[i].distFromLine1((vector2f)loc,(double)a, false));
-      }
-      */
-      vector<int> sceneLines = getSceneLines(loc, maxRange);
-      for(unsigned int i=0; i<sceneLines.size(); i++){
-        if(lines[sceneLines[i]].intersects(loc,a)){
-          ray = min(ray, lines[sceneLines[i]].distFromLine1((vector2f)loc,(float)a, false));
-        }
-      }
-      
+      //Walk the line grid from loc until the nearest hit is found
+      vector2f heading;
+      heading.heading(a);
+      RayCastVisitor visitor(lines, loc, heading, maxRange);
+      traverseLineGrid(loc, heading, 0.0, maxRange, visitor);
+      ray = visitor.ray;
     }
     rayCast.push_back(ray);
   }
@@ -254,6 +396,15 @@ int VectorMap::getLineCorrespondence(vector2f loc, float angle, float minRange,
   return bestLine;
 }
 
+int VectorMap::getLineCorrespondence(vector2f loc, float angle, float minRange, float maxRange)
+{
+  vector2f dir;
+  dir.heading(angle);
+  CorrespondenceVisitor visitor(lines, loc, loc + minRange*dir, loc + maxRange*dir);
+  traverseLineGrid(loc, dir, minRange, maxRange, visitor);
+  return visitor.bestLine;
+}
+
 vector<int> VectorMap::getRayToLineCorrespondences(vector2f loc, float angle, float a0, float a1, const vector<vector2f> pointCloud, float minRange, float maxRange, bool analytical, vector<line2f> *lines )
 {
   //FunctionTimer ft(__FUNCTION__);
@@ -264,8 +415,6 @@ vector<int> VectorMap::getRayToLineCorrespondences(vector2f loc, float angle, fl
   vector<int> locVisibilityList;
   if(UsePreRender && preRenderExists)
     locVisibilityList = *getVisibilityList(loc);
-  else
-    getSceneLines(loc,maxRange);
   
   if(analytical && lines!=NULL){
     *lines = sceneRender(loc, a0, a1);
@@ -287,7 +436,10 @@ vector<int> VectorMap::getRayToLineCorrespondences(vector2f loc, float angle, fl
   }else{
     for(uint i=0; i<pointCloud.size(); i++){
       float curAngle = angle_mod(pointCloud[i].angle() + angle);
-      correspondences.push_back(getLineCorrespondence(loc,curAngle,minRange, maxRange, locVisibilityList));
+      if(UsePreRender && preRenderExists)
+        correspondences.push_back(getLineCorrespondence(loc,curAngle,minRange, maxRange, locVisibilityList));
+      else
+        correspondences.push_back(getLineCorrespondence(loc,curAngle,minRange, maxRange));
     }
   }
   return correspondences;
@@ -298,11 +450,12 @@ vector<int> VectorMap::getRayToLineCorrespondences(vector2f loc, float a0, float
   //FunctionTimer ft(__PRETTY_FUNCTION__);
   vector<int> correspondences;
   correspondences.clear();
-  vector<int> locVisibilityList;
-  if(preRenderExists)
-    locVisibilityList = *getVisibilityList(loc);
-  else
-    locVisibilityList = getSceneLines(loc,maxRange);
+  if(!preRenderExists){
+    for(float a=a0; a<a1; a += da)
+      correspondences.push_back(getLineCorrespondence(loc,a,minRange, maxRange));
+    return correspondences;
+  }
+  const vector<int> &locVisibilityList = *getVisibilityList(loc);
   for(float a=a0; a<a1; a += da){
     correspondences.push_back(getLineCorrespondence(loc,a,minRange, maxRange, locVisibilityList));
   }
@@ -410,9 +563,25 @@ std::vector<int> VectorMap::getSceneLines(vector2f loc, float maxRange)
   linesList.clear();
   sceneLines.clear();
   
-  for(unsigned int i=0; i<lines.size(); i++){
-    if(lines[i].closestDistFromLine(loc, true)<maxRange)
-      linesList.push_back(i);
+  //Only the lines of the grid cells within maxRange of loc can be close enough, kept in the order of the map
+  vector<int> candidates;
+  if(lineGridWidth>0 && lineGridHeight>0){
+    int x0 = bound<int,int>(floor((loc.x-maxRange-minX)/lineGridResolution), 0, int(lineGridWidth)-1);
+    int x1 = bound<int,int>(floor((loc.x+maxRange-minX)/lineGridResolution), 0, int(lineGridWidth)-1);
+    int y0 = bound<int,int>(floor((loc.y-maxRange-minY)/lineGridResolution), 0, int(lineGridHeight)-1);
+    int y1 = bound<int,int>(floor((loc.y+maxRange-minY)/lineGridResolution), 0, int(lineGridHeight)-1);
+    for(int x=x0; x<=x1; x++){
+      for(int y=y0; y<=y1; y++){
+        const vector<int> &cell = lineGrid[x+y*lineGridWidth];
+        candidates.insert(candidates.end(), cell.begin(), cell.end());
+      }
+    }
+    sort(candidates.begin(), candidates.end());
+    candidates.erase(unique(candidates.begin(), candidates.end()), candidates.end());
+  }
+  for(unsigned int i=0; i<candidates.size(); i++){
+    if(lines[candidates[i]].closestDistFromLine(loc, true)<maxRange)
+      linesList.push_back(candidates[i]);
   }
   for(unsigned int i=0; i<linesList.size(); i++){
     line2f curLine = lines[linesList[i]];
@@ -691,6 +860,7 @@ vector<line2f> VectorMap::sceneRender(vector2f loc, float a0, float a1)
   vector<line2f> scene, sceneCleaned;
   vector<line2f> linesList;
   vector<int>* locVisibilityList;
+  vector<int> locSceneLines;
   
   scene.clear();
   sceneCleaned.clear();
@@ -699,8 +869,8 @@ vector<line2f> VectorMap::sceneRender(vector2f loc, float a0, float a1)
   if(preRenderExists){
     locVisibilityList = getVisibilityList(loc);
   }else{
-    locVisibilityList = new vector<int>;
-    *locVisibilityList = getSceneLines(loc,MaxRange);
+    locSceneLines = getSceneLines(loc,MaxRange);
+    locVisibilityList = &locSceneLines;
   }
   for(unsigned int i=0; i<locVisibilityList->size(); i++){
     linesList.push_back(lines[locVisibilityList->at(i)]);
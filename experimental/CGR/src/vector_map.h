@@ -62,11 +62,20 @@ public:
   unsigned int visListWidth, visListHeight;
   bool preRenderExists;
   double profileTimes[100];
+  /// number of meters per cell in the line grid
+  double lineGridResolution;
+  /// size of the line grid
+  unsigned int lineGridWidth, lineGridHeight;
 private:
   vector<vector<vector<int> > > visibilityList;
+  /// Indices of the lines crossing each cell of a uniform grid over the map, used to cast rays when there is no pre-render
+  vector<vector<int> > lineGrid;
+  
+  /// Visit the line grid cells along the ray from loc in direction dir (unit length) between minRange and maxRange, nearest first
+  template <class Visitor> void traverseLineGrid(vector2f loc, vector2f dir, float minRange, float maxRange, Visitor &visit);
   
 public:
-  VectorMap(const char* _mapsFolder){lines.clear(); mapsFolder=string(_mapsFolder);}
+  VectorMap(const char* _mapsFolder){lines.clear(); lineGridWidth = lineGridHeight = 0; mapsFolder=string(_mapsFolder);}
   VectorMap(const char *name, const char* _mapsFolder, bool usePreRender);
   ~VectorMap();
   
@@ -74,6 +83,8 @@ public:
   
   /// Get line which intersects first the given ray first
   int getLineCorrespondence(vector2f loc, float angle, float minRange, float maxRange, const std::vector< int >& visibilityList);
+  /// Same as previous, but with the lines from the line grid
+  int getLineCorrespondence(vector2f loc, float angle, float minRange, float maxRange);
   /// Get lines (for each ray) which intersect first the rays starting at angles a0 to a1, at increments of da
   vector<int> getRayToLineCorrespondences(vector2f loc, float angle, float a0, float a1, const std::vector< vector2f > pointCloud, float minRange, float maxRange, bool analytical = false, vector< line2f >* lines = 0);
   /// Convenience function: same as previous, but specified by center angle, angle increment (da), and numRays to scan
@@ -89,6 +100,10 @@ public:
   vector<int> getSceneLines(vector2f loc, float maxRange);
   /// Load map by name
   bool loadMap(const char* name, bool usePreRender);
+  /// Build the line grid from the lines
+  void buildLineGrid();
+  /// Bytes taken by the lines, the pre-render and the line grid
+  size_t memoryUsage() const;
   /// Get Visibility list for specified location
   vector<int>* getVisibilityList(float x, float y);
   vector<int>* getVisibilityList(vector2f loc){ return getVisibilityList(loc.x, loc.y); }
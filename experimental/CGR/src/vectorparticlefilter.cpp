@@ -19,11 +19,34 @@
 //========================================================================
 
 #include "vectorparticlefilter.h"
-#include <QtGlobal>
 #include <list>
+#include <set>
+#include <stdint.h>
+#include <smmintrin.h>
 
 static const bool UseAnalyticRender = true;
 
+/// KLD resampling parameters used until setKLDParams is called
+static VectorLocalization2D::KLDParams defaultKLDParams()
+{
+  VectorLocalization2D::KLDParams params;
+  params.binSize = 2.0;
+  params.binAngle = RAD(30.0);
+  params.epsilon = 0.2;
+  params.delta = 0.01;
+  params.minParticles = 20;
+  params.maxParticles = 60;
+  return params;
+}
+
+/// Upper p quantile of the standard normal distribution (Abramowitz and Stegun 26.2.23, error below 4.5e-4)
+static float normalUpperQuantile(float p)
+{
+  p = bound(p, FLT_MIN, 0.5f);
+  float t = sqrt(-2.0*log(p));
+  return t - (2.515517 + 0.802853*t + 0.010328*t*t)/(1.0 + 1.432788*t + 0.189269*t*t + 0.001308*t*t*t);
+}
+
 
 inline float eigenCross(const Vector2f &v1, const Vector2f &v2)
 {
@@ -43,46 +66,105 @@ void VectorLocalization2D::LidarParams::initialize()
   laserScan = (float*) malloc(numRays*sizeof(float));
 }
 
-VectorLocalization2D::VectorLocalization2D(const char* _mapsFolder)
+VectorLocalization2D::VectorLocalization2D(const char* _mapsFolder, bool _lazyAtlas, size_t _atlasMemoryBudget)
 {
   mapsFolder = string(_mapsFolder);
+  lazyAtlas = _lazyAtlas;
+  atlasMemoryBudget = _atlasMemoryBudget;
   loadAtlas();
   numParticles = 0;
   particles.clear();
+  setKLDParams(defaultKLDParams());
+  resampleTime = 0.0;
+  refinePool = NULL;
+  setRefineThreads(0);
   locCorrectionP0.zero();
   locCorrectionP1.zero();
 }
 
 VectorLocalization2D::VectorLocalization2D(int _numParticles)
 {
+  lazyAtlas = false;
+  atlasMemoryBudget = 0;
   loadAtlas();
   numParticles = _numParticles;
   particles.resize(_numParticles);
   stage0Weights.resize(_numParticles);
   stageRWeights.resize(_numParticles);
+  setKLDParams(defaultKLDParams());
+  resampleTime = 0.0;
+  refinePool = NULL;
+  setRefineThreads(0);
+}
+
+VectorLocalization2D::~VectorLocalization2D()
+{
+  delete refinePool;
+}
+
+void VectorLocalization2D::setKLDParams(const KLDParams& _kldParams)
+{
+  kldParams = _kldParams;
+  kldParams.minParticles = max(1, kldParams.minParticles);
+  kldParams.maxParticles = max(kldParams.minParticles, kldParams.maxParticles);
+  kldQuantile = normalUpperQuantile(kldParams.delta);
+}
+
+void VectorLocalization2D::setRefineThreads(int _refineThreads)
+{
+  if(_refineThreads<=0)
+    _refineThreads = max(1, int(std::thread::hardware_concurrency()));
+  refineThreads = _refineThreads;
+  //The pool starts with the first refinement
+  delete refinePool;
+  refinePool = NULL;
+  refineBuffers.resize(refineThreads);
+}
+
+void VectorLocalization2D::RefineBuffers::resize(int n)
+{
+  px.resize(n);
+  py.resize(n);
+  qx.resize(n);
+  qy.resize(n);
+  p0x.resize(n);
+  p0y.resize(n);
+  dirx.resize(n);
+  diry.resize(n);
+  length.resize(n);
+  sx.resize(n);
+  sy.resize(n);
+  ax.resize(n);
+  ay.resize(n);
+  logWeights.resize(n);
+  used.resize(n);
 }
 
 void VectorLocalization2D::loadAtlas()
 {
-  static const bool debug = true;
-  string atlasFile = mapsFolder + "/atlas.txt";
-  cout <<atlasFile << endl;
-  FILE* fid = fopen(atlasFile.c_str(),"r");
-  if(fid==NULL){
-    TerminalWarning("Unable to load Atlas!");
-    return;
-  }
-  char mapName[4096];
-  int mapNum;
-  if(debug) printf("Loading Atlas...\n");
-  maps.clear();
-  while(fscanf(fid,"%d %s\n",&mapNum,mapName)==2){
-    if(debug) printf("Loading map %s\n",mapName);
-    maps.push_back(VectorMap(mapName,mapsFolder.c_str(),true));
-  }
-  if(maps.size()>0)
-    currentMap = &maps[0];
-  if(debug) printf("Done Loading Atlas.\n");
+  currentMap = NULL;
+  currentMapRef.reset();
+  currentMapIndex = -1;
+  pendingMap = -1;
+  atlas.load(mapsFolder.c_str(), lazyAtlas, atlasMemoryBudget);
+  if(!lazyAtlas && atlas.size()>0)
+    selectMap(0, atlas.get(0));
+}
+
+void VectorLocalization2D::selectMap(int i, shared_ptr<VectorMap> map)
+{
+  currentMapIndex = i;
+  currentMapRef = map;
+  currentMap = map.get();
+}
+
+vector<VectorMap> VectorLocalization2D::getMaps()
+{
+  vector<shared_ptr<VectorMap> > loadedMaps = atlas.loadedMaps();
+  vector<VectorMap> maps;
+  for(unsigned int i=0; i<loadedMaps.size(); i++)
+    maps.push_back(*loadedMaps[i]);
+  return maps;
 }
 
 Particle2D VectorLocalization2D::createParticle(VectorMap* map, vector2f loc, float angle, float locationUncertainty, float angleUncertainty)
@@ -92,26 +174,28 @@ Particle2D VectorLocalization2D::createParticle(VectorMap* map, vector2f loc, fl
 
 void VectorLocalization2D::setLocation(vector2f loc, float angle, const char* map, float locationUncertainty, float angleUncertainty)
 {
-  for(unsigned int i=0; i<particles.size(); i++){
-    particles[i].loc = vector2f(randn(locationUncertainty, loc.x), randn(locationUncertainty, loc.y));
-    particles[i].angle = randn(angleUncertainty, angle);
-  }
-
-  bool found = false;
-  int mapIndex=0;
-  for(unsigned int i=0; !found && i<maps.size(); i++){
-    if(maps[i].mapName.compare(map)==0){
-      mapIndex = i;
-      found = true;
-    }
-  }
-  if(found){
-    currentMap = &maps[mapIndex];
-  }else{
+  int mapIndex = atlas.find(map);
+  if(mapIndex<0){
+    setLocation(loc, angle, locationUncertainty, angleUncertainty);
     char buf[4096];
     snprintf(buf, 4095, "Unknown map: \"%s\"",map);
     TerminalWarning(buf);
-  }  
+    return;
+  }
+  shared_ptr<VectorMap> newMap = atlas.request(mapIndex);
+  if(newMap){
+    setLocation(loc, angle, locationUncertainty, angleUncertainty);
+    selectMap(mapIndex, newMap);
+    pendingMap = -1;
+  }else{
+    //The particles move once the map has loaded, in updateMap
+    pendingMap = mapIndex;
+    pendingLocation = true;
+    pendingLoc = loc;
+    pendingAngle = angle;
+    pendingLocationUncertainty = locationUncertainty;
+    pendingAngleUncertainty = angleUncertainty;
+  }
 }
 
 void VectorLocalization2D::setLocation(vector2f loc, float angle, float locationUncertainty, float angleUncertainty)
@@ -124,40 +208,52 @@ void VectorLocalization2D::setLocation(vector2f loc, float angle, float location
 
 void VectorLocalization2D::setMap(const char* map)
 {
-  bool found = false;
-  int mapIndex=0;
-  for(unsigned int i=0; !found && i<maps.size(); i++){
-    if(maps[i].mapName.compare(map)==0){
-      mapIndex = i;
-      found = true;
-    }
-  }
-  if(found){
-    currentMap = &maps[mapIndex];
-  }else{
+  int mapIndex = atlas.find(map);
+  if(mapIndex<0){
     char buf[4096];
     snprintf(buf, 4095, "Unknown map: \"%s\"",map);
     TerminalWarning(buf);
+    return;
+  }
+  shared_ptr<VectorMap> newMap = atlas.request(mapIndex);
+  if(newMap){
+    selectMap(mapIndex, newMap);
+    pendingMap = -1;
+  }else{
+    pendingMap = mapIndex;
+    pendingLocation = false;
   }
 }
 
+void VectorLocalization2D::updateMap()
+{
+  if(pendingMap>=0){
+    shared_ptr<VectorMap> newMap = atlas.request(pendingMap);
+    if(newMap){
+      if(pendingLocation)
+        setLocation(pendingLoc, pendingAngle, pendingLocationUncertainty, pendingAngleUncertainty);
+      selectMap(pendingMap, newMap);
+      pendingMap = -1;
+    }
+  }
+  if(currentMapIndex>=0)
+    atlas.prefetch(currentMapIndex, currentLocation);
+}
+
 void VectorLocalization2D::initialize(int _numParticles, const char* mapName, vector2f loc, float angle, float locationUncertainty, float angleUncertainty)
 {
   static const bool debug = false;
   
-  currentMap = &maps[0];
-  bool found = false;
-  for(unsigned int i=0; i<maps.size(); i++){
-    if(maps[i].mapName.compare(mapName)==0){
-      found = true;
-      currentMap = &maps[i];
-    }
-  }
-  if(!found){
+  int mapIndex = atlas.find(mapName);
+  if(mapIndex<0){
+    mapIndex = 0;
     char buf[2048];
-    snprintf(buf,2047,"Map %s not found in Atlas! Reverting to map %s.",mapName,maps[0].mapName.c_str());
+    snprintf(buf,2047,"Map %s not found in Atlas! Reverting to map %s.",mapName,atlas.mapName(0).c_str());
     TerminalWarning(buf);
   }
+  //Waits for the map, when the atlas is lazy and it has not loaded yet
+  selectMap(mapIndex, atlas.get(mapIndex));
+  pendingMap = -1;
   
   numParticles = _numParticles;
   particles.resize(numParticles);
@@ -195,6 +291,7 @@ void VectorLocalization2D::initialize(int _numParticles, const char* mapName, ve
 
 void VectorLocalization2D::predict(float dx, float dy, float dtheta, const MotionModelParams &motionParams)
 {
+  updateMap();
   lastDistanceMoved += vector2f(dx,dy).rotate(lastAngleTurned);
   lastAngleTurned += dtheta;
   for(int i=0; i<numParticles; i++){
@@ -711,7 +808,7 @@ void VectorLocalization2D::getPointCloudGradient(vector2f loc, float angle, vect
   if(EnableProfiling) delete ft;
 }
 
-void VectorLocalization2D::getLidarGradient(vector2f loc, float angle, vector2f& locGrad, float& angleGrad, float& logWeight, VectorLocalization2D::LidarParams lidarParams, const vector<Vector2f>& laserPoints, const vector<int> & lineCorrespondences, const vector<line2f> &lines)
+void VectorLocalization2D::getLidarGradient(vector2f loc, float angle, vector2f& locGrad, float& angleGrad, float& logWeight, const VectorLocalization2D::LidarParams& lidarParams, RefineBuffers& buffers)
 {
   static const bool EnableProfiling = false;
   
@@ -719,108 +816,102 @@ void VectorLocalization2D::getLidarGradient(vector2f loc, float angle, vector2f&
   if(EnableProfiling)
     ft = new FunctionTimer(__PRETTY_FUNCTION__);
   
-  float logShortHitProb = lidarParams.logShortHitProb;
-  Matrix2f robotAngle;
+  static const bool debug = false;
+  Matrix2f robotAngle, robotAngle2;
   robotAngle = Rotation2Df(angle);
+  robotAngle2 = Rotation2Df(angle+lidarParams.angleResolution);
   Vector2f laserLocE = Vector2f(V2COMP(loc)) + robotAngle*(lidarParams.laserToBaseTrans);
-  vector2f laserLoc(laserLocE.x(), laserLocE.y());
   
   if(EnableProfiling) ft->Lap(__LINE__);
   
-  /*
-  if(UseAnalyticRender){
-    lineCorrespondences = currentMap->getRayToLineCorrespondences(laserLoc, angle, lidarParams.angleResolution, lidarParams.numRays, lidarParams.minRange, lidarParams.maxRange, true, &lines);
-  }else{
-    lineCorrespondences = currentMap->getRayToLineCorrespondences(laserLoc, angle, lidarParams.angleResolution, lidarParams.numRays, lidarParams.minRange, lidarParams.maxRange);
+  //Attraction of every ray with a correspondence, four rays at a time. The rays and their lines are laid out by
+  //refineLocationLidar in separate arrays, padded to a multiple of four.
+  const int numRays = buffers.numRays;
+  const __m128 lx = _mm_set1_ps(laserLocE.x()), ly = _mm_set1_ps(laserLocE.y());
+  const __m128 r00 = _mm_set1_ps(robotAngle(0,0)), r01 = _mm_set1_ps(robotAngle(0,1)), r10 = _mm_set1_ps(robotAngle(1,0)), r11 = _mm_set1_ps(robotAngle(1,1));
+  const __m128 s00 = _mm_set1_ps(robotAngle2(0,0)), s01 = _mm_set1_ps(robotAngle2(0,1)), s10 = _mm_set1_ps(robotAngle2(1,0)), s11 = _mm_set1_ps(robotAngle2(1,1));
+  const __m128 minLocation = _mm_set1_ps(-lidarParams.correspondenceMargin), margin = _mm_set1_ps(lidarParams.correspondenceMargin);
+  const __m128 attractorRange = _mm_set1_ps(lidarParams.attractorRange);
+  const __m128 lidarStdDev = _mm_set1_ps(lidarParams.lidarStdDev);
+  const __m128 maxSqError = _mm_set1_ps(-lidarParams.logShortHitProb);
+  const __m128 correlationFactor = _mm_set1_ps(lidarParams.correlationFactor);
+  const __m128 minCosAngleError = _mm_set1_ps(lidarParams.minCosAngleError);
+  const __m128 signBit = _mm_set1_ps(-0.0f), zero = _mm_setzero_ps();
+  for(int i=0; i<numRays; i+=4){
+    __m128 px = _mm_loadu_ps(&buffers.px[i]), py = _mm_loadu_ps(&buffers.py[i]);
+    __m128 dirx = _mm_loadu_ps(&buffers.dirx[i]), diry = _mm_loadu_ps(&buffers.diry[i]);
+    __m128 x = _mm_add_ps(lx, _mm_add_ps(_mm_mul_ps(r00,px), _mm_mul_ps(r01,py)));
+    __m128 y = _mm_add_ps(ly, _mm_add_ps(_mm_mul_ps(r10,px), _mm_mul_ps(r11,py)));
+    //Attractor function of the line
+    __m128 rx = _mm_sub_ps(x, _mm_loadu_ps(&buffers.p0x[i])), ry = _mm_sub_ps(y, _mm_loadu_ps(&buffers.p0y[i]));
+    __m128 location = _mm_add_ps(_mm_mul_ps(rx,dirx), _mm_mul_ps(ry,diry));
+    __m128 attractionX = _mm_sub_ps(rx, _mm_mul_ps(dirx,location));
+    __m128 attractionY = _mm_sub_ps(ry, _mm_mul_ps(diry,location));
+    __m128 distance = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(attractionX,attractionX), _mm_mul_ps(attractionY,attractionY)));
+    __m128 attracted = _mm_and_ps(_mm_cmpge_ps(location,minLocation), _mm_cmple_ps(location, _mm_add_ps(_mm_loadu_ps(&buffers.length[i]),margin)));
+    attracted = _mm_and_ps(attracted, _mm_cmple_ps(distance,attractorRange));
+    attractionX = _mm_and_ps(attracted, attractionX);
+    attractionY = _mm_and_ps(attracted, attractionY);
+    __m128 sqError = _mm_div_ps(_mm_add_ps(_mm_mul_ps(attractionX,attractionX), _mm_mul_ps(attractionY,attractionY)), lidarStdDev);
+    _mm_storeu_ps(&buffers.logWeights[i], _mm_mul_ps(_mm_xor_ps(_mm_min_ps(sqError,maxSqError),signBit), correlationFactor));
+    //Only rays seeing the line at a small enough angle take part in the gradient
+    __m128 dx = _mm_sub_ps(_mm_add_ps(lx, _mm_add_ps(_mm_mul_ps(s00,_mm_loadu_ps(&buffers.qx[i])), _mm_mul_ps(s01,_mm_loadu_ps(&buffers.qy[i])))), x);
+    __m128 dy = _mm_sub_ps(_mm_add_ps(ly, _mm_add_ps(_mm_mul_ps(s10,_mm_loadu_ps(&buffers.qx[i])), _mm_mul_ps(s11,_mm_loadu_ps(&buffers.qy[i])))), y);
+    __m128 sqNorm = _mm_add_ps(_mm_mul_ps(dx,dx), _mm_mul_ps(dy,dy));
+    __m128 norm = _mm_sqrt_ps(sqNorm);
+    __m128 nonZero = _mm_cmpgt_ps(sqNorm,zero);
+    dx = _mm_blendv_ps(dx, _mm_div_ps(dx,norm), nonZero);
+    dy = _mm_blendv_ps(dy, _mm_div_ps(dy,norm), nonZero);
+    __m128 cosAngle = _mm_andnot_ps(signBit, _mm_add_ps(_mm_mul_ps(dirx,dx), _mm_mul_ps(diry,dy)));
+    int used = _mm_movemask_ps(_mm_cmpgt_ps(cosAngle,minCosAngleError));
+    for(int j=0; j<4; j++)
+      buffers.used[i+j] = (used>>j)&1;
+    _mm_storeu_ps(&buffers.sx[i], x);
+    _mm_storeu_ps(&buffers.sy[i], y);
+    _mm_storeu_ps(&buffers.ax[i], attractionX);
+    _mm_storeu_ps(&buffers.ay[i], attractionY);
   }
-  */
-  if(EnableProfiling) ft->Lap(__LINE__);
-  
-  points.clear();
-  gradients.clear();
-  static const bool debug = false;
-  float *scanRays = lidarParams.laserScan;
-  float minRange = lidarParams.minRange;
-  float maxRange = lidarParams.maxRange;
-  float curAngle;
-  Vector2f heading, heading2;
-  float numPoints = 0;
-  float midScan = float(lidarParams.numRays)/2.0;
-  float cosAngle;
-  int noCorrespondences = 0;
   logWeight = 0.0;
-  curAngle = angle - midScan*lidarParams.angleResolution;
-  //Construct gradients per point in point cloud
-  if(EnableProfiling) ft->Lap(__LINE__);
-  
-  Matrix2f robotAngle2;
-  robotAngle2 = Rotation2Df(angle+lidarParams.angleResolution);
-  Vector2f scanPoint, scanPoint2, scanDir, lineDir, attraction;
-  
-  //TODO: Speed up this section!!
-  //===========================================================================
-  laserEval.numObservedPoints = 0;
-  for(int i=0; i<lidarParams.numRays-1; i++, curAngle+=lidarParams.angleResolution){
-    if(scanRays[i]<minRange || scanRays[i]>maxRange)
-      continue;
-    laserEval.numObservedPoints++;  
-    scanPoint = laserLocE + robotAngle*laserPoints[i];
-    
-    if(lineCorrespondences[i]>=0){
-      scanPoint2 = laserLocE + robotAngle2*laserPoints[i+1];
-      scanDir = (scanPoint2-scanPoint).normalized();
-      if(UseAnalyticRender){
-        lineDir = Vector2f(V2COMP(lines[lineCorrespondences[i]].Dir()));
-        attraction = attractorFunction(lines[lineCorrespondences[i]], scanPoint, lidarParams.attractorRange, lidarParams.correspondenceMargin);
-      }else{
-        lineDir = Vector2f(V2COMP(currentMap->lines[lineCorrespondences[i]].Dir()));
-        attraction = attractorFunction(currentMap->lines[lineCorrespondences[i]], scanPoint, lidarParams.attractorRange, lidarParams.correspondenceMargin);
-      }
-      logWeight += -min(attraction.squaredNorm()/lidarParams.lidarStdDev, -logShortHitProb)*lidarParams.correlationFactor;
-      cosAngle = fabs(lineDir.dot(scanDir));
-      if(cosAngle>lidarParams.minCosAngleError){
-        gradients.push_back(attraction);
-        points.push_back(scanPoint);
-      }
-    }else{
-      noCorrespondences++;
-    }
-    
-  }  
-  numPoints = float(points.size());
-  laserEval.numCorrespondences = int(points.size());
-  
-  //if(debug) printf("No correspondences: %d/%d numPoints:%d\n",noCorrespondences,lidarParams.numRays,int(numPoints));
-  //===========================================================================
+  int numUsed = 0;
+  for(int i=0; i<numRays; i++){
+    logWeight += buffers.logWeights[i];
+    numUsed += buffers.used[i];
+  }
+  float numPoints = float(numUsed);
+  buffers.numCorrespondences = numUsed;
   
   if(EnableProfiling) ft->Lap(__LINE__);
   
   if(numPoints<lidarParams.minPoints){
     locGrad.zero();
     angleGrad = 0.0;
+    buffers.meanSqError = 0.0;
     if(EnableProfiling) delete ft;
     return;
   }
   
   //Estimate translation and rotation
   locGrad.zero();
-  heading = Vector2f(0,0);
+  Vector2f heading(0.0,0.0);
   float headingAngle;
-  laserEval.meanSqError = 0.0;
-  Vector2f locE(V2COMP(loc)), r, locGradE(0.0,0.0);
-  for(unsigned int i = 0; i<gradients.size(); i++){
-    r = points[i]-locE;
-    laserEval.meanSqError += gradients[i].squaredNorm();
+  buffers.meanSqError = 0.0;
+  Vector2f locE(V2COMP(loc)), r, gradient, locGradE(0.0,0.0);
+  for(int i=0; i<numRays; i++){
+    if(!buffers.used[i])
+      continue;
+    r = Vector2f(buffers.sx[i],buffers.sy[i])-locE;
+    gradient = Vector2f(buffers.ax[i],buffers.ay[i]);
+    buffers.meanSqError += gradient.squaredNorm();
     if(r.squaredNorm()<sq(0.03))
       continue;
-    locGradE += gradients[i];
-    headingAngle = eigenCross(r, gradients[i]);
+    locGradE += gradient;
+    headingAngle = eigenCross(r, gradient);
     heading += Vector2f(cos(headingAngle),sin(headingAngle));
   }
   locGradE /= numPoints;
   locGrad.set(locGradE.x(),locGradE.y());
   heading /= numPoints;
-  laserEval.meanSqError /= numPoints;
+  buffers.meanSqError /= numPoints;
   
   if(EnableProfiling) ft->Lap(__LINE__);
     
@@ -831,6 +922,15 @@ void VectorLocalization2D::getLidarGradient(vector2f loc, float angle, vector2f&
 }
 //refine del paper
 void VectorLocalization2D::refineLocationLidar(vector2f& loc, float& angle, float& initialWeight, float& finalWeight, const LidarParams &lidarParams, const vector<Vector2f> &laserPoints)
+{
+  RefineBuffers &buffers = refineBuffers[0];
+  refineLocationLidar(loc, angle, initialWeight, finalWeight, lidarParams, laserPoints, buffers);
+  laserEval.numObservedPoints = buffers.numObservedPoints;
+  laserEval.numCorrespondences = buffers.numCorrespondences;
+  laserEval.meanSqError = buffers.meanSqError;
+}
+
+void VectorLocalization2D::refineLocationLidar(vector2f& loc, float& angle, float& initialWeight, float& finalWeight, const LidarParams &lidarParams, const vector<Vector2f> &laserPoints, RefineBuffers& buffers)
 {
   static const bool debug = false;
   
@@ -845,21 +945,53 @@ void VectorLocalization2D::refineLocationLidar(vector2f& loc, float& angle, floa
   robotAngle = Rotation2Df(angle);  
   Vector2f laserLocE = Vector2f(V2COMP(loc)) + robotAngle*(lidarParams.laserToBaseTrans);
   vector2f laserLoc(laserLocE.x(), laserLocE.y());
-  vector<line2f> lines;
   
   if(UseAnalyticRender){
-    lineCorrespondences = currentMap->getRayToLineCorrespondences(laserLoc, angle, lidarParams.angleResolution, lidarParams.numRays, lidarParams.minRange, lidarParams.maxRange, true, &lines);
+    buffers.lineCorrespondences = currentMap->getRayToLineCorrespondences(laserLoc, angle, lidarParams.angleResolution, lidarParams.numRays, lidarParams.minRange, lidarParams.maxRange, true, &buffers.lines);
   }else{
-    lineCorrespondences = currentMap->getRayToLineCorrespondences(laserLoc, angle, lidarParams.angleResolution, lidarParams.numRays, lidarParams.minRange, lidarParams.maxRange);
+    buffers.lineCorrespondences = currentMap->getRayToLineCorrespondences(laserLoc, angle, lidarParams.angleResolution, lidarParams.numRays, lidarParams.minRange, lidarParams.maxRange);
+  }
+  
+  //The rays in range that have a correspondence, with their lines, for getLidarGradient
+  const vector<line2f> &lines = UseAnalyticRender? buffers.lines : currentMap->lines;
+  const float *scanRays = lidarParams.laserScan;
+  buffers.resize(lidarParams.numRays+3);
+  buffers.numObservedPoints = 0;
+  buffers.numRays = 0;
+  for(int i=0; i<lidarParams.numRays-1; i++){
+    if(scanRays[i]<lidarParams.minRange || scanRays[i]>lidarParams.maxRange)
+      continue;
+    buffers.numObservedPoints++;
+    if(buffers.lineCorrespondences[i]<0)
+      continue;
+    const line2f &line = lines[buffers.lineCorrespondences[i]];
+    int j = buffers.numRays++;
+    buffers.px[j] = laserPoints[i].x();
+    buffers.py[j] = laserPoints[i].y();
+    buffers.qx[j] = laserPoints[i+1].x();
+    buffers.qy[j] = laserPoints[i+1].y();
+    buffers.p0x[j] = line.P0().x;
+    buffers.p0y[j] = line.P0().y;
+    buffers.dirx[j] = line.Dir().x;
+    buffers.diry[j] = line.Dir().y;
+    buffers.length[j] = line.Length();
+  }
+  //getLidarGradient takes four rays at a time, the padding is not used
+  for(int j=buffers.numRays; j%4!=0; j++){
+    buffers.px[j] = buffers.py[j] = buffers.qx[j] = buffers.qy[j] = 0.0;
+    buffers.p0x[j] = buffers.p0y[j] = buffers.dirx[j] = buffers.diry[j] = buffers.length[j] = 0.0;
   }
   
   for(int i=0; beingRefined && i<lidarParams.numSteps; i++)
   {
-    getLidarGradient(loc,angle,locGrad,angleGrad,weight,lidarParams, laserPoints, lineCorrespondences, lines);
+    getLidarGradient(loc,angle,locGrad,angleGrad,weight,lidarParams,buffers);
     if(i==0) initialWeight = exp(weight);
     loc -= lidarParams.etaLoc*locGrad;
     angle -= lidarParams.etaAngle*angleGrad;
     beingRefined = fabs(angleGrad)>lidarParams.minRefineFraction*lidarParams.maxAngleGradient && locGrad.sqlength()>sq(lidarParams.minRefineFraction*lidarParams.maxLocGradient);
+    //Stop once the step is within the tolerances
+    if(lidarParams.etaLoc*locGrad.length()<lidarParams.refineLocTolerance && fabs(lidarParams.etaAngle*angleGrad)<lidarParams.refineAngleTolerance)
+      beingRefined = false;
   }
   
   if(debug) printf("after: %.4f,%.4f %.2f\u00b0\n",V2COMP(loc),DEG(angle));
@@ -867,7 +999,6 @@ void VectorLocalization2D::refineLocationLidar(vector2f& loc, float& angle, floa
 }
 
 
-
 bool VectorLocalization2D::inLine(int numPoint, const std::vector< Vector2f >& pointsLaser)
 {
 	float xT = 0.0, yT = 0.0, xyT = 0.0, xxT = 0.0, yyT = 0.0;
@@ -999,8 +1130,19 @@ void VectorLocalization2D::refineLidar(const LidarParams &lidarParams)
   
   particlesRefined = particles;
   if(lidarParams.numSteps>0){  
+    if(refinePool==NULL)
+      refinePool = new ThreadPool(refineThreads);
+    //The particles are refined independently of each other, each with the scratch space of its thread
+    refinePool->run(numParticles, [&](int i, int thread){
+      RefineBuffers &buffers = refineBuffers[thread];
+      refineLocationLidar(particlesRefined[i].loc, particlesRefined[i].angle, stage0Weights[i], stageRWeights[i], lidarParams, laserPoints, buffers);
+      if(i==numParticles-1){
+        laserEval.numObservedPoints = buffers.numObservedPoints;
+        laserEval.numCorrespondences = buffers.numCorrespondences;
+        laserEval.meanSqError = buffers.meanSqError;
+      }
+    });
     for(int i=0; i<numParticles; i++){
-      refineLocationLidar(particlesRefined[i].loc, particlesRefined[i].angle, stage0Weights[i], stageRWeights[i], lidarParams, laserPoints);
       laserEval.stage0Weights += stage0Weights[i];
       laserEval.stageRWeights += stageRWeights[i];
     }
@@ -1121,6 +1263,7 @@ void VectorLocalization2D::computeLocation(vector2f& loc, float& angle)
 
 void VectorLocalization2D::resample(Resample type)
 {
+  double tStart = GetTimeSec();
   switch(type){
     case NaiveResampling:{
       naiveResample();
@@ -1130,7 +1273,11 @@ void VectorLocalization2D::resample(Resample type)
     }break;
     case SensorResettingResampling:{
     }break;
+    case KLDResampling:{
+      kldResample();
+    }break;
   }
+  resampleTime = GetTimeSec() - tStart;
 }
 
 void VectorLocalization2D::lowVarianceResample()
@@ -1252,9 +1399,75 @@ void VectorLocalization2D::naiveResample()
   oldParticles = particles;
 }
 
+void VectorLocalization2D::kldResample()
+{
+  int numRefinedParticles = (int) particlesRefined.size();
+  vector<float> cumulativeWeights(numRefinedParticles);
+  float totalWeight = 0.0;
+  
+  refinedImportanceWeights = unrefinedImportanceWeights = 0.0;
+  for(int i=0; i<numRefinedParticles; i++){
+    //Get rid of particles with undefined weights
+    if(isnan(particlesRefined[i].weight) || isinf(particlesRefined[i].weight) || particlesRefined[i].weight<0.0)
+      particlesRefined[i].weight = 0.0;
+    totalWeight += particlesRefined[i].weight;
+    cumulativeWeights[i] = totalWeight;
+    if(i<numParticles)
+      refinedImportanceWeights += particlesRefined[i].weight;
+    else
+      unrefinedImportanceWeights += particlesRefined[i].weight;
+  }
+  
+  if(totalWeight<FLT_MIN){
+    //Keep the particles as they are, as lowVarianceResample does
+    for(int i=0; i<numParticles; i++){
+      particles[i].weight = 1.0/float(numParticles);
+    }
+    return;
+  }
+  
+  //Draw particles until there are enough for the number of histogram bins they occupy (Fox, KLD-Sampling, 2003)
+  vector<Particle2D> newParticles;
+  newParticles.reserve(kldParams.maxParticles);
+  set<uint64_t> bins;
+  int required = kldParams.minParticles;
+  numRefinedParticlesSampled = numUnrefinedParticlesSampled = 0;
+  while(int(newParticles.size())<kldParams.maxParticles && int(newParticles.size())<required){
+    float x = frand(0.0f,totalWeight);
+    int j = upper_bound(cumulativeWeights.begin(), cumulativeWeights.end(), x) - cumulativeWeights.begin();
+    j = min(j, numRefinedParticles-1);
+    if(j<numParticles)
+      numRefinedParticlesSampled++;
+    else
+      numUnrefinedParticlesSampled++;
+    newParticles.push_back(particlesRefined[j]);
+    
+    const Particle2D &p = particlesRefined[j];
+    uint64_t xBin = int(floor(p.loc.x/kldParams.binSize)) & 0x1FFFFF;
+    uint64_t yBin = int(floor(p.loc.y/kldParams.binSize)) & 0x1FFFFF;
+    uint64_t angleBin = int(floor(angle_pos(p.angle)/kldParams.binAngle)) & 0x1FFFFF;
+    if(bins.insert((xBin<<42) | (yBin<<21) | angleBin).second && bins.size()>1){
+      //Number of samples so that the KL-divergence stays below epsilon with probability 1-delta
+      float k = bins.size()-1;
+      float a = 2.0/(9.0*k);
+      float n = k/(2.0*kldParams.epsilon)*cube(1.0 - a + sqrt(a)*kldQuantile);
+      required = max(kldParams.minParticles, int(ceil(n)));
+    }
+  }
+  
+  numParticles = newParticles.size();
+  float newWeight = 1.0/float(numParticles);
+  for(int i=0; i<numParticles; i++){
+    newParticles[i].weight = newWeight;
+  }
+  particles = newParticles;
+  stage0Weights.resize(numParticles);
+  stageRWeights.resize(numParticles);
+}
+
 void VectorLocalization2D::saveProfilingStats(FILE* f)
 {
-  fprintf(f, "%f, %f, ",refineTime, updateTime);
+  fprintf(f, "%f, %f, %f, %d, ",refineTime, updateTime, resampleTime, numParticles);
 }
 
 void VectorLocalization2D::saveRunLog(FILE* f)
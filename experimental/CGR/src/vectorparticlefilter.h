@@ -26,10 +26,12 @@
 #include <vector>
 #include <map>
 #include "vector_map.h"
+#include "vector_atlas.h"
 #include <eigen3/Eigen/Dense>
 #include "geometry.h"
 #include "util.h"
 #include "terminal_utils.h"
+#include "thread_pool.h"
 
 static const bool EnableProfiling = false;
 
@@ -95,6 +97,9 @@ public:
     float minCosAngleError;
     float correspondenceMargin;
     float minRefineFraction;
+    /// The refinement of a particle stops once a step moves it less than both of these (0 to always run numSteps)
+    float refineLocTolerance;
+    float refineAngleTolerance;
     
     float logObstacleProb; //Probability of an obstacle
     float logShortHitProb;
@@ -104,6 +109,7 @@ public:
     
     float kernelSize;
     
+    LidarParams() : refineLocTolerance(0.0), refineAngleTolerance(0.0) {}
     void initialize();
   };
   
@@ -138,6 +144,21 @@ public:
   };
   
   
+  class KLDParams{
+    public:
+    /// Size of the histogram bins over x and y (meters)
+    float binSize;
+    /// Size of the histogram bins over the angle (radians)
+    float binAngle;
+    /// Bound on the KL-divergence between the particles and the true posterior
+    float epsilon;
+    /// Probability of exceeding epsilon
+    float delta;
+    /// Limits on the number of particles
+    int minParticles;
+    int maxParticles;
+  };
+  
   typedef struct {
     double lastRunTime;
     double runTime;
@@ -148,23 +169,55 @@ public:
     float meanSqError;
   } EvalValues;
   
+  /// Scratch space of the LIDAR refinement, one per thread
+  class RefineBuffers{
+    public:
+    vector<int> lineCorrespondences;
+    vector<line2f> lines;
+    /// The rays in range that have a correspondence: their two laser points and their line, padded to a multiple of four
+    vector<float> px, py, qx, qy;
+    vector<float> p0x, p0y, dirx, diry, length;
+    /// Per ray of the last gradient: the scan point, the attraction, the log weight, and whether the ray is used
+    vector<float> sx, sy, ax, ay, logWeights;
+    vector<unsigned char> used;
+    int numRays;
+    int numObservedPoints;
+    int numCorrespondences;
+    float meanSqError;
+    void resize(int n);
+  };
+  
   enum Resample{
     NaiveResampling,
     LowVarianceResampling,
     SensorResettingResampling,
+    KLDResampling,
   };
-    vector<VectorMap> maps;
+    VectorAtlas atlas;
     vector<Particle2D> particles;
     vector<Particle2D> particlesRefined;
 protected:
   //Current state
   VectorMap* currentMap;
+  /// Keeps the current map loaded while the filter uses it
+  shared_ptr<VectorMap> currentMapRef;
+  int currentMapIndex;
+  /// A change of map waiting for the map to load in the background, and the pose to go with it
+  int pendingMap;
+  bool pendingLocation;
+  vector2f pendingLoc;
+  float pendingAngle, pendingLocationUncertainty, pendingAngleUncertainty;
+  bool lazyAtlas;
+  size_t atlasMemoryBudget;
   vector2f currentLocation;
   float currentAngle;
   vector2f currentLocStdDev;
   float currentAngleStdDev;
   int numParticles;
   vector<float> samplingDensity;
+  KLDParams kldParams;
+  /// Upper 1-delta quantile of the standard normal distribution, for the KLD bound
+  float kldQuantile;
   vector2f lastDistanceMoved;
   float lastAngleTurned;
   
@@ -181,6 +234,11 @@ protected:
   vector<int> lineCorrespondences;
   vector2f locCorrectionP0, locCorrectionP1;
   
+  /// Threads refining the particles, and the scratch space of each
+  int refineThreads;
+  ThreadPool* refinePool;
+  vector<RefineBuffers> refineBuffers;
+  
   //Statistics of performance
   int numUnrefinedParticlesSampled;
   int numRefinedParticlesSampled;
@@ -188,18 +246,26 @@ protected:
   float unrefinedImportanceWeights;
   double refineTime;
   double updateTime;
+  double resampleTime;
   EvalValues pointCloudEval;
   EvalValues laserEval;
     
 public:
 
-  VectorLocalization2D(const char* _mapsFolder);
+  VectorLocalization2D(const char* _mapsFolder, bool _lazyAtlas = false, size_t _atlasMemoryBudget = 0);
   VectorLocalization2D(int _numParticles);
+  ~VectorLocalization2D();
   
   /// Sets Particle Filter LIDAR parameters
   void setParams(MotionModelParams _predictParams, LidarParams _lidarUpdateParams);
-  /// Loads All the floor maps listed in atlas.txt
+  /// Sets the parameters of KLD resampling
+  void setKLDParams(const KLDParams& _kldParams);
+  /// Sets the number of threads of the LIDAR refinement, 0 for one per core
+  void setRefineThreads(int _refineThreads);
+  /// Loads All the floor maps listed in atlas.txt, or with a lazy atlas, each one when it is first needed
   void loadAtlas();
+  /// Switches to the map of the last setMap or setLocation once it has loaded, and loads ahead the maps of nearby transitions
+  void updateMap();
   /// Initialise arrays, and sets initial location to
   void initialize(int _numParticles, const char* mapName, vector2f loc, float angle, float locationUncertainty = 0.0, float angleUncertainty = 0.0);
   /// Predict step of the particle filter. Samples from the motion model
@@ -219,6 +285,8 @@ public:
   void predictParticle(Particle2D& p, float dx, float dy, float dtheta, const VectorLocalization2D::MotionModelParams& motionParams);
   /// Refine a single location hypothesis based on a LIDAR observation
   void refineLocationLidar(vector2f& loc, float& angle, float& initialWeight, float& finalWeight, const VectorLocalization2D::LidarParams& lidarParams, const std::vector< Vector2f >& laserPoints);
+  /// Refine a single location hypothesis based on a LIDAR observation, with the given scratch space
+  void refineLocationLidar(vector2f& loc, float& angle, float& initialWeight, float& finalWeight, const VectorLocalization2D::LidarParams& lidarParams, const std::vector< Vector2f >& laserPoints, RefineBuffers& buffers);
   /// Refine a single location hypothesis based on a Point Cloud observation
   void refineLocationPointCloud(vector2f& loc, float& angle, float& initialWeight, float& finalWeight, const vector< vector2f >& pointCloud, const vector< vector2f >& pointNormals, const VectorLocalization2D::PointCloudParams& pointCloudParams);
   
@@ -231,7 +299,7 @@ public:
   /// Gradient based on pointCloud observation
   void getPointCloudGradient(vector2f loc, float angle, vector2f& locGrad, float& angleGrad, const std::vector< vector2f >& pointCloud, const std::vector< vector2f >& pointNormals, float& logWeight, const VectorLocalization2D::PointCloudParams& pointCloudParams, const std::vector< int >& lineCorrespondences, const std::vector< line2f >& lines);
   /// Gradient based on LIDAR observation
-  void getLidarGradient(vector2f loc, float angle, vector2f& locGrad, float& angleGrad, float& logWeight, VectorLocalization2D::LidarParams lidarParams, const vector< Vector2f >& laserPoints, const vector<int> & lineCorrespondences, const vector<line2f> &lines);
+  void getLidarGradient(vector2f loc, float angle, vector2f& locGrad, float& angleGrad, float& logWeight, const VectorLocalization2D::LidarParams& lidarParams, RefineBuffers& buffers);
   /// Observation likelihood based on LIDAR obhservation
   float observationWeightLidar(vector2f loc, float angle, const VectorLocalization2D::LidarParams& lidarParams, const std::vector< Vector2f >& laserPoints);
   /// Observation likelihood based on point cloud obhservation
@@ -242,18 +310,22 @@ public:
   void setLocation(vector2f loc, float angle, const char* map, float locationUncertainty, float angleUncertainty);
   /// Set pose and map with specified uncertainty
   void setLocation(vector2f loc, float angle, float locationUncertainty, float angleUncertainty);
-  /// Switch to a different map
+  /// Switch to a different map, once it has loaded
   void setMap(const char * map);
   /// Resample particles using low variance resampling
   void lowVarianceResample();
   /// Resample particles using naive resampling
   void naiveResample();
+  /// Resample particles using KLD sampling, with as many particles as the spread of the distribution requires
+  void kldResample();
   /// Compute the maximum likelihood location based on particle spread
   void computeLocation(vector2f &loc, float &angle);
   /// Returns the current map name
   const char* getCurrentMapName(){return currentMap->mapName.c_str();}
-  /// Returns the vector maps 
-  inline vector<VectorMap> getMaps(){return maps;}
+  /// Returns the vector maps that are loaded
+  vector<VectorMap> getMaps();
+  /// Makes map i of the atlas the current map
+  void selectMap(int i, shared_ptr<VectorMap> map);
   /// Creates a particle with the specified properties
   Particle2D createParticle(VectorMap* map, vector2f loc, float angle, float locationUncertainty, float angleUncertainty);
   /// Write to file run statistics about particle distribution
@@ -269,6 +341,10 @@ public:
   bool inLine(int numPoint, const std::vector< Vector2f >& pointsLaser);
   /// Returns current particles
   void getParticles(vector<Particle2D> &_particles){_particles = particles;}
+  /// Returns the current number of particles
+  int getNumParticles(){return numParticles;}
+  /// Returns the time taken by the last refine, update and resample steps
+  void getRunTimes(double &_refineTime, double &_updateTime, double &_resampleTime){_refineTime = refineTime; _updateTime = updateTime; _resampleTime = resampleTime;}
 };
 
 #endif //VECTORPARTICLEFILTER_H
@@ -4,9 +4,18 @@
 #include <QMutex>
 #include <QVector>
 
-#include "biased_random_selector.h"
+#include <stdint.h>
+#include <math.h>
 
-//#include <omp.h>
+#include <algorithm>
+#include <functional>
+#include <random>
+#include <thread>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 /**
 ========================================
@@ -75,6 +84,13 @@ public:
     return weight;
   }
 
+  /// Per-thread generator. adapt() and computeWeight() run in parallel, so particles must draw their noise from here.
+  static std::mt19937 &rng()
+  {
+    thread_local std::mt19937 generator(uint32_t(std::random_device{}() ^ std::hash<std::thread::id>{}(std::this_thread::get_id())));
+    return generator;
+  }
+
 protected:
   double weight;
 };
@@ -93,32 +109,40 @@ public:
 /**
  *    R C P a r t i c l e F i l t e r
  *
- *
+ * Particles live in two buffers that are swapped, never copied wholesale: each step
+ * adapts and weights the resampled generation in place (in parallel), and the next
+ * generation is resampled into the other buffer. By default that happens every step;
+ * callers that opt in with setESSThreshold() resample only when the effective sample
+ * size drops below essThreshold*N, and carry the importance weights over otherwise.
+ * Weights, cumulative weights and resampling indices are kept as plain arrays.
  */
 template < typename RCPFInputData, typename RCPFControl, typename RCPFParticle, typename RCParticleFilterConfig = RCParticleFilter_Config >
 class RCParticleFilter
 {
 public:
+  enum ResamplingMethod { SystematicResampling, ResidualResampling };
+
   RCParticleFilter(RCParticleFilterConfig *conf, const RCPFInputData &data, const RCPFControl &control)
   {
     config = conf;
-    lastControl = control;
-    selector = new BiasedSelector(config->particles);
-    for (int32_t i=0; i<(int32_t)config->particles; ++i)
-    {
-      RCPFParticle p;
-      p.initialize(data, control, config);
-      resampledParticles.push_back(p);
-      weightedParticles.push_back(p);
-    }
+    method = SystematicResampling;
+    essThreshold = 1.;
+    ess = 0;
+    resampledLastStep = false;
+    noCandidates = false;
+    orderValid = false;
+    generator.seed(std::random_device()());
+    bufferA.resize(config->particles);
+    bufferB.resize(config->particles);
+    weightedParticles = &bufferA;
+    resampledParticles = &bufferB;
+    initialize(data, control, config);
   }
 
   void step(const RCPFInputData &data, const RCPFControl &control, bool includeBest=false, uint32_t maxThreads=-1)
   {
-    /// Particle Filter Step #1
-    adaptParticles(lastControl, control);
-    /// Particle Filter Step #2
-    calculateWeights(data, maxThreads);
+    /// Particle Filter Step #1 and #2
+    adaptAndWeight(lastControl, control, data, maxThreads);
     /// Particle Filter Step #3
     clone(control);
 
@@ -131,31 +155,58 @@ public:
 
   RCPFParticle getBest() const { return best; }
 
-
+  /// Replaces a particle of the generation the next step starts from, with the average prior weight
   void forceIncludeParticle(RCPFParticle p, uint32_t index)
   {
-    weightedParticles[index] = p;
+    (*resampledParticles)[index] = p;
+    priorWeights[index] = 1.;
   }
 
-  const QVector<RCPFParticle> &particles() const { return weightedParticles; }
+  const QVector<RCPFParticle> &particles() const { return *weightedParticles; }
 
   RCPFParticle getOrderedParticle(uint32_t p) const
   {
-    return weightedParticles[selector->getNumber(p)];
+    if (not orderValid)
+    {
+      order.resize(weights.size());
+      for (uint32_t i=0; i<order.size(); ++i)
+        order[i] = i;
+      std::sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) { return weights[a] > weights[b]; });
+      orderValid = true;
+    }
+    return (*weightedParticles)[order[p]];
   }
 
   RCPFParticle getResampledParticle(uint32_t p) const
   {
-    return resampledParticles[p];
+    return (*resampledParticles)[p];
   }
+
+  void setResamplingMethod(ResamplingMethod m) { method = m; }
+  /// Resample only when ESS < threshold * particles (1, the default, resamples every step, 0 never)
+  void setESSThreshold(double threshold) { essThreshold = threshold; }
+  double effectiveSampleSize() const { return ess; }
+  bool resampled() const { return resampledLastStep; }
+
 protected:
   QMutex mutex;
   RCParticleFilterConfig *config;
   RCPFParticle best;
   bool noCandidates;
-  BiasedSelector *selector;
   RCPFControl lastControl;
-  QVector < RCPFParticle > resampledParticles, weightedParticles;
+  QVector < RCPFParticle > bufferA, bufferB;
+  QVector < RCPFParticle > *resampledParticles, *weightedParticles;
+
+  ResamplingMethod method;
+  double essThreshold, ess;
+  bool resampledLastStep;
+  std::mt19937 generator;
+  std::vector<double> weights;       // normalized importance weights of weightedParticles
+  std::vector<double> priorWeights;  // weights carried over when a resample is skipped
+  std::vector<double> cumulative;
+  std::vector<uint32_t> indices;
+  mutable std::vector<uint32_t> order;
+  mutable bool orderValid;
 
   void lock()
   {
@@ -169,92 +220,135 @@ protected:
   void initialize(const RCPFInputData &data, const RCPFControl &control, const RCParticleFilterConfig *cfg)
   {
     lastControl = control;
-    for (int32_t i=0; i<(int32_t)config->particles; ++i)
+    const int32_t n = config->particles;
+    for (int32_t i=0; i<n; ++i)
     {
-      RCPFParticle *p = &resampledParticles.operator[](i);
-      p->initialize(data, control, cfg);
-      weightedParticles[i] = *p;
+      (*resampledParticles)[i].initialize(data, control, cfg);
+      (*weightedParticles)[i] = (*resampledParticles)[i];
     }
+    weights.assign(n, n>0 ? 1./n : 0.);
+    priorWeights.assign(n, 1.);
+    cumulative.resize(n);
+    indices.resize(n);
+    orderValid = false;
   }
 
-
-  void adaptParticles(const RCPFControl &controlBack, const RCPFControl &controlNew)
+  /// maxThreads: 0 runs serially, negative uses every available thread
+  static int32_t threadCount(int32_t maxThreads)
   {
-    RCPFParticle *p = &resampledParticles[0];
-    for (int32_t i=0; i<(int32_t)config->particles; ++i)
-    {
-      p[i].adapt(controlBack, controlNew, false);
-      weightedParticles[i] = p[i];
-    }
+#ifdef _OPENMP
+    return maxThreads<0 ? omp_get_max_threads() : std::max<int32_t>(maxThreads, 1);
+#else
+    return 1;
+#endif
   }
 
-  void calculateWeights(const RCPFInputData &data, int32_t maxThreads)
+  void adaptAndWeight(const RCPFControl &controlBack, const RCPFControl &controlNew, const RCPFInputData &data, int32_t maxThreads)
   {
-    RCPFParticle *p = &weightedParticles[0];
-
-    if (maxThreads==0)
-    {
-      for (uint i=0; i<config->particles; ++i)
-      {
-        p[i].computeWeight(data);
-      }
-    }
-    else
-    {
-      //omp_set_num_threads(maxThreads<0?omp_get_max_threads():maxThreads);
-      //#pragma omp parallel for
-      for (uint i=0; i<config->particles; ++i)
-      {
-        p[i].computeWeight(data);
-      }
-    }
+    // The generation to advance becomes the weighted one, no copy involved
+    std::swap(weightedParticles, resampledParticles);
+    RCPFParticle *p = weightedParticles->data();
+    const int32_t n = config->particles;
 
-    for (uint i=0; i<config->particles; ++i)
+    #pragma omp parallel for schedule(dynamic, 16) num_threads(threadCount(maxThreads))
+    for (int32_t i=0; i<n; ++i)
     {
-      selector->setWeight(i, (1000.0*p[i].getWeight())*1000.0, true);
+      p[i].adapt(controlBack, controlNew, false);
+      p[i].computeWeight(data);
     }
 
-    try
+    // Normalize, keeping track of the best particle and the effective sample size
+    double total = 0.;
+    int32_t bestIndex = 0;
+    for (int32_t i=0; i<n; ++i)
     {
-      selector->sort();
+      weights[i] = priorWeights[i] * p[i].getWeight();
+      total += weights[i];
+      if (p[i].getWeight() > p[bestIndex].getWeight())
+        bestIndex = i;
     }
-    catch (std::string s)
+    noCandidates = not (total > 1e-27);
+    double sumSq = 0.;
+    for (int32_t i=0; i<n; ++i)
     {
-      printf("catch %s\n", s.c_str());
+      weights[i] = noCandidates ? 1./n : weights[i]/total;
+      sumSq += weights[i]*weights[i];
     }
-
+    ess = sumSq > 0. ? 1./sumSq : 0.;
+    if (n > 0)
+      best = p[bestIndex];
+    orderValid = false;
   }
-  
+
   void clone(const RCPFControl &control)
   {
-    // Check if there is any considerably probable particle...
-    int selected;
-    try
+    const int32_t n = config->particles;
+    // Nothing probable, or still a healthy population: keep this generation as it is
+    if (noCandidates or (essThreshold < 1. and ess >= essThreshold*n))
     {
-      noCandidates = false;
-      selected = selector->get();
+      resampledParticles = weightedParticles;
+      if (noCandidates)
+        priorWeights.assign(n, 1.);
+      else
+        for (int32_t i=0; i<n; ++i)
+          priorWeights[i] = weights[i]*n;
+      resampledLastStep = false;
+      return;
     }
-    catch (...)
+
+    if (method == ResidualResampling)
+      residualResample();
+    else
+      systematicResample(weights, n, 0);
+
+    resampledParticles = weightedParticles == &bufferA ? &bufferB : &bufferA;
+    const RCPFParticle *src = weightedParticles->data();
+    RCPFParticle *dst = resampledParticles->data();
+    #pragma omp parallel for num_threads(threadCount(-1))
+    for (int32_t i=0; i<n; ++i)
+      dst[i] = src[indices[i]];
+    priorWeights.assign(n, 1.);
+    resampledLastStep = true;
+  }
+
+  /// Draws \p count indices from the (unnormalized) weights \p w with a single uniform, writing indices[offset...]
+  void systematicResample(const std::vector<double> &w, const int32_t count, const int32_t offset)
+  {
+    const int32_t n = w.size();
+    double total = 0.;
+    for (int32_t i=0; i<n; ++i)
     {
-      noCandidates = true;
+      total += w[i];
+      cumulative[i] = total;
     }
-    // Clone
-    try
+    if (count <= 0 or not (total > 0.))
+      return;
+    const double step = total / count;
+    double u = std::uniform_real_distribution<double>(0., step)(generator);
+    int32_t j = 0;
+    for (int32_t i=0; i<count; ++i, u+=step)
     {
-      best = weightedParticles.operator[](selector->getFirst());
-      // If there was, perform a regular clone process
-      for (uint i=0; i<config->particles; ++i)
-      {
-        selected = noCandidates?i:selector->get();
-        RCPFParticle p = weightedParticles.operator[](selected);
-//        p.adapt(lastControl, control, noCandidates);
-        resampledParticles.operator[](i) = p;
-      }
+      while (j < n-1 and cumulative[j] < u)
+        ++j;
+      indices[offset+i] = j;
     }
-    catch (...)
+  }
+
+  /// Copies floor(N*w) of every particle and fills the rest systematically from the residuals
+  void residualResample()
+  {
+    const int32_t n = config->particles;
+    std::vector<double> &residuals = priorWeights;  // overwritten after resampling anyway
+    int32_t k = 0;
+    for (int32_t i=0; i<n; ++i)
     {
-      qFatal("THIS SHOULD NEVER HAPPEN! selector->get\n");
+      const double expected = weights[i]*n;
+      const int32_t copies = std::min<int32_t>(floor(expected), n-k);
+      for (int32_t c=0; c<copies; ++c)
+        indices[k++] = i;
+      residuals[i] = expected - copies;
     }
+    systematicResample(residuals, n-k, k);
   }
 };
 
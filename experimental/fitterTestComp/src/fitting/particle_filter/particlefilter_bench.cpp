@@ -0,0 +1,104 @@
+// Time per RCParticleFilter step of the RectPrismCloudParticle that PfRectPrismFitting
+// runs, for 100 to 1000 particles fitting a 400x200x300 mm box, turned 0.3 rad about z,
+// seen as a cloud of points on its faces. Reports the center and width error of the
+// best particle, the effective sample size and how often the population was
+// resampled, for systematic and residual resampling, resampling every step (the
+// default) and only when the ESS drops below half the particles.
+//   particlefilter_bench [threads] [steps] [cloud points] [particles...]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include "../rect_prism_cloud_particle.h"
+
+static double now()
+{
+  return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+typedef RCParticleFilter<RectPrismCloudPFInputData, int, RectPrismCloudParticle, RCParticleFilter_Config> PrismFilter;
+
+static const float center[3] = {100, -50, 800}, width[3] = {400, 200, 300}, rz = 0.3;
+
+/// Points on the faces of the box, each face getting its share of the points by area
+static void boxCloud(uint32_t points, pcl::PointCloud<PointT> &cloud)
+{
+  std::mt19937 rng(34);
+  std::uniform_real_distribution<float> u(-0.5, 0.5);
+  const float area[3] = {width[1]*width[2], width[0]*width[2], width[0]*width[1]};
+  std::discrete_distribution<int> face({area[0], area[0], area[1], area[1], area[2], area[2]});
+  cloud.points.clear();
+  for (uint32_t i=0; i<points; i++)
+  {
+    const int f = face(rng);
+    float p[3] = {u(rng)*width[0], u(rng)*width[1], u(rng)*width[2]};
+    p[f/2] = (f%2 ? 0.5f : -0.5f)*width[f/2];
+    PointT point;
+    point.x = center[0] + cos(rz)*p[0] - sin(rz)*p[1];
+    point.y = center[1] + sin(rz)*p[0] + cos(rz)*p[1];
+    point.z = center[2] + p[2];
+    cloud.points.push_back(point);
+  }
+}
+
+int main(int argc, char **argv)
+{
+  const int threads = argc > 1 ? atoi(argv[1]) : -1;
+  const int steps = argc > 2 ? atoi(argv[2]) : 30;
+  const uint32_t points = argc > 3 ? atoi(argv[3]) : 500;
+  std::vector<uint32_t> sizes;
+  for (int i=4; i<argc; i++)
+    sizes.push_back(atoi(argv[i]));
+  if (sizes.empty())
+    sizes = {100, 300, 1000};
+
+  RectPrismCloudPFInputData input;
+  boxCloud(points, input.cloud_target);
+  std::vector<float> trueWidth(width, width+3);
+  std::sort(trueWidth.begin(), trueWidth.end());
+
+  printf("%d steps, %u cloud points, %d threads (-1 all)\n", steps, points, threads);
+  printf("%-10s %-11s %-9s %12s %12s %12s %12s %10s\n", "particles", "resampling", "ESS thr", "step [ms]", "center [mm]", "width [mm]", "ESS/N", "resampled");
+  for (const uint32_t particles : sizes)
+  {
+    for (const double threshold : {1., 0.5})
+    {
+      for (const auto method : {PrismFilter::SystematicResampling, PrismFilter::ResidualResampling})
+      {
+        RCParticleFilter_Config config;
+        config.particles = particles;
+        PrismFilter filter(&config, input, 0);
+        filter.setResamplingMethod(method);
+        filter.setESSThreshold(threshold);
+
+        double t = 0;
+        int resamples = 0;
+        for (int s=0; s<steps; s++)
+        {
+          const double t0 = now();
+          filter.step(input, 0, false, threads);
+          t += now() - t0;
+          resamples += filter.resampled();
+        }
+        // Widths are compared sorted: the fit may settle on any permutation of the axes
+        RectPrismCloudParticle best = filter.getBest();
+        const QVec c = best.getTranslation(), w = best.getScale();
+        std::vector<float> fitWidth = {fabsf(w(0)), fabsf(w(1)), fabsf(w(2))};
+        std::sort(fitWidth.begin(), fitWidth.end());
+        double widthError = 0;
+        for (int i=0; i<3; i++)
+          widthError += fabs(fitWidth[i] - trueWidth[i])/3;
+        const double centerError = sqrt((c(0)-center[0])*(c(0)-center[0]) + (c(1)-center[1])*(c(1)-center[1]) + (c(2)-center[2])*(c(2)-center[2]));
+        printf("%-10u %-11s %-9.1f %12.3f %12.1f %12.1f %12.3f %10d\n", particles, method == PrismFilter::SystematicResampling ? "systematic" : "residual",
+               threshold, 1e3*t/steps, centerError, widthError, filter.effectiveSampleSize()/particles, resamples);
+        fflush(stdout);
+      }
+    }
+  }
+  return 0;
+}
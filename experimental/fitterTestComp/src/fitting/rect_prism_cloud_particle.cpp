@@ -174,9 +174,9 @@ QVec RectPrismCloudParticle::getScale()
 
 float RectPrismCloudParticle::getRandom(float var)
 {
-  double U = double(rand())/RAND_MAX;
-  double V = double(rand())/RAND_MAX;
-  return sqrt(-2*log(U))*cos(2.*M_PIl*V)*var;
+  // adapt() runs in parallel, so the noise comes from the per-thread generator
+  std::normal_distribution<float> normal(0.f, 1.f);
+  return normal(rng())*var;
 }
 
 void RectPrismCloudParticle::setRectPrism (RectPrism r )
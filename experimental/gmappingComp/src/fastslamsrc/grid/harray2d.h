@@ -4,6 +4,7 @@
 #include <utils/point.h>
 #include <utils/autoptr.h>
 #include "array2d.h"
+#include "patchpool.h"
 
 namespace GMapping {
 
@@ -34,8 +35,10 @@ class HierarchicalArray2D: public Array2D<autoptr< Array2D<Cell> > >{
 		inline void setActiveArea(const PointSet&, bool patchCoords=false);
 		const PointSet& getActiveArea() const {return m_activeArea; }
 		inline void allocActiveArea();
+		/**Drops the shares of all the patches, the array stays of the same size with no cell allocated.*/
+		inline void releasePatches();
 	protected:
-		virtual Array2D<Cell> * createPatch(const IntPoint& p) const;
+		virtual autoptr< Array2D<Cell> > createPatch(const IntPoint& p) const;
 		PointSet m_activeArea;
 		int m_patchMagnitude;
 		int m_patchSize;
@@ -129,8 +132,8 @@ void HierarchicalArray2D<Cell>::setActiveArea(const typename HierarchicalArray2D
 }
 
 template <class Cell>
-Array2D<Cell>* HierarchicalArray2D<Cell>::createPatch(const IntPoint& ) const{
-	return new Array2D<Cell>(1<<m_patchMagnitude, 1<<m_patchMagnitude);
+autoptr< Array2D<Cell> > HierarchicalArray2D<Cell>::createPatch(const IntPoint& ) const{
+	return PatchPool<Cell>::instance().create(1<<m_patchMagnitude);
 }
 
 
@@ -148,18 +151,25 @@ AccessibilityState  HierarchicalArray2D<Cell>::cellState(int x, int y) const {
 
 template <class Cell>
 void HierarchicalArray2D<Cell>::allocActiveArea(){
+	//copy on write: a patch only this array refers to is written in place
 	for (PointSet::const_iterator it= m_activeArea.begin(); it!=m_activeArea.end(); it++){
-		const autoptr< Array2D<Cell> >& ptr=this->m_cells[it->x][it->y];
-		Array2D<Cell>* patch=0;
+		autoptr< Array2D<Cell> >& ptr=this->m_cells[it->x][it->y];
 		if (!ptr){
-			patch=createPatch(*it);
-		} else{	
-			patch=new Array2D<Cell>(*ptr);
+			ptr=createPatch(*it);
+		} else if (ptr.m_reference->shares>1){
+			ptr=PatchPool<Cell>::instance().copy(*ptr);
 		}
-		this->m_cells[it->x][it->y]=autoptr< Array2D<Cell> >(patch);
 	}
 }
 
+template <class Cell>
+void HierarchicalArray2D<Cell>::releasePatches(){
+	for (int x=0; x<this->m_xsize; x++)
+		for (int y=0; y<this->m_ysize; y++)
+			this->m_cells[x][y]=autoptr< Array2D<Cell> >(0);
+	m_activeArea.clear();
+}
+
 template <class Cell>
 bool HierarchicalArray2D<Cell>::isAllocated(int x, int y) const{
 	IntPoint c=patchIndexes(x,y);
@@ -179,8 +189,7 @@ Cell& HierarchicalArray2D<Cell>::cell(int x, int y){
 	IntPoint c=patchIndexes(x,y);
 	assert(this->isInside(c.x, c.y));
 	if (!this->m_cells[c.x][c.y]){
-		Array2D<Cell>* patch=createPatch(IntPoint(x,y));
-		this->m_cells[c.x][c.y]=autoptr< Array2D<Cell> >(patch);
+		this->m_cells[c.x][c.y]=createPatch(IntPoint(x,y));
 		//cerr << "!!! FATAL: your dick is going to fall down" << endl;
 	}
 	autoptr< Array2D<Cell> >& ptr=this->m_cells[c.x][c.y];
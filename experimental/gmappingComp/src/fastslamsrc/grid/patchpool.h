@@ -0,0 +1,124 @@
+#ifndef PATCHPOOL_H
+#define PATCHPOOL_H
+#include <map>
+#include <mutex>
+#include <vector>
+#include <utils/autoptr.h>
+#include "array2d.h"
+
+namespace GMapping {
+
+/**
+Allocator of the patches of the hierarchical arrays. When the last share of a patch goes,
+the patch is not deleted: it is kept with its reference on the free list of its size, and
+create() and copy() hand it out again. While the filter runs, patches are released about as
+fast as new ones are needed, so after the first scans they no longer come from the heap.
+There is one pool per cell type, used by all the maps, and it can be used from several threads.
+*/
+template <class Cell>
+class PatchPool{
+	public:
+		typedef Array2D<Cell> Patch;
+		typedef typename autoptr<Patch>::reference Reference;
+		static PatchPool& instance();
+		/**A patch of size x size cells, all default constructed.*/
+		inline autoptr<Patch> create(int size);
+		/**A patch with the cells of p.*/
+		inline autoptr<Patch> copy(const Patch& p);
+		/**Deletes the free patches.*/
+		void trim();
+		/**Patches taken from the heap so far.*/
+		inline unsigned long allocated() const {return m_allocated;}
+		/**Patches handed out again from the free lists so far.*/
+		inline unsigned long recycled() const {return m_recycled;}
+		/**Patches on the free lists.*/
+		unsigned long available();
+	protected:
+		PatchPool(): m_allocated(0), m_recycled(0){}
+		Reference* take(int xsize, int ysize, bool& recycled);
+		static void release(Reference* r);
+		std::mutex m_mutex;
+		std::map<std::pair<int,int>, std::vector<Reference*> > m_free;
+		std::atomic<unsigned long> m_allocated, m_recycled;
+};
+
+template <class Cell>
+PatchPool<Cell>& PatchPool<Cell>::instance(){
+	//never destroyed, maps may still release patches during the static destruction
+	static PatchPool<Cell>* pool=new PatchPool<Cell>;
+	return *pool;
+}
+
+template <class Cell>
+typename PatchPool<Cell>::Reference* PatchPool<Cell>::take(int xsize, int ysize, bool& recycled){
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		std::vector<Reference*>& freeList=m_free[std::make_pair(xsize, ysize)];
+		if (!freeList.empty()){
+			Reference* r=freeList.back();
+			freeList.pop_back();
+			m_recycled++;
+			recycled=true;
+			return r;
+		}
+	}
+	Reference* r=new Reference;
+	r->data=new Patch(xsize, ysize);
+	r->release=&PatchPool<Cell>::release;
+	m_allocated++;
+	recycled=false;
+	return r;
+}
+
+template <class Cell>
+void PatchPool<Cell>::release(Reference* r){
+	PatchPool<Cell>& pool=instance();
+	std::lock_guard<std::mutex> lock(pool.m_mutex);
+	pool.m_free[std::make_pair(r->data->getXSize(), r->data->getYSize())].push_back(r);
+}
+
+template <class Cell>
+autoptr<Array2D<Cell> > PatchPool<Cell>::create(int size){
+	bool recycled;
+	Reference* r=take(size, size, recycled);
+	if (recycled){
+		Cell empty;
+		for (int x=0; x<size; x++)
+			for (int y=0; y<size; y++)
+				r->data->m_cells[x][y]=empty;
+	}
+	return autoptr<Patch>::fromReference(r);
+}
+
+template <class Cell>
+autoptr<Array2D<Cell> > PatchPool<Cell>::copy(const Patch& p){
+	bool recycled;
+	Reference* r=take(p.getXSize(), p.getYSize(), recycled);
+	*(r->data)=p;
+	return autoptr<Patch>::fromReference(r);
+}
+
+template <class Cell>
+void PatchPool<Cell>::trim(){
+	std::lock_guard<std::mutex> lock(m_mutex);
+	for (typename std::map<std::pair<int,int>, std::vector<Reference*> >::iterator it=m_free.begin(); it!=m_free.end(); it++){
+		for (unsigned int i=0; i<it->second.size(); i++){
+			delete it->second[i]->data;
+			delete it->second[i];
+		}
+		it->second.clear();
+	}
+}
+
+template <class Cell>
+unsigned long PatchPool<Cell>::available(){
+	std::lock_guard<std::mutex> lock(m_mutex);
+	unsigned long n=0;
+	for (typename std::map<std::pair<int,int>, std::vector<Reference*> >::const_iterator it=m_free.begin(); it!=m_free.end(); it++)
+		n+=it->second.size();
+	return n;
+}
+
+};
+
+#endif
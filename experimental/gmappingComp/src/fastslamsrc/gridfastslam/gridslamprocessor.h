@@ -222,6 +222,9 @@ namespace GMapping {
     /**generate an accupancy grid map [scanmatcher]*/
     MEMBER_PARAM_SET_GET(m_matcher, bool, generateMap, protected, public, public);
 
+    /**score scans with a likelihood field kept with each map instead of a kernel search [scanmatcher]*/
+    MEMBER_PARAM_SET_GET(m_matcher, bool, likelihoodField, protected, public, public);
+
     /**enlarge the map when the robot goes out of the boundaries [scanmatcher]*/
     MEMBER_PARAM_SET_GET(m_matcher, bool, enlargeStep, protected, public, public);
 
@@ -323,6 +326,8 @@ namespace GMapping {
     void updateTreeWeights(bool weightsAlreadyNormalized = false);
     void resetTree();
     double propagateWeights();
+    /**prunes the branches of the particles resampled away, and releases their maps*/
+    void pruneParticles(const std::vector<unsigned int>& deletedParticles);
     
   };
 
@@ -127,22 +127,22 @@ inline bool GridSlamProcessor::resample(const double* plainReading, int adaptSiz
     std::cerr <<  "Deleting Nodes:";
     for (unsigned int i=0; i<deletedParticles.size(); i++){
       std::cerr <<" " << deletedParticles[i];
-      delete m_particles[deletedParticles[i]].node;
-      m_particles[deletedParticles[i]].node=0;
     }
+    pruneParticles(deletedParticles);
     std::cerr  << " Done" <<std::endl;
     
     //END: BUILDING TREE
     std::cerr << "Deleting old particles..." ;
-    m_particles.clear();
+    //the old generation goes before the scans are registered, or every active patch would still be shared
+    m_particles.swap(temp);
+    temp.clear();
     std::cerr << "Done" << std::endl;
-    std::cerr << "Copying Particles and  Registering  scans...";
-    for (ParticleVector::iterator it=temp.begin(); it!=temp.end(); it++){
+    std::cerr << "Registering  scans...";
+    for (ParticleVector::iterator it=m_particles.begin(); it!=m_particles.end(); it++){
       it->setWeight(0);
       m_matcher.invalidateActiveArea();
 	  if (registerScan)
 		m_matcher.registerScan(it->map, it->pose, plainReading);
-      m_particles.push_back(*it);
     }
     std::cerr  << " Done" <<std::endl;
     hasResampled = true;
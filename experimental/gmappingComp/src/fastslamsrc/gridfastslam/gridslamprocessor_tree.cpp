@@ -260,6 +260,17 @@ double GridSlamProcessor::propagateWeights(){
 	return lastNodeWeight;
 }
 
+void GridSlamProcessor::pruneParticles(const std::vector<unsigned int>& deletedParticles){
+	// the patches only a pruned particle referred to go back to the pool right here,
+	// and the survivors registering the scan next get them instead of heap memory
+	for (unsigned int i=0; i<deletedParticles.size(); i++){
+		Particle& p=m_particles[deletedParticles[i]];
+		delete p.node;
+		p.node=0;
+		p.map.storage().releasePatches();
+	}
+}
+
 };
 
 //END
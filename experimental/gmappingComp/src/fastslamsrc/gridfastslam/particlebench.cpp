@@ -0,0 +1,191 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <atomic>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <vector>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <log/sensorstream.h>
+#include "gridslamprocessor.h"
+
+/*
+Memory and speed of the filter against the number of particles, on a CARMEN log (FLASER and
+ODOM lines). Each particle count runs in its own process, with the parameters of etc/config,
+and reports its peak resident size, the heap allocations per processed scan and the processed
+scans per second. The allocations are counted by the operator new of this program.
+*/
+
+using namespace std;
+using namespace GMapping;
+
+static atomic<unsigned long> allocations(0);
+
+//none of them inlined, or gcc sees malloc() and free() on one side and operator new or
+//delete on the other, and warns of a mismatch
+__attribute__((noinline)) void* operator new(size_t size){
+	allocations++;
+	void* p=malloc(size?size:1);
+	if (!p)
+		throw bad_alloc();
+	return p;
+}
+
+__attribute__((noinline)) void operator delete(void* p) noexcept{
+	free(p);
+}
+
+__attribute__((noinline)) void operator delete(void* p, size_t) noexcept{
+	free(p);
+}
+
+static double now(){
+	struct timeval tv;
+	gettimeofday(&tv, 0);
+	return tv.tv_sec+1e-6*tv.tv_usec;
+}
+
+struct Result{
+	unsigned int processed;
+	double time;
+	unsigned long allocations;
+	long peakRSS;
+	unsigned long patchesAllocated, patchesRecycled, patchesFree;
+};
+
+static Result runFilter(const vector<RangeReading*>& scans, const SensorMap& sensorMap, int particles, double delta){
+	GridSlamProcessor processor(cerr);
+	processor.setSensorMap(sensorMap);
+	processor.setMatchingParameters(20., 30., 0.05, 1, 0.05, 0.05, 10, 0.075, 3, 0);
+	processor.setMotionModelParameters(0.1, 0.2, 0.1, 0.2);
+	processor.setUpdateDistances(0.2, 0.1, 0.4);
+	processor.setgenerateMap(true);
+	processor.setllsamplerange(0.1);
+	processor.setllsamplestep(0.1);
+	processor.setlasamplerange(0.01);
+	processor.setlasamplestep(0.02);
+	processor.init(particles, -10, -10, 10, 10, delta, vector<OrientedPoint>(particles, scans[0]->getPose()));
+
+	Result r;
+	r.processed=0;
+	unsigned long a=allocations;
+	double t=now();
+	for (unsigned int i=0; i<scans.size(); i++)
+		if (processor.processScan(*scans[i]))
+			r.processed++;
+	r.time=now()-t;
+	r.allocations=allocations-a;
+
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	r.peakRSS=usage.ru_maxrss;
+	r.patchesAllocated=PatchPool<PointAccumulator>::instance().allocated();
+	r.patchesRecycled=PatchPool<PointAccumulator>::instance().recycled();
+	r.patchesFree=PatchPool<PointAccumulator>::instance().available();
+	return r;
+}
+
+int main(int argc, const char* const* argv){
+	if (argc<2){
+		cout << "usage particlebench <carmen log> [-particles <n,n,...>] [-delta <m>] [-fov <deg>]" << endl;
+		return -1;
+	}
+	vector<int> counts;
+	double delta=0.05, fov=180;
+	for (int c=2; c+1<argc; c+=2){
+		if (!strcmp(argv[c],"-particles")){
+			istringstream is(argv[c+1]);
+			string n;
+			while (getline(is, n, ','))
+				counts.push_back(atoi(n.c_str()));
+		}
+		else if (!strcmp(argv[c],"-delta")) delta=atof(argv[c+1]);
+		else if (!strcmp(argv[c],"-fov")) fov=atof(argv[c+1]);
+	}
+	if (counts.empty()){
+		counts.push_back(10);
+		counts.push_back(30);
+		counts.push_back(100);
+	}
+
+	//the number of beams comes from the first laser line
+	ifstream is(argv[1]);
+	if (!is){
+		cout << "could not read " << argv[1] << endl;
+		return -1;
+	}
+	unsigned int beams=0;
+	string line;
+	while (!beams && getline(is, line)){
+		istringstream lis(line);
+		string name;
+		lis >> name;
+		if (name=="FLASER")
+			lis >> beams;
+	}
+	if (!beams){
+		cout << "no FLASER lines in " << argv[1] << endl;
+		return -1;
+	}
+	is.clear();
+	is.seekg(0);
+
+	RangeSensor* laser=new RangeSensor("FLASER", beams, fov/180.*M_PI/(beams-1), OrientedPoint(0,0,0), 0, 30.);
+	SensorMap sensorMap;
+	sensorMap["FLASER"]=laser;
+	sensorMap["ODOM"]=new OdometrySensor("ODOM");
+	InputSensorStream stream(sensorMap, is);
+	vector<RangeReading*> scans;
+	while (stream){
+		const SensorReading* reading=0;
+		stream >> reading;
+		const RangeReading* scan=dynamic_cast<const RangeReading*>(reading);
+		if (scan)
+			scans.push_back(const_cast<RangeReading*>(scan));
+		else
+			delete reading;
+	}
+	if (scans.empty())
+		return -1;
+	cout << scans.size() << " scans of " << beams << " beams" << endl;
+	cout << "particles  scans/s  allocations/scan  peak RSS [MB]  patches allocated  patches recycled  patches free" << endl;
+
+	for (unsigned int i=0; i<counts.size(); i++){
+		//a process each, for the peak resident size; the filter is verbose, only the result comes back
+		int fd[2];
+		if (pipe(fd))
+			return -1;
+		cout.flush();
+		fflush(stdout);
+		pid_t pid=fork();
+		if (!pid){
+			close(fd[0]);
+			if (!freopen("/dev/null", "w", stdout) || !freopen("/dev/null", "w", stderr))
+				_exit(1);
+			Result r=runFilter(scans, sensorMap, counts[i], delta);
+			_exit(write(fd[1], &r, sizeof(r))==sizeof(r)?0:1);
+		}
+		close(fd[1]);
+		Result r;
+		bool ok=read(fd[0], &r, sizeof(r))==sizeof(r);
+		close(fd[0]);
+		waitpid(pid, 0, 0);
+		if (!ok){
+			cout << counts[i] << " particles failed" << endl;
+			continue;
+		}
+		printf("%9d  %7.2f  %16.0f  %13.1f  %17lu  %16lu  %12lu\n", counts[i], r.processed/r.time,
+			(double)r.allocations/r.processed, r.peakRSS/1024., r.patchesAllocated, r.patchesRecycled, r.patchesFree);
+	}
+
+	for (unsigned int i=0; i<scans.size(); i++)
+		delete scans[i];
+	delete sensorMap["ODOM"];
+	delete laser;
+	return 0;
+}
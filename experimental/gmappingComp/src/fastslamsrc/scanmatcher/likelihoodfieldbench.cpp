@@ -0,0 +1,259 @@
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <sys/time.h>
+#include <log/sensorstream.h>
+#include "scanmatcher.h"
+
+/*
+Compares the kernel search of the scan matcher with the likelihood field on a CARMEN log
+(FLASER and ODOM lines). The log is mapped twice, with the same scan matcher settings
+and each scoring mode, the way ScanMatcherProcessor does it. At every scan a fixed set of
+candidate poses around the odometry pose is scored with both modes on the map built with
+the kernel search, for the throughput and for how often both pick the same best pose.
+Given a file of true poses, one "x y theta" line per scan, also reports the position error
+of the odometry and of both trajectories, all taken relative to their first pose.
+*/
+
+using namespace std;
+using namespace GMapping;
+
+static double now(){
+	struct timeval tv;
+	gettimeofday(&tv, 0);
+	return tv.tv_sec+1e-6*tv.tv_usec;
+}
+
+struct Run{
+	vector<OrientedPoint> poses;
+	double optimizeTime;
+	double scoreTime;
+	unsigned int scored;
+};
+
+static void setupMatcher(ScanMatcher& matcher, const RangeSensor* laser, int kernel, bool field){
+	vector<double> angles(laser->beams().size());
+	for (unsigned int i=0; i<angles.size(); i++)
+		angles[i]=laser->beams()[i].pose.theta;
+	matcher.setLaserParameters(angles.size(), &angles[0], laser->getPose());
+	matcher.setMatchingParameters(15., 30., 0.05, kernel, 0.05, 0.05, 5, 0.075, 0);
+	matcher.setgenerateMap(true);
+	matcher.setlikelihoodField(field);
+}
+
+static void candidates(vector<OrientedPoint>& poses, const OrientedPoint& p){
+	poses.clear();
+	for (int x=-1; x<=1; x++)
+	for (int y=-1; y<=1; y++)
+	for (int t=-1; t<=1; t++)
+		poses.push_back(OrientedPoint(p.x+x*0.025, p.y+y*0.025, p.theta+t*0.0125));
+}
+
+static unsigned int best(const ScanMatcher& matcher, const ScanMatcherMap& map, const vector<OrientedPoint>& poses, const double* readings){
+	unsigned int b=0;
+	double bestScore=-1;
+	for (unsigned int i=0; i<poses.size(); i++){
+		double s=matcher.score(map, poses[i], readings);
+		if (s>bestScore){
+			bestScore=s;
+			b=i;
+		}
+	}
+	return b;
+}
+
+/*position error of each pose against the true one, both relative to their first pose*/
+static void poseError(const vector<OrientedPoint>& poses, const vector<OrientedPoint>& truth, double& mean, double& worst, double& last){
+	mean=worst=last=0;
+	for (unsigned int i=0; i<poses.size(); i++){
+		OrientedPoint d=absoluteDifference(poses[i], poses[0])-absoluteDifference(truth[i], truth[0]);
+		last=sqrt(d.x*d.x+d.y*d.y);
+		mean+=last/poses.size();
+		worst=max(worst, last);
+	}
+}
+
+/*maps the log with one scoring mode; with agreement, counts the scans where the other mode picks the same best candidate*/
+static void mapLog(Run& run, ScanMatcherMap& map, const vector<RangeReading*>& scans, const RangeSensor* laser,
+		int kernel, bool field, unsigned int* agreement){
+	ScanMatcher matcher, other;
+	setupMatcher(matcher, laser, kernel, field);
+	setupMatcher(other, laser, kernel, !field);
+	vector<double> readings(laser->beams().size());
+	vector<OrientedPoint> poses;
+	OrientedPoint pose(0,0,0), odoPose(0,0,0);
+	run.optimizeTime=run.scoreTime=0;
+	run.scored=0;
+	if (agreement)
+		*agreement=0;
+	for (unsigned int i=0; i<scans.size(); i++){
+		const RangeReading& reading=*scans[i];
+		OrientedPoint relPose=reading.getPose();
+		if (!i)
+			odoPose=relPose;
+		pose=absoluteSum(pose, absoluteDifference(relPose, odoPose));
+		pose.theta=atan2(sin(pose.theta), cos(pose.theta));
+		odoPose=relPose;
+		reading.rawView(&readings[0], map.getDelta());
+
+		OrientedPoint newPose=pose;
+		if (i){
+			candidates(poses, pose);
+			double t=now();
+			unsigned int b=best(matcher, map, poses, &readings[0]);
+			run.scoreTime+=now()-t;
+			run.scored+=poses.size();
+			if (agreement && best(other, map, poses, &readings[0])==b)
+				(*agreement)++;
+
+			t=now();
+			matcher.optimize(newPose, map, pose, &readings[0]);
+			run.optimizeTime+=now()-t;
+		}
+		matcher.invalidateActiveArea();
+		matcher.registerScan(map, newPose, &readings[0]);
+		pose=newPose;
+		run.poses.push_back(pose);
+	}
+}
+
+int main(int argc, const char* const* argv){
+	if (argc<2){
+		cout << "usage likelihoodfieldbench <carmen log> [-kernel <cells>] [-delta <m>] [-fov <deg>] [-truth <poses>]" << endl;
+		return -1;
+	}
+	int kernel=1;
+	double delta=0.05, fov=180;
+	const char* truthFile=0;
+	for (int c=2; c+1<argc; c+=2){
+		if (!strcmp(argv[c],"-kernel")) kernel=atoi(argv[c+1]);
+		else if (!strcmp(argv[c],"-delta")) delta=atof(argv[c+1]);
+		else if (!strcmp(argv[c],"-fov")) fov=atof(argv[c+1]);
+		else if (!strcmp(argv[c],"-truth")) truthFile=argv[c+1];
+	}
+
+	//the number of beams comes from the first laser line
+	ifstream is(argv[1]);
+	if (!is){
+		cout << "could not read " << argv[1] << endl;
+		return -1;
+	}
+	unsigned int beams=0;
+	string line;
+	while (!beams && getline(is, line)){
+		istringstream lis(line);
+		string name;
+		lis >> name;
+		if (name=="FLASER")
+			lis >> beams;
+	}
+	if (!beams){
+		cout << "no FLASER lines in " << argv[1] << endl;
+		return -1;
+	}
+	is.clear();
+	is.seekg(0);
+
+	RangeSensor* laser=new RangeSensor("FLASER", beams, fov/180.*M_PI/(beams-1), OrientedPoint(0,0,0), 0, 30.);
+	SensorMap sensorMap;
+	sensorMap["FLASER"]=laser;
+	sensorMap["ODOM"]=new OdometrySensor("ODOM");
+	InputSensorStream stream(sensorMap, is);
+	vector<RangeReading*> scans;
+	double radius=0;
+	while (stream){
+		const SensorReading* reading=0;
+		stream >> reading;
+		const RangeReading* scan=dynamic_cast<const RangeReading*>(reading);
+		if (scan){
+			scans.push_back(const_cast<RangeReading*>(scan));
+			OrientedPoint p=scan->getPose()-scans[0]->getPose();
+			radius=max(radius, sqrt(p.x*p.x+p.y*p.y));
+		} else
+			delete reading;
+	}
+	cout << scans.size() << " scans of " << beams << " beams" << endl;
+	if (scans.size()<2)
+		return -1;
+
+	//the matched trajectory starts at the origin, the map grows if it leaves this area
+	double size=2*radius+40.;
+	ScanMatcherMap kernelMap(Point(0,0), size, size, delta), fieldMap(Point(0,0), size, size, delta);
+	Run kernelRun, fieldRun;
+	unsigned int agreement;
+	mapLog(kernelRun, kernelMap, scans, laser, kernel, false, &agreement);
+	mapLog(fieldRun, fieldMap, scans, laser, kernel, true, 0);
+
+	cout << "candidate poses scored per second" << endl;
+	cout << "  kernel search     " << kernelRun.scored/kernelRun.scoreTime << endl;
+	cout << "  likelihood field  " << fieldRun.scored/fieldRun.scoreTime << endl;
+	cout << "optimize per scan [ms]" << endl;
+	cout << "  kernel search     " << 1e3*kernelRun.optimizeTime/(scans.size()-1) << endl;
+	cout << "  likelihood field  " << 1e3*fieldRun.optimizeTime/(scans.size()-1) << endl;
+	cout << "same best candidate on the kernel search map  " << 100.*agreement/(scans.size()-1) << "%" << endl;
+
+	double dmax=0, dsum=0, tmax=0;
+	for (unsigned int i=0; i<scans.size(); i++){
+		OrientedPoint d=kernelRun.poses[i]-fieldRun.poses[i];
+		double dd=sqrt(d.x*d.x+d.y*d.y);
+		double dt=fabs(atan2(sin(d.theta), cos(d.theta)));
+		dsum+=dd;
+		dmax=max(dmax, dd);
+		tmax=max(tmax, dt);
+	}
+	cout << "trajectory difference  mean " << dsum/scans.size() << " m, max " << dmax << " m, max " << tmax << " rad" << endl;
+
+	if (truthFile){
+		ifstream ts(truthFile);
+		vector<OrientedPoint> truth;
+		OrientedPoint p;
+		while (ts >> p.x >> p.y >> p.theta)
+			truth.push_back(p);
+		if (truth.size()!=scans.size()){
+			cout << truthFile << " has " << truth.size() << " poses for " << scans.size() << " scans" << endl;
+			return -1;
+		}
+		vector<OrientedPoint> odometry;
+		for (unsigned int i=0; i<scans.size(); i++)
+			odometry.push_back(scans[i]->getPose());
+		double mean, worst, last;
+		cout << "position error against " << truthFile << " [m]" << endl;
+		poseError(odometry, truth, mean, worst, last);
+		cout << "  odometry          mean " << mean << ", max " << worst << ", last " << last << endl;
+		poseError(kernelRun.poses, truth, mean, worst, last);
+		cout << "  kernel search     mean " << mean << ", max " << worst << ", last " << last << endl;
+		poseError(fieldRun.poses, truth, mean, worst, last);
+		cout << "  likelihood field  mean " << mean << ", max " << worst << ", last " << last << endl;
+	}
+
+	//occupied cells of either map, and how many of them are occupied in both
+	const ScanMatcherMap& km=kernelMap;
+	const ScanMatcherMap& fm=fieldMap;
+	unsigned int occupied=0, both=0, known=0, agree=0;
+	for (int x=0; x<km.getMapSizeX(); x++)
+	for (int y=0; y<km.getMapSizeY(); y++){
+		Point p=km.map2world(x,y);
+		double a=km.cell(p), b=fm.cell(p);
+		if (a>=0 || b>=0){
+			known++;
+			if ((a>0.5)==(b>0.5))
+				agree++;
+		}
+		if (a>0.5 || b>0.5){
+			occupied++;
+			if (a>0.5 && b>0.5)
+				both++;
+		}
+	}
+	cout << "map agreement  " << 100.*agree/known << "% of the known cells, "
+		<< 100.*both/occupied << "% of the occupied cells" << endl;
+
+	for (unsigned int i=0; i<scans.size(); i++)
+		delete scans[i];
+	delete sensorMap["ODOM"];
+	delete laser;
+	return 0;
+}
@@ -30,6 +30,7 @@ ScanMatcher::ScanMatcher(): m_laserPose(0,0,0){
 	m_linearOdometryReliability=0.;
 	m_freeCellRatio=sqrt(2.);
 	m_initialBeamsSkip=0;
+	m_likelihoodField=false;
 	
 /*	
 	// This  are the dafault settings for a grid map of 10 cm
@@ -48,6 +49,29 @@ ScanMatcher::ScanMatcher(): m_laserPose(0,0,0){
 */
 }
 
+void ScanMatcher::computeFieldCell(LikelihoodFieldCell& fcell, const ScanMatcherMap& map, const IntPoint& p) const{
+	//as the kernel search in score(), but for the center of the cell and without the free cell test
+	Point center=map.map2world(p);
+	bool found=false;
+	Point bestMean(0.,0.);
+	double bestDistance=0;
+	for (int xx=-m_kernelSize; xx<=m_kernelSize; xx++)
+	for (int yy=-m_kernelSize; yy<=m_kernelSize; yy++){
+		const PointAccumulator& cell=map.cell(p+IntPoint(xx,yy));
+		if (((double)cell )> m_fullnessThreshold){
+			Point mean=cell.mean();
+			Point mu=center-mean;
+			if (!found || (mu*mu)<bestDistance){
+				bestMean=mean;
+				bestDistance=mu*mu;
+				found=true;
+			}
+		}
+	}
+	fcell.mean=point<float>((float)bestMean.x, (float)bestMean.y);
+	fcell.state=found?LikelihoodFieldCell::Hit:LikelihoodFieldCell::Empty;
+}
+
 void ScanMatcher::invalidateActiveArea(){
 	m_activeAreaComputed=false;
 }
@@ -220,6 +244,10 @@ double ScanMatcher::registerScan(ScanMatcherMap& map, const OrientedPoint& p, co
 	IntPoint p0=map.world2map(lp);
 	
 	
+	//the likelihood field changes only around the cells that are or become occupied
+	ScanMatcherStorage& storage=map.storage();
+	bool field=storage.hasField();
+	
 	const double * angle=m_laserAngles+m_initialBeamsSkip;
 	double esum=0;
 	for (const double* r=readings+m_initialBeamsSkip; r<readings+m_laserBeams; r++, angle++)
@@ -238,13 +266,18 @@ double ScanMatcher::registerScan(ScanMatcherMap& map, const OrientedPoint& p, co
 			for (int i=0; i<line.num_points-1; i++){
 				PointAccumulator& cell=map.cell(line.points[i]);
 				double e=-cell.entropy();
+				bool occupied=field && storage.isFieldOccupied(cell);
 				cell.update(false, Point(0,0));
+				if (occupied)
+					storage.invalidateField(line.points[i]);
 				e+=cell.entropy();
 				esum+=e;
 			}
 			if (d<m_usableRange){
 				double e=-map.cell(p1).entropy();
 				map.cell(p1).update(true, phit);
+				if (field)
+					storage.invalidateField(p1);
 				e+=map.cell(p1).entropy();
 				esum+=e;
 			}
@@ -256,6 +289,8 @@ double ScanMatcher::registerScan(ScanMatcherMap& map, const OrientedPoint& p, co
 			IntPoint p1=map.world2map(phit);
 			assert(p1.x>=0 && p1.y>=0);
 			map.cell(p1).update(true,phit);
+			if (field)
+				storage.invalidateField(p1);
 		}
 	//cout  << "informationGain=" << -esum << endl;
 	return esum;
@@ -31,6 +31,7 @@ class ScanMatcher{
 		inline double icpStep(OrientedPoint & pret, const ScanMatcherMap& map, const OrientedPoint& p, const double* readings) const;
 		inline double score(const ScanMatcherMap& map, const OrientedPoint& p, const double* readings) const;
 		inline unsigned int likelihoodAndScore(double& s, double& l, const ScanMatcherMap& map, const OrientedPoint& p, const double* readings) const;
+		inline const LikelihoodFieldCell* closestHit(const ScanMatcherMap& map, const IntPoint& p) const;
 		double likelihood(double& lmax, OrientedPoint& mean, CovarianceMatrix& cov, const ScanMatcherMap& map, const OrientedPoint& p, const double* readings);
 		double likelihood(double& _lmax, OrientedPoint& _mean, CovarianceMatrix& _cov, const ScanMatcherMap& map, const OrientedPoint& p, Gaussian3& odometry, const double* readings, double gain=180.);
 		inline const double* laserAngles() const { return m_laserAngles; }
@@ -40,6 +41,7 @@ class ScanMatcher{
 	protected:
 		//state of the matcher
 		bool m_activeAreaComputed;
+		void computeFieldCell(LikelihoodFieldCell& fcell, const ScanMatcherMap& map, const IntPoint& p) const;
 		
 		/**laser parameters*/
 		unsigned int m_laserBeams;
@@ -67,6 +69,8 @@ class ScanMatcher{
 		PARAM_SET_GET(double, linearOdometryReliability, protected, public, public)
 		PARAM_SET_GET(double, freeCellRatio, protected, public, public)
 		PARAM_SET_GET(unsigned int, initialBeamsSkip, protected, public, public)
+		/**score with the likelihood field of the map instead of searching the kernel around each endpoint*/
+		PARAM_SET_GET(bool, likelihoodField, protected, public, public)
 };
 
 inline double ScanMatcher::icpStep(OrientedPoint & pret, const ScanMatcherMap& map, const OrientedPoint& p, const double* readings) const{
@@ -75,6 +79,8 @@ inline double ScanMatcher::icpStep(OrientedPoint & pret, const ScanMatcherMap& m
 	lp.x+=cos(p.theta)*m_laserPose.x-sin(p.theta)*m_laserPose.y;
 	lp.y+=sin(p.theta)*m_laserPose.x+cos(p.theta)*m_laserPose.y;
 	lp.theta+=m_laserPose.theta;
+	if (m_likelihoodField)
+		map.storage().setFieldParameters(m_kernelSize, m_fullnessThreshold);
 	unsigned int skip=0;
 	double freeDelta=map.getDelta()*m_freeCellRatio;
 	std::list<PointPair> pairs;
@@ -88,36 +94,45 @@ inline double ScanMatcher::icpStep(OrientedPoint & pret, const ScanMatcherMap& m
 		phit.x+=*r*cos(lp.theta+*angle);
 		phit.y+=*r*sin(lp.theta+*angle);
 		IntPoint iphit=map.world2map(phit);
-		Point pfree=lp;
-		pfree.x+=(*r-map.getDelta()*freeDelta)*cos(lp.theta+*angle);
-		pfree.y+=(*r-map.getDelta()*freeDelta)*sin(lp.theta+*angle);
- 		pfree=pfree-phit;
-		IntPoint ipfree=map.world2map(pfree);
 		bool found=false;
 		Point bestMu(0.,0.);
 		Point bestCell(0.,0.);
-		for (int xx=-m_kernelSize; xx<=m_kernelSize; xx++)
-		for (int yy=-m_kernelSize; yy<=m_kernelSize; yy++){
-			IntPoint pr=iphit+IntPoint(xx,yy);
-			IntPoint pf=pr+ipfree;
-			//AccessibilityState s=map.storage().cellState(pr);
-			//if (s&Inside && s&Allocated){
-				const PointAccumulator& cell=map.cell(pr);
-				const PointAccumulator& fcell=map.cell(pf);
-				if (((double)cell )> m_fullnessThreshold && ((double)fcell )<m_fullnessThreshold){
-					Point mu=phit-cell.mean();
-					if (!found){
-						bestMu=mu;
-						bestCell=cell.mean();
-						found=true;
-					}else
-						if((mu*mu)<(bestMu*bestMu)){
+		if (m_likelihoodField){
+			const LikelihoodFieldCell* hit=closestHit(map, iphit);
+			if (hit && hit->state==LikelihoodFieldCell::Hit){
+				bestMu=phit-Point(hit->mean.x, hit->mean.y);
+				bestCell=Point(hit->mean.x, hit->mean.y);
+				found=true;
+			}
+		} else {
+			Point pfree=lp;
+			pfree.x+=(*r-map.getDelta()*freeDelta)*cos(lp.theta+*angle);
+			pfree.y+=(*r-map.getDelta()*freeDelta)*sin(lp.theta+*angle);
+			pfree=pfree-phit;
+			IntPoint ipfree=map.world2map(pfree);
+			for (int xx=-m_kernelSize; xx<=m_kernelSize; xx++)
+			for (int yy=-m_kernelSize; yy<=m_kernelSize; yy++){
+				IntPoint pr=iphit+IntPoint(xx,yy);
+				IntPoint pf=pr+ipfree;
+				//AccessibilityState s=map.storage().cellState(pr);
+				//if (s&Inside && s&Allocated){
+					const PointAccumulator& cell=map.cell(pr);
+					const PointAccumulator& fcell=map.cell(pf);
+					if (((double)cell )> m_fullnessThreshold && ((double)fcell )<m_fullnessThreshold){
+						Point mu=phit-cell.mean();
+						if (!found){
 							bestMu=mu;
 							bestCell=cell.mean();
-						} 
+							found=true;
+						}else
+							if((mu*mu)<(bestMu*bestMu)){
+								bestMu=mu;
+								bestCell=cell.mean();
+							} 
 						
-				}
-			//}
+					}
+				//}
+			}
 		}
 		if (found){
 			pairs.push_back(std::make_pair(phit, bestCell));
@@ -143,6 +158,8 @@ inline double ScanMatcher::score(const ScanMatcherMap& map, const OrientedPoint&
 	lp.x+=cos(p.theta)*m_laserPose.x-sin(p.theta)*m_laserPose.y;
 	lp.y+=sin(p.theta)*m_laserPose.x+cos(p.theta)*m_laserPose.y;
 	lp.theta+=m_laserPose.theta;
+	if (m_likelihoodField)
+		map.storage().setFieldParameters(m_kernelSize, m_fullnessThreshold);
 	unsigned int skip=0;
 	double freeDelta=map.getDelta()*m_freeCellRatio;
 	for (const double* r=readings+m_initialBeamsSkip; r<readings+m_laserBeams; r++, angle++){
@@ -154,30 +171,38 @@ inline double ScanMatcher::score(const ScanMatcherMap& map, const OrientedPoint&
 		phit.x+=*r*cos(lp.theta+*angle);
 		phit.y+=*r*sin(lp.theta+*angle);
 		IntPoint iphit=map.world2map(phit);
-		Point pfree=lp;
-		pfree.x+=(*r-map.getDelta()*freeDelta)*cos(lp.theta+*angle);
-		pfree.y+=(*r-map.getDelta()*freeDelta)*sin(lp.theta+*angle);
- 		pfree=pfree-phit;
-		IntPoint ipfree=map.world2map(pfree);
 		bool found=false;
 		Point bestMu(0.,0.);
-		for (int xx=-m_kernelSize; xx<=m_kernelSize; xx++)
-		for (int yy=-m_kernelSize; yy<=m_kernelSize; yy++){
-			IntPoint pr=iphit+IntPoint(xx,yy);
-			IntPoint pf=pr+ipfree;
-			//AccessibilityState s=map.storage().cellState(pr);
-			//if (s&Inside && s&Allocated){
-				const PointAccumulator& cell=map.cell(pr);
-				const PointAccumulator& fcell=map.cell(pf);
-				if (((double)cell )> m_fullnessThreshold && ((double)fcell )<m_fullnessThreshold){
-					Point mu=phit-cell.mean();
-					if (!found){
-						bestMu=mu;
-						found=true;
-					}else
-						bestMu=(mu*mu)<(bestMu*bestMu)?mu:bestMu;
-				}
-			//}
+		if (m_likelihoodField){
+			const LikelihoodFieldCell* hit=closestHit(map, iphit);
+			if (hit && hit->state==LikelihoodFieldCell::Hit){
+				bestMu=phit-Point(hit->mean.x, hit->mean.y);
+				found=true;
+			}
+		} else {
+			Point pfree=lp;
+			pfree.x+=(*r-map.getDelta()*freeDelta)*cos(lp.theta+*angle);
+			pfree.y+=(*r-map.getDelta()*freeDelta)*sin(lp.theta+*angle);
+			pfree=pfree-phit;
+			IntPoint ipfree=map.world2map(pfree);
+			for (int xx=-m_kernelSize; xx<=m_kernelSize; xx++)
+			for (int yy=-m_kernelSize; yy<=m_kernelSize; yy++){
+				IntPoint pr=iphit+IntPoint(xx,yy);
+				IntPoint pf=pr+ipfree;
+				//AccessibilityState s=map.storage().cellState(pr);
+				//if (s&Inside && s&Allocated){
+					const PointAccumulator& cell=map.cell(pr);
+					const PointAccumulator& fcell=map.cell(pf);
+					if (((double)cell )> m_fullnessThreshold && ((double)fcell )<m_fullnessThreshold){
+						Point mu=phit-cell.mean();
+						if (!found){
+							bestMu=mu;
+							found=true;
+						}else
+							bestMu=(mu*mu)<(bestMu*bestMu)?mu:bestMu;
+					}
+				//}
+			}
 		}
 		if (found)
 			s+=exp(-1./m_gaussianSigma*bestMu*bestMu);
@@ -195,6 +220,8 @@ inline unsigned int ScanMatcher::likelihoodAndScore(double& s, double& l, const
 	lp.y+=sin(p.theta)*m_laserPose.x+cos(p.theta)*m_laserPose.y;
 	lp.theta+=m_laserPose.theta;
 	double noHit=nullLikelihood/(m_likelihoodSigma);
+	if (m_likelihoodField)
+		map.storage().setFieldParameters(m_kernelSize, m_fullnessThreshold);
 	unsigned int skip=0;
 	unsigned int c=0;
 	double freeDelta=map.getDelta()*m_freeCellRatio;
@@ -207,30 +234,38 @@ inline unsigned int ScanMatcher::likelihoodAndScore(double& s, double& l, const
 		phit.x+=*r*cos(lp.theta+*angle);
 		phit.y+=*r*sin(lp.theta+*angle);
 		IntPoint iphit=map.world2map(phit);
-		Point pfree=lp;
-		pfree.x+=(*r-freeDelta)*cos(lp.theta+*angle);
-		pfree.y+=(*r-freeDelta)*sin(lp.theta+*angle);
-		pfree=pfree-phit;
-		IntPoint ipfree=map.world2map(pfree);
 		bool found=false;
 		Point bestMu(0.,0.);
-		for (int xx=-m_kernelSize; xx<=m_kernelSize; xx++)
-		for (int yy=-m_kernelSize; yy<=m_kernelSize; yy++){
-			IntPoint pr=iphit+IntPoint(xx,yy);
-			IntPoint pf=pr+ipfree;
-			//AccessibilityState s=map.storage().cellState(pr);
-			//if (s&Inside && s&Allocated){
-				const PointAccumulator& cell=map.cell(pr);
-				const PointAccumulator& fcell=map.cell(pf);
-				if (((double)cell )>m_fullnessThreshold && ((double)fcell )<m_fullnessThreshold){
-					Point mu=phit-cell.mean();
-					if (!found){
-						bestMu=mu;
-						found=true;
-					}else
-						bestMu=(mu*mu)<(bestMu*bestMu)?mu:bestMu;
-				}
-			//}	
+		if (m_likelihoodField){
+			const LikelihoodFieldCell* hit=closestHit(map, iphit);
+			if (hit && hit->state==LikelihoodFieldCell::Hit){
+				bestMu=phit-Point(hit->mean.x, hit->mean.y);
+				found=true;
+			}
+		} else {
+			Point pfree=lp;
+			pfree.x+=(*r-freeDelta)*cos(lp.theta+*angle);
+			pfree.y+=(*r-freeDelta)*sin(lp.theta+*angle);
+			pfree=pfree-phit;
+			IntPoint ipfree=map.world2map(pfree);
+			for (int xx=-m_kernelSize; xx<=m_kernelSize; xx++)
+			for (int yy=-m_kernelSize; yy<=m_kernelSize; yy++){
+				IntPoint pr=iphit+IntPoint(xx,yy);
+				IntPoint pf=pr+ipfree;
+				//AccessibilityState s=map.storage().cellState(pr);
+				//if (s&Inside && s&Allocated){
+					const PointAccumulator& cell=map.cell(pr);
+					const PointAccumulator& fcell=map.cell(pf);
+					if (((double)cell )>m_fullnessThreshold && ((double)fcell )<m_fullnessThreshold){
+						Point mu=phit-cell.mean();
+						if (!found){
+							bestMu=mu;
+							found=true;
+						}else
+							bestMu=(mu*mu)<(bestMu*bestMu)?mu:bestMu;
+					}
+				//}	
+			}
 		}
 		if (found){
 			s+=exp(-1./m_gaussianSigma*bestMu*bestMu);
@@ -244,6 +279,13 @@ inline unsigned int ScanMatcher::likelihoodAndScore(double& s, double& l, const
 	return c;
 }
 
+inline const LikelihoodFieldCell* ScanMatcher::closestHit(const ScanMatcherMap& map, const IntPoint& p) const{
+	LikelihoodFieldCell* fcell=map.storage().fieldCell(p);
+	if (fcell && fcell->state==LikelihoodFieldCell::Unknown)
+		computeFieldCell(*fcell, map, p);
+	return fcell;
+}
+
 };
 
 #endif
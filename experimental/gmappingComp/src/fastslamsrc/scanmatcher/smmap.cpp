@@ -10,6 +10,56 @@ const PointAccumulator& PointAccumulator::Unknown(){
 
 PointAccumulator* PointAccumulator::unknown_ptr=0;
 
-};
+ScanMatcherStorage::ScanMatcherStorage(int xsize, int ysize, int patchMagnitude)
+  :HierarchicalArray2D<PointAccumulator>(xsize, ysize, patchMagnitude),
+   m_field(this->m_xsize, this->m_ysize){
+	m_fieldKernelSize=-1;
+	m_fieldThreshold=0;
+}
+
+ScanMatcherStorage::ScanMatcherStorage(const ScanMatcherStorage& s)
+  :HierarchicalArray2D<PointAccumulator>(s), m_field(s.m_field){
+	m_fieldKernelSize=s.m_fieldKernelSize;
+	m_fieldThreshold=s.m_fieldThreshold;
+}
+
+ScanMatcherStorage& ScanMatcherStorage::operator=(const ScanMatcherStorage& s){
+	HierarchicalArray2D<PointAccumulator>::operator=(s);
+	m_field=s.m_field;
+	m_fieldKernelSize=s.m_fieldKernelSize;
+	m_fieldThreshold=s.m_fieldThreshold;
+	return *this;
+}
+
+void ScanMatcherStorage::resize(int xmin, int ymin, int xmax, int ymax){
+	HierarchicalArray2D<PointAccumulator>::resize(xmin, ymin, xmax, ymax);
+	//the map grows rarely, the field is computed again
+	clearField();
+}
+
+void ScanMatcherStorage::releasePatches(){
+	HierarchicalArray2D<PointAccumulator>::releasePatches();
+	clearField();
+}
 
+void ScanMatcherStorage::clearField() const{
+	m_field=Array2D<autoptr<FieldPatch> >(this->m_xsize, this->m_ysize);
+}
 
+void ScanMatcherStorage::allocActiveArea(){
+	//a field cell depends on the cells up to the kernel size around it, so registerScan()
+	//can also change the field of the neighbouring patches
+	int ring=m_fieldKernelSize>0?(m_fieldKernelSize+m_patchSize-1)>>m_patchMagnitude:0;
+	for (PointSet::const_iterator it=m_activeArea.begin(); it!=m_activeArea.end(); it++)
+		for (int x=it->x-ring; x<=it->x+ring; x++)
+			for (int y=it->y-ring; y<=it->y+ring; y++){
+				if (!m_field.isInside(x,y))
+					continue;
+				autoptr<FieldPatch>& patch=m_field.cell(x,y);
+				if (patch && patch.m_reference->shares>1)
+					patch=PatchPool<LikelihoodFieldCell>::instance().copy(*patch);
+			}
+	HierarchicalArray2D<PointAccumulator>::allocActiveArea();
+}
+
+};
@@ -46,8 +46,79 @@ double PointAccumulator::entropy() const{
 	return -( x*log(x)+ (1-x)*log(1-x) );
 }
 
+/**Closest hit to a cell within the matching kernel, see ScanMatcherStorage.*/
+struct LikelihoodFieldCell{
+	enum State{Unknown, Empty, Hit};
+	LikelihoodFieldCell(): state(Unknown){}
+	point<float> mean;
+	unsigned char state;
+};
+
+/**
+The storage of the scan matcher map. Next to each patch of cells it can keep a patch of
+the likelihood field: for every cell, the mean of the occupied cell within the matching
+kernel that is closest to its center. Scoring a beam is then one lookup instead of a
+kernel search. The field is computed cell by cell when first asked for. Copies of a map
+share the field patches as they share the cell patches, and allocActiveArea() replicates
+the shared field patches around the ones registerScan() is going to write; registerScan()
+then forgets the field only around the cells whose occupancy or mean it changes.
+*/
+class ScanMatcherStorage: public HierarchicalArray2D<PointAccumulator>{
+	public:
+		typedef Array2D<LikelihoodFieldCell> FieldPatch;
+		ScanMatcherStorage(int xsize, int ysize, int patchMagnitude=5);
+		ScanMatcherStorage(const ScanMatcherStorage& s);
+		ScanMatcherStorage& operator=(const ScanMatcherStorage& s);
+		void resize(int ixmin, int iymin, int ixmax, int iymax);
+		void allocActiveArea();
+		void releasePatches();
+		
+		/**The field cell of the map cell p, 0 outside of the map. Its state is Unknown until computed.*/
+		inline LikelihoodFieldCell* fieldCell(const IntPoint& p) const;
+		/**Drops the whole field if it was computed with another kernel or threshold.*/
+		inline void setFieldParameters(int kernelSize, double fullnessThreshold) const;
+		inline bool hasField() const {return m_fieldKernelSize>=0;}
+		inline bool isFieldOccupied(const PointAccumulator& cell) const {return (double)cell>m_fieldThreshold;}
+		/**To be called when the cell p is or was occupied and changed, the field around it is computed again.*/
+		inline void invalidateField(const IntPoint& p);
+	protected:
+		void clearField() const;
+		mutable Array2D<autoptr<FieldPatch> > m_field;
+		mutable int m_fieldKernelSize;
+		mutable double m_fieldThreshold;
+};
+
+LikelihoodFieldCell* ScanMatcherStorage::fieldCell(const IntPoint& p) const{
+	IntPoint c=patchIndexes(p);
+	if (!m_field.isInside(c))
+		return 0;
+	autoptr<FieldPatch>& patch=m_field.cell(c);
+	if (!patch)
+		patch=PatchPool<LikelihoodFieldCell>::instance().create(m_patchSize);
+	return &(*patch).cell(p.x-(c.x<<m_patchMagnitude), p.y-(c.y<<m_patchMagnitude));
+}
+
+void ScanMatcherStorage::invalidateField(const IntPoint& p){
+	for (int x=p.x-m_fieldKernelSize; x<=p.x+m_fieldKernelSize; x++)
+	for (int y=p.y-m_fieldKernelSize; y<=p.y+m_fieldKernelSize; y++){
+		IntPoint c=patchIndexes(x,y);
+		if (!m_field.isInside(c))
+			continue;
+		autoptr<FieldPatch>& patch=m_field.cell(c);
+		if (patch)
+			(*patch).cell(x-(c.x<<m_patchMagnitude), y-(c.y<<m_patchMagnitude)).state=LikelihoodFieldCell::Unknown;
+	}
+}
+
+void ScanMatcherStorage::setFieldParameters(int kernelSize, double fullnessThreshold) const{
+	if (kernelSize==m_fieldKernelSize && fullnessThreshold==m_fieldThreshold)
+		return;
+	clearField();
+	m_fieldKernelSize=kernelSize;
+	m_fieldThreshold=fullnessThreshold;
+}
 
-typedef Map<PointAccumulator,HierarchicalArray2D<PointAccumulator> > ScanMatcherMap;
+typedef Map<PointAccumulator,ScanMatcherStorage> ScanMatcherMap;
 
 };
 
@@ -1,6 +1,7 @@
 #ifndef AUTOPTR_H
 #define AUTOPTR_H
 #include <assert.h>
+#include <atomic>
 
 namespace GMapping{
 
@@ -11,9 +12,13 @@ class autoptr{
 	public:
 	struct reference{
 		X* data;
-		unsigned int shares;
+		std::atomic<unsigned int> shares;
+		/**if set, called with the reference instead of deleting it and the data when the last share goes*/
+		void (*release)(reference*);
 	};
 		inline autoptr(X* p=(X*)(0));
+		/**shares a reference made elsewhere, e.g. by a pool, that has no shares yet*/
+		static inline autoptr<X> fromReference(reference* r);
 		inline autoptr(const autoptr<X>& ap);
 		inline autoptr& operator=(const autoptr<X>& ap);
 		inline ~autoptr();
@@ -23,6 +28,7 @@ class autoptr{
 		//p	
 		reference * m_reference;
 	protected:
+		inline void drop();
 };
 
 template <class X>
@@ -32,9 +38,32 @@ autoptr<X>::autoptr(X* p){
 		m_reference=new reference;
 		m_reference->data=p;
 		m_reference->shares=1;
+		m_reference->release=0;
 	}
 }
 
+template <class X>
+autoptr<X> autoptr<X>::fromReference(reference* r){
+	autoptr<X> ap;
+	ap.m_reference=r;
+	if (r)
+		r->shares=1;
+	return ap;
+}
+
+template <class X>
+void autoptr<X>::drop(){
+	if (m_reference && !(--m_reference->shares)){
+		if (m_reference->release)
+			m_reference->release(m_reference);
+		else{
+			delete m_reference->data;
+			delete m_reference;
+		}
+	}
+	m_reference=0;
+}
+
 template <class X>
 autoptr<X>::autoptr(const autoptr<X>& ap){
 	m_reference=0;
@@ -51,11 +80,7 @@ autoptr<X>& autoptr<X>::operator=(const autoptr<X>& ap){
 	if (m_reference==ref){
 		return *this;
 	}
-	if (m_reference && !(--m_reference->shares)){
-		delete m_reference->data;
-		delete m_reference;
-		m_reference=0;
-	}	
+	drop();
 	if (ref){
 		m_reference=ref;
 		m_reference->shares++;
@@ -69,27 +94,24 @@ autoptr<X>& autoptr<X>::operator=(const autoptr<X>& ap){
 
 template <class X>
 autoptr<X>::~autoptr(){
-	if (m_reference && !(--m_reference->shares)){
-		delete m_reference->data;
-		delete m_reference;
-		m_reference=0;
-	}	
+	drop();
 }
 
 template <class X>
 autoptr<X>::operator int() const{
-	return m_reference && m_reference->shares && m_reference->data;
+	//a reference has shares as long as an autoptr refers to it, this avoids loading the atomic counter on every access
+	return m_reference && m_reference->data;
 }
 
 template <class X>
 X& autoptr<X>::operator*(){
-	assert(m_reference && m_reference->shares && m_reference->data);
+	assert(m_reference && m_reference->data);
 	return *(m_reference->data);
 }
 
 template <class X>
 const X& autoptr<X>::operator*() const{
-	assert(m_reference && m_reference->shares && m_reference->data);
+	assert(m_reference && m_reference->data);
 	return *(m_reference->data);
 }
 
@@ -159,6 +159,8 @@ void SpecificMonitor::readConfig(RoboCompCommonBehavior::ParameterList &params )
 	
 	configGetString("", "GMapping.generateMap", aux.value, "true");
 	params["GMapping.generateMap"] = aux;
+	configGetString("", "GMapping.likelihoodField", aux.value, "0");
+	params["GMapping.likelihoodField"] = aux;
 
 
 	try{
@@ -138,6 +138,7 @@ void SpecificWorker::initialize()
 	rInfo("Worker::Generate map in processor");
 	processor->setgenerateMap((bool) QString::fromStdString(params["GMapping.generateMap"].value).toInt());
 	printf("generate map: %d\n", (bool) QString::fromStdString(params["GMapping.generateMap"].value).toInt());
+	processor->setlikelihoodField((bool) QString::fromStdString(params["GMapping.likelihoodField"].value).toInt());
 
 	xmin = QString::fromStdString(params["GMapping.xmin"].value).toDouble();
 	xmax = QString::fromStdString(params["GMapping.xmax"].value).toDouble();
@@ -0,0 +1,150 @@
+// Copyright 2014-2015 Isis Innovation Limited and the authors of InfiniTAM
+
+#include "PrefetchingImageSource.h"
+
+#include "../Utils/FileUtils.h"
+
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+
+using namespace InfiniTAM::Engine;
+
+ImageFileSequence::ImageFileSequence(const char *rgbImageMask, const char *depthImageMask)
+{
+	strncpy(this->rgbImageMask, rgbImageMask, BUF_SIZE - 1);
+	strncpy(this->depthImageMask, depthImageMask, BUF_SIZE - 1);
+	this->rgbImageMask[BUF_SIZE - 1] = 0;
+	this->depthImageMask[BUF_SIZE - 1] = 0;
+}
+
+bool ImageFileSequence::readFrame(int frameNo, ITMUChar4Image *rgb, ITMShortImage *rawDepth)
+{
+	char str[BUF_SIZE];
+
+	snprintf(str, BUF_SIZE, rgbImageMask, frameNo);
+	if (!ReadImageFromFile(rgb, str)) return false;
+
+	snprintf(str, BUF_SIZE, depthImageMask, frameNo);
+	if (!ReadImageFromFile(rawDepth, str)) return false;
+
+	return true;
+}
+
+PrefetchingImageSource::PrefetchingImageSource(const char *calibFilename, ImageSequenceReader *reader, int noThreads, int noBufferedFrames)
+	: ImageSourceEngine(calibFilename)
+{
+	this->reader = reader;
+
+	if (noThreads < 1) noThreads = 1;
+	if (noBufferedFrames < noThreads) noBufferedFrames = noThreads;
+
+	currentFrameNo = 0;
+	stop = false;
+
+	// the first frame gives the size of the buffers
+	ring.resize(noBufferedFrames);
+	ring[0].rgb = new ITMUChar4Image(true, false);
+	ring[0].rawDepth = new ITMShortImage(true, false);
+	if (reader->readFrame(0, ring[0].rgb, ring[0].rawDepth))
+	{
+		ring[0].frameNo = 0;
+		endFrameNo = INT_MAX;
+	}
+	else
+	{
+		printf("error reading frame 0\n");
+		ring[0].frameNo = -1;
+		endFrameNo = 0;
+	}
+	nextFrameToRead = 1;
+
+	rgbSize = ring[0].rgb->noDims;
+	depthSize = ring[0].rawDepth->noDims;
+
+	for (size_t i = 1; i < ring.size(); i++)
+	{
+		ring[i].rgb = new ITMUChar4Image(rgbSize, true, false);
+		ring[i].rawDepth = new ITMShortImage(depthSize, true, false);
+		ring[i].frameNo = -1;
+	}
+
+	for (int i = 0; i < noThreads; i++) workers.push_back(std::thread(&PrefetchingImageSource::Run, this));
+}
+
+PrefetchingImageSource::~PrefetchingImageSource()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stop = true;
+	}
+	slotReleased.notify_all();
+	for (size_t i = 0; i < workers.size(); i++) workers[i].join();
+
+	for (size_t i = 0; i < ring.size(); i++)
+	{
+		delete ring[i].rgb;
+		delete ring[i].rawDepth;
+	}
+
+	delete reader;
+}
+
+void PrefetchingImageSource::Run(void)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	while (!stop)
+	{
+		// the slot of frame n is free once the consumer has taken frame n - ring.size()
+		if (nextFrameToRead >= endFrameNo || nextFrameToRead >= currentFrameNo + (int)ring.size())
+		{
+			slotReleased.wait(lock);
+			continue;
+		}
+
+		int frameNo = nextFrameToRead++;
+		Slot &slot = ring[frameNo % ring.size()];
+		lock.unlock();
+
+		bool success = reader->readFrame(frameNo, slot.rgb, slot.rawDepth);
+
+		lock.lock();
+		if (success) slot.frameNo = frameNo;
+		else if (frameNo < endFrameNo) endFrameNo = frameNo;
+		frameRead.notify_all();
+	}
+}
+
+bool PrefetchingImageSource::waitForCurrentFrame(std::unique_lock<std::mutex> &lock)
+{
+	while (currentFrameNo < endFrameNo && ring[currentFrameNo % ring.size()].frameNo != currentFrameNo) frameRead.wait(lock);
+	return currentFrameNo < endFrameNo;
+}
+
+bool PrefetchingImageSource::hasMoreImages(void)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	return waitForCurrentFrame(lock);
+}
+
+void PrefetchingImageSource::getImages(ITMUChar4Image *rgb, ITMShortImage *rawDepth)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	if (!waitForCurrentFrame(lock))
+	{
+		printf("error reading frame %i\n", currentFrameNo);
+		return;
+	}
+
+	// no worker touches the slot before currentFrameNo moves on
+	Slot &slot = ring[currentFrameNo % ring.size()];
+	lock.unlock();
+
+	rgb->SetFrom(slot.rgb, ORUtils::MemoryBlock<Vector4u>::CPU_TO_CPU);
+	rawDepth->SetFrom(slot.rawDepth, ORUtils::MemoryBlock<short>::CPU_TO_CPU);
+
+	lock.lock();
+	slot.frameNo = -1;
+	++currentFrameNo;
+	slotReleased.notify_all();
+}
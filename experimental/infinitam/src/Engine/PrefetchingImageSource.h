@@ -0,0 +1,100 @@
+// Copyright 2014-2015 Isis Innovation Limited and the authors of InfiniTAM
+
+#pragma once
+
+#include "ImageSourceEngine.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace InfiniTAM
+{
+	namespace Engine
+	{
+		/** \brief
+		    Random access to the frames of a recorded sequence
+		*/
+		class ImageSequenceReader
+		{
+		public:
+			virtual ~ImageSequenceReader() {}
+
+			/** Reads frame \p frameNo, false if the sequence has no such
+			    frame. Called from several threads at once.
+			*/
+			virtual bool readFrame(int frameNo, ITMUChar4Image *rgb, ITMShortImage *rawDepth) = 0;
+		};
+
+		/** \brief
+		    One image file per frame, named by printf style masks as for
+		    ImageFileReader
+		*/
+		class ImageFileSequence : public ImageSequenceReader
+		{
+		private:
+			static const int BUF_SIZE = 2048;
+			char rgbImageMask[BUF_SIZE];
+			char depthImageMask[BUF_SIZE];
+
+		public:
+			ImageFileSequence(const char *rgbImageMask, const char *depthImageMask);
+
+			bool readFrame(int frameNo, ITMUChar4Image *rgb, ITMShortImage *rawDepth);
+		};
+
+		/** \brief
+		    Reads the frames of an ImageSequenceReader ahead of time
+
+		    A pool of threads decodes the next frames into a ring of
+		    buffers, allocated once with the size of the first frame.
+		    getImages() then only has to copy the frame out, and waits
+		    only if decoding falls behind. The sequence ends at the
+		    first frame that cannot be read.
+		*/
+		class PrefetchingImageSource : public ImageSourceEngine
+		{
+		private:
+			struct Slot
+			{
+				ITMUChar4Image *rgb;
+				ITMShortImage *rawDepth;
+				/// frame held by the slot once read, -1 while being filled
+				int frameNo;
+			};
+
+			ImageSequenceReader *reader;
+			std::vector<Slot> ring;
+
+			/// next frame returned by getImages()
+			int currentFrameNo;
+			/// next frame to give to a worker
+			int nextFrameToRead;
+			/// first frame that could not be read
+			int endFrameNo;
+			bool stop;
+
+			Vector2i rgbSize, depthSize;
+
+			std::mutex mutex;
+			std::condition_variable frameRead, slotReleased;
+			std::vector<std::thread> workers;
+
+			void Run(void);
+			bool waitForCurrentFrame(std::unique_lock<std::mutex> &lock);
+
+		public:
+			/** Takes ownership of \p reader. \p noThreads frames are decoded
+			    in parallel, at most \p noBufferedFrames ahead of the consumer.
+			*/
+			PrefetchingImageSource(const char *calibFilename, ImageSequenceReader *reader, int noThreads = 2, int noBufferedFrames = 8);
+			~PrefetchingImageSource();
+
+			bool hasMoreImages(void);
+			void getImages(ITMUChar4Image *rgb, ITMShortImage *rawDepth);
+			Vector2i getDepthImageSize(void) { return depthSize; }
+			Vector2i getRGBImageSize(void) { return rgbSize; }
+		};
+	}
+}
@@ -0,0 +1,313 @@
+// Copyright 2014-2015 Isis Innovation Limited and the authors of InfiniTAM
+
+#include "RGBDSequenceFile.h"
+
+#include <string.h>
+
+using namespace InfiniTAM::Engine;
+
+static int seekFile(FILE *f, uint64_t offset)
+{
+#ifdef _WIN32
+	return _fseeki64(f, (__int64)offset, SEEK_SET);
+#else
+	return fseeko(f, (off_t)offset, SEEK_SET);
+#endif
+}
+
+static uint64_t tellFile(FILE *f)
+{
+#ifdef _WIN32
+	return (uint64_t)_ftelli64(f);
+#else
+	return (uint64_t)ftello(f);
+#endif
+}
+
+/// Turns the residuals in \p data into depths, in place. The first row is predicted from the left, the others from above.
+static void restoreDepth(unsigned short *data, Vector2i imgSize)
+{
+	for (int x = 1; x < imgSize.x; x++) data[x] = (unsigned short)(data[x - 1] + data[x]);
+
+	// no dependency along a row, so this vectorises
+	for (int y = 1; y < imgSize.y; y++)
+	{
+		unsigned short *row = data + y * imgSize.x;
+		const unsigned short *prevRow = row - imgSize.x;
+		for (int x = 0; x < imgSize.x; x++) row[x] = (unsigned short)(prevRow[x] + row[x]);
+	}
+}
+
+static inline unsigned short zigzag(unsigned short residual) { return (unsigned short)((residual << 1) ^ (unsigned short)((short)residual >> 15)); }
+static inline unsigned short unzigzag(unsigned short code) { return (unsigned short)((code >> 1) ^ (unsigned short)(-(short)(code & 1))); }
+
+// Residuals are zigzag coded (0, -1, 1, -2, ... -> 0, 1, 2, 3, ...) and written as
+//   0x00-0x7f            residual 0-127
+//   0x80-0xbf, 1 byte    residual 128-16511
+//   0xc0-0xfe            2-64 zero residuals
+//   0xff, 2 bytes        any residual, little endian
+static inline void flushZeroRun(std::vector<unsigned char> &out, int &zeroRun)
+{
+	if (zeroRun == 1) out.push_back(0x00);
+	else if (zeroRun > 1) out.push_back((unsigned char)(0xc0 + zeroRun - 2));
+	zeroRun = 0;
+}
+
+void RGBDSequenceFile::EncodeDepth(const short *depth, Vector2i imgSize, std::vector<unsigned char> &out)
+{
+	const unsigned short *data = (const unsigned short*)depth;
+
+	out.clear();
+	int zeroRun = 0;
+
+	for (int y = 0; y < imgSize.y; y++)
+	{
+		const unsigned short *row = data + y * imgSize.x;
+		const unsigned short *prevRow = row - imgSize.x;
+
+		for (int x = 0; x < imgSize.x; x++)
+		{
+			int prediction;
+			if (y > 0) prediction = prevRow[x];
+			else prediction = x > 0 ? row[x - 1] : 0;
+
+			unsigned short code = zigzag((unsigned short)(row[x] - prediction));
+
+			if (code == 0)
+			{
+				if (++zeroRun == 64) flushZeroRun(out, zeroRun);
+				continue;
+			}
+
+			flushZeroRun(out, zeroRun);
+
+			if (code < 0x80) out.push_back((unsigned char)code);
+			else if (code < 0x80 + 0x4000)
+			{
+				out.push_back((unsigned char)(0x80 | ((code - 0x80) >> 8)));
+				out.push_back((unsigned char)((code - 0x80) & 0xff));
+			}
+			else
+			{
+				out.push_back(0xff);
+				out.push_back((unsigned char)(code & 0xff));
+				out.push_back((unsigned char)(code >> 8));
+			}
+		}
+	}
+
+	flushZeroRun(out, zeroRun);
+}
+
+bool RGBDSequenceFile::DecodeDepth(const unsigned char *in, size_t noBytes, short *depth, Vector2i imgSize)
+{
+	const unsigned char *end = in + noBytes;
+	unsigned short *out = (unsigned short*)depth, *outEnd = out + imgSize.x * imgSize.y;
+
+	// residuals first, the prediction then runs without the branches of the codes
+	while (out < outEnd)
+	{
+		if (in >= end) return false;
+		unsigned char b = *in++;
+
+		if (b < 0x80) *out++ = unzigzag(b);
+		else if (b < 0xc0)
+		{
+			if (in >= end) return false;
+			*out++ = unzigzag((unsigned short)(0x80 + (((b & 0x3f) << 8) | *in++)));
+		}
+		else if (b < 0xff)
+		{
+			int zeroRun = b - 0xc0 + 2;
+			if (outEnd - out < zeroRun) return false;
+			memset(out, 0, zeroRun * sizeof(unsigned short));
+			out += zeroRun;
+		}
+		else
+		{
+			if (end - in < 2) return false;
+			*out++ = unzigzag((unsigned short)(in[0] | (in[1] << 8)));
+			in += 2;
+		}
+	}
+	if (in != end) return false;
+
+	restoreDepth((unsigned short*)depth, imgSize);
+	return true;
+}
+
+RGBDSequenceFileWriter::RGBDSequenceFileWriter()
+{
+	f = NULL;
+}
+
+RGBDSequenceFileWriter::~RGBDSequenceFileWriter()
+{
+	close();
+}
+
+bool RGBDSequenceFileWriter::open(const char *fileName)
+{
+	close();
+
+	f = fopen(fileName, "wb");
+	if (f == NULL) return false;
+
+	memset(&header, 0, sizeof(header));
+	header.magic = RGBDSequenceFile::FILE_MAGIC;
+	header.version = RGBDSequenceFile::FILE_VERSION;
+	index.clear();
+
+	// rewritten by close() once the index is known
+	return fwrite(&header, sizeof(header), 1, f) == 1;
+}
+
+bool RGBDSequenceFileWriter::writeFrame(const ITMUChar4Image *rgb, const ITMShortImage *rawDepth)
+{
+	if (f == NULL) return false;
+
+	if (index.empty())
+	{
+		header.rgbWidth = rgb->noDims.x; header.rgbHeight = rgb->noDims.y;
+		header.depthWidth = rawDepth->noDims.x; header.depthHeight = rawDepth->noDims.y;
+	}
+	else if (rgb->noDims != Vector2i(header.rgbWidth, header.rgbHeight) || rawDepth->noDims != Vector2i(header.depthWidth, header.depthHeight))
+	{
+		printf("frame %i does not have the size of the first frame\n", (int)index.size());
+		return false;
+	}
+
+	RGBDSequenceFile::IndexEntry entry;
+	entry.offset = tellFile(f);
+
+	int noRGBPixels = rgb->noDims.x * rgb->noDims.y;
+	const Vector4u *rgbData = rgb->GetData(MEMORYDEVICE_CPU);
+	buffer.resize(noRGBPixels * 3);
+	for (int i = 0; i < noRGBPixels; i++)
+	{
+		buffer[i * 3 + 0] = rgbData[i].x;
+		buffer[i * 3 + 1] = rgbData[i].y;
+		buffer[i * 3 + 2] = rgbData[i].z;
+	}
+	entry.rgbBytes = (uint32_t)buffer.size();
+	if (fwrite(&buffer[0], 1, buffer.size(), f) != buffer.size()) return false;
+
+	RGBDSequenceFile::EncodeDepth(rawDepth->GetData(MEMORYDEVICE_CPU), rawDepth->noDims, buffer);
+	entry.depthBytes = (uint32_t)buffer.size();
+	if (!buffer.empty() && fwrite(&buffer[0], 1, buffer.size(), f) != buffer.size()) return false;
+
+	index.push_back(entry);
+	return true;
+}
+
+bool RGBDSequenceFileWriter::close(void)
+{
+	if (f == NULL) return false;
+
+	header.noFrames = (int32_t)index.size();
+	header.indexOffset = tellFile(f);
+
+	bool success = true;
+	if (!index.empty()) success &= fwrite(&index[0], sizeof(RGBDSequenceFile::IndexEntry), index.size(), f) == index.size();
+	success &= seekFile(f, 0) == 0;
+	success &= fwrite(&header, sizeof(header), 1, f) == 1;
+	success &= fclose(f) == 0;
+
+	f = NULL;
+	return success;
+}
+
+RGBDSequenceFileReader::RGBDSequenceFileReader()
+{
+	f = NULL;
+	memset(&header, 0, sizeof(header));
+}
+
+RGBDSequenceFileReader::~RGBDSequenceFileReader()
+{
+	if (f != NULL) fclose(f);
+	for (size_t i = 0; i < freeBuffers.size(); i++) delete freeBuffers[i];
+}
+
+bool RGBDSequenceFileReader::isSequenceFile(const char *fileName)
+{
+	FILE *f = fopen(fileName, "rb");
+	if (f == NULL) return false;
+
+	uint32_t magic = 0;
+	bool isSequence = fread(&magic, sizeof(magic), 1, f) == 1 && magic == RGBDSequenceFile::FILE_MAGIC;
+
+	fclose(f);
+	return isSequence;
+}
+
+bool RGBDSequenceFileReader::open(const char *fileName)
+{
+	if (f != NULL) fclose(f);
+
+	f = fopen(fileName, "rb");
+	if (f == NULL) return false;
+
+	if (fread(&header, sizeof(header), 1, f) != 1 || header.magic != RGBDSequenceFile::FILE_MAGIC)
+	{
+		printf("'%s' is not an RGB-D sequence file\n", fileName);
+		return false;
+	}
+	if (header.version != RGBDSequenceFile::FILE_VERSION)
+	{
+		printf("'%s' has unsupported version %u\n", fileName, header.version);
+		return false;
+	}
+
+	index.resize(header.noFrames);
+	if (header.noFrames > 0 && (seekFile(f, header.indexOffset) != 0 ||
+		fread(&index[0], sizeof(RGBDSequenceFile::IndexEntry), index.size(), f) != index.size()))
+	{
+		printf("'%s' has no index, it was not closed properly\n", fileName);
+		index.clear();
+		header.noFrames = 0;
+		return false;
+	}
+
+	return true;
+}
+
+bool RGBDSequenceFileReader::readFrame(int frameNo, ITMUChar4Image *rgb, ITMShortImage *rawDepth)
+{
+	if (frameNo < 0 || frameNo >= header.noFrames) return false;
+
+	const RGBDSequenceFile::IndexEntry &entry = index[frameNo];
+	Vector2i rgbSize = getRGBImageSize(), depthSize = getDepthImageSize();
+	if (entry.rgbBytes != (uint32_t)(rgbSize.x * rgbSize.y * 3)) return false;
+
+	std::vector<unsigned char> *buffer;
+	bool success;
+	{
+		std::lock_guard<std::mutex> lock(fileMutex);
+		if (freeBuffers.empty()) buffer = new std::vector<unsigned char>();
+		else { buffer = freeBuffers.back(); freeBuffers.pop_back(); }
+
+		buffer->resize(entry.rgbBytes + entry.depthBytes);
+		success = seekFile(f, entry.offset) == 0 && fread(&(*buffer)[0], 1, buffer->size(), f) == buffer->size();
+	}
+
+	if (success)
+	{
+		const unsigned char *rgbBytes = &(*buffer)[0];
+
+		rgb->ChangeDims(rgbSize);
+		Vector4u *rgbData = rgb->GetData(MEMORYDEVICE_CPU);
+		for (int i = 0; i < rgbSize.x * rgbSize.y; i++)
+		{
+			rgbData[i].x = rgbBytes[i * 3 + 0]; rgbData[i].y = rgbBytes[i * 3 + 1];
+			rgbData[i].z = rgbBytes[i * 3 + 2]; rgbData[i].w = 255;
+		}
+
+		rawDepth->ChangeDims(depthSize);
+		success = RGBDSequenceFile::DecodeDepth(rgbBytes + entry.rgbBytes, entry.depthBytes, rawDepth->GetData(MEMORYDEVICE_CPU), depthSize);
+	}
+
+	std::lock_guard<std::mutex> lock(fileMutex);
+	freeBuffers.push_back(buffer);
+	return success;
+}
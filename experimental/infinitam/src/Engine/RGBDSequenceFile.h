@@ -0,0 +1,97 @@
+// Copyright 2014-2015 Isis Innovation Limited and the authors of InfiniTAM
+
+#pragma once
+
+#include "PrefetchingImageSource.h"
+
+#include <stdint.h>
+#include <stdio.h>
+
+namespace InfiniTAM
+{
+	namespace Engine
+	{
+		/** \brief
+		    Single file holding a whole RGB-D sequence
+
+		    A header, the frames one after the other, then an index with
+		    the position of every frame, so that frames can be read in
+		    any order. Colour is stored as packed 24 bit RGB. Depth is
+		    compressed losslessly: each pixel is predicted from the one
+		    above it, and the residuals are written as one to three byte
+		    codes, with runs of exact predictions collapsed into single
+		    bytes. On sensor data this is as compact as predicting from
+		    more neighbours, and decoding the rows vectorises.
+		*/
+		namespace RGBDSequenceFile
+		{
+			static const uint32_t FILE_MAGIC = 0x51535449; // "ITSQ"
+			static const uint32_t FILE_VERSION = 1;
+
+			struct Header
+			{
+				uint32_t magic, version;
+				int32_t rgbWidth, rgbHeight, depthWidth, depthHeight;
+				int32_t noFrames;
+				uint32_t reserved;
+				uint64_t indexOffset;
+			};
+
+			struct IndexEntry
+			{
+				uint64_t offset;
+				uint32_t rgbBytes, depthBytes;
+			};
+
+			void EncodeDepth(const short *depth, Vector2i imgSize, std::vector<unsigned char> &out);
+			bool DecodeDepth(const unsigned char *in, size_t noBytes, short *depth, Vector2i imgSize);
+		}
+
+		class RGBDSequenceFileWriter
+		{
+		private:
+			FILE *f;
+			RGBDSequenceFile::Header header;
+			std::vector<RGBDSequenceFile::IndexEntry> index;
+			std::vector<unsigned char> buffer;
+
+		public:
+			RGBDSequenceFileWriter();
+			~RGBDSequenceFileWriter();
+
+			bool open(const char *fileName);
+			/// All frames must have the size of the first one
+			bool writeFrame(const ITMUChar4Image *rgb, const ITMShortImage *rawDepth);
+			/// Writes the index, the file cannot be read before
+			bool close(void);
+
+			int getNoFrames(void) const { return (int)index.size(); }
+		};
+
+		class RGBDSequenceFileReader : public ImageSequenceReader
+		{
+		private:
+			FILE *f;
+			RGBDSequenceFile::Header header;
+			std::vector<RGBDSequenceFile::IndexEntry> index;
+
+			/// only protects the file position and the buffers, frames are decoded in parallel
+			std::mutex fileMutex;
+			/// compressed frames are read into these, one per thread reading
+			std::vector<std::vector<unsigned char>*> freeBuffers;
+
+		public:
+			RGBDSequenceFileReader();
+			~RGBDSequenceFileReader();
+
+			bool open(const char *fileName);
+			static bool isSequenceFile(const char *fileName);
+
+			int getNoFrames(void) const { return header.noFrames; }
+			Vector2i getRGBImageSize(void) const { return Vector2i(header.rgbWidth, header.rgbHeight); }
+			Vector2i getDepthImageSize(void) const { return Vector2i(header.depthWidth, header.depthHeight); }
+
+			bool readFrame(int frameNo, ITMUChar4Image *rgb, ITMShortImage *rawDepth);
+		};
+	}
+}
@@ -115,9 +115,18 @@ struct ComputeUpdatedVoxelInfo<true, TVoxel> {
 	}
 };
 
+/// Default observer of buildHashAllocAndVisibleTypePP: entries are only flagged, not recorded
+struct ITMUnrecordedEntries
+{
+	_CPU_AND_GPU_CODE_ inline void markedVisible(int hashIdx) const { }
+	_CPU_AND_GPU_CODE_ inline void markedForAllocation(int hashIdx) const { }
+};
+
+/// TMarkedEntries is told about each entry the first time its visible or allocation type goes from 0 to non-zero
+template<class TMarkedEntries>
 _CPU_AND_GPU_CODE_ inline void buildHashAllocAndVisibleTypePP(DEVICEPTR(uchar) *entriesAllocType, DEVICEPTR(uchar) *entriesVisibleType, int x, int y,
 	DEVICEPTR(Vector4s) *blockCoords, const CONSTPTR(float) *depth, Matrix4f invM_d, Vector4f projParams_d, float mu, Vector2i imgSize,
-	float oneOverVoxelSize, const CONSTPTR(ITMHashEntry) *hashTable, float viewFrustum_min, float viewFrustum_max)
+	float oneOverVoxelSize, const CONSTPTR(ITMHashEntry) *hashTable, float viewFrustum_min, float viewFrustum_max, THREADPTR(TMarkedEntries) &marked)
 {
 	float depth_measure; unsigned int hashIdx; int noSteps;
 	Vector4f pt_camera_f; Vector3f point_e, point, direction; Vector3s blockPos;
@@ -157,6 +166,7 @@ _CPU_AND_GPU_CODE_ inline void buildHashAllocAndVisibleTypePP(DEVICEPTR(uchar) *
 		if (IS_EQUAL3(hashEntry.pos, blockPos) && hashEntry.ptr >= -1)
 		{
 			//entry has been streamed out but is visible or in memory and visible
+			if (entriesVisibleType[hashIdx] == 0) marked.markedVisible(hashIdx);
 			entriesVisibleType[hashIdx] = (hashEntry.ptr == -1) ? 2 : 1;
 
 			isFound = true;
@@ -175,6 +185,7 @@ _CPU_AND_GPU_CODE_ inline void buildHashAllocAndVisibleTypePP(DEVICEPTR(uchar) *
 					if (IS_EQUAL3(hashEntry.pos, blockPos) && hashEntry.ptr >= -1)
 					{
 						//entry has been streamed out but is visible or in memory and visible
+						if (entriesVisibleType[hashIdx] == 0) marked.markedVisible(hashIdx);
 						entriesVisibleType[hashIdx] = (hashEntry.ptr == -1) ? 2 : 1;
 
 						isFound = true;
@@ -187,6 +198,8 @@ _CPU_AND_GPU_CODE_ inline void buildHashAllocAndVisibleTypePP(DEVICEPTR(uchar) *
 
 			if (!isFound) //still not found
 			{
+				if (entriesAllocType[hashIdx] == 0) marked.markedForAllocation(hashIdx);
+				if (entriesVisibleType[hashIdx] == 0) marked.markedVisible(hashIdx);
 				entriesAllocType[hashIdx] = isExcess ? 2 : 1; //needs allocation 
 				entriesVisibleType[hashIdx] = 1; //new entry is visible
 
@@ -198,6 +211,15 @@ _CPU_AND_GPU_CODE_ inline void buildHashAllocAndVisibleTypePP(DEVICEPTR(uchar) *
 	}
 }
 
+_CPU_AND_GPU_CODE_ inline void buildHashAllocAndVisibleTypePP(DEVICEPTR(uchar) *entriesAllocType, DEVICEPTR(uchar) *entriesVisibleType, int x, int y,
+	DEVICEPTR(Vector4s) *blockCoords, const CONSTPTR(float) *depth, Matrix4f invM_d, Vector4f projParams_d, float mu, Vector2i imgSize,
+	float oneOverVoxelSize, const CONSTPTR(ITMHashEntry) *hashTable, float viewFrustum_min, float viewFrustum_max)
+{
+	ITMUnrecordedEntries marked;
+	buildHashAllocAndVisibleTypePP(entriesAllocType, entriesVisibleType, x, y, blockCoords, depth, invM_d, projParams_d, mu, imgSize,
+		oneOverVoxelSize, hashTable, viewFrustum_min, viewFrustum_max, marked);
+}
+
 template<bool useSwapping>
 _CPU_AND_GPU_CODE_ inline void checkPointVisibility(THREADPTR(bool) &isVisible, THREADPTR(bool) &isVisibleEnlarged,
 	const THREADPTR(Vector4f) &pt_image, const CONSTPTR(Matrix4f) & M_d, const CONSTPTR(Vector4f) &projParams_d,
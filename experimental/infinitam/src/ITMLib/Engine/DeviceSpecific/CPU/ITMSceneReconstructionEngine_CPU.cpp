@@ -4,14 +4,54 @@
 #include "../../DeviceAgnostic/ITMSceneReconstructionEngine.h"
 #include "../../../Objects/ITMRenderState_VH.h"
 
+#include <algorithm>
+#include <chrono>
+
+#ifdef WITH_OPENMP
+#include <omp.h>
+#endif
+
 using namespace ITMLib::Engine;
 
+namespace
+{
+	inline double seconds()
+	{
+		return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	/// Appends the entries marked by buildHashAllocAndVisibleTypePP to the lists of the calling thread
+	struct ThreadMarkedEntries
+	{
+		std::vector<int> *visible, *allocation;
+
+		inline void markedVisible(int hashIdx) { visible->push_back(hashIdx); }
+		inline void markedForAllocation(int hashIdx) { allocation->push_back(hashIdx); }
+	};
+
+	/// Moves the per-thread lists into ids, sorted and without duplicates, so the result does not depend on the thread schedule
+	void mergeMarkedEntries(std::vector< std::vector<int> > &perThread, std::vector<int> &ids)
+	{
+		for (size_t threadId = 0; threadId < perThread.size(); threadId++)
+		{
+			ids.insert(ids.end(), perThread[threadId].begin(), perThread[threadId].end());
+			perThread[threadId].clear();
+		}
+		std::sort(ids.begin(), ids.end());
+		ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+	}
+}
+
 template<class TVoxel>
-ITMSceneReconstructionEngine_CPU<TVoxel,ITMVoxelBlockHash>::ITMSceneReconstructionEngine_CPU(void) 
+ITMSceneReconstructionEngine_CPU<TVoxel,ITMVoxelBlockHash>::ITMSceneReconstructionEngine_CPU(bool useCompactedAllocation) 
 {
 	int noTotalEntries = ITMVoxelBlockHash::noTotalEntries;
 	entriesAllocType = new ORUtils::MemoryBlock<unsigned char>(noTotalEntries, MEMORYDEVICE_CPU);
 	blockCoords = new ORUtils::MemoryBlock<Vector4s>(noTotalEntries, MEMORYDEVICE_CPU);
+
+	this->useCompactedAllocation = useCompactedAllocation;
+	lastRenderState = NULL;
+	markingTime = allocationTime = visibleListTime = 0;
 }
 
 template<class TVoxel>
@@ -154,30 +194,91 @@ void ITMSceneReconstructionEngine_CPU<TVoxel, ITMVoxelBlockHash>::AllocateSceneF
 
 	int noVisibleEntries = 0;
 
-	memset(entriesAllocType, 0, noTotalEntries);
+	double t0 = seconds();
+
+	// The compacted lists need the visible types left by the previous call on the same render state,
+	// otherwise the whole table is swept once to rebuild them
+	bool compacted = useCompactedAllocation && renderState == lastRenderState;
+
+	if (!compacted) memset(entriesAllocType, 0, noTotalEntries);
+
+	visibleCandidates.clear(); allocationCandidates.clear();
+	if (compacted)
+	{
+		visibleCandidates.insert(visibleCandidates.end(), visibleEntryIDs, visibleEntryIDs + renderState_vh->noVisibleEntries);
+		visibleCandidates.insert(visibleCandidates.end(), nonZeroVisibleType.begin(), nonZeroVisibleType.end());
+	}
 
 	for (int i = 0; i < renderState_vh->noVisibleEntries; i++)
 		entriesVisibleType[visibleEntryIDs[i]] = 3; // visible at previous frame and unstreamed
 
 	//build hashVisibility
+	if (useCompactedAllocation)
+	{
 #ifdef WITH_OPENMP
-	#pragma omp parallel for
+		int noThreads = omp_get_max_threads();
+#else
+		int noThreads = 1;
+#endif
+		if ((int)markedVisible.size() < noThreads)
+		{
+			markedVisible.resize(noThreads);
+			markedForAllocation.resize(noThreads);
+		}
+
+#ifdef WITH_OPENMP
+		#pragma omp parallel
+#endif
+		{
+#ifdef WITH_OPENMP
+			int threadId = omp_get_thread_num();
+#else
+			int threadId = 0;
+#endif
+			ThreadMarkedEntries marked = { &markedVisible[threadId], &markedForAllocation[threadId] };
+
+#ifdef WITH_OPENMP
+			#pragma omp for
 #endif
-	for (int locId = 0; locId < depthImgSize.x*depthImgSize.y; locId++)
+			for (int locId = 0; locId < depthImgSize.x*depthImgSize.y; locId++)
+			{
+				int y = locId / depthImgSize.x;
+				int x = locId - y * depthImgSize.x;
+				buildHashAllocAndVisibleTypePP(entriesAllocType, entriesVisibleType, x, y, blockCoords, depth, invM_d,
+					invProjParams_d, mu, depthImgSize, oneOverVoxelSize, hashTable, scene->sceneParams->viewFrustum_min,
+					scene->sceneParams->viewFrustum_max, marked);
+			}
+		}
+
+		mergeMarkedEntries(markedForAllocation, allocationCandidates);
+	}
+	else
 	{
-		int y = locId / depthImgSize.x;
-		int x = locId - y * depthImgSize.x;
-		buildHashAllocAndVisibleTypePP(entriesAllocType, entriesVisibleType, x, y, blockCoords, depth, invM_d,
-			invProjParams_d, mu, depthImgSize, oneOverVoxelSize, hashTable, scene->sceneParams->viewFrustum_min,
-			scene->sceneParams->viewFrustum_max);
+#ifdef WITH_OPENMP
+		#pragma omp parallel for
+#endif
+		for (int locId = 0; locId < depthImgSize.x*depthImgSize.y; locId++)
+		{
+			int y = locId / depthImgSize.x;
+			int x = locId - y * depthImgSize.x;
+			buildHashAllocAndVisibleTypePP(entriesAllocType, entriesVisibleType, x, y, blockCoords, depth, invM_d,
+				invProjParams_d, mu, depthImgSize, oneOverVoxelSize, hashTable, scene->sceneParams->viewFrustum_min,
+				scene->sceneParams->viewFrustum_max);
+		}
 	}
 
+	double t1 = seconds();
+
+	// Both lists are sorted, so entries are visited in the same order as by the full sweep
+	int noAllocationCandidates = compacted ? (int)allocationCandidates.size() : noTotalEntries;
+
 	if (onlyUpdateVisibleList) useSwapping = false;
 	if (!onlyUpdateVisibleList)
 	{
 		//allocate
-		for (int targetIdx = 0; targetIdx < noTotalEntries; targetIdx++)
+		for (int i = 0; i < noAllocationCandidates; i++)
 		{
+			int targetIdx = compacted ? allocationCandidates[i] : i;
 			int vbaIdx, exlIdx;
 			unsigned char hashChangeType = entriesAllocType[targetIdx];
 
@@ -219,6 +320,7 @@ void ITMSceneReconstructionEngine_CPU<TVoxel, ITMVoxelBlockHash>::AllocateSceneF
 					hashTable[SDF_BUCKET_NUM + exlOffset] = hashEntry; //add child to the excess list
 
 					entriesVisibleType[SDF_BUCKET_NUM + exlOffset] = 1; //make child visible and in memory
+					if (compacted) visibleCandidates.push_back(SDF_BUCKET_NUM + exlOffset);
 				}
 
 				break;
@@ -226,9 +328,15 @@ void ITMSceneReconstructionEngine_CPU<TVoxel, ITMVoxelBlockHash>::AllocateSceneF
 		}
 	}
 
+	double t2 = seconds();
+
+	if (useCompactedAllocation) mergeMarkedEntries(markedVisible, visibleCandidates);
+	int noVisibleCandidates = compacted ? (int)visibleCandidates.size() : noTotalEntries;
+
 	//build visible list
-	for (int targetIdx = 0; targetIdx < noTotalEntries; targetIdx++)
+	for (int i = 0; i < noVisibleCandidates; i++)
 	{
+		int targetIdx = compacted ? visibleCandidates[i] : i;
 		unsigned char hashVisibleType = entriesVisibleType[targetIdx];
 		const ITMHashEntry &hashEntry = hashTable[targetIdx];
 		
@@ -271,12 +379,13 @@ void ITMSceneReconstructionEngine_CPU<TVoxel, ITMVoxelBlockHash>::AllocateSceneF
 	//reallocate deleted ones from previous swap operation
 	if (useSwapping)
 	{
-		for (int targetIdx = 0; targetIdx < noTotalEntries; targetIdx++)
+		// entries with a visible type > 0 are exactly the visible list
+		for (int i = 0; i < noVisibleEntries; i++)
 		{
 			int vbaIdx;
-			ITMHashEntry hashEntry = hashTable[targetIdx];
+			int targetIdx = visibleEntryIDs[i];
 
-			if (entriesVisibleType[targetIdx] > 0 && hashEntry.ptr == -1) 
+			if (hashTable[targetIdx].ptr == -1) 
 			{
 				vbaIdx = lastFreeVoxelBlockId; lastFreeVoxelBlockId--;
 				if (vbaIdx >= 0) hashTable[targetIdx].ptr = voxelAllocationList[vbaIdx];
@@ -284,14 +393,28 @@ void ITMSceneReconstructionEngine_CPU<TVoxel, ITMVoxelBlockHash>::AllocateSceneF
 		}
 	}
 
+	if (useCompactedAllocation)
+	{
+		// leave the allocation types zeroed for the next call, instead of clearing the whole table
+		for (size_t i = 0; i < allocationCandidates.size(); i++) entriesAllocType[allocationCandidates[i]] = 0;
+
+		nonZeroVisibleType.assign(visibleEntryIDs, visibleEntryIDs + noVisibleEntries);
+		lastRenderState = renderState;
+	}
+
 	renderState_vh->noVisibleEntries = noVisibleEntries;
 
 	scene->localVBA.lastFreeBlockId = lastFreeVoxelBlockId;
 	scene->index.SetLastFreeExcessListId(lastFreeExcessListId);
+
+	double t3 = seconds();
+	markingTime = t1 - t0;
+	allocationTime = t2 - t1;
+	visibleListTime = t3 - t2;
 }
 
 template<class TVoxel>
-ITMSceneReconstructionEngine_CPU<TVoxel,ITMPlainVoxelArray>::ITMSceneReconstructionEngine_CPU(void) 
+ITMSceneReconstructionEngine_CPU<TVoxel,ITMPlainVoxelArray>::ITMSceneReconstructionEngine_CPU(bool useCompactedAllocation) 
 {}
 
 template<class TVoxel>
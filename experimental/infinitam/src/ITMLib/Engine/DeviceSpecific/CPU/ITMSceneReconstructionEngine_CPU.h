@@ -2,6 +2,8 @@
 
 #pragma once
 
+#include <vector>
+
 #include "../../ITMSceneReconstructionEngine.h"
 
 namespace ITMLib
@@ -19,7 +21,20 @@ namespace ITMLib
 			ORUtils::MemoryBlock<unsigned char> *entriesAllocType;
 			ORUtils::MemoryBlock<Vector4s> *blockCoords;
 
+			/// Only visit the hash entries marked in the current frame or visible in the last one, instead of the whole table
+			bool useCompactedAllocation;
+			/// Per-thread lists of the entries marked while building the visible and allocation types
+			std::vector< std::vector<int> > markedVisible, markedForAllocation;
+			/// Entries with a non-zero visible type in lastRenderState, i.e., its last visible list
+			std::vector<int> nonZeroVisibleType;
+			const ITMRenderState *lastRenderState;
+			/// Sorted entries the allocation and visible list passes have to look at in the current frame
+			std::vector<int> visibleCandidates, allocationCandidates;
+
 		public:
+			/// Seconds the last AllocateSceneFromDepth spent marking the hash entries, allocating blocks and building the visible list
+			double markingTime, allocationTime, visibleListTime;
+
 			void ResetScene(ITMScene<TVoxel, ITMVoxelBlockHash> *scene);
 
 			void AllocateSceneFromDepth(ITMScene<TVoxel, ITMVoxelBlockHash> *scene, const ITMView *view, const ITMTrackingState *trackingState,
@@ -28,7 +43,7 @@ namespace ITMLib
 			void IntegrateIntoScene(ITMScene<TVoxel, ITMVoxelBlockHash> *scene, const ITMView *view, const ITMTrackingState *trackingState,
 				const ITMRenderState *renderState);
 
-			ITMSceneReconstructionEngine_CPU(void);
+			ITMSceneReconstructionEngine_CPU(bool useCompactedAllocation = false);
 			~ITMSceneReconstructionEngine_CPU(void);
 		};
 
@@ -44,7 +59,7 @@ namespace ITMLib
 			void IntegrateIntoScene(ITMScene<TVoxel, ITMPlainVoxelArray> *scene, const ITMView *view, const ITMTrackingState *trackingState,
 				const ITMRenderState *renderState);
 
-			ITMSceneReconstructionEngine_CPU(void);
+			ITMSceneReconstructionEngine_CPU(bool useCompactedAllocation = false);
 			~ITMSceneReconstructionEngine_CPU(void);
 		};
 	}
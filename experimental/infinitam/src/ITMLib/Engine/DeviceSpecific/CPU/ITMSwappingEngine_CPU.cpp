@@ -4,65 +4,160 @@
 #include "../../DeviceAgnostic/ITMSwappingEngine.h"
 #include "../../../Objects/ITMRenderState_VH.h"
 
-using namespace ITMLib::Engine;
-
-template<class TVoxel>
-ITMSwappingEngine_CPU<TVoxel,ITMVoxelBlockHash>::ITMSwappingEngine_CPU(void)
-{
-}
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
 
-template<class TVoxel>
-ITMSwappingEngine_CPU<TVoxel,ITMVoxelBlockHash>::~ITMSwappingEngine_CPU(void)
-{
-}
+using namespace ITMLib::Engine;
 
-template<class TVoxel>
-int ITMSwappingEngine_CPU<TVoxel, ITMVoxelBlockHash>::LoadFromGlobalMemory(ITMScene<TVoxel, ITMVoxelBlockHash> *scene)
+namespace ITMLib
 {
-	ITMGlobalCache<TVoxel> *globalCache = scene->globalCache;
+	namespace Engine
+	{
+		/// Up to SDF_TRANSFER_BLOCK_NUM blocks going to or coming from the global cache
+		template<class TVoxel>
+		struct ITMSwappingBatch_CPU
+		{
+			ITMGlobalCache<TVoxel> *globalCache;
+			bool isRead;
+			int noEntries;
+			std::vector<int> entryIDs;
+			std::vector<bool> hasData;
+			std::vector<TVoxel> voxelBlocks;
+
+			ITMSwappingBatch_CPU(void) : globalCache(NULL), isRead(false), noEntries(0),
+				entryIDs(SDF_TRANSFER_BLOCK_NUM), hasData(SDF_TRANSFER_BLOCK_NUM), voxelBlocks(SDF_TRANSFER_BLOCK_NUM * SDF_BLOCK_SIZE3) { }
+		};
+
+		/**
+		    Batches are processed in submission order, so a block read
+		    after being swapped out always gets the data written then.
+		    Only one read is outstanding at any time. Writes are bounded
+		    by maxPendingBatches: the frame only waits for the thread if
+		    it falls that far behind.
+		*/
+		template<class TVoxel>
+		class ITMSwappingQueue_CPU
+		{
+		private:
+			static const size_t maxPendingBatches = 4;
+
+			std::mutex mutex;
+			std::condition_variable workAvailable, workDone;
+			std::deque<ITMSwappingBatch_CPU<TVoxel>*> pending;
+			std::vector<ITMSwappingBatch_CPU<TVoxel>*> freeBatches;
+			ITMSwappingBatch_CPU<TVoxel> *completedRead;
+			bool readInFlight, busy, stop;
+			std::thread worker;
+
+			void Run(void)
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				while (true)
+				{
+					while (pending.empty() && !stop) workAvailable.wait(lock);
+					if (pending.empty()) break;
+
+					ITMSwappingBatch_CPU<TVoxel> *batch = pending.front();
+					pending.pop_front();
+					busy = true;
+					lock.unlock();
+
+					for (int i = 0; i < batch->noEntries; i++)
+					{
+						TVoxel *voxelBlock = &batch->voxelBlocks[i * SDF_BLOCK_SIZE3];
+						if (batch->isRead) batch->hasData[i] = batch->globalCache->GetStoredData(batch->entryIDs[i], voxelBlock);
+						else if (batch->hasData[i]) batch->globalCache->SetStoredData(batch->entryIDs[i], voxelBlock);
+					}
+
+					lock.lock();
+					busy = false;
+					if (batch->isRead) completedRead = batch;
+					else freeBatches.push_back(batch);
+					workDone.notify_all();
+				}
+			}
 
-	ITMHashSwapState *swapStates = globalCache->GetSwapStates(false);
+		public:
+			ITMSwappingQueue_CPU(void) : completedRead(NULL), readInFlight(false), busy(false), stop(false)
+			{
+				worker = std::thread(&ITMSwappingQueue_CPU::Run, this);
+			}
 
-	int *neededEntryIDs_local = globalCache->GetNeededEntryIDs(false);
+			~ITMSwappingQueue_CPU(void)
+			{
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					stop = true;
+				}
+				workAvailable.notify_all();
+				worker.join();
+
+				delete completedRead;
+				for (size_t i = 0; i < freeBatches.size(); i++) delete freeBatches[i];
+			}
 
-	TVoxel *syncedVoxelBlocks_global = globalCache->GetSyncedVoxelBlocks(false);
-	bool *hasSyncedData_global = globalCache->GetHasSyncedData(false);
-	int *neededEntryIDs_global = globalCache->GetNeededEntryIDs(false);
+			ITMSwappingBatch_CPU<TVoxel> *AcquireBatch(void)
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				if (freeBatches.empty()) return new ITMSwappingBatch_CPU<TVoxel>();
+				ITMSwappingBatch_CPU<TVoxel> *batch = freeBatches.back();
+				freeBatches.pop_back();
+				return batch;
+			}
 
-	int noTotalEntries = globalCache->noTotalEntries;
+			void ReleaseBatch(ITMSwappingBatch_CPU<TVoxel> *batch)
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				freeBatches.push_back(batch);
+			}
 
-	int noNeededEntries = 0;
-	for (int entryId = 0; entryId < noTotalEntries; entryId++)
-	{
-		if (noNeededEntries >= SDF_TRANSFER_BLOCK_NUM) break;
-		if (swapStates[entryId].state == 1)
-		{
-			neededEntryIDs_local[noNeededEntries] = entryId;
-			noNeededEntries++;
-		}
-	}
+			void Submit(ITMSwappingBatch_CPU<TVoxel> *batch)
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				while (pending.size() >= maxPendingBatches) workDone.wait(lock);
+				if (batch->isRead) readInFlight = true;
+				pending.push_back(batch);
+				workAvailable.notify_one();
+			}
 
-	// would copy neededEntryIDs_local into neededEntryIDs_global here
+			/// The last read batch if it has been completed, NULL otherwise. Release it once used.
+			ITMSwappingBatch_CPU<TVoxel> *TakeCompletedRead(void)
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				ITMSwappingBatch_CPU<TVoxel> *batch = completedRead;
+				completedRead = NULL;
+				if (batch != NULL) readInFlight = false;
+				return batch;
+			}
 
-	if (noNeededEntries > 0)
-	{
-		memset(syncedVoxelBlocks_global, 0, noNeededEntries * SDF_BLOCK_SIZE3 * sizeof(TVoxel));
-		memset(hasSyncedData_global, 0, noNeededEntries * sizeof(bool));
-		for (int i = 0; i < noNeededEntries; i++)
-		{
-			int entryId = neededEntryIDs_global[i];
+			bool IsReadInFlight(void)
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				return readInFlight;
+			}
 
-			if (globalCache->HasStoredData(entryId))
+			/// Blocks until every submitted batch has been processed
+			void Flush(void)
 			{
-				hasSyncedData_global[i] = true;
-				memcpy(syncedVoxelBlocks_global + i * SDF_BLOCK_SIZE3, globalCache->GetStoredVoxelBlock(entryId), SDF_BLOCK_SIZE3 * sizeof(TVoxel));
+				std::unique_lock<std::mutex> lock(mutex);
+				while (!pending.empty() || busy) workDone.wait(lock);
 			}
-		}
+		};
 	}
+}
 
-	// would copy syncedVoxelBlocks_global and hasSyncedData_global and syncedVoxelBlocks_local and hasSyncedData_local here
+template<class TVoxel>
+ITMSwappingEngine_CPU<TVoxel,ITMVoxelBlockHash>::ITMSwappingEngine_CPU(void)
+{
+	queue = new ITMSwappingQueue_CPU<TVoxel>();
+}
 
-	return noNeededEntries;
+template<class TVoxel>
+ITMSwappingEngine_CPU<TVoxel,ITMVoxelBlockHash>::~ITMSwappingEngine_CPU(void)
+{
+	delete queue;
 }
 
 template<class TVoxel>
@@ -74,33 +169,58 @@ void ITMSwappingEngine_CPU<TVoxel, ITMVoxelBlockHash>::IntegrateGlobalIntoLocal(
 
 	ITMHashSwapState *swapStates = globalCache->GetSwapStates(false);
 
-	TVoxel *syncedVoxelBlocks_local = globalCache->GetSyncedVoxelBlocks(false);
-	bool *hasSyncedData_local = globalCache->GetHasSyncedData(false);
-	int *neededEntryIDs_local = globalCache->GetNeededEntryIDs(false);
-
 	TVoxel *localVBA = scene->localVBA.GetVoxelBlocks();
 
-	int noNeededEntries = this->LoadFromGlobalMemory(scene);
+	int noTotalEntries = globalCache->noTotalEntries;
 
 	int maxW = scene->sceneParams->maxW;
 
-	for (int i = 0; i < noNeededEntries; i++)
+	// combine the blocks fetched since the last frame
+	ITMSwappingBatch_CPU<TVoxel> *batch = queue->TakeCompletedRead();
+	if (batch != NULL)
 	{
-		int entryDestId = neededEntryIDs_local[i];
-
-		if (hasSyncedData_local[i])
+		for (int i = 0; i < batch->noEntries; i++)
 		{
-			TVoxel *srcVB = syncedVoxelBlocks_local + i * SDF_BLOCK_SIZE3;
-			TVoxel *dstVB = localVBA + hashTable[entryDestId].ptr * SDF_BLOCK_SIZE3;
+			int entryDestId = batch->entryIDs[i];
+
+			// deallocated again while it was being fetched, it will be requested again
+			if (swapStates[entryDestId].state != 1 || hashTable[entryDestId].ptr < 0) continue;
 
-			for (int vIdx = 0; vIdx < SDF_BLOCK_SIZE3; vIdx++)
+			if (batch->hasData[i])
 			{
-				CombineVoxelInformation<TVoxel::hasColorInformation, TVoxel>::compute(srcVB[vIdx], dstVB[vIdx], maxW);
+				TVoxel *srcVB = &batch->voxelBlocks[i * SDF_BLOCK_SIZE3];
+				TVoxel *dstVB = localVBA + hashTable[entryDestId].ptr * SDF_BLOCK_SIZE3;
+
+				for (int vIdx = 0; vIdx < SDF_BLOCK_SIZE3; vIdx++)
+				{
+					CombineVoxelInformation<TVoxel::hasColorInformation, TVoxel>::compute(srcVB[vIdx], dstVB[vIdx], maxW);
+				}
 			}
+
+			swapStates[entryDestId].state = 2;
 		}
+		queue->ReleaseBatch(batch);
+	}
+
+	if (queue->IsReadInFlight()) return;
 
-		swapStates[entryDestId].state = 2;
+	// request the next ones
+	batch = queue->AcquireBatch();
+	batch->globalCache = globalCache;
+	batch->isRead = true;
+	batch->noEntries = 0;
+	for (int entryId = 0; entryId < noTotalEntries; entryId++)
+	{
+		if (batch->noEntries >= SDF_TRANSFER_BLOCK_NUM) break;
+		if (swapStates[entryId].state == 1)
+		{
+			batch->entryIDs[batch->noEntries] = entryId;
+			batch->noEntries++;
+		}
 	}
+
+	if (batch->noEntries > 0) queue->Submit(batch);
+	else queue->ReleaseBatch(batch);
 }
 
 template<class TVoxel>
@@ -113,25 +233,21 @@ void ITMSwappingEngine_CPU<TVoxel, ITMVoxelBlockHash>::SaveToGlobalMemory(ITMSce
 	ITMHashEntry *hashTable = scene->index.GetEntries();
 	uchar *entriesVisibleType = ((ITMRenderState_VH*)renderState)->GetEntriesVisibleType();
 
-	TVoxel *syncedVoxelBlocks_local = globalCache->GetSyncedVoxelBlocks(false);
-	bool *hasSyncedData_local = globalCache->GetHasSyncedData(false);
-	int *neededEntryIDs_local = globalCache->GetNeededEntryIDs(false);
-
-	TVoxel *syncedVoxelBlocks_global = globalCache->GetSyncedVoxelBlocks(false);
-	bool *hasSyncedData_global = globalCache->GetHasSyncedData(false);
-	int *neededEntryIDs_global = globalCache->GetNeededEntryIDs(false);
-
 	TVoxel *localVBA = scene->localVBA.GetVoxelBlocks();
 	int *voxelAllocationList = scene->localVBA.GetAllocationList();
 
 	int noTotalEntries = globalCache->noTotalEntries;
-	
-	int noNeededEntries = 0;
+
 	int noAllocatedVoxelEntries = scene->localVBA.lastFreeBlockId;
 
+	ITMSwappingBatch_CPU<TVoxel> *batch = queue->AcquireBatch();
+	batch->globalCache = globalCache;
+	batch->isRead = false;
+	batch->noEntries = 0;
+
 	for (int entryDestId = 0; entryDestId < noTotalEntries; entryDestId++)
 	{
-		if (noNeededEntries >= SDF_TRANSFER_BLOCK_NUM) break;
+		if (batch->noEntries >= SDF_TRANSFER_BLOCK_NUM) break;
 
 		int localPtr = hashTable[entryDestId].ptr;
 		ITMHashSwapState &swapState = swapStates[entryDestId];
@@ -140,10 +256,10 @@ void ITMSwappingEngine_CPU<TVoxel, ITMVoxelBlockHash>::SaveToGlobalMemory(ITMSce
 		{
 			TVoxel *localVBALocation = localVBA + localPtr * SDF_BLOCK_SIZE3;
 
-			neededEntryIDs_local[noNeededEntries] = entryDestId;
+			batch->entryIDs[batch->noEntries] = entryDestId;
 
-			hasSyncedData_local[noNeededEntries] = true;
-			memcpy(syncedVoxelBlocks_local + noNeededEntries * SDF_BLOCK_SIZE3, localVBALocation, SDF_BLOCK_SIZE3 * sizeof(TVoxel));
+			batch->hasData[batch->noEntries] = true;
+			memcpy(&batch->voxelBlocks[batch->noEntries * SDF_BLOCK_SIZE3], localVBALocation, SDF_BLOCK_SIZE3 * sizeof(TVoxel));
 
 			swapStates[entryDestId].state = 0;
 
@@ -157,22 +273,21 @@ void ITMSwappingEngine_CPU<TVoxel, ITMVoxelBlockHash>::SaveToGlobalMemory(ITMSce
 				for (int i = 0; i < SDF_BLOCK_SIZE3; i++) localVBALocation[i] = TVoxel();
 			}
 
-			noNeededEntries++;
+			batch->noEntries++;
 		}
 	}
 
 	scene->localVBA.lastFreeBlockId = noAllocatedVoxelEntries;
 
-	// would copy neededEntryIDs_local, hasSyncedData_local and syncedVoxelBlocks_local into *_global here
+	// stored in the global cache by the background thread
+	if (batch->noEntries > 0) queue->Submit(batch);
+	else queue->ReleaseBatch(batch);
+}
 
-	if (noNeededEntries > 0)
-	{
-		for (int entryId = 0; entryId < noNeededEntries; entryId++)
-		{
-			if (hasSyncedData_global[entryId])
-				globalCache->SetStoredData(neededEntryIDs_global[entryId], syncedVoxelBlocks_global + entryId * SDF_BLOCK_SIZE3);
-		}
-	}
+template<class TVoxel>
+void ITMSwappingEngine_CPU<TVoxel, ITMVoxelBlockHash>::Flush(void)
+{
+	queue->Flush();
 }
 
 template class ITMLib::Engine::ITMSwappingEngine_CPU<ITMVoxel, ITMVoxelIndex>;
@@ -16,19 +16,27 @@ namespace ITMLib
 			void SaveToGlobalMemory(ITMScene<TVoxel, TIndex> *scene, ITMRenderState *renderState) {}
 		};
 
+		template<class TVoxel> class ITMSwappingQueue_CPU;
+
 		template<class TVoxel>
 		class ITMSwappingEngine_CPU<TVoxel, ITMVoxelBlockHash> : public ITMSwappingEngine < TVoxel, ITMVoxelBlockHash >
 		{
 		private:
-			int LoadFromGlobalMemory(ITMScene<TVoxel, ITMVoxelBlockHash> *scene);
+			/// Background thread reading and writing the global cache
+			ITMSwappingQueue_CPU<TVoxel> *queue;
 
 		public:
-			// This class is currently just for debugging purposes -- swaps CPU memory to CPU memory.
-			// Potentially this could stream into the host memory from somwhere else (disk, database, etc.).
+			// Swaps CPU memory to the host side global cache (which may be backed by a file).
+			// Blocks are copied in and out of the local VBA in the frame, at most SDF_TRANSFER_BLOCK_NUM
+			// each way; storing and fetching them from the cache happens on a background thread, so
+			// blocks requested in one frame are integrated in a later one.
 
 			void IntegrateGlobalIntoLocal(ITMScene<TVoxel, ITMVoxelBlockHash> *scene, ITMRenderState *renderState);
 			void SaveToGlobalMemory(ITMScene<TVoxel, ITMVoxelBlockHash> *scene, ITMRenderState *renderState);
 
+			/// Waits for the background thread, e.g., before saving the global cache to a file
+			void Flush(void);
+
 			ITMSwappingEngine_CPU(void);
 			~ITMSwappingEngine_CPU(void);
 		};
@@ -75,11 +75,7 @@ int ITMSwappingEngine_CUDA<TVoxel,ITMVoxelBlockHash>::LoadFromGlobalMemory(ITMSc
 		{
 			int entryId = neededEntryIDs_global[i];
 
-			if (globalCache->HasStoredData(entryId))
-			{
-				hasSyncedData_global[i] = true;
-				memcpy(syncedVoxelBlocks_global + i * SDF_BLOCK_SIZE3, globalCache->GetStoredVoxelBlock(entryId), SDF_BLOCK_SIZE3 * sizeof(TVoxel));
-			}
+			hasSyncedData_global[i] = globalCache->GetStoredData(entryId, syncedVoxelBlocks_global + i * SDF_BLOCK_SIZE3);
 		}
 
 		ITMSafeCall(cudaMemcpy(hasSyncedData_local, hasSyncedData_global, sizeof(bool) * noNeededEntries, cudaMemcpyHostToDevice));
@@ -16,7 +16,7 @@ ITMDenseMapper<TVoxel, TIndex>::ITMDenseMapper(const ITMLibSettings *settings)
 	switch (settings->deviceType)
 	{
 	case ITMLibSettings::DEVICE_CPU:
-		sceneRecoEngine = new ITMSceneReconstructionEngine_CPU<TVoxel,TIndex>();
+		sceneRecoEngine = new ITMSceneReconstructionEngine_CPU<TVoxel,TIndex>(settings->useCompactedAllocation);
 		if (settings->useSwapping) swappingEngine = new ITMSwappingEngine_CPU<TVoxel,TIndex>();
 		break;
 	case ITMLibSettings::DEVICE_CUDA:
@@ -38,7 +38,12 @@ template<class TVoxel, class TIndex>
 ITMDenseMapper<TVoxel,TIndex>::~ITMDenseMapper()
 {
 	delete sceneRecoEngine;
-	if (swappingEngine!=NULL) delete swappingEngine;
+	if (swappingEngine!=NULL)
+	{
+		// blocks still queued for the global cache are written before the scene can go
+		swappingEngine->Flush();
+		delete swappingEngine;
+	}
 }
 
 template<class TVoxel, class TIndex>
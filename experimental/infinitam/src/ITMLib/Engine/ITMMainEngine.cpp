@@ -15,7 +15,7 @@ ITMMainEngine::ITMMainEngine(const ITMLibSettings *settings, const ITMRGBDCalib
 	this->settings = settings;
 
 	this->scene = new ITMScene<ITMVoxel, ITMVoxelIndex>(&(settings->sceneParams), settings->useSwapping, 
-		settings->deviceType == ITMLibSettings::DEVICE_CUDA ? MEMORYDEVICE_CUDA : MEMORYDEVICE_CPU);
+		settings->deviceType == ITMLibSettings::DEVICE_CUDA ? MEMORYDEVICE_CUDA : MEMORYDEVICE_CPU, settings->globalCacheFile);
 
 	meshingEngine = NULL;
 	switch (settings->deviceType)
@@ -73,9 +73,10 @@ ITMMainEngine::~ITMMainEngine()
 	delete renderState_live;
 	if (renderState_freeview!=NULL) delete renderState_freeview;
 
-	delete scene;
-
+	// the swapping engine may still be writing to the scene's global cache
 	delete denseMapper;
+
+	delete scene;
 	delete trackingController;
 
 	delete tracker;
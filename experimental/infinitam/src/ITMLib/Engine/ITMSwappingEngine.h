@@ -27,6 +27,9 @@ namespace ITMLib
 
 			virtual void SaveToGlobalMemory(ITMScene<TVoxel, TIndex> *scene, ITMRenderState *renderState) = 0;
 
+			/// Waits until every block handed to the global cache has been stored
+			virtual void Flush(void) { }
+
 			virtual ~ITMSwappingEngine(void) { }
 		};
 	}
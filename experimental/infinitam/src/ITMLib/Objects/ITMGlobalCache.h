@@ -4,36 +4,179 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 
 #include "../Utils/ITMLibDefines.h"
 #ifndef COMPILE_WITHOUT_CUDA
 #include "../../ORUtils/CUDADefines.h"
 #endif
 
+/// Number of voxel blocks mapped at once when the global store grows
+#define SDF_STORE_CHUNK_BLOCKS 0x1000
+
+/// First bytes of a sparse global cache file ("IMGC")
+#define ITMGLOBALCACHE_FILE_MAGIC 0x43474d49u
+
 namespace ITMLib
 {
 	namespace Objects
 	{
+		/** \brief
+		    Host side storage of the voxel blocks swapped out of the
+		    local voxel block array.
+
+		    Only the blocks that have been swapped out take memory: they
+		    live in a store that grows in chunks of SDF_STORE_CHUNK_BLOCKS,
+		    mapped from a scratch file if one is given (so the kernel can
+		    page them out) or anonymous otherwise. Blocks whose voxels
+		    are all equal (e.g., never integrated) are kept as a single
+		    voxel. The stored data is not thread safe: it is meant to be
+		    accessed by one thread at a time.
+		*/
 		template<class TVoxel>
 		class ITMGlobalCache
 		{
 		private:
-			bool *hasStoredData;
-			TVoxel *storedVoxelBlocks;
+			/// Per hash entry: -1 no stored data, >= 0 block in the store, <= -2 constant block -(id+2)
+			int *storedBlockIds;
+
+			std::vector<TVoxel*> storeChunks;
+			std::vector<int> freeStoreBlocks;
+			int noStoreBlocks;
+
+			std::vector<TVoxel> constantVoxels;
+			std::vector<int> freeConstantVoxels;
+
+			int storeFile;
+
 			ITMHashSwapState *swapStates_host, *swapStates_device;
 
 			bool *hasSyncedData_host, *hasSyncedData_device;
 			TVoxel *syncedVoxelBlocks_host, *syncedVoxelBlocks_device;
 
 			int *neededEntryIDs_host, *neededEntryIDs_device;
+
+			static const size_t chunkSize = SDF_STORE_CHUNK_BLOCKS * SDF_BLOCK_SIZE3 * sizeof(TVoxel);
+
+			inline TVoxel *GetStoreBlock(int blockId) const
+			{
+				return storeChunks[blockId / SDF_STORE_CHUNK_BLOCKS] + (blockId % SDF_STORE_CHUNK_BLOCKS) * SDF_BLOCK_SIZE3;
+			}
+
+			void AddStoreChunk(void)
+			{
+				void *chunk;
+#ifdef _WIN32
+				chunk = malloc(chunkSize);
+				if (chunk == NULL) DIEWITHEXCEPTION("Could not allocate the global voxel store");
+#else
+				if (storeFile >= 0)
+				{
+					off_t offset = (off_t)storeChunks.size() * chunkSize;
+					if (ftruncate(storeFile, offset + chunkSize) != 0) DIEWITHEXCEPTION("Could not grow the global voxel store file");
+					chunk = mmap(NULL, chunkSize, PROT_READ | PROT_WRITE, MAP_SHARED, storeFile, offset);
+				}
+				else chunk = mmap(NULL, chunkSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+				if (chunk == MAP_FAILED) DIEWITHEXCEPTION("Could not map the global voxel store");
+#endif
+				storeChunks.push_back((TVoxel*)chunk);
+			}
+
+			int AllocateStoreBlock(void)
+			{
+				if (!freeStoreBlocks.empty())
+				{
+					int blockId = freeStoreBlocks.back();
+					freeStoreBlocks.pop_back();
+					return blockId;
+				}
+				if (noStoreBlocks == (int)storeChunks.size() * SDF_STORE_CHUNK_BLOCKS) AddStoreChunk();
+				return noStoreBlocks++;
+			}
+
+			int AllocateConstantVoxel(void)
+			{
+				if (!freeConstantVoxels.empty())
+				{
+					int id = freeConstantVoxels.back();
+					freeConstantVoxels.pop_back();
+					return id;
+				}
+				constantVoxels.push_back(TVoxel());
+				return (int)constantVoxels.size() - 1;
+			}
+
+			void ReleaseStoredData(int address)
+			{
+				int blockId = storedBlockIds[address];
+				if (blockId >= 0) freeStoreBlocks.push_back(blockId);
+				else if (blockId <= -2) freeConstantVoxels.push_back(-blockId - 2);
+				storedBlockIds[address] = -1;
+			}
+
+			void ReleaseAllStoredData(void)
+			{
+				for (int i = 0; i < noTotalEntries; i++) storedBlockIds[i] = -1;
+				freeStoreBlocks.clear();
+				freeConstantVoxels.clear();
+				constantVoxels.clear();
+				noStoreBlocks = 0;
+			}
+
+			/// Compares each voxel with the next one, padding included, so it may miss some constant blocks but never merges different ones
+			static inline bool IsConstantBlock(const TVoxel *data)
+			{
+				return memcmp(data, data + 1, sizeof(TVoxel) * (SDF_BLOCK_SIZE3 - 1)) == 0;
+			}
+
 		public:
-			inline void SetStoredData(int address, TVoxel *data) 
-			{ 
-				hasStoredData[address] = true; 
-				memcpy(storedVoxelBlocks + address * SDF_BLOCK_SIZE3, data, sizeof(TVoxel) * SDF_BLOCK_SIZE3);
+			inline void SetStoredData(int address, const TVoxel *data)
+			{
+				int blockId = storedBlockIds[address];
+				if (IsConstantBlock(data))
+				{
+					if (blockId > -2)
+					{
+						ReleaseStoredData(address);
+						blockId = -AllocateConstantVoxel() - 2;
+						storedBlockIds[address] = blockId;
+					}
+					constantVoxels[-blockId - 2] = data[0];
+				}
+				else
+				{
+					if (blockId < 0)
+					{
+						ReleaseStoredData(address);
+						blockId = AllocateStoreBlock();
+						storedBlockIds[address] = blockId;
+					}
+					memcpy(GetStoreBlock(blockId), data, sizeof(TVoxel) * SDF_BLOCK_SIZE3);
+				}
 			}
-			inline bool HasStoredData(int address) const { return hasStoredData[address]; }
-			inline TVoxel *GetStoredVoxelBlock(int address) { return storedVoxelBlocks + address * SDF_BLOCK_SIZE3; }
+			inline bool HasStoredData(int address) const { return storedBlockIds[address] != -1; }
+
+			/// Copies the stored voxels of an entry into data, false if it has none
+			inline bool GetStoredData(int address, TVoxel *data) const
+			{
+				int blockId = storedBlockIds[address];
+				if (blockId >= 0) memcpy(data, GetStoreBlock(blockId), sizeof(TVoxel) * SDF_BLOCK_SIZE3);
+				else if (blockId <= -2) std::fill(data, data + SDF_BLOCK_SIZE3, constantVoxels[-blockId - 2]);
+				return blockId != -1;
+			}
+
+			/// Blocks held in the store and as a single voxel, for statistics
+			int GetNoStoredBlocks(void) const { return noStoreBlocks - (int)freeStoreBlocks.size(); }
+			int GetNoConstantBlocks(void) const { return (int)(constantVoxels.size() - freeConstantVoxels.size()); }
 
 			bool *GetHasSyncedData(bool useGPU) const { return useGPU ? hasSyncedData_device : hasSyncedData_host; }
 			TVoxel *GetSyncedVoxelBlocks(bool useGPU) const { return useGPU ? syncedVoxelBlocks_device : syncedVoxelBlocks_host; }
@@ -41,13 +184,28 @@ namespace ITMLib
 			ITMHashSwapState *GetSwapStates(bool useGPU) { return useGPU ? swapStates_device : swapStates_host; }
 			int *GetNeededEntryIDs(bool useGPU) { return useGPU ? neededEntryIDs_device : neededEntryIDs_host; }
 
-			int noTotalEntries; 
+			int noTotalEntries;
+
+			/// storeFileName: scratch file backing the store, NULL to keep it in anonymous memory. A name
+			/// ending in XXXXXX is made unique as by mkstemp, so several processes can share the default.
+			ITMGlobalCache(const char *storeFileName = NULL) : noTotalEntries(SDF_BUCKET_NUM + SDF_EXCESS_LIST_SIZE)
+			{
+				storedBlockIds = (int*)malloc(noTotalEntries * sizeof(int));
+				noStoreBlocks = 0;
+				ReleaseAllStoredData();
 
-			ITMGlobalCache() : noTotalEntries(SDF_BUCKET_NUM + SDF_EXCESS_LIST_SIZE)
-			{	
-				hasStoredData = (bool*)malloc(noTotalEntries * sizeof(bool));
-				storedVoxelBlocks = (TVoxel*)malloc(noTotalEntries * sizeof(TVoxel) * SDF_BLOCK_SIZE3);
-				memset(hasStoredData, 0, noTotalEntries);
+				storeFile = -1;
+#ifndef _WIN32
+				if (storeFileName != NULL)
+				{
+					std::vector<char> name(storeFileName, storeFileName + strlen(storeFileName) + 1);
+					const size_t len = name.size() - 1;
+					if (len >= 6 && strcmp(&name[len - 6], "XXXXXX") == 0) storeFile = mkstemp(&name[0]);
+					else storeFile = open(&name[0], O_RDWR | O_CREAT | O_TRUNC, 0600);
+					if (storeFile < 0) DIEWITHEXCEPTION("Could not create the global voxel store file");
+					unlink(&name[0]); // scratch only, removed when closed
+				}
+#endif
 
 				swapStates_host = (ITMHashSwapState *)malloc(noTotalEntries * sizeof(ITMHashSwapState));
 				memset(swapStates_host, 0, sizeof(ITMHashSwapState) * noTotalEntries);
@@ -71,43 +229,91 @@ namespace ITMLib
 #endif
 			}
 
+			/// Writes only the entries with stored data: entry id, whether the block is constant, then one or SDF_BLOCK_SIZE3 voxels
 			void SaveToFile(char *fileName) const
 			{
-				TVoxel *storedData = storedVoxelBlocks;
-
 				FILE *f = fopen(fileName, "wb");
 
-				fwrite(hasStoredData, sizeof(bool), noTotalEntries, f);
+				unsigned int magic = ITMGLOBALCACHE_FILE_MAGIC;
+				int noStoredEntries = 0;
+				for (int i = 0; i < noTotalEntries; i++) if (storedBlockIds[i] != -1) noStoredEntries++;
+
+				fwrite(&magic, sizeof(unsigned int), 1, f);
+				fwrite(&noStoredEntries, sizeof(int), 1, f);
 				for (int i = 0; i < noTotalEntries; i++)
 				{
-					fwrite(storedData, sizeof(TVoxel) * SDF_BLOCK_SIZE3, 1, f);
-					storedData += SDF_BLOCK_SIZE3;
+					int blockId = storedBlockIds[i];
+					if (blockId == -1) continue;
+
+					unsigned char isConstant = blockId <= -2;
+					fwrite(&i, sizeof(int), 1, f);
+					fwrite(&isConstant, sizeof(unsigned char), 1, f);
+					if (isConstant) fwrite(&constantVoxels[-blockId - 2], sizeof(TVoxel), 1, f);
+					else fwrite(GetStoreBlock(blockId), sizeof(TVoxel) * SDF_BLOCK_SIZE3, 1, f);
 				}
 
 				fclose(f);
 			}
 
+			/// Reads files written by SaveToFile, as well as the older dense format (every block, stored or not)
 			void ReadFromFile(char *fileName)
 			{
-				TVoxel *storedData = storedVoxelBlocks;
 				FILE *f = fopen(fileName, "rb");
+				if (f == NULL) return;
 
-				size_t tmp = fread(hasStoredData, sizeof(bool), noTotalEntries, f);
-				if (tmp == (size_t)noTotalEntries) {
-					for (int i = 0; i < noTotalEntries; i++)
+				ReleaseAllStoredData();
+				std::vector<TVoxel> block(SDF_BLOCK_SIZE3);
+
+				unsigned int magic = 0;
+				if (fread(&magic, sizeof(unsigned int), 1, f) == 1 && magic == ITMGLOBALCACHE_FILE_MAGIC)
+				{
+					int noStoredEntries = 0;
+					if (fread(&noStoredEntries, sizeof(int), 1, f) != 1) noStoredEntries = 0;
+					for (int n = 0; n < noStoredEntries; n++)
 					{
-						fread(storedData, sizeof(TVoxel) * SDF_BLOCK_SIZE3, 1, f);
-						storedData += SDF_BLOCK_SIZE3;
+						int address; unsigned char isConstant;
+						if (fread(&address, sizeof(int), 1, f) != 1 || fread(&isConstant, sizeof(unsigned char), 1, f) != 1) break;
+						if (address < 0 || address >= noTotalEntries) break;
+						if (isConstant)
+						{
+							if (fread(&block[0], sizeof(TVoxel), 1, f) != 1) break;
+							std::fill(block.begin() + 1, block.end(), block[0]);
+						}
+						else if (fread(&block[0], sizeof(TVoxel) * SDF_BLOCK_SIZE3, 1, f) != 1) break;
+						SetStoredData(address, &block[0]);
+					}
+				}
+				else
+				{
+					rewind(f);
+					std::vector<unsigned char> hasStoredData(noTotalEntries);
+					size_t tmp = fread(&hasStoredData[0], sizeof(bool), noTotalEntries, f);
+					if (tmp == (size_t)noTotalEntries) {
+						for (int i = 0; i < noTotalEntries; i++)
+						{
+							if (fread(&block[0], sizeof(TVoxel) * SDF_BLOCK_SIZE3, 1, f) != 1) break;
+							if (hasStoredData[i]) SetStoredData(i, &block[0]);
+						}
 					}
 				}
 
 				fclose(f);
 			}
 
-			~ITMGlobalCache(void) 
+			~ITMGlobalCache(void)
 			{
-				free(hasStoredData);
-				free(storedVoxelBlocks);
+				free(storedBlockIds);
+				for (size_t i = 0; i < storeChunks.size(); i++)
+				{
+#ifdef _WIN32
+					free(storeChunks[i]);
+#else
+					munmap(storeChunks[i], chunkSize);
+#endif
+				}
+#ifndef _WIN32
+				if (storeFile >= 0) close(storeFile);
+#endif
 
 				free(swapStates_host);
 
@@ -126,6 +332,10 @@ namespace ITMLib
 				free(neededEntryIDs_host);
 #endif
 			}
+
+			// Suppress the default copy constructor and assignment operator
+			ITMGlobalCache(const ITMGlobalCache&);
+			ITMGlobalCache& operator=(const ITMGlobalCache&);
 		};
 	}
 }
@@ -34,12 +34,12 @@ namespace ITMLib
 			/** Global content of the 8x8x8 voxel blocks -- stored on host only */
 			ITMGlobalCache<TVoxel> *globalCache;
 
-			ITMScene(const ITMSceneParams *sceneParams, bool useSwapping, MemoryDeviceType memoryType)
+			ITMScene(const ITMSceneParams *sceneParams, bool useSwapping, MemoryDeviceType memoryType, const char *globalCacheFile = NULL)
 				: index(memoryType), localVBA(memoryType, index.getNumAllocatedVoxelBlocks(), index.getVoxelBlockSize())
 			{
 				this->sceneParams = sceneParams;
 				this->useSwapping = useSwapping;
-				if (useSwapping) globalCache = new ITMGlobalCache<TVoxel>();
+				if (useSwapping) globalCache = new ITMGlobalCache<TVoxel>(globalCacheFile);
 			}
 
 			~ITMScene(void)
@@ -33,6 +33,13 @@ ITMLibSettings::ITMLibSettings(void)
 	/// enables or disables swapping. HERE BE DRAGONS: It should work, but requires more testing
 	useSwapping = false;
 
+	/// swapped out blocks are kept in a scratch file on disk, so scenes larger than RAM can be paged out; NULL keeps them in anonymous memory
+	globalCacheFile = "/var/tmp/InfiniTAM_globalCache_XXXXXX";
+
+	/// allocates and builds the visible list from the entries marked in this frame instead of sweeping the whole hash table;
+	/// off until it measures faster than the sweep, see InfiniTAM_recobench
+	useCompactedAllocation = false;
+
 	/// enables or disables approximate raycast
 	useApproximateRaycast = false;
 
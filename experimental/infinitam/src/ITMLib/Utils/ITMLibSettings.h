@@ -25,6 +25,12 @@ namespace ITMLib
 			/// Enables swapping between host and device.
 			bool useSwapping;
 
+			/// Scratch file backing the swapped out voxel blocks (a trailing XXXXXX is made unique), NULL to keep them in memory
+			const char *globalCacheFile;
+
+			/// For the CPU reconstruction engine: only visit the hash entries touched in the current or previous frame when allocating
+			bool useCompactedAllocation;
+
 			bool useApproximateRaycast;
 
 			bool useBilateralFilter;
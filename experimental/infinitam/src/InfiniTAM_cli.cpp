@@ -4,6 +4,8 @@
 
 #include "Engine/CLIEngine.h"
 #include "Engine/ImageSourceEngine.h"
+#include "Engine/PrefetchingImageSource.h"
+#include "Engine/RGBDSequenceFile.h"
 #include "Engine/OpenNIEngine.h"
 #include "Engine/Kinect2Engine.h"
 
@@ -32,6 +34,7 @@ try
 		printf("usage: %s [<calibfile> [<imagesource>] ]\n"
 		       "  <calibfile>   : path to a file containing intrinsic calibration parameters\n"
 		       "  <imagesource> : either one argument to specify OpenNI device ID\n"
+		       "                  or an RGB-D sequence file (see InfiniTAM_seq)\n"
 		       "                  or two arguments specifying rgb and depth file masks\n"
 		       "\n"
 		       "examples:\n"
@@ -45,7 +48,14 @@ try
 	ImageSourceEngine *imageSource;
 	IMUSourceEngine *imuSource = NULL;
 	printf("using calibration file: %s\n", calibFile);
-	if (imagesource_part2 == NULL) 
+	if (imagesource_part1 != NULL && imagesource_part2 == NULL && RGBDSequenceFileReader::isSequenceFile(imagesource_part1))
+	{
+		printf("using sequence file: %s\n", imagesource_part1);
+		RGBDSequenceFileReader *reader = new RGBDSequenceFileReader();
+		reader->open(imagesource_part1);
+		imageSource = new PrefetchingImageSource(calibFile, reader);
+	}
+	else if (imagesource_part2 == NULL) 
 	{
 		printf("using OpenNI device: %s\n", (imagesource_part1==NULL)?"<OpenNI default device>":imagesource_part1);
 		imageSource = new OpenNIEngine(calibFile, imagesource_part1);
@@ -60,7 +70,7 @@ try
 		if (imagesource_part3 == NULL)
 		{
 			printf("using rgb images: %s\nusing depth images: %s\n", imagesource_part1, imagesource_part2);
-			imageSource = new ImageFileReader(calibFile, imagesource_part1, imagesource_part2);
+			imageSource = new PrefetchingImageSource(calibFile, new ImageFileSequence(imagesource_part1, imagesource_part2));
 		}
 		else
 		{
@@ -0,0 +1,176 @@
+// Copyright 2014-2015 Isis Innovation Limited and the authors of InfiniTAM
+
+// Time per call of every ITMLowLevelEngine_CPU function against the former
+// per-pixel loops over the DeviceAgnostic helpers, on random images with holes,
+// negative depths, NaN and -0, from 320x240 up to 640x480 plus some odd sizes.
+// Every output must be bit-identical to the former loops, except the gradient
+// border: the former code cleared only the first three quarters of the buffer
+// (sizeof(Vector3s) per pixel), so border pixels after that kept the previous
+// frame; every border pixel must now be zero. Run with OMP_NUM_THREADS to see
+// the row-parallel loops scale.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+
+#include "ITMLib/Engine/DeviceSpecific/CPU/ITMLowLevelEngine_CPU.h"
+#include "ITMLib/Engine/DeviceAgnostic/ITMLowLevelEngine.h"
+
+using namespace ITMLib::Engine;
+
+static double now()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/// mean time of one call in us, after a warm-up call
+template<class F> static double timeCall(F f, int noCalls)
+{
+	f();
+	double t0 = now();
+	for (int i = 0; i < noCalls; i++) f();
+	return 1e6 * (now() - t0) / noCalls;
+}
+
+// the former single-threaded loops
+
+template<class T> static void formerCopyImage(ORUtils::Image<T> *image_out, const ORUtils::Image<T> *image_in)
+{
+	memcpy(image_out->GetData(MEMORYDEVICE_CPU), image_in->GetData(MEMORYDEVICE_CPU), image_in->dataSize * sizeof(T));
+}
+
+static void formerFilterSubsample(ITMUChar4Image *image_out, const ITMUChar4Image *image_in)
+{
+	Vector2i oldDims = image_in->noDims, newDims(oldDims.x / 2, oldDims.y / 2);
+	image_out->ChangeDims(newDims);
+	const Vector4u *imageData_in = image_in->GetData(MEMORYDEVICE_CPU);
+	Vector4u *imageData_out = image_out->GetData(MEMORYDEVICE_CPU);
+	for (int y = 0; y < newDims.y; y++) for (int x = 0; x < newDims.x; x++)
+		filterSubsample(imageData_out, x, y, newDims, imageData_in, oldDims);
+}
+
+template<class T> static void formerFilterSubsampleWithHoles(ORUtils::Image<T> *image_out, const ORUtils::Image<T> *image_in)
+{
+	Vector2i oldDims = image_in->noDims, newDims(oldDims.x / 2, oldDims.y / 2);
+	image_out->ChangeDims(newDims);
+	const T *imageData_in = image_in->GetData(MEMORYDEVICE_CPU);
+	T *imageData_out = image_out->GetData(MEMORYDEVICE_CPU);
+	for (int y = 0; y < newDims.y; y++) for (int x = 0; x < newDims.x; x++)
+		filterSubsampleWithHoles(imageData_out, x, y, newDims, imageData_in, oldDims);
+}
+
+static void formerGradient(ITMShort4Image *grad_out, const ITMUChar4Image *image_in, bool alongX)
+{
+	grad_out->ChangeDims(image_in->noDims);
+	Vector2i imgSize = image_in->noDims;
+	Vector4s *grad = grad_out->GetData(MEMORYDEVICE_CPU);
+	const Vector4u *image = image_in->GetData(MEMORYDEVICE_CPU);
+	// the former memset of imgSize.x * imgSize.y * sizeof(Vector3s) bytes: the first three quarters of the buffer, possibly ending mid-element
+	int noBytes = imgSize.x * imgSize.y * sizeof(Vector3s), noWhole = noBytes / sizeof(Vector4s);
+	std::fill(grad, grad + noWhole, Vector4s(0, 0, 0, 0));
+	for (int c = 0; c < (int)((noBytes % sizeof(Vector4s)) / sizeof(short)); c++) grad[noWhole][c] = 0;
+	for (int y = 1; y < imgSize.y - 1; y++) for (int x = 1; x < imgSize.x - 1; x++)
+	{
+		if (alongX) gradientX(grad, x, y, image, imgSize);
+		else gradientY(grad, x, y, image, imgSize);
+	}
+}
+
+template<class T> static bool identical(const ORUtils::Image<T> *a, const ORUtils::Image<T> *b)
+{
+	return a->noDims == b->noDims && memcmp(a->GetData(MEMORYDEVICE_CPU), b->GetData(MEMORYDEVICE_CPU), a->dataSize * sizeof(T)) == 0;
+}
+
+/// same interior as the former loops, zero border
+static bool identicalGradient(const ITMShort4Image *former, const ITMShort4Image *grad)
+{
+	Vector2i size = grad->noDims;
+	const Vector4s *a = former->GetData(MEMORYDEVICE_CPU), *b = grad->GetData(MEMORYDEVICE_CPU);
+	for (int y = 0; y < size.y; y++) for (int x = 0; x < size.x; x++)
+	{
+		int i = x + y * size.x;
+		bool border = x == 0 || y == 0 || x == size.x - 1 || y == size.y - 1;
+		if (border ? b[i] != Vector4s(0, 0, 0, 0) : memcmp(&a[i], &b[i], sizeof(Vector4s)) != 0) return false;
+	}
+	return true;
+}
+
+int main(int argc, char** argv)
+try
+{
+	const int noCalls = argc > 1 ? atoi(argv[1]) : 200;
+	if (noCalls <= 0)
+	{
+		printf("usage: %s [<calls per function>]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	ITMLowLevelEngine_CPU lowLevelEngine;
+	std::mt19937 rng(44);
+	const Vector2i sizes[] = { Vector2i(320, 240), Vector2i(480, 360), Vector2i(640, 480), Vector2i(641, 481), Vector2i(80, 60), Vector2i(3, 3) };
+	bool allIdentical = true;
+	const Vector4s stale(0x5a5a, 0x5a5a, 0x5a5a, 0x5a5a);
+
+	printf("%-9s %-28s %12s %12s %9s\n", "size", "function", "former [us]", "now [us]", "identical");
+	for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+	{
+		Vector2i size = sizes[s];
+		ITMUChar4Image rgb(size, true, false);
+		ITMFloatImage depth(size, true, false);
+		ITMFloat4Image points(size, true, false);
+		for (int i = 0; i < size.x * size.y; i++)
+		{
+			for (int c = 0; c < 4; c++) rgb.GetData(MEMORYDEVICE_CPU)[i][c] = rng() & 255;
+			int kind = rng() % 20;
+			float d = 0.3f + (rng() % 100000) * 1e-4f;
+			depth.GetData(MEMORYDEVICE_CPU)[i] = kind == 0 ? 0.f : kind == 1 ? -1.f : kind == 2 ? NAN : kind == 3 ? -0.f : d;
+			Vector4f p;
+			for (int c = 0; c < 3; c++) p[c] = ((int)(rng() % 20001) - 10000) * 1e-3f;
+			p.w = kind < 3 ? -1.f : kind == 3 ? -0.f : 1.f;
+			if (kind == 4) p.x = -0.f;
+			points.GetData(MEMORYDEVICE_CPU)[i] = p;
+		}
+		// the coarse levels are cheap, call them more often
+		int calls = size.x * size.y >= 320 * 240 ? noCalls : 20 * noCalls;
+
+		ITMUChar4Image rgbA(size, true, false), rgbB(size, true, false);
+		ITMFloatImage depthA(size, true, false), depthB(size, true, false);
+		ITMFloat4Image pointsA(size, true, false), pointsB(size, true, false);
+		ITMShort4Image gradA(size, true, false), gradB(size, true, false);
+
+		char name[32];
+		sprintf(name, "%ix%i", size.x, size.y);
+		double former, current;
+		bool same;
+#define ROW(function, formerCall, call, check) \
+		former = timeCall([&]{ formerCall; }, calls); current = timeCall([&]{ call; }, calls); same = check; allIdentical &= same; \
+		printf("%-9s %-28s %12.1f %12.1f %9s\n", name, function, former, current, same ? "yes" : "NO");
+
+		ROW("CopyImage uchar4", formerCopyImage(&rgbA, &rgb), lowLevelEngine.CopyImage(&rgbB, &rgb), identical(&rgbA, &rgbB));
+		ROW("CopyImage float", formerCopyImage(&depthA, &depth), lowLevelEngine.CopyImage(&depthB, &depth), identical(&depthA, &depthB));
+		ROW("CopyImage float4", formerCopyImage(&pointsA, &points), lowLevelEngine.CopyImage(&pointsB, &points), identical(&pointsA, &pointsB));
+		ROW("FilterSubsample", formerFilterSubsample(&rgbA, &rgb), lowLevelEngine.FilterSubsample(&rgbB, &rgb), identical(&rgbA, &rgbB));
+		ROW("FilterSubsampleWithHoles f", formerFilterSubsampleWithHoles(&depthA, &depth), lowLevelEngine.FilterSubsampleWithHoles(&depthB, &depth),
+			identical(&depthA, &depthB));
+		ROW("FilterSubsampleWithHoles f4", formerFilterSubsampleWithHoles(&pointsA, &points), lowLevelEngine.FilterSubsampleWithHoles(&pointsB, &points),
+			identical(&pointsA, &pointsB));
+		// checked on a buffer holding stale data, as between frames
+		ROW("GradientX", formerGradient(&gradA, &rgb, true), lowLevelEngine.GradientX(&gradB, &rgb),
+			(std::fill(gradB.GetData(MEMORYDEVICE_CPU), gradB.GetData(MEMORYDEVICE_CPU) + gradB.dataSize, stale), lowLevelEngine.GradientX(&gradB, &rgb), identicalGradient(&gradA, &gradB)));
+		ROW("GradientY", formerGradient(&gradA, &rgb, false), lowLevelEngine.GradientY(&gradB, &rgb),
+			(std::fill(gradB.GetData(MEMORYDEVICE_CPU), gradB.GetData(MEMORYDEVICE_CPU) + gradB.dataSize, stale), lowLevelEngine.GradientY(&gradB, &rgb), identicalGradient(&gradA, &gradB)));
+#undef ROW
+	}
+	printf("%s\n", allIdentical ? "identical to the former loops" : "DIFFERENT from the former loops");
+	return allIdentical ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+catch(std::exception& e)
+{
+	std::cerr << e.what() << '\n';
+	return EXIT_FAILURE;
+}
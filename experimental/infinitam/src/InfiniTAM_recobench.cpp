@@ -0,0 +1,262 @@
+// Copyright 2014-2015 Isis Innovation Limited and the authors of InfiniTAM
+
+// Per-stage time of the CPU scene reconstruction with compacted allocation
+// (ITMLibSettings::useCompactedAllocation, off by default) against the full hash
+// table sweep, fed with the same views and poses: marking the hash entries the
+// depth image touches, allocating blocks, building the visible list (all three
+// inside AllocateSceneFromDepth) and integration. A recorded sequence is tracked
+// by an ITMMainEngine with the default settings; the synthetic one is a camera
+// moving inside a box-shaped room with known poses. Every frame the visible list,
+// the visible types, the hash table, the free-list heads and the voxels of the
+// visible blocks of both scenes must be identical. With more than one OpenMP
+// thread the full sweep itself depends on the schedule (colliding buckets race),
+// so only the consistency of the compacted visible list is checked then.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <set>
+#include <vector>
+
+#ifdef WITH_OPENMP
+#include <omp.h>
+#endif
+
+#include "Engine/ImageSourceEngine.h"
+#include "ITMLib/Engine/DeviceSpecific/CPU/ITMSceneReconstructionEngine_CPU.h"
+#include "ITMLib/Objects/ITMRenderState_VH.h"
+
+using namespace InfiniTAM::Engine;
+using namespace ITMLib::Objects;
+using namespace ITMLib::Engine;
+
+static double now()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/// one reconstruction engine with its own scene and render state
+struct Reconstruction
+{
+	ITMSceneReconstructionEngine_CPU<ITMVoxel, ITMVoxelIndex> engine;
+	ITMScene<ITMVoxel, ITMVoxelIndex> scene;
+	ITMRenderState_VH renderState;
+	std::vector<double> markingTimes, allocationTimes, visibleListTimes, allocateSceneTimes, integrationTimes;
+
+	Reconstruction(const ITMSceneParams *sceneParams, Vector2i imgSize, bool useCompactedAllocation)
+		: engine(useCompactedAllocation), scene(sceneParams, false, MEMORYDEVICE_CPU),
+		  renderState(ITMVoxelBlockHash::noTotalEntries, imgSize, sceneParams->viewFrustum_min, sceneParams->viewFrustum_max)
+	{
+		engine.ResetScene(&scene);
+		memset(renderState.GetEntriesVisibleType(), 0, ITMVoxelBlockHash::noTotalEntries);
+	}
+
+	void process(const ITMView *view, const ITMTrackingState *trackingState, bool onlyUpdateVisibleList)
+	{
+		double t0 = now();
+		engine.AllocateSceneFromDepth(&scene, view, trackingState, &renderState, onlyUpdateVisibleList);
+		double t1 = now();
+		engine.IntegrateIntoScene(&scene, view, trackingState, &renderState);
+		double t2 = now();
+		markingTimes.push_back(engine.markingTime);
+		allocationTimes.push_back(engine.allocationTime);
+		visibleListTimes.push_back(engine.visibleListTime);
+		allocateSceneTimes.push_back(t1 - t0);
+		integrationTimes.push_back(t2 - t1);
+	}
+};
+
+static bool identical(Reconstruction &a, Reconstruction &b)
+{
+	if (a.renderState.noVisibleEntries != b.renderState.noVisibleEntries) return false;
+	if (a.scene.localVBA.lastFreeBlockId != b.scene.localVBA.lastFreeBlockId) return false;
+	if (a.scene.index.GetLastFreeExcessListId() != b.scene.index.GetLastFreeExcessListId()) return false;
+	if (memcmp(a.renderState.GetVisibleEntryIDs(), b.renderState.GetVisibleEntryIDs(), sizeof(int) * a.renderState.noVisibleEntries)) return false;
+	if (memcmp(a.renderState.GetEntriesVisibleType(), b.renderState.GetEntriesVisibleType(), ITMVoxelBlockHash::noTotalEntries)) return false;
+	if (memcmp(a.scene.index.GetEntries(), b.scene.index.GetEntries(), sizeof(ITMHashEntry) * ITMVoxelBlockHash::noTotalEntries)) return false;
+
+	const ITMHashEntry *entries = a.scene.index.GetEntries();
+	const ITMVoxel *voxelsA = a.scene.localVBA.GetVoxelBlocks(), *voxelsB = b.scene.localVBA.GetVoxelBlocks();
+	for (int i = 0; i < a.renderState.noVisibleEntries; i++)
+	{
+		const ITMHashEntry &entry = entries[a.renderState.GetVisibleEntryIDs()[i]];
+		if (entry.ptr < 0) continue;
+		if (memcmp(voxelsA + entry.ptr * SDF_BLOCK_SIZE3, voxelsB + entry.ptr * SDF_BLOCK_SIZE3, sizeof(ITMVoxel) * SDF_BLOCK_SIZE3)) return false;
+	}
+	return true;
+}
+
+/// the visible list holds exactly the entries with a non-zero visible type
+static bool consistent(Reconstruction &r)
+{
+	const uchar *types = r.renderState.GetEntriesVisibleType();
+	std::set<int> listed(r.renderState.GetVisibleEntryIDs(), r.renderState.GetVisibleEntryIDs() + r.renderState.noVisibleEntries);
+	if ((int)listed.size() != r.renderState.noVisibleEntries) return false;
+	for (int i = 0; i < ITMVoxelBlockHash::noTotalEntries; i++)
+		if ((types[i] != 0) != (listed.count(i) != 0)) return false;
+	return true;
+}
+
+/// depth (m) of a camera inside a 4 x 3 x 5 m room with some relief on the walls
+static void renderRoom(ITMView *view, const ITMPose *pose)
+{
+	Matrix4f invM = pose->GetInvM();
+	Vector4f c = invM * Vector4f(0, 0, 0, 1);
+	Vector2i size = view->depth->noDims;
+	float *depth = view->depth->GetData(MEMORYDEVICE_CPU);
+	Vector4f pp = view->calib->intrinsics_d.projectionParamsSimple.all;
+	const float lo[3] = { -2.f, -1.5f, -2.5f }, hi[3] = { 2.f, 1.5f, 2.5f };
+	for (int y = 0; y < size.y; y++) for (int x = 0; x < size.x; x++)
+	{
+		Vector4f d = invM * Vector4f((x - pp.z) / pp.x, (y - pp.w) / pp.y, 1.f, 0.f);
+		float cc[3] = { c.x, c.y, c.z }, dd[3] = { d.x, d.y, d.z }, t = 1e9f;
+		for (int a = 0; a < 3; a++)
+		{
+			if (dd[a] > 1e-6f) t = std::min(t, (hi[a] - cc[a]) / dd[a]);
+			else if (dd[a] < -1e-6f) t = std::min(t, (lo[a] - cc[a]) / dd[a]);
+		}
+		Vector4f p = c + d * t;
+		depth[x + y * size.x] = t + 0.01f * sinf(7.f * p.z) * cosf(5.f * p.x + 3.f * p.y);
+	}
+}
+
+static void percentiles(std::vector<double> v, double &mean, double &p99)
+{
+	std::sort(v.begin(), v.end());
+	mean = 0;
+	for (size_t i = 0; i < v.size(); i++) mean += v[i];
+	mean /= v.size();
+	p99 = v[std::min(v.size() - 1, (size_t)(0.99 * v.size()))];
+}
+
+/// one row per reconstruction: mean and p99 in ms
+static void printStage(const char *stage, const std::vector<double> &full, const std::vector<double> &compacted)
+{
+	double mean, p99;
+	char name[64];
+	sprintf(name, "%s, full sweep", stage);
+	percentiles(full, mean, p99);
+	printf("%-36s %10.3f %10.3f\n", name, 1e3 * mean, 1e3 * p99);
+	sprintf(name, "%s, compacted", stage);
+	percentiles(compacted, mean, p99);
+	printf("%-36s %10.3f %10.3f\n", name, 1e3 * mean, 1e3 * p99);
+}
+
+int main(int argc, char** argv)
+try
+{
+	const bool recorded = argc >= 4;
+	const int maxFrames = recorded ? (argc > 4 ? atoi(argv[4]) : 100000) : (argc > 1 ? atoi(argv[1]) : 200);
+	if (argc == 3 || (argc > 1 && !recorded && maxFrames <= 0))
+	{
+		printf("usage: %s [<frames>]\n"
+		       "       %s <calib> <rgbmask> <depthmask> [<frames>]\n"
+		       "\n"
+		       "examples:\n"
+		       "  %s 300\n"
+		       "  %s ./Files/Teddy/calib.txt ./Files/Teddy/Frames/%%04i.ppm ./Files/Teddy/Frames/%%04i.pgm\n\n", argv[0], argv[0], argv[0], argv[0]);
+		return EXIT_FAILURE;
+	}
+	int noThreads = 1;
+#ifdef WITH_OPENMP
+	noThreads = omp_get_max_threads();
+#endif
+
+	ITMLibSettings settings;
+	settings.deviceType = ITMLibSettings::DEVICE_CPU;
+	ImageSourceEngine *imageSource = NULL;
+	ITMMainEngine *mainEngine = NULL;
+	ITMUChar4Image *rgb = NULL;
+	ITMShortImage *rawDepth = NULL;
+	ITMRGBDCalib calib;
+	Vector2i imgSize(640, 480);
+	ITMView *syntheticView = NULL;
+	ITMTrackingState *syntheticTrackingState = NULL;
+	if (recorded)
+	{
+		imageSource = new ImageFileReader(argv[1], argv[2], argv[3]);
+		imgSize = imageSource->getDepthImageSize();
+		mainEngine = new ITMMainEngine(&settings, &imageSource->calib, imageSource->getRGBImageSize(), imgSize);
+		rgb = new ITMUChar4Image(imageSource->getRGBImageSize(), true, false);
+		rawDepth = new ITMShortImage(imgSize, true, false);
+	}
+	else
+	{
+		calib.intrinsics_d.SetFrom(525.f, 525.f, 319.5f, 239.5f, imgSize.x, imgSize.y);
+		calib.intrinsics_rgb = calib.intrinsics_d;
+		syntheticView = new ITMView(&calib, imgSize, imgSize, false);
+		syntheticTrackingState = new ITMTrackingState(imgSize, MEMORYDEVICE_CPU);
+	}
+
+	Reconstruction compacted(&settings.sceneParams, imgSize, true), full(&settings.sceneParams, imgSize, false);
+	std::vector<double> trackingTimes;
+	int noFrames = 0, mismatch = -1;
+	while (noFrames < maxFrames && (!recorded || imageSource->hasMoreImages()))
+	{
+		const ITMView *view;
+		const ITMTrackingState *trackingState;
+		if (recorded)
+		{
+			imageSource->getImages(rgb, rawDepth);
+			double t0 = now();
+			mainEngine->ProcessFrame(rgb, rawDepth);
+			trackingTimes.push_back(now() - t0);
+			view = mainEngine->GetView();
+			trackingState = mainEngine->GetTrackingState();
+		}
+		else
+		{
+			// turning slowly while drifting around the middle of the room
+			float angle = 0.01f * noFrames;
+			Vector3f position(0.5f * sinf(0.03f * noFrames), 0.1f, 0.8f * cosf(0.02f * noFrames));
+			syntheticTrackingState->pose_d->SetFrom(0, 0, 0, 0, angle, 0);
+			Vector4f t = syntheticTrackingState->pose_d->GetM() * Vector4f(-position.x, -position.y, -position.z, 0);
+			syntheticTrackingState->pose_d->SetFrom(t.x, t.y, t.z, 0, angle, 0);
+			renderRoom(syntheticView, syntheticTrackingState->pose_d);
+			view = syntheticView;
+			trackingState = syntheticTrackingState;
+		}
+
+		// the swapping-off update of the visible list that ITMDenseMapper::UpdateVisibleList does every so often
+		bool onlyUpdateVisibleList = noFrames % 25 == 24;
+		compacted.process(view, trackingState, onlyUpdateVisibleList);
+		full.process(view, trackingState, onlyUpdateVisibleList);
+		noFrames++;
+
+		bool same = noThreads == 1 ? identical(compacted, full) : consistent(compacted);
+		if (!same && mismatch < 0) mismatch = noFrames - 1;
+	}
+
+	printf("%i %s frames %ix%i, %i thread(s)\n", noFrames, recorded ? "recorded" : "synthetic", imgSize.x, imgSize.y, noThreads);
+	printf("%-36s %10s %10s\n", "stage [ms]", "mean", "p99");
+	if (recorded)
+	{
+		double mean, p99;
+		percentiles(trackingTimes, mean, p99);
+		printf("%-36s %10.3f %10.3f\n", "main engine frame", 1e3 * mean, 1e3 * p99);
+	}
+	printStage("marking", full.markingTimes, compacted.markingTimes);
+	printStage("allocation", full.allocationTimes, compacted.allocationTimes);
+	printStage("visible list", full.visibleListTimes, compacted.visibleListTimes);
+	printStage("AllocateSceneFromDepth", full.allocateSceneTimes, compacted.allocateSceneTimes);
+	printStage("integration", full.integrationTimes, compacted.integrationTimes);
+	printf("visible blocks %i, allocated blocks %i\n", compacted.renderState.noVisibleEntries, SDF_LOCAL_BLOCK_NUM - 1 - compacted.scene.localVBA.lastFreeBlockId);
+	if (mismatch >= 0) printf("%s from frame %i\n", noThreads == 1 ? "DIFFERENT" : "INCONSISTENT", mismatch);
+	else printf("%s on every frame\n", noThreads == 1 ? "identical" : "consistent");
+
+	delete syntheticView;
+	delete syntheticTrackingState;
+	delete rgb;
+	delete rawDepth;
+	delete mainEngine;
+	delete imageSource;
+	return mismatch < 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+catch(std::exception& e)
+{
+	std::cerr << e.what() << '\n';
+	return EXIT_FAILURE;
+}
@@ -0,0 +1,113 @@
+// Copyright 2014-2015 Isis Innovation Limited and the authors of InfiniTAM
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#include "Engine/ImageSourceEngine.h"
+#include "Engine/PrefetchingImageSource.h"
+#include "Engine/RGBDSequenceFile.h"
+#include "Utils/NVTimer.h"
+
+using namespace InfiniTAM::Engine;
+
+static int convert(const char *rgbImageMask, const char *depthImageMask, const char *outFile)
+{
+	RGBDSequenceFileWriter writer;
+	if (!writer.open(outFile))
+	{
+		printf("cannot create '%s'\n", outFile);
+		return EXIT_FAILURE;
+	}
+
+	ImageSourceEngine *imageSource = new PrefetchingImageSource("", new ImageFileSequence(rgbImageMask, depthImageMask));
+	ITMUChar4Image *rgb = new ITMUChar4Image(imageSource->getRGBImageSize(), true, false);
+	ITMShortImage *rawDepth = new ITMShortImage(imageSource->getDepthImageSize(), true, false);
+
+	bool success = true;
+	while (success && imageSource->hasMoreImages())
+	{
+		imageSource->getImages(rgb, rawDepth);
+		success = writer.writeFrame(rgb, rawDepth);
+	}
+	int noFrames = writer.getNoFrames();
+	success &= writer.close();
+
+	delete rgb;
+	delete rawDepth;
+	delete imageSource;
+
+	if (!success)
+	{
+		printf("error writing '%s'\n", outFile);
+		return EXIT_FAILURE;
+	}
+	printf("%i frames written to '%s'\n", noFrames, outFile);
+	return EXIT_SUCCESS;
+}
+
+/// frames per second through getImages() alone
+static void benchmark(const char *name, ImageSourceEngine *imageSource)
+{
+	ITMUChar4Image *rgb = new ITMUChar4Image(imageSource->getRGBImageSize(), true, false);
+	ITMShortImage *rawDepth = new ITMShortImage(imageSource->getDepthImageSize(), true, false);
+
+	StopWatchInterface *timer;
+	sdkCreateTimer(&timer);
+	sdkStartTimer(&timer);
+
+	int noFrames = 0;
+	while (imageSource->hasMoreImages())
+	{
+		imageSource->getImages(rgb, rawDepth);
+		noFrames++;
+	}
+
+	sdkStopTimer(&timer);
+	float time = sdkGetTimerValue(&timer);
+	printf("%-32s %i frames in %.1f ms, %.1f frames/s\n", name, noFrames, time, noFrames * 1000.0f / time);
+
+	sdkDeleteTimer(&timer);
+	delete rgb;
+	delete rawDepth;
+	delete imageSource;
+}
+
+int main(int argc, char** argv)
+try
+{
+	if (argc == 5 && !strcmp(argv[1], "convert")) return convert(argv[2], argv[3], argv[4]);
+
+	if (argc >= 3 && !strcmp(argv[1], "bench"))
+	{
+		int noThreads = 2;
+		if (argc == 3)
+		{
+			RGBDSequenceFileReader *reader = new RGBDSequenceFileReader();
+			if (!reader->open(argv[2])) { delete reader; return EXIT_FAILURE; }
+			benchmark("sequence file, prefetching", new PrefetchingImageSource("", reader, noThreads));
+			return EXIT_SUCCESS;
+		}
+		if (argc == 4 || argc == 5)
+		{
+			if (argc == 5) noThreads = atoi(argv[4]);
+			benchmark("image files, synchronous", new ImageFileReader("", argv[2], argv[3]));
+			benchmark("image files, prefetching", new PrefetchingImageSource("", new ImageFileSequence(argv[2], argv[3]), noThreads));
+			return EXIT_SUCCESS;
+		}
+	}
+
+	printf("usage: %s convert <rgbmask> <depthmask> <sequencefile>\n"
+	       "       %s bench <rgbmask> <depthmask> [<threads>]\n"
+	       "       %s bench <sequencefile>\n"
+	       "\n"
+	       "examples:\n"
+	       "  %s convert ./Files/Teddy/Frames/%%04i.ppm ./Files/Teddy/Frames/%%04i.pgm ./Files/Teddy.itmseq\n"
+	       "  %s bench ./Files/Teddy.itmseq\n\n", argv[0], argv[0], argv[0], argv[0], argv[0]);
+	return EXIT_FAILURE;
+}
+catch(std::exception& e)
+{
+	std::cerr << e.what() << '\n';
+	return EXIT_FAILURE;
+}
@@ -0,0 +1,184 @@
+// Copyright 2014-2015 Isis Innovation Limited and the authors of InfiniTAM
+
+// Memory and frame times of the CPU reconstruction with swapping on a long
+// trajectory: a camera walks down a 2.4 m wide synthetic corridor, turning side
+// to side, so blocks keep leaving the view and are swapped out to the global
+// cache. Reports the percentiles of the frame time (allocation, integration and
+// both swapping calls) and of the swapping calls alone, VmRSS, VmHWM and the
+// address space added by the scene, then saves the cache, reads the file back
+// into a second cache and compares every stored block.
+// The global cache is backed by the file of ITMLibSettings::globalCacheFile
+// unless another one, or "-" for anonymous memory, is given.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include "ITMLib/Engine/DeviceSpecific/CPU/ITMSceneReconstructionEngine_CPU.h"
+#include "ITMLib/Engine/DeviceSpecific/CPU/ITMSwappingEngine_CPU.h"
+#include "ITMLib/Objects/ITMRenderState_VH.h"
+#include "ITMLib/Objects/ITMTrackingState.h"
+#include "ITMLib/Utils/ITMLibSettings.h"
+
+using namespace ITMLib::Objects;
+using namespace ITMLib::Engine;
+
+static double now()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/// a "Vm...:" line of /proc/self/status in kB, -1 if not there
+static long statusKb(const char *key)
+{
+	FILE *f = fopen("/proc/self/status", "r");
+	if (f == NULL) return -1;
+	char line[256];
+	long value = -1;
+	size_t len = strlen(key);
+	while (fgets(line, sizeof(line), f))
+		if (strncmp(line, key, len) == 0 && line[len] == ':') value = atol(line + len + 1);
+	fclose(f);
+	return value;
+}
+
+/// depth (m) of a camera in a corridor 2.4 m wide and high, running 200 m along z
+static void renderCorridor(ITMView *view, const ITMPose *pose)
+{
+	Matrix4f invM = pose->GetInvM();
+	Vector4f c = invM * Vector4f(0, 0, 0, 1);
+	Vector2i size = view->depth->noDims;
+	float *depth = view->depth->GetData(MEMORYDEVICE_CPU);
+	Vector4f pp = view->calib->intrinsics_d.projectionParamsSimple.all;
+	const float lo[3] = { -1.2f, -1.2f, -2.f }, hi[3] = { 1.2f, 1.2f, 200.f };
+	for (int y = 0; y < size.y; y++) for (int x = 0; x < size.x; x++)
+	{
+		Vector4f d = invM * Vector4f((x - pp.z) / pp.x, (y - pp.w) / pp.y, 1.f, 0.f);
+		float cc[3] = { c.x, c.y, c.z }, dd[3] = { d.x, d.y, d.z }, t = 1e9f;
+		for (int a = 0; a < 3; a++)
+		{
+			if (dd[a] > 1e-6f) t = std::min(t, (hi[a] - cc[a]) / dd[a]);
+			else if (dd[a] < -1e-6f) t = std::min(t, (lo[a] - cc[a]) / dd[a]);
+		}
+		// some relief on the walls so that blocks differ
+		Vector4f p = c + d * t;
+		depth[x + y * size.x] = t + 0.01f * sinf(7.f * p.z) * cosf(5.f * p.x + 3.f * p.y);
+	}
+}
+
+static double percentile(std::vector<double> v, double p)
+{
+	std::sort(v.begin(), v.end());
+	return v[std::min(v.size() - 1, (size_t)(p * v.size()))];
+}
+
+int main(int argc, char** argv)
+try
+{
+	const int maxFrames = argc > 1 ? atoi(argv[1]) : 1500;
+	if (maxFrames <= 0 || argc > 4)
+	{
+		printf("usage: %s [<frames> [<cache store file>|- [<saved cache file>]]]\n"
+		       "\n"
+		       "examples:\n"
+		       "  %s 1500\n"
+		       "  %s 3000 /data/InfiniTAM_globalCache_XXXXXX /data/corridor.cache\n\n", argv[0], argv[0], argv[0]);
+		return EXIT_FAILURE;
+	}
+	ITMLibSettings settings;
+	const char *storeFile = settings.globalCacheFile;
+	if (argc > 2) storeFile = strcmp(argv[2], "-") == 0 ? NULL : argv[2];
+	const char *savedFile = argc > 3 ? argv[3] : "InfiniTAM_swapbench.cache";
+
+	Vector2i imgSize(320, 240);
+	ITMRGBDCalib calib;
+	calib.intrinsics_d.SetFrom(262.5f, 262.5f, 159.5f, 119.5f, imgSize.x, imgSize.y);
+	calib.intrinsics_rgb = calib.intrinsics_d;
+	ITMView view(&calib, imgSize, imgSize, false);
+	ITMTrackingState trackingState(imgSize, MEMORYDEVICE_CPU);
+
+	long vmSizeBefore = statusKb("VmSize");
+	ITMScene<ITMVoxel, ITMVoxelIndex> *scene = new ITMScene<ITMVoxel, ITMVoxelIndex>(&settings.sceneParams, true, MEMORYDEVICE_CPU, storeFile);
+	ITMRenderState_VH renderState(ITMVoxelBlockHash::noTotalEntries, imgSize, settings.sceneParams.viewFrustum_min, settings.sceneParams.viewFrustum_max);
+	memset(renderState.GetEntriesVisibleType(), 0, ITMVoxelBlockHash::noTotalEntries);
+	ITMSceneReconstructionEngine_CPU<ITMVoxel, ITMVoxelIndex> sceneRecoEngine;
+	ITMSwappingEngine_CPU<ITMVoxel, ITMVoxelIndex> *swappingEngine = new ITMSwappingEngine_CPU<ITMVoxel, ITMVoxelIndex>();
+	sceneRecoEngine.ResetScene(scene);
+
+	std::vector<double> frameTimes, swapTimes;
+	for (int frame = 0; frame < maxFrames; frame++)
+	{
+		// forward along the corridor, turning side to side
+		float angle = 0.6f * sinf(0.02f * frame);
+		Vector3f position(0.3f * sinf(0.013f * frame), 0.f, 0.03f * frame);
+		trackingState.pose_d->SetFrom(0, 0, 0, 0, angle, 0);
+		Vector4f t = trackingState.pose_d->GetM() * Vector4f(-position.x, -position.y, -position.z, 0);
+		trackingState.pose_d->SetFrom(t.x, t.y, t.z, 0, angle, 0);
+		renderCorridor(&view, trackingState.pose_d);
+
+		double t0 = now();
+		sceneRecoEngine.AllocateSceneFromDepth(scene, &view, &trackingState, &renderState);
+		sceneRecoEngine.IntegrateIntoScene(scene, &view, &trackingState, &renderState);
+		double t1 = now();
+		swappingEngine->IntegrateGlobalIntoLocal(scene, &renderState);
+		swappingEngine->SaveToGlobalMemory(scene, &renderState);
+		double t2 = now();
+		frameTimes.push_back(1e3 * (t2 - t0));
+		swapTimes.push_back(1e3 * (t2 - t1));
+	}
+	double t0 = now();
+	swappingEngine->Flush();
+	double flushTime = now() - t0;
+
+	ITMGlobalCache<ITMVoxel> *globalCache = scene->globalCache;
+	int noStored = 0;
+	for (int i = 0; i < globalCache->noTotalEntries; i++) noStored += globalCache->HasStoredData(i);
+	printf("%i frames %ix%i, global cache in %s\n", maxFrames, imgSize.x, imgSize.y, storeFile != NULL ? storeFile : "anonymous memory");
+	printf("stored blocks %i (%i constant), free local blocks %i\n", noStored, globalCache->GetNoConstantBlocks(), scene->localVBA.lastFreeBlockId);
+	printf("%-14s %8s %8s %8s %8s\n", "[ms]", "p50", "p95", "p99", "max");
+	printf("%-14s %8.2f %8.2f %8.2f %8.2f\n", "frame", percentile(frameTimes, .5), percentile(frameTimes, .95), percentile(frameTimes, .99), percentile(frameTimes, 1));
+	printf("%-14s %8.2f %8.2f %8.2f %8.2f\n", "swapping", percentile(swapTimes, .5), percentile(swapTimes, .95), percentile(swapTimes, .99), percentile(swapTimes, 1));
+	printf("final flush %.1f ms\n", 1e3 * flushTime);
+	printf("VmRSS %ld MB, VmHWM %ld MB, scene address space %ld MB\n", statusKb("VmRSS") / 1024, statusKb("VmHWM") / 1024,
+	       (statusKb("VmSize") - vmSizeBefore) / 1024);
+
+	t0 = now();
+	globalCache->SaveToFile((char*)savedFile);
+	double saveTime = now() - t0;
+	FILE *f = fopen(savedFile, "rb");
+	long savedSize = 0;
+	if (f != NULL)
+	{
+		fseek(f, 0, SEEK_END);
+		savedSize = ftell(f);
+		fclose(f);
+	}
+	printf("SaveToFile %.0f ms, %.1f MB\n", 1e3 * saveTime, savedSize / 1048576.0);
+
+	// the file read back must hold the same blocks
+	ITMGlobalCache<ITMVoxel> *readBack = new ITMGlobalCache<ITMVoxel>();
+	readBack->ReadFromFile((char*)savedFile);
+	remove(savedFile);
+	std::vector<ITMVoxel> a(SDF_BLOCK_SIZE3), b(SDF_BLOCK_SIZE3);
+	int noDifferent = 0;
+	for (int i = 0; i < globalCache->noTotalEntries; i++)
+	{
+		bool hasA = globalCache->GetStoredData(i, &a[0]), hasB = readBack->GetStoredData(i, &b[0]);
+		if (hasA != hasB || (hasA && memcmp(&a[0], &b[0], sizeof(ITMVoxel) * SDF_BLOCK_SIZE3))) noDifferent++;
+	}
+	printf("%s after the file round trip\n", noDifferent == 0 ? "identical" : "DIFFERENT");
+
+	delete readBack;
+	delete swappingEngine;
+	delete scene;
+	return noDifferent == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+catch(std::exception& e)
+{
+	std::cerr << e.what() << '\n';
+	return EXIT_FAILURE;
+}
@@ -190,6 +190,12 @@ int laserRGBComp::run(int argc, char* argv[])
 	configGetInt("DecimationLevel", cfg.DECIMATION_LEVEL, 0);
 	printf("DecimationLevel: %d\n", cfg.DECIMATION_LEVEL);
 	
+	configGetInt("RGBDStrideW", cfg.strideW, 3);
+	printf("RGBDStrideW: %d\n", cfg.strideW);
+	
+	configGetInt("RGBDStrideH", cfg.strideH, 2);
+	printf("RGBDStrideH: %d\n", cfg.strideH);
+	
 	configGetString("ActualLaserID", cfg.actualLaserID, "");
 	printf("ActualLaserID: %s\n", cfg.actualLaserID.c_str());
 	
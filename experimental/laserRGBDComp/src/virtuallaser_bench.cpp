@@ -0,0 +1,140 @@
+/*
+ *    Copyright (C) 2020 by RoboLab - University of Extremadura
+ *
+ *    This file is part of RoboComp
+ *
+ *    RoboComp is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    RoboComp is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with RoboComp.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Latency of the fused virtual laser for 1 to N VGA cameras looking around the
+// robot: per-camera partial scans in parallel and a final merge, against a
+// single shared scan filled point by point with atan2 as Worker::compute did.
+//   virtuallaser_bench [max cameras] [cycles] [laser bins]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#include "virtuallaserfusion.h"
+
+static double now()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/// The former path: every decimated point transformed, binned with atan2 and min-ed into one scan
+static void referenceFuse(const VirtualLaserFusion::Params &p, const float *M, const std::vector<float> &cloud, int32_t width, int32_t height, std::vector<float> &scan)
+{
+	for (int32_t r=0; r<height; r+=p.strideH)
+	{
+		for (int32_t c=0; c<width; c+=p.strideW)
+		{
+			const float *q = &cloud[(int64_t(r)*width + c)*4];
+			const float x = M[0]*q[0] + M[1]*q[1] + M[2]*q[2]  + M[3];
+			const float y = M[4]*q[0] + M[5]*q[1] + M[6]*q[2]  + M[7];
+			const float z = M[8]*q[0] + M[9]*q[1] + M[10]*q[2] + M[11];
+			if (not ((y>=p.minHeight and y<=p.maxHeight) or (p.useNegative and y<p.minHeightNeg)))
+				continue;
+			const double ang = atan2(x, z) + p.fov/2.;
+			const int32_t b = int32_t((ang * p.laserSize) / p.fov);
+			if (b < 0 or b >= p.laserSize)
+				continue;
+			scan[b] = std::min(scan[b], std::min(sqrtf(x*x + z*z), p.maxLength));
+		}
+	}
+}
+
+int main(int argc, char **argv)
+{
+	const int maxCameras = argc > 1 ? atoi(argv[1]) : 4;
+	const int cycles = argc > 2 ? atoi(argv[2]) : 50;
+	const int laserSize = argc > 3 ? atoi(argv[3]) : 200;
+	const int32_t width = 640, height = 480;
+
+	VirtualLaserFusion fusion;
+	VirtualLaserFusion::Params params = fusion.getParams();
+	params.laserSize = laserSize;
+	params.fov = 2.*M_PI;
+	params.strideW = 3;
+	params.strideH = 2;
+	fusion.setParams(params);
+
+	// Organized clouds (x, y, z, w per pixel), a different random scene per camera
+	srand(29);
+	std::vector< std::vector<float> > clouds(maxCameras, std::vector<float>(width*height*4));
+	for (auto &cloud : clouds)
+	{
+		for (int32_t i=0; i<width*height; i++)
+		{
+			cloud[i*4+0] = -2000.f + 4000.f*rand()/RAND_MAX;
+			cloud[i*4+1] = -1500.f + 3000.f*rand()/RAND_MAX;
+			cloud[i*4+2] =   300.f + 4700.f*rand()/RAND_MAX;
+			cloud[i*4+3] = 1.f;
+		}
+	}
+	// Cameras 1.2m high, evenly spread around the robot
+	std::vector< std::vector<float> > extrinsics(maxCameras, std::vector<float>(16, 0.f));
+	for (int c=0; c<maxCameras; c++)
+	{
+		const float a = 2.*M_PI*c/maxCameras;
+		float *M = extrinsics[c].data();
+		M[0] = cos(a);  M[2] = sin(a);
+		M[5] = 1;       M[7] = 1200;
+		M[8] = -sin(a); M[10] = cos(a);
+		M[15] = 1;
+	}
+
+	printf("%dx%d clouds, stride %dx%d, %d bins, %d cycles\n", width, height, params.strideW, params.strideH, laserSize, cycles);
+	printf("%-8s %14s %14s %14s %12s\n", "cameras", "fused [ms]", "max [ms]", "former [ms]", "bins differ");
+	std::vector<float> scan(laserSize), reference(laserSize);
+	for (int cameras=1; cameras<=maxCameras; cameras++)
+	{
+		fusion.setCameraCount(cameras);
+		double total = 0, worst = 0;
+		for (int k=0; k<cycles; k++)
+		{
+			const double t = now();
+			std::fill(scan.begin(), scan.end(), params.maxLength);
+			#pragma omp parallel for
+			for (int c=0; c<cameras; c++)
+			{
+				fusion.clear(c);
+				fusion.fuse(c, extrinsics[c].data(), clouds[c].data(), 4, width, height);
+			}
+			fusion.merge(scan.data());
+			const double dt = now() - t;
+			total += dt;
+			worst = std::max(worst, dt);
+		}
+
+		double former = 0;
+		for (int k=0; k<cycles; k++)
+		{
+			const double t = now();
+			std::fill(reference.begin(), reference.end(), params.maxLength);
+			for (int c=0; c<cameras; c++)
+				referenceFuse(params, extrinsics[c].data(), clouds[c], width, height, reference);
+			former += now() - t;
+		}
+		int differ = 0;
+		for (int i=0; i<laserSize; i++)
+			differ += scan[i] != reference[i];
+		printf("%-8d %14.3f %14.3f %14.3f %12d\n", cameras, 1e3*total/cycles, 1e3*worst, 1e3*former/cycles, differ);
+		fflush(stdout);
+	}
+	return 0;
+}
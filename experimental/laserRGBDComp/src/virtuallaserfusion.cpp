@@ -0,0 +1,151 @@
+/*
+ *    Copyright (C) 2020 by RoboLab - University of Extremadura
+ *
+ *    This file is part of RoboComp
+ *
+ *    RoboComp is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    RoboComp is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with RoboComp.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "virtuallaserfusion.h"
+
+#include <math.h>
+#include <algorithm>
+
+VirtualLaserFusion::VirtualLaserFusion()
+{
+	params.laserSize = 0;
+	params.fov = 2.*M_PI;
+	params.maxLength = 4000;
+	params.minHeight = 100;
+	params.maxHeight = 2000;
+	params.minHeightNeg = -1000;
+	params.useNegative = true;
+	params.strideW = 3;
+	params.strideH = 2;
+}
+
+void VirtualLaserFusion::setParams(const Params &params_)
+{
+	params = params_;
+	if (params.strideW < 1) params.strideW = 1;
+	if (params.strideH < 1) params.strideH = 1;
+	buildLUT();
+	setCameraCount(partials.size());
+}
+
+void VirtualLaserFusion::setCameraCount(const int32_t cameras)
+{
+	partials.resize(cameras);
+	rowX.resize(cameras);
+	rowDist.resize(cameras);
+	rowZ.resize(cameras);
+	for (int32_t c=0; c<cameras; c++)
+		clear(c);
+}
+
+void VirtualLaserFusion::clear(const int32_t camera)
+{
+	partials[camera].assign(params.laserSize, params.maxLength);
+}
+
+/**
+* \brief Tabulates the laser bin of every pseudo-angle cell, using the same binning as Worker::angle2bin.
+* Cells crossing a bin boundary are marked with SPLIT_CELL and resolved with atan2.
+*/
+void VirtualLaserFusion::buildLUT()
+{
+	binLUT.resize(LUT_SIZE);
+	for (int32_t i=0; i<LUT_SIZE; i++)
+	{
+		const int32_t b0 = pseudoAngleBin(float(i) / (LUT_SIZE/4));
+		const int32_t b1 = pseudoAngleBin(float(i+1) / (LUT_SIZE/4));
+		binLUT[i] = b0 == b1 ? b0 : SPLIT_CELL;
+	}
+}
+
+int32_t VirtualLaserFusion::pseudoAngleBin(const float p) const
+{
+	float x, y;
+	if      (p < 1.f) { const float q = p;     x = 1.f-q; y = q;     }
+	else if (p < 2.f) { const float q = p-1.f; x = -q;    y = 1.f-q; }
+	else if (p < 3.f) { const float q = p-2.f; x = q-1.f; y = -q;    }
+	else              { const float q = p-3.f; x = q;     y = q-1.f; }
+	return exactBin(y, x);
+}
+
+int32_t VirtualLaserFusion::exactBin(const float x, const float z) const
+{
+	const double ang = atan2(x, z) + params.fov/2.;
+	const int32_t b = int32_t((ang * params.laserSize) / params.fov);
+	return (b>=0 and b<params.laserSize) ? b : -1;
+}
+
+void VirtualLaserFusion::fuse(const int32_t camera, const float *M, const float *xyz, const int32_t stride, const int32_t width, const int32_t height)
+{
+	std::vector<float> &partial = partials[camera];
+	std::vector<float> &bx = rowX[camera];
+	std::vector<float> &bd = rowDist[camera];
+	std::vector<float> &bz = rowZ[camera];
+	const int32_t cols = (width + params.strideW - 1) / params.strideW;
+	bx.resize(cols);
+	bd.resize(cols);
+	bz.resize(cols);
+
+	const float m00=M[0], m01=M[1], m02=M[2],  m03=M[3];
+	const float m10=M[4], m11=M[5], m12=M[6],  m13=M[7];
+	const float m20=M[8], m21=M[9], m22=M[10], m23=M[11];
+	const float minH = params.minHeight, maxH = params.maxHeight;
+	const float minHNeg = params.useNegative ? params.minHeightNeg : -INFINITY;
+	const float maxLength = params.maxLength;
+
+	for (int32_t r=0; r<height; r+=params.strideH)
+	{
+		const float *row = xyz + int64_t(r)*width*stride;
+		const int32_t rowStride = stride*params.strideW;
+
+		// Transform the decimated row. Points filtered out by height get an infinite distance
+		#pragma omp simd
+		for (int32_t c=0; c<cols; c++)
+		{
+			const float px=row[c*rowStride], py=row[c*rowStride+1], pz=row[c*rowStride+2];
+			const float x = m00*px + m01*py + m02*pz + m03;
+			const float y = m10*px + m11*py + m12*pz + m13;
+			const float z = m20*px + m21*py + m22*pz + m23;
+			const bool keep = (y>=minH and y<=maxH) or (y<minHNeg);
+			bx[c] = x;
+			bz[c] = z;
+			bd[c] = keep ? std::min(sqrtf(x*x + z*z), maxLength) : INFINITY;
+		}
+
+		// Scatter-min into this camera's bins
+		for (int32_t c=0; c<cols; c++)
+		{
+			const float d = bd[c];
+			if (not (d < INFINITY))
+				continue;
+			const int32_t b = bin(bx[c], bz[c]);
+			if (b >= 0 and partial[b] > d)
+				partial[b] = d;
+		}
+	}
+}
+
+void VirtualLaserFusion::merge(float *out) const
+{
+	for (const auto &partial : partials)
+	{
+		#pragma omp simd
+		for (int32_t i=0; i<params.laserSize; i++)
+			out[i] = std::min(out[i], partial[i]);
+	}
+}
@@ -0,0 +1,107 @@
+/*
+ *    Copyright (C) 2020 by RoboLab - University of Extremadura
+ *
+ *    This file is part of RoboComp
+ *
+ *    RoboComp is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    RoboComp is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with RoboComp.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef VIRTUALLASERFUSION_H
+#define VIRTUALLASERFUSION_H
+
+#include <stdint.h>
+#include <vector>
+
+/**
+* \brief Fuses the point clouds of several RGBD cameras into one virtual laser scan.
+*
+* Each camera writes a partial scan of its own, so the cameras can be processed
+* concurrently without sharing any bin. merge() then takes the element-wise
+* minimum of the partial scans. Points are transformed with the camera's
+* precomputed extrinsic (base <- camera, row-major 4x4) and binned through a
+* pseudo-angle lookup table instead of atan2.
+*/
+class VirtualLaserFusion
+{
+public:
+	struct Params
+	{
+		int32_t laserSize;
+		float fov;
+		float maxLength;
+		float minHeight;
+		float maxHeight;
+		float minHeightNeg;
+		bool useNegative;   // points below minHeightNeg are obstacles too (e.g., stairs)
+		int32_t strideW;    // pixel decimation along rows
+		int32_t strideH;    // pixel decimation along columns
+	};
+
+	VirtualLaserFusion();
+
+	void setParams(const Params &params_);
+	const Params &getParams() const { return params; }
+
+	/// Number of partial scans (one per camera). Resets them all.
+	void setCameraCount(const int32_t cameras);
+
+	/// Clears the partial scan of a camera to maxLength
+	void clear(const int32_t camera);
+
+	/**
+	* \brief Bins the points of a camera into its partial scan
+	* @param M row-major base <- camera matrix
+	* @param xyz first point, x, y and z are read at xyz[i*stride], xyz[i*stride+1], xyz[i*stride+2]
+	* @param stride floats between consecutive points
+	* @param width, height image size of the cloud (height is 1 for unorganized clouds)
+	*/
+	void fuse(const int32_t camera, const float *M, const float *xyz, const int32_t stride, const int32_t width, const int32_t height);
+
+	/// out[i] = min(out[i], partial_c[i]) for every camera c
+	void merge(float *out) const;
+
+	/// Bin of a direction given by its x and z components, -1 if outside the field of view
+	inline int32_t bin(const float x, const float z) const
+	{
+		const int32_t b = binLUT[lutIndex(x, z)];
+		return b != SPLIT_CELL ? b : exactBin(x, z);
+	}
+
+private:
+	static const int32_t LUT_SIZE = 8192;
+	static const int32_t SPLIT_CELL = -2;
+
+	Params params;
+	std::vector<int32_t> binLUT;
+	std::vector< std::vector<float> > partials;
+	std::vector< std::vector<float> > rowX, rowDist, rowZ;
+
+	void buildLUT();
+	int32_t pseudoAngleBin(const float p) const;
+	int32_t exactBin(const float x, const float z) const;
+	/// Monotonic replacement of atan2(y, x) in [0, 4) ("diamond angle")
+	static inline float pseudoAngle(const float y, const float x)
+	{
+		if (y >= 0)
+			return x >= 0 ? y/(x+y+1e-30f) : 1.f - x/(y-x);
+		else
+			return x < 0 ? 2.f - y/(-x-y) : 3.f + x/(x-y);
+	}
+	static inline int32_t lutIndex(const float x, const float z)
+	{
+		int32_t i = pseudoAngle(x, z) * (LUT_SIZE/4);
+		return i < LUT_SIZE ? i : LUT_SIZE-1;
+	}
+};
+
+#endif
@@ -48,6 +48,21 @@ Worker::Worker(RoboCompOmniRobot::OmniRobotPrx omnirobotprx, RoboCompJointMotor:
 	updateJoint  = cfg.updateJoint;
 	DECIMATION_LEVEL = cfg.DECIMATION_LEVEL;
 
+	VirtualLaserFusion::Params fusionParams;
+	fusionParams.laserSize    = LASER_SIZE;
+	fusionParams.fov          = localFOV;
+	fusionParams.maxLength    = maxLength;
+	fusionParams.minHeight    = minHeight;
+	fusionParams.maxHeight    = maxHeight;
+	fusionParams.minHeightNeg = minHeightNeg;
+	fusionParams.useNegative  = true;
+	fusionParams.strideW      = cfg.strideW;
+	fusionParams.strideH      = cfg.strideH;
+	fusion.setParams(fusionParams);
+	fusion.setCameraCount(rgbds.size());
+	extrinsics.resize(rgbds.size());
+	fusedDists.resize(LASER_SIZE);
+
 	mutex = new QMutex();
 
 	innerModel = new InnerModel(cfg.xmlpath);
@@ -196,10 +211,20 @@ void Worker::compute()
 		(*laserDataW)[i].dist = maxLength;
 	}
 
-	/// FOR EACH OF THE CONFIGURED PROXIES
+	/// Extrinsics are resolved once per cycle, before going parallel: InnerModel is not thread safe
+	for (uint r=0; r<rgbds.size(); ++r)
+	{
+		const RTMat TR = innerModel->getTransformationMatrix(base, QString::fromStdString(rgbds[r].id));
+		for (int i=0; i<4; i++)
+			for (int j=0; j<4; j++)
+				extrinsics[r][i*4+j] = TR(i,j);
+	}
+
+	/// FOR EACH OF THE CONFIGURED PROXIES, each one into its own partial scan
 	#pragma omp parallel for
 	for (uint r=0; r<rgbds.size(); ++r)
 	{
+		fusion.clear(r);
 #ifdef STORE_POINTCLOUDS_AND_EXIT
 		pcl::PointCloud<pcl::PointXYZ>::Ptr cloud(new pcl::PointCloud<pcl::PointXYZ>); // PCL
 #endif
@@ -232,44 +257,26 @@ void Worker::compute()
 
 					/// Get the corresponding (stored) protocloud
 					RoboCompRGBDBus::PointCloud pointCloud = rgbds[r].protoPointClouds[clist[0]];
-					/// Multiply the protocloud by the depth
+					/// Multiply the protocloud by the depth, invalid depths are discarded
 					for (uint32_t pi=0; pi<pointCloud.size(); pi++)
 					{
-						pointCloud[pi].x *= images[iter->first].depthImage[pi];
-						pointCloud[pi].y *= images[iter->first].depthImage[pi];
-						pointCloud[pi].z  = images[iter->first].depthImage[pi];
+						const float depth = images[iter->first].depthImage[pi];
+						if (isnan(depth) or depth <= 10)
+						{
+							pointCloud[pi].y = NAN;
+							continue;
+						}
+						pointCloud[pi].x *= depth;
+						pointCloud[pi].y *= depth;
+						pointCloud[pi].z  = depth;
 					}
 qFatal("deeddededede");
 					/// Inserts the resulting points in the virtual laser
-					RTMat TR = innerModel->getTransformationMatrix(base, QString::fromStdString(iter->first));
 #ifdef STORE_POINTCLOUDS_AND_EXIT
-					cloud->points.resize(pointCloud.size());
+					storeCloud(cloud, extrinsics[r].data(), &pointCloud[0].x, pointCloud.size());
 #endif
-					for (uint32_t ioi=0; ioi<pointCloud.size(); ioi+=3)
-					{
-						if ((not isnan(images[iter->first].depthImage[ioi])) and images[iter->first].depthImage[ioi] > 10)
-						{
-							QVec p = (TR * QVec::vec4(pointCloud[ioi].x, pointCloud[ioi].y, pointCloud[ioi].z, 1)).fromHomogeneousCoordinates();
-#ifdef STORE_POINTCLOUDS_AND_EXIT
-							cloud->points[ioi].x =  p(0)/1000;
-							cloud->points[ioi].y =  p(1)/1000;
-							cloud->points[ioi].z = -p(2)/1000;
-#endif
-							if ( (p(1)>=minHeight and p(1)<=maxHeight) /* or (p(1)<minHeightNeg) */)
-							{
-								p(1) = 0;
-								double d = sqrt(p(0)*p(0) + p(2)*p(2));
-								if (d>maxLength) d = maxLength;
-								const double a = atan2(p(0), p(2));
-								const int32_t bin = angle2bin(a);
-								if (bin>=0 and bin<LASER_SIZE and (*laserDataW)[bin].dist > d)
-								{
-									if ( (*laserDataW)[bin].dist > d)
-										(*laserDataW)[bin].dist = d;
-								}
-							}
-						}
-					}
+					if (not pointCloud.empty())
+						fusion.fuse(r, extrinsics[r].data(), &pointCloud[0].x, sizeof(pointCloud[0])/sizeof(float), pointCloud.size(), 1);
 				}
 			}
 		}
@@ -285,66 +292,32 @@ qFatal("deeddededede");
 				cout << "Can't connect to rgbd: " << ex << endl;
 				continue;
 			}
-// 			RTMat TR = innerModel->getTransformationMatrix(base, base);
-			RTMat TR = innerModel->getTransformationMatrix(base, QString::fromStdString(rgbds[r].id));
-			TR.print("tr");
-			printf("de %s a %s...\n", rgbds[r].id.c_str(), base.toStdString().c_str());
-
-			QVec p2 = (TR * QVec::vec4(0,0,0, 1)).fromHomogeneousCoordinates();
-			p2.print("zero");
-			p2 = (TR * QVec::vec4(0,0,1500, 1)).fromHomogeneousCoordinates();
-			p2.print("1500z");
-
-#ifdef STORE_POINTCLOUDS_AND_EXIT
-			cloud->points.resize(points.size());
-#endif
-// printf("%d\n", __LINE__);
 
 			uint32_t pw = 640;
 			uint32_t ph = 480;
 			if (points.size() == 320*240) { pw=320; ph=240; }
 			if (points.size() == 160*120) { pw=160; ph=120; }
 			if (points.size() == 80*60) { pw=80; ph=60; }
-			for (uint32_t rr=0; rr<ph; rr+=2)
-			{
-				for (uint32_t cc=0; cc<pw; cc+=3)
-				{
-					uint32_t ioi = rr*pw+cc;
-					if (ioi<points.size())
-					{
-						//uint interest = pw*1.5;
-						//if (ioi == interest) QVec::vec3(points[ioi].x, points[ioi].y, points[ioi].z).print("en cam");
-						const QVec p = (TR * QVec::vec4(points[ioi].x, points[ioi].y, points[ioi].z, 1)).fromHomogeneousCoordinates();
-						//if (ioi == interest) p.print("en final");
+			if (points.size() < pw*ph)
+				ph = points.size() / pw;
 #ifdef STORE_POINTCLOUDS_AND_EXIT
-						cloud->points[ioi].x = p(0)/1000;
-						cloud->points[ioi].y = p(1)/1000;
-						cloud->points[ioi].z = p(2)/1000;
+			storeCloud(cloud, extrinsics[r].data(), &points[0].x, points.size());
 #endif
-						if ( (p(1)>=minHeight and p(1)<=maxHeight) or (p(1)<minHeightNeg) )
-						{
-// 							p(1) = 0;
-							double d = sqrt(p(0)*p(0) + p(2)*p(2));
-							if (d>maxLength) d = maxLength;
-							const double a = atan2(p(0), p(2));
-							const int32_t bin = angle2bin(a);
-							if (bin>=0 and bin<LASER_SIZE and (*laserDataW)[bin].dist > d)
-							{
-								//if (ioi == interest)  printf("yess\n");
-								(*laserDataW)[bin].dist = d;
-							}
-						}
-					}
-				}
-			}
-// printf("%d\n", __LINE__);
-
+			if (ph > 0)
+				fusion.fuse(r, extrinsics[r].data(), &points[0].x, sizeof(points[0])/sizeof(float), pw, ph);
 		}
 #ifdef STORE_POINTCLOUDS_AND_EXIT
 		writePCD(rgbds[r].id+".pcd", cloud);
 		writePCD_Y0("floor.pcd");
 #endif
 	}
+
+	/// Element-wise minimum of the partial scans
+	for (int32_t i=0; i<LASER_SIZE; ++i)
+		fusedDists[i] = (*laserDataW)[i].dist;
+	fusion.merge(fusedDists.data());
+	for (int32_t i=0; i<LASER_SIZE; ++i)
+		(*laserDataW)[i].dist = fusedDists[i];
 #ifdef STORE_POINTCLOUDS_AND_EXIT
 	qFatal("done");
 #endif
@@ -405,6 +378,19 @@ qFatal("deeddededede");
 }
 
 
+void Worker::storeCloud(pcl::PointCloud<pcl::PointXYZ>::Ptr cloud, const float *M, const float *xyz, const uint32_t size)
+{
+	const uint32_t stride = sizeof(RoboCompRGBD::PointXYZ)/sizeof(float);
+	cloud->points.resize(size);
+	for (uint32_t i=0; i<size; i++)
+	{
+		const float *p = xyz + i*stride;
+		cloud->points[i].x = (M[0]*p[0] + M[1]*p[1] + M[2]*p[2]  + M[3]) /1000;
+		cloud->points[i].y = (M[4]*p[0] + M[5]*p[1] + M[6]*p[2]  + M[7]) /1000;
+		cloud->points[i].z = (M[8]*p[0] + M[9]*p[1] + M[10]*p[2] + M[11])/1000;
+	}
+}
+
 void Worker::writePCD(std::string path, pcl::PointCloud<pcl::PointXYZ>::Ptr cloud)
 {
 	printf("Writing: %s  width:%d height:%d points:%d\n", path.c_str(), (int)cloud->width, (int)cloud->height, (int)cloud->points.size());
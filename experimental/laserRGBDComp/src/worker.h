@@ -25,6 +25,7 @@
 #include <CommonBehavior.h>
 
 #include <vector>
+#include <array>
 
 #include <OmniRobot.h>
 #include <Laser.h>
@@ -37,6 +38,7 @@
 #include <extendedRangeSensor/extendedRangeSensor.h>
 
 #include "config.h"
+#include "virtuallaserfusion.h"
 
 #include <pcl/io/pcd_io.h>
 #include <pcl/point_types.h>
@@ -79,6 +81,7 @@ struct WorkerConfig
 	float maxLength;
 	float FOV;
 	int DECIMATION_LEVEL;
+	int strideW, strideH;
 	bool updateJoint;
 
 	// laser-related
@@ -137,10 +140,15 @@ private:
 	
 	ExtendedRangeSensor *extended;
 
+	VirtualLaserFusion fusion;
+	std::vector< std::array<float, 16> > extrinsics;
+	std::vector<float> fusedDists;
+
 	void updateInnerModel();
 	int32_t angle2bin(double ang);
 	void medianFilter();
 
+	void storeCloud(pcl::PointCloud<pcl::PointXYZ>::Ptr cloud, const float *M, const float *xyz, const uint32_t size);
 	void writePCD(std::string path, pcl::PointCloud<pcl::PointXYZ>::Ptr cloud);
 	void writePCD_Y0(std::string path);
 signals:
@@ -0,0 +1,95 @@
+// Latency of LMap::getLaserData with ray casting and with the full map scan,
+// for maps of several sizes holding a rectangular room seen by the laser:
+//   laserextraction_bench [laser bins] [reps] [cells per side...]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#include "map.h"
+
+static double now()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/// Distance from the origin to a 6m x 5m room centred 0.5m ahead, along the beam
+static float roomDistance(float angle)
+{
+	const float sx = sin(angle), sz = cos(angle);
+	float d = 1e9;
+	if (sx > 0) d = std::min(d, 3000.f/sx);
+	if (sx < 0) d = std::min(d, -3000.f/sx);
+	if (sz > 0) d = std::min(d, 3000.f/sz);
+	if (sz < 0) d = std::min(d, -2000.f/sz);
+	return d;
+}
+
+int main(int argc, char **argv)
+{
+	const int laserBins = argc > 1 ? atoi(argv[1]) : 360;
+	const int reps = argc > 2 ? atoi(argv[2]) : 5;
+	std::vector<int> sizes;
+	for (int i=3; i<argc; i++)
+		sizes.push_back(atoi(argv[i]));
+	if (sizes.empty())
+		sizes = {125, 250, 500, 1000};
+	const float maxLength = 4000;
+	const float side = 2.2*maxLength;
+
+	InnerModel *innerModel = new InnerModel();
+	InnerModelTransform *movableRoot = innerModel->newTransform("movableRoot", "static", innerModel->getRoot(), 0,0,0, 0,0,0, 0);
+	innerModel->getRoot()->addChild(movableRoot);
+	InnerModelTransform *robot = innerModel->newTransform("robot", "static", innerModel->getRoot(), 0,0,0, 0,0,0, 0);
+	innerModel->getRoot()->addChild(robot);
+	InnerModelTransform *laser = innerModel->newTransform("laser", "static", robot, 0,400,0, 0,0,0, 0);
+	robot->addChild(laser);
+
+	TLaserData scan(720);
+	for (size_t i=0; i<scan.size(); i++)
+	{
+		scan[i].angle = -M_PI + 2.*M_PI*i/scan.size();
+		scan[i].dist = roomDistance(scan[i].angle);
+	}
+	TLaserData rayCast(laserBins), fullScan(laserBins);
+	for (int i=0; i<laserBins; i++)
+		rayCast[i].angle = fullScan[i].angle = (double(i)-(0.5*laserBins))*((2.*M_PIl)/laserBins);
+
+	printf("%d virtual laser bins, %d reps\n", laserBins, reps);
+	printf("%-8s %14s %14s %16s\n", "cells", "raycast [ms]", "fullscan [ms]", "median diff [mm]");
+	for (const int cells : sizes)
+	{
+		LMap map(side, side/cells, maxLength, "movableRoot", "laser", innerModel, "robot", 290);
+		map.update_timeAndPositionIssues("laser");
+		for (int i=0; i<3; i++)
+			map.update_include_laser(&scan, "laser");
+		map.update_done("laser", 0);
+
+		double tRay = 1e9, tFull = 1e9;
+		for (int r=0; r<reps; r++)
+		{
+			map.setExtractionMode(LMap::RayCastExtraction);
+			double t = now();
+			map.getLaserData(&rayCast, laserBins, maxLength);
+			tRay = std::min(tRay, now()-t);
+			map.setExtractionMode(LMap::FullScanExtraction);
+			t = now();
+			map.getLaserData(&fullScan, laserBins, maxLength);
+			tFull = std::min(tFull, now()-t);
+		}
+		std::vector<float> diffs;
+		for (int i=0; i<laserBins; i++)
+		{
+			if (rayCast[i].dist < maxLength and fullScan[i].dist < maxLength)
+				diffs.push_back(fabs(rayCast[i].dist-fullScan[i].dist));
+		}
+		std::nth_element(diffs.begin(), diffs.begin()+diffs.size()/2, diffs.end());
+		printf("%-8d %14.3f %14.3f %16.1f\n", map.getBins(), 1e3*tRay, 1e3*tFull, diffs.empty() ? 0.f : diffs[diffs.size()/2]);
+		fflush(stdout);
+	}
+	delete innerModel;
+	return 0;
+}
@@ -190,6 +190,22 @@ int laserRGBComp::run(int argc, char* argv[])
 	configGetInt("DecimationLevel", cfg.DECIMATION_LEVEL, 0);
 	printf("DecimationLevel: %d\n", cfg.DECIMATION_LEVEL);
 	
+	configGetFloat("MapResolution", cfg.mapResolution, 0);
+	printf("MapResolution: %f\n", cfg.mapResolution);
+	
+	configGetInt("RGBDStep", cfg.rgbdStep, 0);
+	printf("RGBDStep: %d\n", cfg.rgbdStep);
+	
+	std::string extraction;
+	configGetString("LaserExtraction", extraction, "raycast");
+	if (extraction == "raycast")
+		cfg.rayCastExtraction = true;
+	else if (extraction == "fullscan")
+		cfg.rayCastExtraction = false;
+	else
+		qFatal("Wrong LaserExtraction value (raycast or fullscan)");
+	printf("LaserExtraction: %s\n", extraction.c_str());
+	
 	configGetString("ActualLaserID", cfg.actualLaserID, "");
 	printf("ActualLaserID: %s\n", cfg.actualLaserID.c_str());
 	
@@ -1,14 +1,22 @@
 #include <math.h>
 #include "map.h"
 
+#ifdef _OPENMP
+	#include <omp.h>
+#endif
+
 using namespace std;
 
-LMap::LMap(float side_, int32_t bins_, float laserRange_, const QString &movableRootID_, const QString &virtualLaserID_, InnerModel *innerModel_, const QString &robotID_, const float robotRadius_)
+LMap::LMap(float side_, float resolution_, float laserRange_, const QString &movableRootID_, const QString &virtualLaserID_, InnerModel *innerModel_, const QString &robotID_, const float robotRadius_)
 {
 	Q_ASSERT(0.5*side_ > 1.25 * laserRange);
 	side = side_;
-	bins = bins_;
+	// Rounded, so that a resolution computed as side/N gives exactly N cells despite float error
+	bins = std::max(int32_t(1), int32_t(lrint(side_/resolution_)));
+	rgbdStep = 0;
+	extractionMode = RayCastExtraction;
 	innerModel = innerModel_;
+	transforms.setInnerModel(innerModel);
 	laserRange = laserRange_;
 	robotID = robotID_;
 	robotRadius = robotRadius_;
@@ -22,6 +30,7 @@ LMap::LMap(float side_, int32_t bins_, float laserRange_, const QString &movable
 	mapLaser = cv::Mat(bins, bins, CV_8UC1, cv::Scalar(128));
 	mapRGBDs = cv::Mat(bins, bins, CV_8UC1, cv::Scalar(128));
 	mapBlend = cv::Mat(bins, bins, CV_8UC1, cv::Scalar(128));
+	rgbdHits.resize(bins*bins, 0);
 //	cv::namedWindow("mapLaser", cv::WINDOW_AUTOSIZE);
 //	cv::namedWindow("mapRGBDs", cv::WINDOW_AUTOSIZE);
 //	cv::namedWindow("mapBlend", cv::WINDOW_AUTOSIZE);
@@ -57,6 +66,8 @@ void LMap::update_timeAndPositionIssues(QString actualLaserID)
 		innerModel->updateTransformValues(movableRootID, pFromMRIDp(0), pFromMRIDp(1), pFromMRIDp(2), 0,0,0);
 		printf("moving movableRootID %f\n", distFromReference);
 	}
+	// Frame chains used by the update_include_* methods are resolved once from here on
+	transforms.invalidate();
 
 	// Decrease the obstacle certainty
 	const float forgetRateSubtractLaser = 7;
@@ -165,7 +176,6 @@ void LMap::update_include_rgbd(RoboCompRGBD::PointSeq *points, QString rgbdID)
 	int maxHeight = 1900;
 	int minHeightNeg = -200;
 
-	RTMat TRr = innerModel->getTransformationMatrix("robot", rgbdID); // WARNING This was used because it could be fater than calling transform multiple times
 	const uint32_t rgbd_size = points->size();
 	uint32_t pw = 640;
 	uint32_t ph = 480;
@@ -174,28 +184,81 @@ void LMap::update_include_rgbd(RoboCompRGBD::PointSeq *points, QString rgbdID)
 	if (points->size() == 320*240) { pw=320; ph=240; stepW=7; stepH=10; }
 	if (points->size() == 160*120) { pw=160; ph=120; stepW=4; stepH=6;  }
 	if (points->size() == 80*60)   { pw= 80; ph= 60; stepW=3; stepH=2;  }
-	#pragma omp parallel for
+	if (rgbdStep > 0) { stepW = stepH = rgbdStep; }
+
+	// Gather the valid decimated points in SoA form
+	rgbdBuffers.resize(((ph+stepH-1)/stepH) * ((pw+stepW-1)/stepW));
+	uint32_t n = 0;
 	for (uint32_t rr=0; rr<ph; rr+=stepH)
 	{
 		for (uint32_t cc=0; cc<pw; cc+=stepW)
 		{
-			uint32_t ioi = rr*pw+cc;
-			if (ioi<rgbd_size)
-			{
-				if (std::isnan(points->operator[](ioi).x) or std::isnan(points->operator[](ioi).y) or std::isnan(points->operator[](ioi).z))
-					continue;
-				if (points->operator[](ioi).z<0)
-					continue;
-				const QVec pRobot = (TRr * QVec::vec4(points->operator[](ioi).x, points->operator[](ioi).y, points->operator[](ioi).z, 1)).fromHomogeneousCoordinates();
-				if (not ( (pRobot(1)>=minHeight and pRobot(1)<=maxHeight) or (pRobot(1)<minHeightNeg) ))
-					continue;
-				const QVec mapCoord = fromReferenceToImageCoordinates(pRobot, "robot");
-				if (mapCoord(0)<=2 or mapCoord(0)>=bins-2 or mapCoord(2)<=2 or mapCoord(2)>=bins-2)
-					continue;
-				addToRGBDsCoordinates(mapCoord(0), mapCoord(2));
-			}
+			const uint32_t ioi = rr*pw+cc;
+			if (ioi>=rgbd_size)
+				continue;
+			const RoboCompRGBD::PointXYZ &p = points->operator[](ioi);
+			if (std::isnan(p.x) or std::isnan(p.y) or std::isnan(p.z) or p.z<0)
+				continue;
+			rgbdBuffers.x[n] = p.x;
+			rgbdBuffers.y[n] = p.y;
+			rgbdBuffers.z[n] = p.z;
+			n++;
+		}
+	}
+
+	// Robot coordinates (for the height filter) and then map coordinates, one batch each
+	TransformBuffers &b = rgbdBuffers;
+	transforms.transformXYZ("robot", rgbdID, b.x.data(), b.y.data(), b.z.data(), n, b.ox.data(), b.oy.data(), b.oz.data());
+	transforms.transformXYZ(movableRootID, "robot", b.ox.data(), b.oy.data(), b.oz.data(), n, b.x.data(), b.y.data(), b.z.data());
+
+	// Each thread collects the cells it hits in its own sparse buffer. Saturated
+	// increments commute, so merging the buffers gives the same map regardless
+	// of the number of threads or how the points were scheduled.
+	const float scale = float(bins)/float(side);
+#ifdef _OPENMP
+	rgbdTiles.resize(omp_get_max_threads());
+#else
+	rgbdTiles.resize(1);
+#endif
+	for (auto &tile : rgbdTiles)
+		tile.clear();
+	#pragma omp parallel
+	{
+#ifdef _OPENMP
+		std::vector<int32_t> &tile = rgbdTiles[omp_get_thread_num()];
+#else
+		std::vector<int32_t> &tile = rgbdTiles[0];
+#endif
+		#pragma omp for schedule(static)
+		for (uint32_t i=0; i<n; i++)
+		{
+			if (not ( (b.oy[i]>=minHeight and b.oy[i]<=maxHeight) or (b.oy[i]<minHeightNeg) ))
+				continue;
+			const float mx =  b.x[i]*scale + 0.5*bins;
+			const float mz = -b.z[i]*scale + 0.5*bins;
+			if (mx<=2 or mx>=bins-2 or mz<=2 or mz>=bins-2)
+				continue;
+			tile.push_back(int32_t(mz)*bins + int32_t(mx));
 		}
 	}
+
+	// Reduction: hits per cell, then a single saturated update per touched cell
+	for (const auto &tile : rgbdTiles)
+	{
+		for (const int32_t cell : tile)
+		{
+			if (rgbdHits[cell]++ == 0)
+				rgbdTouched.push_back(cell);
+		}
+	}
+	for (const int32_t cell : rgbdTouched)
+	{
+		uchar &v = mapRGBDs.at<uchar>(cell / bins, cell % bins);
+		const int64_t t = int64_t(v) + 100*int64_t(rgbdHits[cell]);
+		v = t>255 ? 255 : t;
+		rgbdHits[cell] = 0;
+	}
+	rgbdTouched.clear();
 }
 
 void LMap::update_done(QString actualLaserID, float minDist)
@@ -230,6 +293,90 @@ void LMap::update_done(QString actualLaserID, float minDist)
 
 
 void LMap::getLaserData(RoboCompLaser::TLaserData *laserData, int32_t laserBins, float maxLength)
+{
+	if (extractionMode == RayCastExtraction)
+		getLaserDataRayCast(laserData, laserBins, maxLength);
+	else
+		getLaserDataFullScan(laserData, laserBins, maxLength);
+}
+
+void LMap::getLaserDataRayCast(RoboCompLaser::TLaserData *laserData, int32_t laserBins, float maxLength)
+{
+	// Virtual laser pose in image coordinates
+	const TransformSnapshot::Matrix &M = transforms.matrix(movableRootID, virtualLaserID);
+	const float scale = float(bins)/float(side);
+	const float x0 =  M.m[3]*scale + 0.5*bins;
+	const float z0 = -M.m[11]*scale + 0.5*bins;
+
+	// Beam directions in the laser's reference frame, recomputed only when the number of bins changes
+	if (int32_t(beamSin.size()) != laserBins)
+	{
+		beamSin.resize(laserBins);
+		beamCos.resize(laserBins);
+		for (int32_t i=0; i<laserBins; ++i)
+		{
+			const double angle = (double(i)+0.5)*(2.*M_PIl)/laserBins - M_PIl;
+			beamSin[i] = sin(angle);
+			beamCos[i] = cos(angle);
+		}
+	}
+
+	const float maxT = maxLength*scale;
+	for (int32_t i=0; i<laserBins; ++i)
+	{
+		// Direction in image coordinates (z axis is flipped), one unit per cell
+		const float dx =   M.m[0]*beamSin[i] + M.m[2]*beamCos[i];
+		const float dz = -(M.m[8]*beamSin[i] + M.m[10]*beamCos[i]);
+		const float t = castRay(x0, z0, dx, dz, maxT);
+		(*laserData)[i].dist = t < maxT ? t/scale : maxLength;
+	}
+}
+
+/**
+* \brief Amanatides-Woo traversal of mapThreshold from (x0, z0) along (dx, dz)
+* @return distance in cells to the first occupied cell, or maxT if none is found
+*/
+inline float LMap::castRay(const float x0, const float z0, float dx, float dz, const float maxT)
+{
+	const float norm = sqrt(dx*dx + dz*dz);
+	if (norm <= 0)
+		return maxT;
+	dx /= norm;
+	dz /= norm;
+
+	int32_t cx = floor(x0);
+	int32_t cz = floor(z0);
+	const int32_t stepX = dx > 0 ? 1 : -1;
+	const int32_t stepZ = dz > 0 ? 1 : -1;
+	const float tDeltaX = dx != 0 ? fabs(1.f/dx) : INFINITY;
+	const float tDeltaZ = dz != 0 ? fabs(1.f/dz) : INFINITY;
+	float tMaxX = dx != 0 ? (dx > 0 ? (cx+1-x0) : (x0-cx))*tDeltaX : INFINITY;
+	float tMaxZ = dz != 0 ? (dz > 0 ? (cz+1-z0) : (z0-cz))*tDeltaZ : INFINITY;
+	float t = 0;
+
+	while (t < maxT)
+	{
+		if (cx < 0 or cx >= bins or cz < 0 or cz >= bins)
+			break;
+		if (mapThreshold.at<uchar>(cz, cx) > 0)
+			return t;
+		if (tMaxX < tMaxZ)
+		{
+			t = tMaxX;
+			tMaxX += tDeltaX;
+			cx += stepX;
+		}
+		else
+		{
+			t = tMaxZ;
+			tMaxZ += tDeltaZ;
+			cz += stepZ;
+		}
+	}
+	return maxT;
+}
+
+void LMap::getLaserDataFullScan(RoboCompLaser::TLaserData *laserData, int32_t laserBins, float maxLength)
 {
 	/// Clear laser measurement
 	for (int32_t i=0; i<laserBins; ++i)
@@ -298,6 +445,16 @@ inline QVec LMap::fromReferenceToImageCoordinates(const QVec &point, const QStri
 	return QVec::vec3(mapCoord(0) + 0.5*bins, 0, -mapCoord(2) + 0.5*bins);
 }
 
+void LMap::setRGBDStep(int32_t step)
+{
+	rgbdStep = step;
+}
+
+void LMap::setExtractionMode(ExtractionMode mode)
+{
+	extractionMode = mode;
+}
+
 inline void LMap::addToLaserCoordinates(const int x, const int z)
 {
 	if (x >= 0 and x < bins and z >= 0 and z < bins)
@@ -306,13 +463,5 @@ inline void LMap::addToLaserCoordinates(const int x, const int z)
 		mapLaser.at<uchar>(z, x) = t>255 ? 255 : t;
 	}
 };
-inline void LMap::addToRGBDsCoordinates(const int x, const int z)
-{
-	if (x >= 0 and x < bins and z >= 0 and z < bins)
-	{
-		const int64_t t = int64_t(mapRGBDs.at<uchar>(z, x)) + 100;
-		mapRGBDs.at<uchar>(z, x) = t>255 ? 255 : t;
-	}
-};
 
 
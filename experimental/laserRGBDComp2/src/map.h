@@ -8,13 +8,18 @@
 #include <Laser.h>
 #include <RGBD.h>
 
+#include <transformsnapshot/transformsnapshot.h>
+
 using namespace RoboCompLaser;
 
 class LMap
 {
 
 public:
-	LMap(float side_, int32_t bins_, float laserRange_, const QString &movableRootID_, const QString &virtualLaserID_, InnerModel *innerModel_, const QString &robotID, const float robotRadius);
+	/// RayCastExtraction casts one ray per beam, FullScanExtraction projects every map cell into the virtual laser
+	enum ExtractionMode { RayCastExtraction, FullScanExtraction };
+
+	LMap(float side_, float resolution_, float laserRange_, const QString &movableRootID_, const QString &virtualLaserID_, InnerModel *innerModel_, const QString &robotID, const float robotRadius);
 
 	void update_timeAndPositionIssues(QString actualLaserID);
 	void update_include_laser(TLaserData *laserData, QString actualLaserID);
@@ -23,6 +28,14 @@ public:
 
 	void getLaserData(TLaserData *laserData, int32_t bins, float maxLength);
 
+	/// Pixel step used to sample the RGBD clouds (0 selects it from the image size)
+	void setRGBDStep(int32_t step);
+	void setExtractionMode(ExtractionMode mode);
+
+	int32_t getBins() const { return bins; }
+	/// Occupancy accumulated from the RGBD clouds, 128 being unknown
+	const cv::Mat &getRGBDMap() const { return mapRGBDs; }
+
 private:
 	int32_t bins;
 	float side;
@@ -35,19 +48,29 @@ private:
 	QTime lastForgetSubtractRGBD;
 	QTime lastForgetAdd;
 	InnerModel *innerModel;
+	TransformSnapshot transforms;
+	TransformBuffers rgbdBuffers;
+	int32_t rgbdStep;
+	std::vector< std::vector<int32_t> > rgbdTiles;
+	std::vector<uint32_t> rgbdHits;
+	std::vector<int32_t> rgbdTouched;
+	ExtractionMode extractionMode;
+	std::vector<float> beamSin, beamCos;
 	QString movableRootID;
 	QString virtualLaserID;
 	QString robotID;
 	float robotRadius;
 
 private:
+	void getLaserDataRayCast(TLaserData *laserData, int32_t laserBins, float maxLength);
+	void getLaserDataFullScan(TLaserData *laserData, int32_t laserBins, float maxLength);
+	inline float castRay(const float x0, const float z0, float dx, float dz, const float maxT);
 	inline int32_t angle2bin(double ang, const int bins);
 	inline QVec fromReferenceLaserToImageCoordinates(const float dist, const float angle, const QString &reference);
 	inline QVec fromReferenceToImageCoordinates(const QVec &point, const QString &reference);
 	inline QVec fromImageToReference(float xi, float zi, const QString &reference);
 	inline void fromImageToVirtualLaser(float xi, float zi, int32_t laserBins, float &dist, int32_t &bin);
 	inline void addToLaserCoordinates(const int x, const int z);
-	inline void addToRGBDsCoordinates(const int x, const int z);
 };
 
 
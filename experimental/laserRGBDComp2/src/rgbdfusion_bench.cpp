@@ -0,0 +1,93 @@
+// Times LMap::update_include_rgbd for each number of threads and checks that
+// the fused map is the same whatever the number of threads:
+//   rgbdfusion_bench [max threads] [frames] [map resolution mm]
+// Returns 1 if any map differs from the single-threaded one.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+
+#ifdef _OPENMP
+	#include <omp.h>
+#endif
+
+#include "map.h"
+
+static double now()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/// Random VGA clouds in front of the camera, reproducible from the seed
+static std::vector<RoboCompRGBD::PointSeq> makeFrames(int frames)
+{
+	srand(27);
+	std::vector<RoboCompRGBD::PointSeq> clouds(frames);
+	for (auto &cloud : clouds)
+	{
+		cloud.resize(640*480);
+		for (auto &p : cloud)
+		{
+			p.x = -3000.f + 6000.f*rand()/RAND_MAX;
+			p.y = -1500.f + 2500.f*rand()/RAND_MAX;
+			p.z =   300.f + 3700.f*rand()/RAND_MAX;
+			p.w = 1.f;
+			if (rand()%50 == 0)
+				p.z = NAN;
+		}
+	}
+	return clouds;
+}
+
+int main(int argc, char **argv)
+{
+	const int maxThreads = argc > 1 ? atoi(argv[1]) : 4;
+	const int frames = argc > 2 ? atoi(argv[2]) : 20;
+	const float maxLength = 4000;
+	const float side = 2.2*maxLength;
+	const float resolution = argc > 3 ? atof(argv[3]) : side/250.;
+
+	// root -> movableRoot, root -> robot -> rgbd (1.2m high, looking forward) and robot -> laser
+	InnerModel *innerModel = new InnerModel();
+	InnerModelTransform *movableRoot = innerModel->newTransform("movableRoot", "static", innerModel->getRoot(), 0,0,0, 0,0,0, 0);
+	innerModel->getRoot()->addChild(movableRoot);
+	InnerModelTransform *robot = innerModel->newTransform("robot", "static", innerModel->getRoot(), 0,0,0, 0,0,0, 0);
+	innerModel->getRoot()->addChild(robot);
+	InnerModelTransform *rgbd = innerModel->newTransform("rgbd", "static", robot, 0,1200,100, 0,0,0, 0);
+	robot->addChild(rgbd);
+	InnerModelTransform *laser = innerModel->newTransform("laser", "static", robot, 0,400,0, 0,0,0, 0);
+	robot->addChild(laser);
+
+	std::vector<RoboCompRGBD::PointSeq> clouds = makeFrames(frames);
+	bool deterministic = true;
+	for (const int step : {0, 1})
+	{
+		printf("%d frames, resolution %.1f mm, step %s\n", frames, resolution, step ? "1" : "from the image size");
+		cv::Mat reference;
+		for (int threads=1; threads<=maxThreads; threads++)
+		{
+#ifdef _OPENMP
+			omp_set_num_threads(threads);
+#endif
+			LMap map(side, resolution, maxLength, "movableRoot", "laser", innerModel, "robot", 290);
+			map.setRGBDStep(step);
+			double t = now();
+			for (auto &cloud : clouds)
+				map.update_include_rgbd(&cloud, "rgbd");
+			t = now() - t;
+
+			const cv::Mat &fused = map.getRGBDMap();
+			bool same = true;
+			if (threads == 1)
+				reference = fused.clone();
+			else
+				same = cv::countNonZero(fused != reference) == 0;
+			deterministic = deterministic and same;
+			printf("  %d threads  %d x %d cells  %8.3f ms/frame  %s\n", threads, map.getBins(), map.getBins(), 1e3*t/frames, same ? "identical" : "DIFFERENT");
+		}
+	}
+	delete innerModel;
+	return deterministic ? 0 : 1;
+}
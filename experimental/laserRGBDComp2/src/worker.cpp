@@ -69,7 +69,11 @@ innerModel->transform("root", "root").print("robot");
 
 	printf("<<< virtualLaserID: %s>>>\n", virtualLaserID.toStdString().c_str());
 
-	map = new LMap(2.2*maxLength, 250, maxLength, "movableRoot", virtualLaserID, innerModel, "robot", 290);
+	// Map resolution (mm per cell) is independent of the map size, defaulting to the former 250 cells per side
+	const float mapResolution = cfg.mapResolution > 0 ? cfg.mapResolution : 2.2*maxLength/250.;
+	map = new LMap(2.2*maxLength, mapResolution, maxLength, "movableRoot", virtualLaserID, innerModel, "robot", 290);
+	map->setRGBDStep(cfg.rgbdStep);
+	map->setExtractionMode(cfg.rayCastExtraction ? LMap::RayCastExtraction : LMap::FullScanExtraction);
 
 	confData.staticConf = 1;
 	confData.maxMeasures = 100;
@@ -80,6 +80,9 @@ struct WorkerConfig
 	float maxLength;
 	float FOV;
 	int DECIMATION_LEVEL;
+	float mapResolution;
+	int rgbdStep;
+	bool rayCastExtraction;
 	bool updateJoint;
 
 	// laser-related
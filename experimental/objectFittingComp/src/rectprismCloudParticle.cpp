@@ -200,6 +200,22 @@ void RectPrismCloudParticle::adapt(const int &controlBack, const int &controlNew
 
 void RectPrismCloudParticle::computeWeight(const RectPrismCloudPFInputData &data)
 {
+  if (not data.voxels.empty())
+  {
+    // Same transform as RectPrism::placePoint, built once per particle instead of once per point
+    const QVec center = r.getCenter();
+    const QVec rotation = r.getRotation();
+    const QVec width = r.getWidth();
+    const RTMat T(-rotation(0), -rotation(1), -rotation(2), QVec::vec3(-center(0), -center(1), -center(2)));
+    float M[12];
+    for (int row=0; row<3; row++)
+      for (int col=0; col<4; col++)
+        M[row*4+col] = T(row, col);
+    const double meanDistance = data.voxels.meanBoxDistance(M, fabs(width(0))/2, fabs(width(1))/2, fabs(width(2))/2);
+    this->weight = 1./(meanDistance+1.);
+    return;
+  }
+
 //   printf("RectPrism: A(%f,%f,%f), B(%f,%f,%f), r=%f\n", c.getA().getX() , c.getA().getY() ,c.getA().getZ() , c.getB().getX() ,c.getB().getY() ,c.getB().getZ(), c.getR());
   this->weight=0.;
   //double mint, maxt;
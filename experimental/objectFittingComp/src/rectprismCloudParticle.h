@@ -13,13 +13,28 @@
 #include <particleFiltering/particleFilter.h>
 #include <limits>
 #include "shapes/rectprism.h"
+#include "voxelizedCloud.h"
 
 #include <qmat/QMatAll>
 
 class RectPrismCloudPFInputData
 {
 public:
+  RectPrismCloudPFInputData() : voxelSize(-1.f) { }
+
+  /// Sets the target cloud and, if enabled, voxelizes it once for every particle's computeWeight
+  void setCloud(const pcl::PointCloud<pcl::PointXYZRGB>::Ptr &cloud)
+  {
+    cloud_target = cloud;
+    if (voxelSize >= 0)
+      voxels.build(*cloud, voxelSize);
+    else
+      voxels.clear();
+  }
+
   pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_target;
+  VoxelizedCloud voxels;
+  float voxelSize;   // mm; negative (default) uses RectPrism::distance, 0 the vectorized loop on every point, >0 one centroid per voxel
 };
 
 class RectPrismCloudParticle : public RCParticleFilter_Particle<RectPrismCloudPFInputData, int, RCParticleFilter_Config>
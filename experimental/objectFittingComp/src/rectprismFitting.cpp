@@ -7,7 +7,7 @@ RectPrismFitting::RectPrismFitting(pcl::PointCloud<pcl::PointXYZRGB>::Ptr cl): c
 {
   //sigset(SIGINT, sig_term); 
   
-  input.cloud_target=cl;
+  input.setCloud(cl);
   c.particles=100;
   
   //cup from kinect
@@ -140,7 +140,7 @@ void RectPrismFitting::run(pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_, QVec &
 { 
   cout<<"Clouuud: "<<cloud_->size()<<endl;
   
-  input.cloud_target=cloud_;
+  input.setCloud(cloud_);
   
   computing=true;
 
@@ -14,6 +14,8 @@ public:
 
   inline double getRandom() { return (rand()%32000)/32000.0; }
   inline bool isComputing () { return computing; }
+  /// Likelihood on a voxelized cloud from the next run on (see RectPrismCloudPFInputData::voxelSize), off by default
+  inline void setVoxelSize (float leaf) { input.voxelSize = leaf; }
   
 private:
   
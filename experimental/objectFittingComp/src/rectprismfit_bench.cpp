@@ -0,0 +1,140 @@
+// Fits a noisy, rotated box cloud with RectPrismCloudParticle for each likelihood
+// mode: RectPrism::distance per point (the default), the vectorized loop on every
+// point, and voxel centroids of several sizes. Reports particle evaluations per
+// second, the weights each mode gives to the same particles (against the default
+// mode), and the fitted pose against the default mode and the true box.
+//   rectprismfit_bench [steps] [particles] [voxel sizes mm...]
+// Returns 1 if the vectorized loop on every point does not match RectPrism::distance.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <math.h>
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include "rectprismCloudParticle.h"
+
+typedef RCParticleFilter<RectPrismCloudPFInputData, int, RectPrismCloudParticle, RCParticleFilter_Config> RectPrismFilter;
+
+static double now()
+{
+  return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/// Points every spacing mm over the faces of a box of the given widths, rotation and center, 1 mm noise, 2% NaN
+static pcl::PointCloud<pcl::PointXYZRGB>::Ptr makeBox(const QVec &center, const QVec &rotation, const QVec &width, float spacing)
+{
+  std::mt19937 rng(35);
+  std::normal_distribution<float> noise(0.f, 1.f);
+  pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud(new pcl::PointCloud<pcl::PointXYZRGB>());
+  const RTMat T(rotation(0), rotation(1), rotation(2), center);
+  for (int axis=0; axis<3; axis++)
+  {
+    const int u = (axis+1)%3, v = (axis+2)%3;
+    for (int side=-1; side<=1; side+=2)
+    {
+      for (float a=-width(u)/2; a<=width(u)/2; a+=spacing)
+      {
+        for (float b=-width(v)/2; b<=width(v)/2; b+=spacing)
+        {
+          QVec local = QVec::vec4(0, 0, 0, 1);
+          local[axis] = side*width(axis)/2;
+          local[u] = a;
+          local[v] = b;
+          const QVec world = T * local;
+          pcl::PointXYZRGB p;
+          p.x = world(0) + noise(rng);
+          p.y = world(1) + noise(rng);
+          p.z = world(2) + noise(rng);
+          if (rng()%50 == 0)
+            p.z = NAN;
+          cloud->push_back(p);
+        }
+      }
+    }
+  }
+  return cloud;
+}
+
+static double dist3(QVec a, QVec b)
+{
+  return sqrt((a(0)-b(0))*(a(0)-b(0)) + (a(1)-b(1))*(a(1)-b(1)) + (a(2)-b(2))*(a(2)-b(2)));
+}
+
+int main(int argc, char **argv)
+{
+  const int steps = argc > 1 ? atoi(argv[1]) : 20;
+  RCParticleFilter_Config config;
+  config.particles = argc > 2 ? atoi(argv[2]) : 100;
+  std::vector<float> modes = {-1.f, 0.f};
+  for (int i=3; i<argc; i++)
+    modes.push_back(atof(argv[i]));
+  if (argc <= 3)
+    modes.insert(modes.end(), {2.f, 5.f, 10.f});
+
+  const QVec center = QVec::vec3(50, -20, 600), rotation = QVec::vec3(0.3, 0.2, 0.1), width = QVec::vec3(200, 120, 80);
+  pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud = makeBox(center, rotation, width, 2.f);
+
+  std::vector<RectPrismCloudParticle> population;
+  RectPrismCloudParticle reference;
+  bool exactMatches = true;
+  printf("%lu points, %u particles, %d steps\n", cloud->size(), config.particles, steps);
+  printf("%-10s %8s %12s %14s %14s %14s %14s\n", "voxel mm", "points", "evals/s", "max |dw|/w", "center d [mm]", "width d [mm]", "center err [mm]");
+  for (const float leaf : modes)
+  {
+    RectPrismCloudPFInputData input;
+    input.voxelSize = leaf;
+    input.setCloud(cloud);
+
+    // Same random sequence for every mode. Particle initialization is verbose: keep it off the table.
+    srand(35);
+    qsrand(35);
+    fflush(stdout);
+    const int out = dup(1), null = open("/dev/null", O_WRONLY);
+    dup2(null, 1);
+    RectPrismFilter filter(&config, input, 0);
+    fflush(stdout);
+    dup2(out, 1);
+    close(null);
+    close(out);
+
+    double t = 0;
+    for (int s=0; s<steps; s++)
+    {
+      const double t0 = now();
+      filter.step(input, 0, false, -1);
+      t += now() - t0;
+    }
+    RectPrismCloudParticle best = filter.getBest();
+
+    // Weights of the default mode's final population under this mode
+    if (leaf < 0)
+    {
+      population.assign(filter.particles().begin(), filter.particles().end());
+      reference = best;
+    }
+    double maxRelative = 0;
+    for (const auto &p : population)
+    {
+      RectPrismCloudParticle exact = p, mode = p;
+      RectPrismCloudPFInputData exactInput;
+      exactInput.setCloud(cloud);
+      exact.computeWeight(exactInput);
+      mode.computeWeight(input);
+      maxRelative = std::max(maxRelative, fabs(mode.getWeight() - exact.getWeight()) / exact.getWeight());
+    }
+    if (leaf == 0 and maxRelative > 1e-4)
+      exactMatches = false;
+
+    char name[32];
+    snprintf(name, sizeof(name), leaf < 0 ? "off" : "%.1f", leaf);
+    printf("%-10s %8lu %12.0f %14.2e %14.2f %14.2f %14.2f\n", name, leaf < 0 ? cloud->size() : input.voxels.size(), config.particles*steps/t,
+           maxRelative, dist3(best.getTranslation(), reference.getTranslation()), dist3(best.getScale(), reference.getScale()),
+           dist3(best.getTranslation(), center));
+    fflush(stdout);
+  }
+  return exactMatches ? 0 : 1;
+}
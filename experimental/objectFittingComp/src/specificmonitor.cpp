@@ -71,7 +71,7 @@ bool SpecificMonitor::sendParamsToWorker(RoboCompCommonBehavior::ParameterList p
 	if(checkParams(params))
 	{
 		//Set params to worker
-		
+		worker->setParams(params);
 		return true;
 	}
 	else
@@ -93,6 +93,11 @@ void SpecificMonitor::readConfig(RoboCompCommonBehavior::ParameterList &params )
 	    //aux.editable = true;
 	    //configGetString( "DRobot.Device", aux.value,"/dev/ttyUSB0");
 	    //params["DRobot.Device"] = aux;
+	RoboCompCommonBehavior::Parameter aux;
+	aux.editable = true;
+	// mm; negative (default) fits on RectPrism::distance, 0 on every point vectorized, >0 on one centroid per voxel
+	configGetString( "ObjectFitting.VoxelSize", aux.value, "-1");
+	params["ObjectFitting.VoxelSize"] = aux;
 }
 
 //comprueba que los parametros sean correctos y los transforma a la estructura del worker
@@ -200,7 +200,7 @@ void SpecificWorker::compute()
 }
 void SpecificWorker::setParams(RoboCompCommonBehavior::ParameterList params)
 {
-  timer.setSingleShot(true);
+  rectprismfitting->setVoxelSize(QString::fromStdString(params["ObjectFitting.VoxelSize"].value).toFloat());
   timer.start(Period);
 };
 
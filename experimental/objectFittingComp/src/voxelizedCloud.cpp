@@ -0,0 +1,78 @@
+#include "voxelizedCloud.h"
+
+#include <math.h>
+#include <unordered_map>
+
+// Padding keeps every SoA buffer a whole number of vector lanes, padded points have weight 0
+static const size_t VOXEL_LANES = 8;
+
+void VoxelizedCloud::build(const pcl::PointCloud<pcl::PointXYZRGB> &cloud, const float leaf)
+{
+  x.clear(); y.clear(); z.clear(); w.clear();
+  normalizer = cloud.points.size();
+
+  if (leaf <= 0)
+  {
+    for (const auto &p : cloud.points)
+    {
+      if (isnan(p.x) or isnan(p.y) or isnan(p.z))
+        continue;
+      x.push_back(p.x); y.push_back(p.y); z.push_back(p.z); w.push_back(1.f);
+    }
+  }
+  else
+  {
+    const float inv = 1.f/leaf;
+    std::unordered_map<uint64_t, uint32_t> voxels;
+    voxels.reserve(cloud.points.size()/4);
+    for (const auto &p : cloud.points)
+    {
+      if (isnan(p.x) or isnan(p.y) or isnan(p.z))
+        continue;
+      const uint64_t ix = uint64_t(int64_t(floorf(p.x*inv)) & 0x1FFFFF);
+      const uint64_t iy = uint64_t(int64_t(floorf(p.y*inv)) & 0x1FFFFF);
+      const uint64_t iz = uint64_t(int64_t(floorf(p.z*inv)) & 0x1FFFFF);
+      const auto it = voxels.emplace((ix<<42) | (iy<<21) | iz, uint32_t(x.size())).first;
+      const uint32_t v = it->second;
+      if (v == x.size())
+      {
+        x.push_back(0.f); y.push_back(0.f); z.push_back(0.f); w.push_back(0.f);
+      }
+      x[v] += p.x; y[v] += p.y; z[v] += p.z; w[v] += 1.f;
+    }
+    for (size_t v=0; v<x.size(); v++)
+    {
+      x[v] /= w[v]; y[v] /= w[v]; z[v] /= w[v];
+    }
+  }
+
+  const size_t padded = (x.size() + VOXEL_LANES - 1) / VOXEL_LANES * VOXEL_LANES;
+  x.resize(padded, 0.f); y.resize(padded, 0.f); z.resize(padded, 0.f); w.resize(padded, 0.f);
+}
+
+double VoxelizedCloud::meanBoxDistance(const float M[12], const float hx, const float hy, const float hz) const
+{
+  if (normalizer == 0)
+    return 0.;
+  const float m00=M[0], m01=M[1], m02=M[2],  m03=M[3];
+  const float m10=M[4], m11=M[5], m12=M[6],  m13=M[7];
+  const float m20=M[8], m21=M[9], m22=M[10], m23=M[11];
+  const float *px=x.data(), *py=y.data(), *pz=z.data(), *pw=w.data();
+  const size_t n = x.size();
+
+  float sum = 0.f;
+  #pragma omp simd reduction(+:sum) aligned(px, py, pz, pw: 16)
+  for (size_t i=0; i<n; i++)
+  {
+    const float bx = m00*px[i] + m01*py[i] + m02*pz[i] + m03;
+    const float by = m10*px[i] + m11*py[i] + m12*pz[i] + m13;
+    const float bz = m20*px[i] + m21*py[i] + m22*pz[i] + m23;
+    // Outside: distance to the box. Inside: distance to the closest face.
+    const float qx = fabsf(bx) - hx, qy = fabsf(by) - hy, qz = fabsf(bz) - hz;
+    const float ox = qx > 0.f ? qx : 0.f, oy = qy > 0.f ? qy : 0.f, oz = qz > 0.f ? qz : 0.f;
+    const float qmax = qx > qy ? (qx > qz ? qx : qz) : (qy > qz ? qy : qz);
+    const float inside = qmax < 0.f ? -qmax : 0.f;
+    sum += pw[i] * (sqrtf(ox*ox + oy*oy + oz*oz) + inside);
+  }
+  return sum / normalizer;
+}
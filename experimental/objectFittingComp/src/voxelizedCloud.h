@@ -0,0 +1,46 @@
+#ifndef VOXELIZEDCLOUD_H
+#define VOXELIZEDCLOUD_H
+
+#include <stdint.h>
+#include <vector>
+
+#include <pcl/point_types.h>
+#include <pcl/point_cloud.h>
+#include <Eigen/Core>
+
+/**
+ *    V o x e l i z e d C l o u d
+ *
+ * Target cloud reduced once per frame to one point per voxel (the centroid of the
+ * valid points falling in it) stored as aligned structure-of-arrays, each point
+ * weighted by the number of points it stands for. Particles evaluate their
+ * likelihood against it with a branch-free, vectorizable point-to-box distance.
+ */
+class VoxelizedCloud
+{
+public:
+  typedef std::vector<float, Eigen::aligned_allocator<float> > FloatBuffer;
+
+  VoxelizedCloud() : normalizer(0) { }
+
+  /// leaf <= 0 keeps every valid point (exact evaluation)
+  void build(const pcl::PointCloud<pcl::PointXYZRGB> &cloud, const float leaf);
+
+  void clear() { x.clear(); y.clear(); z.clear(); w.clear(); normalizer = 0; }
+  bool empty() const { return normalizer == 0; }
+  size_t size() const { return x.size(); }
+
+  /**
+   * \brief Weighted sum of the unsigned distances from the points to the surface of a box,
+   * divided by the number of points of the original cloud (NaNs included, as in computeWeight).
+   * @param M row-major 3x4 matrix taking cloud points to the box frame
+   * @param hx, hy, hz half widths of the box
+   */
+  double meanBoxDistance(const float M[12], const float hx, const float hy, const float hz) const;
+
+private:
+  FloatBuffer x, y, z, w;
+  size_t normalizer;
+};
+
+#endif
@@ -1,3 +1,6 @@
+#ifndef DJK_H
+#define DJK_H
+
 #include <vector>
 #include <iostream>
 
@@ -126,3 +129,5 @@ public:
 
 
 };
+
+#endif
@@ -1,5 +1,15 @@
 #include <QStringList>
 #include <QTextStream>
+#include <QDataStream>
+#include <stdexcept>
+
+#include "sparsegraph.h"
+
+#define IKG_BINARY_MAGIC 0x494B4742  // "IKGB"
+#define IKG_BINARY_VERSION 1
+
+// DJ_INFINITY, the weight djk.h gave to absent edges, is still found in graphs saved with the dense matrix
+#include "djk.h"
 
 
 class ConnectivityGraph
@@ -58,22 +68,21 @@ public:
 		for (int32_t i=0;i<size; i++)
 		{
 			vertices.push_back(VertexData());
-			std::vector<float> eds;
-			for (int32_t j=0;j<size; j++)
-			{
-				eds.push_back(DJ_INFINITY);
-			}
-			edges.push_back(eds);
 		}
+		invalidate();
 	}
 
+	/// Loads a graph saved with save() (text) or saveBinary()
 	ConnectivityGraph(QString path)
 	{
+		invalidate();
+		if (loadBinary(path))
+			return;
+
 		QFile file(path);
 		if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
 		{
-			printf("Can't open file\n");
-			throw 1;
+			throw std::runtime_error("Can't open graph file " + path.toStdString());
 		}
 
 		QTextStream in(&file);
@@ -110,7 +119,9 @@ public:
 				int a = parts[0].toInt();
 				int b = parts[1].toInt();
 				float peso = parts[2].toFloat();
-				edges[a][b] = peso;
+				// Old files list every pair, absent edges having DJ_INFINITY weight
+				if (peso > 0 and peso < DJ_INFINITY)
+					edges.push_back(SparseGraph::Edge{(uint32_t)a, (uint32_t)b, peso});
 			}
 			lineN++;
 		}
@@ -139,32 +150,62 @@ public:
 			out << "\n";
 		}
 
-		for (uint v1=0; v1<edges.size(); v1++)
+		for (const auto &e : edges)
 		{
-			for (uint v2=0; v2<edges[v1].size(); v2++)
-			{
-				out << v1 << "_" << v2 << "_" << edges[v1][v2] << "\n";
-			}
+			out << e.from << "_" << e.to << "_" << e.weight << "\n";
 		}
 		return true;
 	}
 
-	void addVertex(const VertexData &v)
+	/**
+	* \brief Compact binary version of save(): magic, version, vertices with their
+	* configurations and then the edge list, all little endian with single precision floats.
+	*/
+	bool saveBinary(QString path)
 	{
-		// Add vertex
-		vertices.push_back(v);
-		// Add edges for existing nodes
-		for (uint32_t j=0;j<vertices.size()-1; j++)
+		QFile file(path);
+		if (!file.open(QIODevice::WriteOnly))
+			return false;
+
+		QDataStream out(&file);
+		out.setByteOrder(QDataStream::LittleEndian);
+		out.setFloatingPointPrecision(QDataStream::SinglePrecision);
+		out << (quint32)IKG_BINARY_MAGIC << (quint32)IKG_BINARY_VERSION;
+		out << (quint32)vertices.size();
+		for (const auto &v : vertices)
 		{
-			edges[j].push_back(DJ_INFINITY);
+			out << (qint64)v.id << (quint8)v.valid;
+			out << v.pose[0] << v.pose[1] << v.pose[2];
+			out << v.poseElbow[0] << v.poseElbow[1] << v.poseElbow[2];
+			out << (quint32)v.configurations.size();
+			for (const auto &configuration : v.configurations)
+			{
+				out << (quint32)configuration.size();
+				for (const auto &motor : configuration)
+				{
+					out << QByteArray(motor.name.data(), motor.name.size()) << motor.position << motor.maxSpeed;
+				}
+			}
 		}
-		// Add edges for the new node
-		std::vector<float> eds;
-		for (uint32_t j=0;j<vertices.size(); j++)
+		out << (quint32)edges.size();
+		for (const auto &e : edges)
 		{
-			eds.push_back(DJ_INFINITY);
+			out << (quint32)e.from << (quint32)e.to << e.weight;
 		}
-		edges.push_back(eds);
+		return out.status() == QDataStream::Ok;
+	}
+
+	void addVertex(const VertexData &v)
+	{
+		vertices.push_back(v);
+		invalidate();
+	}
+
+	/// Must be called after modifying vertices or edges directly
+	void invalidate()
+	{
+		graphDirty = true;
+		treeDirty = true;
 	}
 
 	int size()
@@ -175,24 +216,35 @@ public:
 
 
 	std::vector<VertexData> vertices;
-	std::vector< std::vector< float > > edges;
+	std::vector<SparseGraph::Edge> edges;
 
 	void add_edge(int a, int b, float dist)
 	{
-		edges[a][b] = dist;
-		edges[b][a] = dist;
+		edges.push_back(SparseGraph::Edge{(uint32_t)a, (uint32_t)b, dist});
+		edges.push_back(SparseGraph::Edge{(uint32_t)b, (uint32_t)a, dist});
+		graphDirty = true;
 	}
 
 	void add_configurationToNode(int node, MotorGoalPositionList gpl)
 	{
 		vertices[node].configurations.push_back(gpl);
+		treeDirty = true;
 	}
 
 	int path(int source, int dest, std::vector<int> &path)
 	{
-		Dijkstra d = Dijkstra(&edges);
-		d.calculateDistance(source);
-		return d.go(dest, path);
+		return sparseGraph().dijkstra(source, dest, path);
+	}
+
+	/**
+	* \brief Same as path(), guided by the straight-line distance between the vertices' poses.
+	* Only optimal if every edge weighs at least the distance between the poses it joins;
+	* with any other edge weight use path().
+	*/
+	int pathAStar(int source, int dest, std::vector<int> &path)
+	{
+		SparseGraph &g = sparseGraph();
+		return g.astar(source, dest, path, positions.data());
 	}
 
 
@@ -205,24 +257,103 @@ public:
 		return getCloserTo(p);
 	}
 
+	/// Closest valid vertex having at least one configuration, -1 if there is none
 	int getCloserTo(float *p)
 	{
-		float minDist = -1;
-		int32_t minIndex = -1;
+		if (treeDirty)
+		{
+			std::vector<float> xyz;
+			std::vector<int32_t> ids;
+			for (uint i=0; i<vertices.size(); i++)
+			{
+				if (vertices[i].valid and vertices[i].configurations.size() > 0)
+				{
+					xyz.insert(xyz.end(), vertices[i].pose, vertices[i].pose+3);
+					ids.push_back(i);
+				}
+			}
+			tree.build(xyz, ids);
+			treeDirty = false;
+		}
+		return tree.nearest(p);
+	}
+
+private:
+	SparseGraph graph;
+	KDTree3 tree;
+	std::vector<float> positions;
+	bool graphDirty, treeDirty;
+
+	SparseGraph &sparseGraph()
+	{
+		if (graphDirty)
+		{
+			graph.build(vertices.size(), edges);
+			positions.resize(3*vertices.size());
+			for (uint i=0; i<vertices.size(); i++)
+			{
+				std::copy(vertices[i].pose, vertices[i].pose+3, &positions[3*i]);
+			}
+			graphDirty = false;
+		}
+		return graph;
+	}
+
+	bool loadBinary(QString path)
+	{
+		QFile file(path);
+		if (!file.open(QIODevice::ReadOnly))
+			return false;
 
-		for (uint i=0; i<vertices.size(); i++)
+		QDataStream in(&file);
+		in.setByteOrder(QDataStream::LittleEndian);
+		in.setFloatingPointPrecision(QDataStream::SinglePrecision);
+		quint32 magic, version, nVertices;
+		in >> magic >> version;
+		if (magic != IKG_BINARY_MAGIC or version != IKG_BINARY_VERSION)
+			return false;
+		in >> nVertices;
+		vertices.resize(nVertices);
+		for (auto &v : vertices)
 		{
-			if (vertices[i].valid and vertices[i].configurations.size() > 0)
+			qint64 id;
+			quint8 valid;
+			quint32 nConfigurations;
+			in >> id >> valid;
+			in >> v.pose[0] >> v.pose[1] >> v.pose[2];
+			in >> v.poseElbow[0] >> v.poseElbow[1] >> v.poseElbow[2];
+			v.id = id;
+			v.valid = valid;
+			in >> nConfigurations;
+			v.configurations.resize(nConfigurations);
+			for (auto &configuration : v.configurations)
 			{
-				const float d = vertices[i].distTo(p);
-				if (minDist<0 or minDist>d)
+				quint32 nMotors;
+				in >> nMotors;
+				configuration.resize(nMotors);
+				for (auto &motor : configuration)
 				{
-					minDist = d;
-					minIndex = i;
+					QByteArray name;
+					in >> name >> motor.position >> motor.maxSpeed;
+					motor.name = std::string(name.constData(), name.size());
 				}
 			}
 		}
-		return minIndex;
+		quint32 nEdges;
+		in >> nEdges;
+		edges.resize(nEdges);
+		for (auto &e : edges)
+		{
+			quint32 from, to;
+			in >> from >> to >> e.weight;
+			e.from = from;
+			e.to = to;
+		}
+		if (in.status() != QDataStream::Ok)
+		{
+			throw std::runtime_error("Corrupt binary graph file " + path.toStdString());
+		}
+		return true;
 	}
 };
 
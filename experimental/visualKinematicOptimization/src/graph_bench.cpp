@@ -0,0 +1,141 @@
+// Shortest path query latency of the dense Dijkstra in djk.h against the heap
+// Dijkstra and A* of SparseGraph, and nearest vertex lookup of KDTree3 against a
+// scan of every vertex, on random arm-like graphs: vertices spread in a 1 m cube,
+// each joined to a few random others with a weight of at least their distance.
+//   graph_bench [queries] [edges per vertex] [vertices...]
+// Returns 1 if a path cost or a nearest vertex differs between the methods.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include "djk.h"
+#include "sparsegraph.h"
+
+static double now()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static float dist(const float *a, const float *b)
+{
+	return sqrt((a[0]-b[0])*(a[0]-b[0]) + (a[1]-b[1])*(a[1]-b[1]) + (a[2]-b[2])*(a[2]-b[2]));
+}
+
+int main(int argc, char **argv)
+{
+	const int queries = argc > 1 ? atoi(argv[1]) : 20;
+	const int degree = argc > 2 ? atoi(argv[2]) : 4;
+	std::vector<int> sizes;
+	for (int i=3; i<argc; i++)
+		sizes.push_back(atoi(argv[i]));
+	if (sizes.empty())
+		sizes = {1000, 3000, 5000, 30000};
+	// The dense matrix takes 4V^2 bytes: djk.h is skipped above this
+	const int denseLimit = 5000;
+
+	int failures = 0;
+	printf("%d queries, %d random edges per vertex (both directions)\n", queries, degree);
+	printf("%-9s %9s %12s %12s %12s %12s %12s\n", "vertices", "edges", "djk.h [ms]", "heap [ms]", "A* [ms]", "scan [us]", "k-d [us]");
+	for (const int V : sizes)
+	{
+		std::mt19937 rng(36);
+		std::uniform_real_distribution<float> u(0, 1);
+		std::vector<float> xyz(3*V);
+		std::vector<int32_t> ids(V);
+		for (int v=0; v<V; v++)
+		{
+			for (int k=0; k<3; k++)
+				xyz[3*v+k] = 1000*u(rng);
+			ids[v] = v;
+		}
+		std::vector<SparseGraph::Edge> edges;
+		for (int a=0; a<V; a++)
+		{
+			for (int e=0; e<degree; e++)
+			{
+				const int b = rng()%V;
+				if (b == a)
+					continue;
+				const float w = dist(&xyz[3*a], &xyz[3*b]) * (1 + 0.5*u(rng));
+				edges.push_back(SparseGraph::Edge{(uint32_t)a, (uint32_t)b, w});
+				edges.push_back(SparseGraph::Edge{(uint32_t)b, (uint32_t)a, w});
+			}
+		}
+		SparseGraph graph;
+		graph.build(V, edges);
+		KDTree3 tree;
+		tree.build(xyz, ids);
+
+		std::vector< std::vector< float > > adjMatrix;
+		const bool dense = V <= denseLimit;
+		if (dense)
+		{
+			adjMatrix.assign(V, std::vector<float>(V, 0));
+			for (const auto &e : edges)
+				adjMatrix[e.from][e.to] = e.weight;
+		}
+		Dijkstra djk(&adjMatrix);
+
+		double tDense = 0, tHeap = 0, tAStar = 0;
+		for (int q=0; q<queries; q++)
+		{
+			const int source = rng()%V, dest = rng()%V;
+			std::vector<int> pathHeap, pathAStar, pathDense;
+			double t = now();
+			const float cHeap = graph.dijkstra(source, dest, pathHeap);
+			tHeap += now() - t;
+			t = now();
+			const float cAStar = graph.astar(source, dest, pathAStar, xyz.data());
+			tAStar += now() - t;
+			if (fabs(cHeap - cAStar) > 1e-3*fabs(cHeap))
+				failures++;
+			if (dense)
+			{
+				t = now();
+				djk.calculateDistance(source);
+				const float cDense = djk.go(dest, pathDense);
+				tDense += now() - t;
+				if (fabs(cHeap - cDense) > 1e-3*fabs(cHeap))
+					failures++;
+			}
+		}
+
+		const int lookups = 10000;
+		double tScan = 0, tTree = 0;
+		for (int q=0; q<lookups; q++)
+		{
+			const float p[3] = {1000*u(rng), 1000*u(rng), 1000*u(rng)};
+			double t = now();
+			int best = 0;
+			float bestDist = dist(p, &xyz[0]);
+			for (int v=1; v<V; v++)
+			{
+				const float d = dist(p, &xyz[3*v]);
+				if (d < bestDist)
+				{
+					bestDist = d;
+					best = v;
+				}
+			}
+			tScan += now() - t;
+			t = now();
+			const int found = tree.nearest(p);
+			tTree += now() - t;
+			if (found != best and dist(p, &xyz[3*found]) != bestDist)
+				failures++;
+		}
+
+		char denseTime[16] = "-";
+		if (dense)
+			snprintf(denseTime, sizeof(denseTime), "%.3f", 1e3*tDense/queries);
+		printf("%-9d %9zu %12s %12.3f %12.3f %12.2f %12.2f\n", V, graph.edgeCount(), denseTime, 1e3*tHeap/queries, 1e3*tAStar/queries,
+		       1e6*tScan/lookups, 1e6*tTree/lookups);
+		fflush(stdout);
+	}
+	printf("mismatches %d\n", failures);
+	return failures ? 1 : 0;
+}
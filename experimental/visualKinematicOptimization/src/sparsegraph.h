@@ -0,0 +1,219 @@
+#ifndef SPARSEGRAPH_H
+#define SPARSEGRAPH_H
+
+#include <stdint.h>
+#include <math.h>
+
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <queue>
+#include <utility>
+#include <vector>
+
+/**
+* \brief Directed weighted graph in compressed sparse row form.
+*
+* Built from an edge list; edges of vertex v are targets[offsets[v]..offsets[v+1]).
+* Shortest paths use a binary heap (lazy deletion), so a query is O((V+E) log V)
+* instead of the O(V^2) of the dense Dijkstra in djk.h.
+*/
+class SparseGraph
+{
+public:
+	struct Edge
+	{
+		uint32_t from, to;
+		float weight;
+	};
+
+	SparseGraph() : numVertices(0) { }
+
+	/// Rebuilds the CSR arrays. Parallel edges keep the last weight given, as the dense matrix did.
+	void build(const uint32_t vertices, std::vector<Edge> edges)
+	{
+		numVertices = vertices;
+		std::stable_sort(edges.begin(), edges.end(), [](const Edge &a, const Edge &b) { return a.from != b.from ? a.from < b.from : a.to < b.to; });
+		offsets.assign(numVertices+1, 0);
+		targets.clear();
+		weights.clear();
+		targets.reserve(edges.size());
+		weights.reserve(edges.size());
+		for (size_t i=0; i<edges.size(); i++)
+		{
+			if (i+1<edges.size() and edges[i+1].from == edges[i].from and edges[i+1].to == edges[i].to)
+				continue;
+			targets.push_back(edges[i].to);
+			weights.push_back(edges[i].weight);
+			offsets[edges[i].from+1]++;
+		}
+		for (uint32_t v=0; v<numVertices; v++)
+			offsets[v+1] += offsets[v];
+		distance.assign(numVertices, INFINITY);
+		predecessor.assign(numVertices, -1);
+	}
+
+	uint32_t size() const { return numVertices; }
+	size_t edgeCount() const { return targets.size(); }
+
+	/// Shortest path cost from source to dest (-1 if unreachable), the vertices of the path are appended to path
+	float dijkstra(const int32_t source, const int32_t dest, std::vector<int> &path)
+	{
+		return search(source, dest, path, [](uint32_t) { return 0.f; });
+	}
+
+	/**
+	* \brief A* search guided by the straight-line distance between vertex positions (xyz[3*v]).
+	* The result is optimal as long as every edge weight is at least scale times that distance.
+	*/
+	float astar(const int32_t source, const int32_t dest, std::vector<int> &path, const float *xyz, const float scale=1.f)
+	{
+		if (dest < 0 or dest >= (int32_t)numVertices)
+			return -1;
+		const float *g = xyz + 3*dest;
+		return search(source, dest, path, [xyz, g, scale](uint32_t v)
+		{
+			const float *p = xyz + 3*v;
+			return scale * sqrtf((p[0]-g[0])*(p[0]-g[0]) + (p[1]-g[1])*(p[1]-g[1]) + (p[2]-g[2])*(p[2]-g[2]));
+		});
+	}
+
+private:
+	uint32_t numVertices;
+	std::vector<uint32_t> offsets, targets;
+	std::vector<float> weights;
+	std::vector<float> distance;
+	std::vector<int32_t> predecessor;
+	std::vector<uint32_t> touched;
+
+	typedef std::pair<float, uint32_t> QueueEntry;
+
+	float search(const int32_t source, const int32_t dest, std::vector<int> &path, const std::function<float(uint32_t)> &heuristic)
+	{
+		if (source < 0 or dest < 0 or source >= (int32_t)numVertices or dest >= (int32_t)numVertices)
+			return -1;
+
+		// Only the vertices reached by the previous query are reset
+		for (uint32_t v : touched)
+		{
+			distance[v] = INFINITY;
+			predecessor[v] = -1;
+		}
+		touched.clear();
+
+		std::priority_queue<QueueEntry, std::vector<QueueEntry>, std::greater<QueueEntry> > open;
+		distance[source] = 0;
+		touched.push_back(source);
+		open.push(QueueEntry(heuristic(source), source));
+		while (not open.empty())
+		{
+			const QueueEntry top = open.top();
+			open.pop();
+			const uint32_t u = top.second;
+			if (top.first > distance[u] + heuristic(u))
+				continue;  // stale entry
+			if ((int32_t)u == dest)
+				break;
+			for (uint32_t e=offsets[u]; e<offsets[u+1]; e++)
+			{
+				const uint32_t v = targets[e];
+				const float d = distance[u] + weights[e];
+				if (d < distance[v])
+				{
+					if (distance[v] == INFINITY)
+						touched.push_back(v);
+					distance[v] = d;
+					predecessor[v] = u;
+					open.push(QueueEntry(d + heuristic(v), v));
+				}
+			}
+		}
+
+		if (distance[dest] == INFINITY)
+			return -1;
+		const size_t first = path.size();
+		for (int32_t v=dest; v!=-1; v=(v==source ? -1 : predecessor[v]))
+			path.push_back(v);
+		std::reverse(path.begin()+first, path.end());
+		return distance[dest];
+	}
+};
+
+
+/**
+* \brief Static 3D k-d tree over a set of points, for nearest neighbour queries.
+*/
+class KDTree3
+{
+public:
+	KDTree3() { }
+
+	/// Indexes the given points; ids are returned by nearest()
+	void build(const std::vector<float> &xyz_, const std::vector<int32_t> &ids_)
+	{
+		xyz = xyz_;
+		ids = ids_;
+		nodes.resize(ids.size());
+		for (uint32_t i=0; i<nodes.size(); i++)
+			nodes[i] = i;
+		build(0, nodes.size(), 0);
+	}
+
+	bool empty() const { return nodes.empty(); }
+
+	/// Id of the closest point to p, -1 if the tree is empty
+	int32_t nearest(const float *p) const
+	{
+		if (nodes.empty())
+			return -1;
+		uint32_t best = nodes[0];
+		float bestDist = std::numeric_limits<float>::max();
+		nearest(0, nodes.size(), 0, p, best, bestDist);
+		return ids[best];
+	}
+
+private:
+	std::vector<float> xyz;
+	std::vector<int32_t> ids;
+	std::vector<uint32_t> nodes;  // implicit tree: the median of [begin, end) is its root
+
+	void build(const uint32_t begin, const uint32_t end, const uint32_t axis)
+	{
+		if (end - begin <= 1)
+			return;
+		const uint32_t mid = (begin + end) / 2;
+		std::nth_element(nodes.begin()+begin, nodes.begin()+mid, nodes.begin()+end, [this, axis](uint32_t a, uint32_t b) { return xyz[3*a+axis] < xyz[3*b+axis]; });
+		build(begin, mid, (axis+1)%3);
+		build(mid+1, end, (axis+1)%3);
+	}
+
+	void nearest(const uint32_t begin, const uint32_t end, const uint32_t axis, const float *p, uint32_t &best, float &bestDist) const
+	{
+		if (begin >= end)
+			return;
+		const uint32_t mid = (begin + end) / 2;
+		const float *q = &xyz[3*nodes[mid]];
+		const float d = (p[0]-q[0])*(p[0]-q[0]) + (p[1]-q[1])*(p[1]-q[1]) + (p[2]-q[2])*(p[2]-q[2]);
+		if (d < bestDist)
+		{
+			bestDist = d;
+			best = nodes[mid];
+		}
+		const float delta = p[axis] - q[axis];
+		const uint32_t next = (axis+1)%3;
+		if (delta < 0)
+		{
+			nearest(begin, mid, next, p, best, bestDist);
+			if (delta*delta < bestDist)
+				nearest(mid+1, end, next, p, best, bestDist);
+		}
+		else
+		{
+			nearest(mid+1, end, next, p, best, bestDist);
+			if (delta*delta < bestDist)
+				nearest(begin, mid, next, p, best, bestDist);
+		}
+	}
+};
+
+#endif
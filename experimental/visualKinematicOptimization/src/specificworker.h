@@ -31,7 +31,6 @@
 #include <osgviewer/osgview.h>
 #include <innermodel/innermodelviewer.h>
 
-#include <djk.h>
 #include <graph.h>
 
 class SpecificWorker : public GenericWorker